@@ -0,0 +1,217 @@
+#pragma once
+#include "../include/headFile.hpp"
+
+// 线程绑核和 NUMA 就近分配
+// 不依赖 libnuma: CPU 所在的节点从 sysfs 读, 内存策略直接用 set_mempolicy 系统调用
+// 线程绑到一个核并把内存策略设为该核所在的节点后, 它之后分配 (首次写入) 的页都落在本节点上,
+// 所以要先绑核, 再建缓冲池和 Arena
+class Affinity
+{
+public:
+    // "0-3,8,10-11" -> {0, 1, 2, 3, 8, 10, 11}, 格式不对时返回空
+    static std::vector<int> parse(const std::string &list)
+    {
+        std::vector<int> cpus;
+        std::istringstream in(list);
+        std::string item;
+        while (std::getline(in, item, ','))
+        {
+            size_t dash = item.find('-');
+            char *end = nullptr;
+            long first = std::strtol(item.c_str(), &end, 10);
+            long last = dash == std::string::npos ? first : std::strtol(item.c_str() + dash + 1, &end, 10);
+            if (item.empty() || *end != '\0' || first < 0 || last < first || last >= CPU_SETSIZE)
+            {
+                return {};
+            }
+            for (long cpu = first; cpu <= last; ++cpu)
+            {
+                cpus.push_back(static_cast<int>(cpu));
+            }
+        }
+        return cpus;
+    }
+
+    // CPU 所在的 NUMA 节点, 单节点机器或读不到时返回 0
+    static int nodeOf(int cpu)
+    {
+        std::error_code ec;
+        std::filesystem::path dir = "/sys/devices/system/cpu/cpu" + std::to_string(cpu);
+        for (auto &entry : std::filesystem::directory_iterator(dir, ec))
+        {
+            std::string name = entry.path().filename();
+            if (name.rfind("node", 0) == 0 && name.size() > 4 && std::isdigit(static_cast<unsigned char>(name[4])))
+            {
+                return std::atoi(name.c_str() + 4);
+            }
+        }
+        return 0;
+    }
+
+    // 当前线程绑到 cpu 上, 内存优先从它所在的节点分配
+    static bool pin(int cpu)
+    {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        int err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+        if (err != 0)
+        {
+            std::cerr << "Cannot pin thread to CPU " << cpu << ": " << strerror(err) << std::endl;
+            return false;
+        }
+        // 节点内存不够时退回其他节点, 不会因此分配失败
+        unsigned long mask = 1UL << nodeOf(cpu);
+        if (syscall(SYS_set_mempolicy, MPOL_PREFERRED, &mask, sizeof(mask) * 8) == -1 && errno != ENOSYS)
+        {
+            std::cerr << "set_mempolicy: " << strerror(errno) << std::endl;
+        }
+        return true;
+    }
+
+    // 工作线程 (线程池、日志同步等) 可以用的核, 进程启动时设置一次; 为空表示不绑
+    static std::vector<int> &workerCpus()
+    {
+        static std::vector<int> cpus;
+        return cpus;
+    }
+
+    // 工作线程启动时调用, 按启动顺序轮流绑到 workerCpus 上
+    static void pinWorker()
+    {
+        static std::atomic<size_t> next{0};
+        const std::vector<int> &cpus = workerCpus();
+        if (!cpus.empty())
+        {
+            pin(cpus[next.fetch_add(1, std::memory_order_relaxed) % cpus.size()]);
+        }
+    }
+
+    // 同一端口的一组 SO_REUSEPORT 监听 socket 按加入顺序编号, 新连接交给第 i 个 socket,
+    // i 是处理这个连接的软中断所在的核在 cpus 里的下标; 不在 cpus 里的核按取模分配
+    // 网卡队列的中断绑到 cpus[i] 上时, 同一个连接的中断处理和读写都在同一个核上, 不跨核也不跨节点
+    static bool steerByCpu(int fd, const std::vector<int> &cpus)
+    {
+        std::vector<struct sock_filter> code;
+        code.push_back(BPF_STMT(BPF_LD | BPF_W | BPF_ABS, static_cast<uint32_t>(SKF_AD_OFF + SKF_AD_CPU)));
+        for (size_t i = 0; i < cpus.size(); ++i)
+        {
+            code.push_back(BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, static_cast<uint32_t>(cpus[i]), 0, 1));
+            code.push_back(BPF_STMT(BPF_RET | BPF_K, static_cast<uint32_t>(i)));
+        }
+        code.push_back(BPF_STMT(BPF_ALU | BPF_MOD | BPF_K, static_cast<uint32_t>(cpus.size())));
+        code.push_back(BPF_STMT(BPF_RET | BPF_A, 0));
+        struct sock_fprog prog{};
+        prog.len = static_cast<unsigned short>(code.size());
+        prog.filter = code.data();
+        if (setsockopt(fd, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &prog, sizeof(prog)) == -1)
+        {
+            perror("setsockopt(SO_ATTACH_REUSEPORT_CBPF)");
+            return false;
+        }
+        return true;
+    }
+};
+
+// 压测期间的每核利用率和跨节点内存访问
+// 利用率来自 /proc/stat, 跨节点分配来自每个节点的 numastat: other_node 是本节点的进程分配到别的节点上的页数
+class PlacementStats
+{
+public:
+    PlacementStats() { sample(m_cpuStart, m_nodeStart); }
+
+    void report(std::ostream &out)
+    {
+        std::vector<CpuTimes> cpus;
+        std::vector<NodeCounters> nodes;
+        sample(cpus, nodes);
+
+        out << "per-core utilization:";
+        for (size_t i = 0; i < cpus.size() && i < m_cpuStart.size(); ++i)
+        {
+            uint64_t total = cpus[i].total - m_cpuStart[i].total;
+            uint64_t busy = total - (cpus[i].idle - m_cpuStart[i].idle);
+            out << " cpu" << i << "=" << std::fixed << std::setprecision(0) << (total ? 100.0 * busy / total : 0) << "%";
+        }
+        out << std::endl;
+        for (size_t i = 0; i < nodes.size() && i < m_nodeStart.size(); ++i)
+        {
+            uint64_t hit = nodes[i].hit - m_nodeStart[i].hit;
+            uint64_t miss = nodes[i].miss - m_nodeStart[i].miss;
+            uint64_t other = nodes[i].other - m_nodeStart[i].other;
+            out << "node" << i << ": local pages " << hit << ", misses " << miss << ", allocated on other nodes " << other
+                << std::endl;
+        }
+    }
+
+private:
+    struct CpuTimes
+    {
+        uint64_t total = 0;
+        uint64_t idle = 0; // idle + iowait
+    };
+
+    struct NodeCounters
+    {
+        uint64_t hit = 0;
+        uint64_t miss = 0;
+        uint64_t other = 0;
+    };
+
+    static void sample(std::vector<CpuTimes> &cpus, std::vector<NodeCounters> &nodes)
+    {
+        std::ifstream stat("/proc/stat");
+        std::string line;
+        while (std::getline(stat, line))
+        {
+            // 只看 "cpuN ...", 跳过汇总的 "cpu ..."
+            if (line.rfind("cpu", 0) != 0 || line.size() < 4 || !std::isdigit(static_cast<unsigned char>(line[3])))
+            {
+                continue;
+            }
+            std::istringstream in(line.substr(line.find(' ')));
+            CpuTimes t;
+            uint64_t value;
+            for (int field = 0; in >> value; ++field)
+            {
+                t.total += value;
+                if (field == 3 || field == 4)
+                {
+                    t.idle += value;
+                }
+            }
+            cpus.push_back(t);
+        }
+
+        for (int node = 0;; ++node)
+        {
+            std::ifstream numastat("/sys/devices/system/node/node" + std::to_string(node) + "/numastat");
+            if (!numastat)
+            {
+                break;
+            }
+            NodeCounters c;
+            std::string name;
+            uint64_t value;
+            while (numastat >> name >> value)
+            {
+                if (name == "numa_hit")
+                {
+                    c.hit = value;
+                }
+                else if (name == "numa_miss")
+                {
+                    c.miss = value;
+                }
+                else if (name == "other_node")
+                {
+                    c.other = value;
+                }
+            }
+            nodes.push_back(c);
+        }
+    }
+
+    std::vector<CpuTimes> m_cpuStart;
+    std::vector<NodeCounters> m_nodeStart;
+};
@@ -0,0 +1,313 @@
+#pragma once
+#include "../include/headFile.hpp"
+
+#define CAPTURE_MAGIC "CHATCAP1"
+#define CAPTURE_FLUSH (256 * 1024)        // 攒到这么多字节就叫醒写线程
+#define CAPTURE_BACKLOG (64 * 1024 * 1024) // 写线程跟不上时最多积压这么多, 再多的记录丢弃并计数
+#define CAPTURE_INTERVAL_MS 200           // 不满一批时写线程也按这个间隔落盘
+#define CAPTURE_REDACTED "*"              // REGISTER/LOGIN 里用户名之后的参数 (密码、邮箱、验证码) 录成这一个记号
+
+// 流量录制文件
+// 文件头是 8 字节的 CAPTURE_MAGIC 和 8 字节 (小端) 的开始时间 (系统时钟, 微秒), 之后是一条条记录:
+//   类型 (1 字节) | 距上一条的时间 (微秒, varint) | 连接号 (varint) | [帧: 负载长度 (varint) | 负载]
+// 连接号是服务器进程内的连接序号, 不随 fd 复用; 负载是解压之后、去掉长度头的请求, 带着客户端的请求号前缀
+// 凭据不进文件: REGISTER/LOGIN 用户名之后的部分换成 CAPTURE_REDACTED, 回放时再换成统一的测试密码
+// 找到 REGISTER/LOGIN 请求里用户名之后的部分 [begin, end), 不是这两个命令或没有这部分时返回 false
+// 按空白分词, 和服务器解析这两个命令的方式一致, 多个空格分隔时也不会把密码漏掉
+inline bool captureCredentials(std::string_view msg, size_t &begin, size_t &end)
+{
+    size_t off = 0;
+    if (!msg.empty() && msg[0] == '#')
+    {
+        off = msg.find(' ');
+        if (off == std::string_view::npos)
+        {
+            return false;
+        }
+        off++;
+    }
+    std::string_view cmd = msg.substr(off);
+    if (cmd.substr(0, 9) == "REGISTER ")
+    {
+        off += 9;
+    }
+    else if (cmd.substr(0, 6) == "LOGIN ")
+    {
+        off += 6;
+    }
+    else
+    {
+        return false;
+    }
+    const char *blank = " \t\r\n";
+    size_t user = msg.find_first_not_of(blank, off);
+    size_t after = user == std::string_view::npos ? std::string_view::npos : msg.find_first_of(blank, user);
+    begin = after == std::string_view::npos ? std::string_view::npos : msg.find_first_not_of(blank, after);
+    if (begin == std::string_view::npos)
+    {
+        return false;
+    }
+    end = msg.find_last_not_of(blank) + 1;
+    return true;
+}
+
+enum class CaptureEvent : uint8_t
+{
+    Open = 0,  // 新连接
+    Frame = 1, // 收到一帧
+    Close = 2, // 连接关闭
+};
+
+struct CaptureRecord
+{
+    CaptureEvent type = CaptureEvent::Frame;
+    uint64_t at = 0; // 距录制开始的微秒数
+    uint64_t conn = 0;
+    std::string_view payload; // 指向 CaptureReader 持有的文件内容
+};
+
+// 服务器端: 事件循环把记录编码进内存缓冲区 (只有一把不会争用的锁), 后台线程成批写文件
+// 事件循环从不等磁盘; 磁盘跟不上时丢弃新记录而不是阻塞, 关闭时报告丢了多少
+class CaptureWriter
+{
+public:
+    // maxBytes 为 0 表示不限文件大小, 否则写满后停止录制
+    CaptureWriter(const std::string &path, uint64_t maxBytes) : m_path(path), m_maxBytes(maxBytes)
+    {
+        m_fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+        if (m_fd == -1)
+        {
+            throw std::runtime_error("cannot open capture " + path + ": " + strerror(errno));
+        }
+        uint64_t wall = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+        m_buf.append(CAPTURE_MAGIC, 8);
+        for (int i = 0; i < 8; ++i)
+        {
+            m_buf.push_back(static_cast<char>(wall >> (8 * i)));
+        }
+        m_last = nowUs();
+        m_writer = std::thread([this]()
+                               { writeLoop(); });
+    }
+
+    ~CaptureWriter()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stopping = true;
+        }
+        m_cond.notify_one();
+        m_writer.join();
+        close(m_fd);
+        std::cerr << "Capture " << m_path << ": " << m_written << " bytes";
+        if (m_dropped != 0)
+        {
+            std::cerr << ", " << m_dropped << " records dropped";
+        }
+        std::cerr << std::endl;
+    }
+
+    CaptureWriter(const CaptureWriter &other) = delete;
+    CaptureWriter &operator=(const CaptureWriter &other) = delete;
+
+    void open(uint64_t conn) { append(CaptureEvent::Open, conn, {}); }
+    void frame(uint64_t conn, std::string_view payload)
+    {
+        size_t begin, end;
+        if (!captureCredentials(payload, begin, end))
+        {
+            append(CaptureEvent::Frame, conn, payload);
+            return;
+        }
+        std::string redacted(payload.substr(0, begin));
+        redacted += CAPTURE_REDACTED;
+        redacted.append(payload.substr(end));
+        append(CaptureEvent::Frame, conn, redacted);
+    }
+    void close(uint64_t conn) { append(CaptureEvent::Close, conn, {}); }
+
+    static void putVarint(std::string &out, uint64_t value)
+    {
+        while (value >= 0x80)
+        {
+            out.push_back(static_cast<char>(value | 0x80));
+            value >>= 7;
+        }
+        out.push_back(static_cast<char>(value));
+    }
+
+private:
+    static uint64_t nowUs()
+    {
+        return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    void append(CaptureEvent type, uint64_t conn, std::string_view payload)
+    {
+        uint64_t now = nowUs();
+        bool wake;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_full || m_buf.size() + payload.size() + 32 > CAPTURE_BACKLOG)
+            {
+                m_dropped++;
+                return;
+            }
+            m_buf.push_back(static_cast<char>(type));
+            putVarint(m_buf, now - m_last);
+            putVarint(m_buf, conn);
+            if (type == CaptureEvent::Frame)
+            {
+                putVarint(m_buf, payload.size());
+                m_buf.append(payload.data(), payload.size());
+            }
+            m_last = now;
+            wake = m_buf.size() >= CAPTURE_FLUSH && !m_flushing;
+            m_flushing |= wake;
+        }
+        if (wake)
+        {
+            m_cond.notify_one();
+        }
+    }
+
+    void writeLoop()
+    {
+        std::string batch;
+        while (true)
+        {
+            bool stopping;
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_cond.wait_for(lock, std::chrono::milliseconds(CAPTURE_INTERVAL_MS), [this]
+                                { return m_stopping || m_flushing; });
+                stopping = m_stopping;
+                m_flushing = false;
+                batch.clear();
+                batch.swap(m_buf);
+            }
+            // 文件大小到上限后不再写, 最后一批按整条记录截断不了, 整批丢弃
+            if (m_maxBytes != 0 && m_written + batch.size() > m_maxBytes)
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                if (!m_full)
+                {
+                    std::cerr << "Capture " << m_path << " reached its size limit, recording stopped" << std::endl;
+                }
+                m_full = true;
+                m_buf.clear();
+                batch.clear();
+            }
+            for (size_t done = 0; done < batch.size();)
+            {
+                ssize_t n = write(m_fd, batch.data() + done, batch.size() - done);
+                if (n == -1)
+                {
+                    if (errno == EINTR)
+                    {
+                        continue;
+                    }
+                    perror("write: capture");
+                    std::lock_guard<std::mutex> lock(m_mutex);
+                    m_full = true;
+                    break;
+                }
+                done += n;
+                m_written += n;
+            }
+            if (stopping)
+            {
+                return;
+            }
+        }
+    }
+
+    std::string m_path;
+    uint64_t m_maxBytes;
+    int m_fd = -1;
+    std::thread m_writer;
+    std::mutex m_mutex; // 保护下面这些
+    std::condition_variable m_cond;
+    std::string m_buf;
+    uint64_t m_last = 0; // 上一条记录的时间, 微秒
+    bool m_flushing = false;
+    bool m_stopping = false;
+    bool m_full = false; // 到了大小上限或写失败, 之后的记录都丢弃
+    uint64_t m_dropped = 0;
+    uint64_t m_written = 0; // 只由写线程访问
+};
+
+// 回放端: 整个文件读进内存, 按顺序取出记录
+class CaptureReader
+{
+public:
+    explicit CaptureReader(const std::string &path)
+    {
+        std::ifstream in(path, std::ios::binary);
+        if (!in)
+        {
+            throw std::runtime_error("cannot open capture " + path);
+        }
+        m_data.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+        if (m_data.size() < 16 || m_data.compare(0, 8, CAPTURE_MAGIC) != 0)
+        {
+            throw std::runtime_error(path + " is not a capture file");
+        }
+        for (int i = 0; i < 8; ++i)
+        {
+            m_startedAt |= static_cast<uint64_t>(static_cast<uint8_t>(m_data[8 + i])) << (8 * i);
+        }
+        m_off = 16;
+    }
+
+    // 录制开始时的系统时间, 微秒
+    uint64_t startedAt() const { return m_startedAt; }
+
+    // 没有更多记录时返回 false; 文件末尾不完整的记录 (进程被杀时最后一批没写完) 当作结束
+    bool next(CaptureRecord &record)
+    {
+        size_t off = m_off;
+        uint64_t delta = 0, conn = 0, len = 0;
+        if (off >= m_data.size())
+        {
+            return false;
+        }
+        uint8_t type = static_cast<uint8_t>(m_data[off++]);
+        if (type > static_cast<uint8_t>(CaptureEvent::Close) || !getVarint(off, delta) || !getVarint(off, conn))
+        {
+            return false;
+        }
+        if (type == static_cast<uint8_t>(CaptureEvent::Frame) && (!getVarint(off, len) || m_data.size() - off < len))
+        {
+            return false;
+        }
+        m_at += delta;
+        record.type = static_cast<CaptureEvent>(type);
+        record.at = m_at;
+        record.conn = conn;
+        record.payload = std::string_view(m_data.data() + off, len);
+        m_off = off + len;
+        return true;
+    }
+
+private:
+    bool getVarint(size_t &off, uint64_t &value)
+    {
+        value = 0;
+        for (int shift = 0; shift < 64 && off < m_data.size(); shift += 7)
+        {
+            uint8_t byte = static_cast<uint8_t>(m_data[off++]);
+            value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+            if (!(byte & 0x80))
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    std::string m_data;
+    size_t m_off = 0;
+    uint64_t m_at = 0;
+    uint64_t m_startedAt = 0;
+};
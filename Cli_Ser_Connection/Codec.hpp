@@ -0,0 +1,165 @@
+#pragma once
+#include "../include/headFile.hpp"
+
+// 帧压缩
+// 长度头的最高位表示负载经过压缩, 低 29 位是负载 (压缩后) 的长度
+// 只有握手时双方都声明支持才会发送压缩帧, 但接收方总是能解开带标志的帧
+#define FRAME_COMPRESSED 0x80000000u
+// 分段: 握手时声明了 lanes 的客户端会收到切成多段的大帧, 每段都带 FRAME_CHUNK, 除最后一段外还带 FRAME_MORE
+// 各段按顺序到达, 中间可能插着别的完整帧; 压缩标志对拼好的整帧生效, 每段都带
+#define FRAME_CHUNK 0x40000000u
+#define FRAME_MORE 0x20000000u
+#define FRAME_LENGTH_MASK 0x1fffffffu
+#define COMPRESS_MIN 64 // 小于这个长度的帧不压缩
+
+// 握手: 客户端发 "HELLO <编码列表>", 服务器回 "CODEC <选中的编码>"
+// 目前只有 deflate (zlib); 编码名进协议, 以后换成 zstd/lz4 只需加一项
+enum class FrameCodecId : uint8_t
+{
+    None = 0,
+    Deflate = 1,
+};
+
+// 每帧独立压缩的 raw deflate, 带一个双方共享的预置字典
+// 短消息单独压缩时没有可参考的历史数据, 字典里放的是协议关键字和常见聊天用语, 让几十字节的消息也能压下来
+// z_stream 初始化代价较高, 每个线程保留一对, 每帧只做 reset
+class FrameCodec
+{
+public:
+    static constexpr const char *OFFER = "deflate";
+
+    FrameCodec()
+    {
+        // 8KB 窗口和较小的哈希表: 帧都是独立压缩的, 大窗口用不上, 却让每帧的 reset 变贵
+        // 解压端用最大窗口, 能解开任何窗口大小的流
+        if (deflateInit2(&m_deflate, 6, Z_DEFLATED, -13, 5, Z_DEFAULT_STRATEGY) != Z_OK ||
+            inflateInit2(&m_inflate, -15) != Z_OK)
+        {
+            throw std::runtime_error("zlib init failed");
+        }
+    }
+
+    ~FrameCodec()
+    {
+        deflateEnd(&m_deflate);
+        inflateEnd(&m_inflate);
+    }
+
+    FrameCodec(const FrameCodec &other) = delete;
+    FrameCodec &operator=(const FrameCodec &other) = delete;
+
+    // 当前线程的编解码器
+    static FrameCodec &local()
+    {
+        thread_local FrameCodec codec;
+        return codec;
+    }
+
+    // 从对方的编码列表里选一个本端支持的
+    static FrameCodecId negotiate(std::string_view offer)
+    {
+        while (!offer.empty())
+        {
+            size_t space = offer.find(' ');
+            std::string_view name = offer.substr(0, space);
+            if (name == "deflate")
+            {
+                return FrameCodecId::Deflate;
+            }
+            if (space == std::string_view::npos)
+            {
+                break;
+            }
+            offer.remove_prefix(space + 1);
+        }
+        return FrameCodecId::None;
+    }
+
+    static const char *name(FrameCodecId id)
+    {
+        return id == FrameCodecId::Deflate ? "deflate" : "none";
+    }
+
+    // 压缩结果的最大长度
+    size_t bound(size_t len)
+    {
+        return deflateBound(&m_deflate, len);
+    }
+
+    // 压缩到 dst (至少 bound(len) 字节), 压缩后不比原文小时返回 0, 调用方应发送原文
+    size_t compress(const char *src, size_t len, char *dst, size_t cap, bool useDictionary = true)
+    {
+        deflateReset(&m_deflate);
+        if (useDictionary)
+        {
+            deflateSetDictionary(&m_deflate, reinterpret_cast<const Bytef *>(dictionary().data()), dictionary().size());
+        }
+        m_deflate.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(src));
+        m_deflate.avail_in = len;
+        m_deflate.next_out = reinterpret_cast<Bytef *>(dst);
+        m_deflate.avail_out = cap;
+        if (deflate(&m_deflate, Z_FINISH) != Z_STREAM_END)
+        {
+            return 0;
+        }
+        size_t out = cap - m_deflate.avail_out;
+        return out < len ? out : 0;
+    }
+
+    // 解压到 out, 结果超过 limit 字节时视为错误 (防止压缩炸弹)
+    bool decompress(const char *src, size_t len, std::string &out, size_t limit, bool useDictionary = true)
+    {
+        inflateReset(&m_inflate);
+        if (useDictionary)
+        {
+            inflateSetDictionary(&m_inflate, reinterpret_cast<const Bytef *>(dictionary().data()), dictionary().size());
+        }
+        m_inflate.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(src));
+        m_inflate.avail_in = len;
+        out.clear();
+        size_t chunk = std::max<size_t>(len * 4, 1024);
+        while (true)
+        {
+            size_t used = out.size();
+            size_t grow = std::min(chunk, limit + 1 - used);
+            out.resize(used + grow);
+            m_inflate.next_out = reinterpret_cast<Bytef *>(out.data() + used);
+            m_inflate.avail_out = grow;
+            int ret = inflate(&m_inflate, Z_FINISH);
+            size_t spare = m_inflate.avail_out;
+            out.resize(used + grow - spare);
+            if (ret == Z_STREAM_END)
+            {
+                return true;
+            }
+            // 输出还有空间却没有结束, 说明输入被截断
+            if ((ret != Z_BUF_ERROR && ret != Z_OK) || spare != 0 || out.size() > limit)
+            {
+                return false;
+            }
+            chunk *= 2;
+        }
+    }
+
+    // 双方共享的预置字典, 越常用的内容越靠后 (deflate 对近处的匹配编码更短)
+    // 可以用客户端的 --codec-bench 从真实聊天记录重新训练后替换, 但替换就是协议变更, 两端必须同时升级
+    static std::string_view dictionary()
+    {
+        static const std::string dict =
+            "https://www.http://.com .cn .png .jpg .mp4 .pdf .zip "
+            "Thank you! Thanks a lot. You're welcome. No problem. Good morning! Good night. "
+            "See you tomorrow. Are you there? What are you doing? I don't know. I think so. "
+            "Sounds good. Let me check. Where are you? When will you arrive? On my way. "
+            "OK ok haha lol yes no sorry please maybe sure "
+            "早上好 晚上好 晚安 谢谢 不客气 没关系 好的 可以 不行 知道了 收到 哈哈哈 "
+            "你在干嘛 在吗 在的 吃饭了吗 明天见 一会儿见 我到了 等一下 马上 稍等 "
+            "什么时候 怎么了 为什么 不知道 没问题 辛苦了 我觉得 是不是 "
+            "ERROR invalid OFFLINE REGISTERED LOGGEDIN LIMITED BUSY CODESENT CODEC deflate "
+            "HISTEND (HIST MSG ";
+        return dict;
+    }
+
+private:
+    z_stream m_deflate{};
+    z_stream m_inflate{};
+};
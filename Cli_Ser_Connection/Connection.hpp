@@ -1,10 +1,16 @@
+#pragma once
 #include "../include/headFile.hpp"
 
 class Sen
 { 
 public:
     ssize_t writen(int fd, const char *buf, size_t len);
+    ssize_t writevn(int fd, struct iovec *iov, int iovcnt);
     void sendToCli(int fd, const std::string &buf);
+    void sendToCli(int fd, const char *buf, size_t len);
+    template <typename Container>
+    void sendMany(int fd, const Container &bufs);
+    void packFrame(std::string &out, const char *buf, size_t len);
     void sendStatusOfInt(int fd, int status);
     void sendStatusOfSize_t(int fd, size_t status);
 };
@@ -33,26 +39,125 @@ ssize_t Sen::writen(int fd, const char *buf, size_t len)
     return len; // 返回实际发送的字节数
 }
 
+// 用 writev 发送多段数据, 处理部分写入, 不做额外拷贝
+ssize_t Sen::writevn(int fd, struct iovec *iov, int iovcnt)
+{
+    size_t total = 0;
+    while (iovcnt > 0)
+    {
+        struct msghdr msg{};
+        msg.msg_iov = iov;
+        msg.msg_iovlen = iovcnt;
+        ssize_t sent = sendmsg(fd, &msg, MSG_NOSIGNAL);
+        if (sent == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue; // 如果被信号中断，继续尝试发送
+            }
+            std::cerr << "Error in writevn: " << strerror(errno) << std::endl;
+            return -1; // 发送失败，返回-1
+        }
+        total += sent;
+
+        // 跳过已经完整发出的段, 并调整写了一半的那一段
+        size_t done = sent;
+        while (iovcnt > 0 && done >= iov->iov_len)
+        {
+            done -= iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if (iovcnt > 0)
+        {
+            iov->iov_base = static_cast<char *>(iov->iov_base) + done;
+            iov->iov_len -= done;
+        }
+    }
+    return total; // 返回实际发送的字节数
+}
+
 // 发送一个以长度为前缀的字符串数据
 void Sen::sendToCli(int fd, const std::string &buf)
 {
-    if (fd < 0 || buf.empty())
+    sendToCli(fd, buf.data(), buf.size());
+}
+
+// 长度头和内容作为两段一次发出, 不再拼接到临时缓冲区
+void Sen::sendToCli(int fd, const char *buf, size_t size)
+{
+    if (fd < 0 || size == 0)
     {
         return; // 文件描述符无效或字符串为空，不进行发送
     }
 
-    uint32_t len = htonl(static_cast<uint32_t>(buf.size())); // 将长度转为网络字节序
-    std::vector<char> data(sizeof(len) + buf.size()); // 创建一个存放长度和内容的缓冲区
-    std::memcpy(data.data(), &len, sizeof(len)); // 复制长度到缓冲区
-    std::memcpy(data.data() + sizeof(len), buf.data(), buf.size()); // 复制字符串内容到缓冲区
+    uint32_t len = htonl(static_cast<uint32_t>(size)); // 将长度转为网络字节序
+    struct iovec iov[2];
+    iov[0].iov_base = &len;
+    iov[0].iov_len = sizeof(len);
+    iov[1].iov_base = const_cast<char *>(buf);
+    iov[1].iov_len = size;
 
-    if (writen(fd, data.data(), data.size()) == -1)
+    if (writevn(fd, iov, 2) == -1)
     {
         std::cerr << "Failed to send message" << std::endl;
         close(fd); // 发送失败，关闭文件描述符
     }
 }
 
+// 批量发送多条消息, 每批最多 IOV_MAX / 2 条消息合并为一次系统调用
+// 元素类型需要提供 data() 和 size(), 例如 std::string 或 std::string_view
+template <typename Container>
+void Sen::sendMany(int fd, const Container &bufs)
+{
+    if (fd < 0)
+    {
+        return;
+    }
+
+    constexpr size_t BATCH = IOV_MAX / 2;
+    thread_local std::vector<uint32_t> lens;
+    thread_local std::vector<struct iovec> iov;
+    lens.reserve(BATCH); // 预留足够容量, push_back 不会让 iov 中的指针失效
+
+    auto it = std::begin(bufs);
+    auto end = std::end(bufs);
+    while (it != end)
+    {
+        lens.clear();
+        iov.clear();
+        for (; it != end && lens.size() < BATCH; ++it)
+        {
+            if (it->size() == 0)
+            {
+                continue; // 空消息不发送, 与 sendToCli 保持一致
+            }
+            lens.push_back(htonl(static_cast<uint32_t>(it->size())));
+            iov.push_back({&lens.back(), sizeof(uint32_t)});
+            iov.push_back({const_cast<char *>(it->data()), it->size()});
+        }
+        if (iov.empty())
+        {
+            break;
+        }
+
+        if (writevn(fd, iov.data(), static_cast<int>(iov.size())) == -1)
+        {
+            std::cerr << "Failed to send messages" << std::endl;
+            close(fd); // 发送失败，关闭文件描述符
+            return;
+        }
+    }
+}
+
+// 把一帧追加到调用方自己的发送缓冲区, 供非阻塞的事件循环使用
+void Sen::packFrame(std::string &out, const char *buf, size_t size)
+{
+    uint32_t len = htonl(static_cast<uint32_t>(size));
+    out.append(reinterpret_cast<const char *>(&len), sizeof(len));
+    out.append(buf, size);
+}
+
 // 发送整数状态码
 void Sen::sendStatusOfInt(int fd, int status)
 {
@@ -78,6 +183,8 @@ class Rec
 public:
     ssize_t readBuf(int fd, char *buf, size_t len);
     int recvToCil(int fd, std::string &buf);
+    int recvToBuf(int fd, char *buf, size_t cap);
+    bool unpackFrame(const std::string &in, size_t &off, std::string_view &frame);
     int recvStatusOfInt(int fd);
     size_t recvStatusOfSize_t(int fd);
 };
@@ -111,30 +218,103 @@ ssize_t Rec::readBuf(int fd, char *buf, size_t len)
     return len - remaining; // 返回实际读取的字节数
 }
 
-// 接收一个带长度前缀的字符串数据
-int Rec::recvToCil(int fd, std::string &buf)
+// 读取 4 字节长度头, 失败返回 -1
+static int readFrameLength(Rec &r, int fd, uint32_t &len)
 {
-    uint32_t len = 0;
-    if (readBuf(fd, reinterpret_cast<char*>(&len), sizeof(len)) != sizeof(len))
+    if (r.readBuf(fd, reinterpret_cast<char*>(&len), sizeof(len)) != sizeof(len))
     {
         std::cerr << "Failed to read message length" << std::endl;
         return -1; // 读取长度失败
     }
-
     len = ntohl(len); // 将长度从网络字节序转换为主机字节序
-    std::vector<char> data(len); // 创建一个缓冲区用于存储数据
+    return 0;
+}
+
+// 接收一个带长度前缀的字符串数据, 内容直接读进目标字符串
+int Rec::recvToCil(int fd, std::string &buf)
+{
+    uint32_t len = 0;
+    if (readFrameLength(*this, fd, len) == -1)
+    {
+        return -1;
+    }
 
-    ssize_t received = readBuf(fd, data.data(), len);
+    ssize_t received = 0;
+#if defined(__cpp_lib_string_resize_and_overwrite)
+    // 不对新增的空间做无意义的清零
+    buf.resize_and_overwrite(len, [&](char *p, size_t n)
+                             {
+                                 received = readBuf(fd, p, n);
+                                 return received < 0 ? 0 : static_cast<size_t>(received); });
+#else
+    buf.resize(len); // 容量足够时不会重新分配
+    received = readBuf(fd, buf.data(), len);
+#endif
     if (received != static_cast<ssize_t>(len))
     {
         std::cerr << "Incomplete message received" << std::endl;
+        buf.clear();
         return -1; // 数据接收不完整
     }
 
-    buf.assign(data.begin(), data.end()); // 将接收到的数据赋值给字符串
     return received; // 返回实际接收到的字节数
 }
 
+// 接收一帧到调用者提供的缓冲区, 返回内容长度
+// 缓冲区放不下时丢弃这一帧并返回 -1, 保证后续帧仍然对齐
+int Rec::recvToBuf(int fd, char *buf, size_t cap)
+{
+    uint32_t len = 0;
+    if (readFrameLength(*this, fd, len) == -1)
+    {
+        return -1;
+    }
+
+    if (len > cap)
+    {
+        std::cerr << "Message larger than buffer: " << len << std::endl;
+        char discard[4096];
+        size_t remaining = len;
+        while (remaining > 0)
+        {
+            size_t chunk = std::min(remaining, sizeof(discard));
+            if (readBuf(fd, discard, chunk) != static_cast<ssize_t>(chunk))
+            {
+                break;
+            }
+            remaining -= chunk;
+        }
+        return -1;
+    }
+
+    ssize_t received = readBuf(fd, buf, len);
+    if (received != static_cast<ssize_t>(len))
+    {
+        std::cerr << "Incomplete message received" << std::endl;
+        return -1; // 数据接收不完整
+    }
+    return received;
+}
+
+// 从调用方自己的接收缓冲区 off 处切出一帧, 数据不够一帧时返回 false
+bool Rec::unpackFrame(const std::string &in, size_t &off, std::string_view &frame)
+{
+    uint32_t len = 0;
+    if (in.size() - off < sizeof(len))
+    {
+        return false;
+    }
+    std::memcpy(&len, in.data() + off, sizeof(len));
+    len = ntohl(len);
+    if (in.size() - off - sizeof(len) < len)
+    {
+        return false;
+    }
+    frame = std::string_view(in.data() + off + sizeof(len), len);
+    off += sizeof(len) + len;
+    return true;
+}
+
 // 接收整数类型的状态码
 int Rec::recvStatusOfInt(int fd)
 {
@@ -0,0 +1,310 @@
+#pragma once
+#include "../include/headFile.hpp"
+
+#define TLS_CIPHERS "TLS_AES_128_GCM_SHA256:TLS_AES_256_GCM_SHA384:TLS_CHACHA20_POLY1305_SHA256" // 内核 kTLS 支持的 TLS 1.3 套件
+
+// TLS 1.3 的证书和参数, 服务器和客户端共用
+// 握手在用户态由 OpenSSL 完成, 之后记录层交给内核 (kTLS): 加解密在内核里做, 收发仍然是普通的 read/writev/sendfile,
+// 不多一次拷贝, 文件也能零拷贝发送
+// 内核没有 tls 模块、OpenSSL 编译时关掉了 kTLS、或者 OpenSSL 不支持把某个方向交给内核 (3.0 不能卸载 TLS 1.3 的接收方向) 时,
+// 那个方向退回 SSL_read/SSL_write, 多一次拷贝, 功能不变
+class TlsContext
+{
+public:
+    enum Role
+    {
+        Server,
+        Client,
+    };
+
+    // 服务器: cert/key 是 PEM 文件, 都为空时生成一张临时自签名证书 (只用于测试)
+    // 客户端: cert 是信任的 CA 文件, 为空时用系统的 CA; verify 为 false 时不校验服务器证书 (只用于基准)
+    // ktls 为 false 时全部在用户态加解密, 基准用来对比
+    explicit TlsContext(Role role, const std::string &cert = "", const std::string &key = "", bool verify = true, bool ktls = true)
+        : m_role(role)
+    {
+        m_ctx = SSL_CTX_new(role == Server ? TLS_server_method() : TLS_client_method());
+        if (!m_ctx)
+        {
+            throw std::runtime_error("TLS init failed: " + lastError());
+        }
+        SSL_CTX_set_min_proto_version(m_ctx, TLS1_3_VERSION);
+        SSL_CTX_set_ciphersuites(m_ctx, TLS_CIPHERS);
+        // 写到一半遇到 EAGAIN 时, 剩下的数据会从连接的输出缓冲区 (地址可能变了) 重新交给 SSL_write
+        // 空闲连接不保留 OpenSSL 的读写缓冲区
+        SSL_CTX_set_mode(m_ctx, SSL_MODE_ENABLE_PARTIAL_WRITE | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER | SSL_MODE_RELEASE_BUFFERS);
+#ifdef SSL_OP_IGNORE_UNEXPECTED_EOF
+        // 对方不发 close_notify 直接断开时和明文连接一样当作正常关闭
+        SSL_CTX_set_options(m_ctx, SSL_OP_IGNORE_UNEXPECTED_EOF);
+#endif
+#ifdef SSL_OP_ENABLE_KTLS
+        if (ktls)
+        {
+            SSL_CTX_set_options(m_ctx, SSL_OP_ENABLE_KTLS);
+        }
+#endif
+
+        if (role == Server)
+        {
+            // 不发会话票据: 用不上会话恢复, 而且握手后再发的记录会让内核的记录序号和 OpenSSL 对不上
+            SSL_CTX_set_num_tickets(m_ctx, 0);
+            bool loaded = cert.empty() && key.empty()
+                              ? selfSign()
+                              : SSL_CTX_use_certificate_chain_file(m_ctx, cert.c_str()) == 1 &&
+                                    SSL_CTX_use_PrivateKey_file(m_ctx, key.c_str(), SSL_FILETYPE_PEM) == 1 &&
+                                    SSL_CTX_check_private_key(m_ctx) == 1;
+            if (!loaded)
+            {
+                std::string error = lastError();
+                SSL_CTX_free(m_ctx);
+                throw std::runtime_error("TLS certificate error: " + error);
+            }
+        }
+        else if (verify)
+        {
+            SSL_CTX_set_verify(m_ctx, SSL_VERIFY_PEER, nullptr);
+            int ok = cert.empty() ? SSL_CTX_set_default_verify_paths(m_ctx) : SSL_CTX_load_verify_locations(m_ctx, cert.c_str(), nullptr);
+            if (ok != 1)
+            {
+                std::string error = lastError();
+                SSL_CTX_free(m_ctx);
+                throw std::runtime_error("TLS CA error: " + error);
+            }
+        }
+    }
+
+    ~TlsContext()
+    {
+        SSL_CTX_free(m_ctx);
+    }
+
+    TlsContext(const TlsContext &other) = delete;
+    TlsContext &operator=(const TlsContext &other) = delete;
+
+    SSL_CTX *get() const { return m_ctx; }
+    Role role() const { return m_role; }
+
+    static std::string lastError()
+    {
+        unsigned long code = ERR_get_error();
+        ERR_clear_error();
+        if (code == 0)
+        {
+            return errno ? strerror(errno) : "unknown error";
+        }
+        char buf[256];
+        ERR_error_string_n(code, buf, sizeof(buf));
+        return buf;
+    }
+
+private:
+    // 临时的 P-256 自签名证书, 有效期一天
+    bool selfSign()
+    {
+        EVP_PKEY *pkey = EVP_EC_gen("P-256");
+        X509 *x509 = X509_new();
+        bool ok = pkey && x509;
+        if (ok)
+        {
+            X509_set_version(x509, 2);
+            ASN1_INTEGER_set(X509_get_serialNumber(x509), 1);
+            X509_gmtime_adj(X509_getm_notBefore(x509), 0);
+            X509_gmtime_adj(X509_getm_notAfter(x509), 24 * 3600);
+            X509_set_pubkey(x509, pkey);
+            X509_NAME *name = X509_get_subject_name(x509);
+            X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC, reinterpret_cast<const unsigned char *>("localhost"), -1, -1, 0);
+            X509_set_issuer_name(x509, name);
+            ok = X509_sign(x509, pkey, EVP_sha256()) > 0 && SSL_CTX_use_certificate(m_ctx, x509) == 1 &&
+                 SSL_CTX_use_PrivateKey(m_ctx, pkey) == 1;
+        }
+        X509_free(x509);
+        EVP_PKEY_free(pkey);
+        return ok;
+    }
+
+    SSL_CTX *m_ctx = nullptr;
+    Role m_role;
+};
+
+// 一条 TLS 连接
+// 接口和系统调用一致: 出错返回 -1 并设置 errno, 要等 socket 就绪时 errno 为 EAGAIN, 对方关闭时 read 返回 0,
+// 调用方原来处理 read/write 的代码不用改
+// 析构时不关 fd, 也不发 close_notify: 热升级时 fd 已经交给新进程, 这里只释放本进程的 OpenSSL 状态
+class TlsStream
+{
+public:
+    // host 非空时 (客户端) 校验证书上的主机名或 IP 地址, 主机名同时作为 SNI
+    TlsStream(TlsContext &ctx, int fd, const std::string &host = "")
+    {
+        m_ssl = SSL_new(ctx.get());
+        if (!m_ssl || SSL_set_fd(m_ssl, fd) != 1)
+        {
+            SSL_free(m_ssl);
+            throw std::runtime_error("TLS session failed: " + TlsContext::lastError());
+        }
+        if (ctx.role() == TlsContext::Server)
+        {
+            SSL_set_accept_state(m_ssl);
+        }
+        else
+        {
+            SSL_set_connect_state(m_ssl);
+            struct in6_addr addr;
+            if (inet_pton(AF_INET, host.c_str(), &addr) == 1 || inet_pton(AF_INET6, host.c_str(), &addr) == 1)
+            {
+                X509_VERIFY_PARAM_set1_ip_asc(SSL_get0_param(m_ssl), host.c_str());
+            }
+            else if (!host.empty())
+            {
+                SSL_set_tlsext_host_name(m_ssl, host.c_str());
+                SSL_set1_host(m_ssl, host.c_str());
+            }
+        }
+    }
+
+    ~TlsStream()
+    {
+        SSL_free(m_ssl);
+    }
+
+    TlsStream(const TlsStream &other) = delete;
+    TlsStream &operator=(const TlsStream &other) = delete;
+
+    // 推进握手: 1 完成, 0 还要等 socket 就绪 (wantWrite 表示等可写), -1 失败
+    // 阻塞 socket 上一次调用就会完成或失败
+    int handshake()
+    {
+        int ret = SSL_do_handshake(m_ssl);
+        if (ret == 1)
+        {
+            m_established = true;
+#ifndef OPENSSL_NO_KTLS
+            m_kernelSend = BIO_get_ktls_send(SSL_get_wbio(m_ssl));
+            m_kernelRecv = BIO_get_ktls_recv(SSL_get_rbio(m_ssl));
+#endif
+            return 1;
+        }
+        int error = SSL_get_error(m_ssl, ret);
+        if (error == SSL_ERROR_WANT_READ || error == SSL_ERROR_WANT_WRITE)
+        {
+            m_wantWrite = error == SSL_ERROR_WANT_WRITE;
+            return 0;
+        }
+        ERR_clear_error();
+        return -1;
+    }
+
+    bool established() const { return m_established; }
+    bool wantWrite() const { return m_wantWrite; }
+    bool kernelSend() const { return m_kernelSend; }
+    bool kernelRecv() const { return m_kernelRecv; }
+
+    // 两个方向都在内核里时连接状态全在内核, fd 可以原样交给别的进程
+    bool detachable() const { return m_kernelSend && m_kernelRecv; }
+
+    const char *mode() const
+    {
+        return detachable() ? "ktls" : m_kernelSend ? "ktls-tx" : m_kernelRecv ? "ktls-rx" : "user";
+    }
+
+    // 接收方向在内核里时, 收到告警或 KeyUpdate 这类非数据记录会让 read 返回 EIO, 按连接出错处理
+    ssize_t read(void *buf, size_t n)
+    {
+        if (m_kernelRecv)
+        {
+            return ::read(SSL_get_rfd(m_ssl), buf, n);
+        }
+        size_t done = 0;
+        int ret = SSL_read_ex(m_ssl, buf, n, &done);
+        return ret == 1 ? static_cast<ssize_t>(done) : fail(ret);
+    }
+
+    ssize_t write(const void *buf, size_t n)
+    {
+        if (m_kernelSend)
+        {
+            return ::write(SSL_get_wfd(m_ssl), buf, n);
+        }
+        size_t done = 0;
+        int ret = SSL_write_ex(m_ssl, buf, n, &done);
+        return ret == 1 ? static_cast<ssize_t>(done) : fail(ret);
+    }
+
+    // 用户态加密时先拼成一段, 避免帧头单独成为一条记录
+    ssize_t writev(const struct iovec *iov, int count)
+    {
+        if (m_kernelSend)
+        {
+            return ::writev(SSL_get_wfd(m_ssl), iov, count);
+        }
+        m_scratch.clear();
+        for (int i = 0; i < count; i++)
+        {
+            m_scratch.append(static_cast<const char *>(iov[i].iov_base), iov[i].iov_len);
+        }
+        return write(m_scratch.data(), m_scratch.size());
+    }
+
+    // 发送方向在内核里时零拷贝; 否则读到用户态经 SSL_write 发出
+    ssize_t sendfile(int fileFd, off_t *offset, size_t n)
+    {
+        if (m_kernelSend)
+        {
+            return ::sendfile(SSL_get_wfd(m_ssl), fileFd, offset, n);
+        }
+        m_scratch.resize(std::min<size_t>(n, 64 * 1024));
+        ssize_t got = pread(fileFd, m_scratch.data(), m_scratch.size(), *offset);
+        if (got <= 0)
+        {
+            return got;
+        }
+        ssize_t sent = write(m_scratch.data(), got);
+        if (sent > 0)
+        {
+            *offset += sent;
+        }
+        return sent;
+    }
+
+    // 主动关闭前发 close_notify, 尽力而为
+    void shutdown()
+    {
+        if (m_established)
+        {
+            SSL_shutdown(m_ssl);
+            ERR_clear_error();
+        }
+    }
+
+private:
+    ssize_t fail(int ret)
+    {
+        int error = SSL_get_error(m_ssl, ret);
+        ERR_clear_error();
+        switch (error)
+        {
+        case SSL_ERROR_WANT_READ:
+        case SSL_ERROR_WANT_WRITE:
+            errno = EAGAIN;
+            return -1;
+        case SSL_ERROR_ZERO_RETURN:
+            return 0;
+        case SSL_ERROR_SYSCALL:
+            if (errno == 0)
+            {
+                errno = ECONNRESET;
+            }
+            return -1;
+        default:
+            errno = EPROTO;
+            return -1;
+        }
+    }
+
+    SSL *m_ssl = nullptr;
+    bool m_established = false;
+    bool m_wantWrite = false;
+    bool m_kernelSend = false;
+    bool m_kernelRecv = false;
+    std::string m_scratch; // 用户态加密时拼接 iovec 和读文件用
+};
@@ -0,0 +1,250 @@
+#pragma once
+#include "../include/headFile.hpp"
+
+#define TRACE_RING 4096 // 每个线程保留最近的多少个区间
+
+// 抽样的请求追踪
+// 每 N 个请求帧抽一个, 给它一个追踪号; 追踪号放在线程局部变量里, 处理这个请求时经过的各段 (收帧、分发、
+// 线程池排队和执行、Redis 命令、发送完成) 各记一个区间, 写进所在线程自己的环形缓冲区, 不加锁
+// 没抽中的请求每个埋点只多一次线程局部变量的读和一次判断
+// 需要时把所有线程的环形缓冲区导出为 Chrome trace JSON, 用 chrome://tracing 或 Perfetto 按时间线查看,
+// 同一个请求的各段带同样的 id 参数
+class Trace
+{
+public:
+    // 一个区间, 字段都是原子的: 导出线程和写入线程可能同时访问同一格
+    struct Span
+    {
+        std::atomic<const char *> name{nullptr}; // 只能是字符串常量
+        std::atomic<uint64_t> id{0};
+        std::atomic<uint64_t> tag{0};            // 最多 8 个字符的附加说明, 比如命令名
+        std::atomic<int64_t> begin{0};           // 纳秒, steady_clock
+        std::atomic<int64_t> duration{0};
+    };
+
+    // 一个线程的环形缓冲区, 线程退出后也不释放, 导出时还能看到它记下的内容
+    struct Ring
+    {
+        pid_t tid = 0;
+        std::string thread;
+        std::atomic<uint64_t> head{0}; // 已写入的区间总数
+        Span spans[TRACE_RING];
+    };
+
+    // 抽样比例: 每 n 个请求抽一个, 0 表示关闭; 启动时设置一次
+    static void setRate(uint32_t n) { rate().store(n, std::memory_order_relaxed); }
+    static bool enabled() { return rate().load(std::memory_order_relaxed) != 0; }
+
+    // 请求入口调用: 抽中时返回新的追踪号, 否则返回 0
+    static uint64_t sample()
+    {
+        uint32_t n = rate().load(std::memory_order_relaxed);
+        if (n == 0)
+        {
+            return 0;
+        }
+        thread_local uint32_t countdown = 0;
+        if (countdown-- != 0)
+        {
+            return 0;
+        }
+        countdown = n - 1;
+        return nextId().fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // 当前线程正在处理的请求的追踪号, 0 表示没有抽中
+    static uint64_t &current()
+    {
+        thread_local uint64_t id = 0;
+        return id;
+    }
+
+    // 线程在导出结果里显示的名字, 线程启动时调用
+    static void nameThread(const std::string &name)
+    {
+        threadName() = name;
+    }
+
+    static int64_t now()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    // 记一个已经结束的区间
+    static void record(const char *name, uint64_t id, int64_t begin, int64_t end, uint64_t tag = 0)
+    {
+        Ring &ring = local();
+        uint64_t n = ring.head.load(std::memory_order_relaxed);
+        Span &span = ring.spans[n % TRACE_RING];
+        span.name.store(name, std::memory_order_relaxed);
+        span.id.store(id, std::memory_order_relaxed);
+        span.tag.store(tag, std::memory_order_relaxed);
+        span.begin.store(begin, std::memory_order_relaxed);
+        span.duration.store(end - begin, std::memory_order_relaxed);
+        ring.head.store(n + 1, std::memory_order_release);
+    }
+
+    // 把一段文字的前 8 个字符 (到第一个空格为止) 装进 tag
+    static uint64_t tagOf(std::string_view text)
+    {
+        uint64_t tag = 0;
+        size_t n = std::min<size_t>(text.find(' '), sizeof(tag));
+        std::memcpy(&tag, text.data(), std::min(n, text.size()));
+        return tag;
+    }
+
+    // 作用域内的区间, 当前请求没有抽中时什么都不做
+    class Scope
+    {
+    public:
+        Scope(const char *name, uint64_t tag = 0) : Scope(name, current(), tag) {}
+
+        // 请求入口用: 在作用域内把 id 设为当前线程的追踪号, 结束时恢复
+        Scope(const char *name, uint64_t id, uint64_t tag) : m_name(name), m_id(id), m_tag(tag)
+        {
+            if (m_id != 0)
+            {
+                m_saved = current();
+                current() = m_id;
+                m_begin = now();
+            }
+        }
+
+        ~Scope()
+        {
+            if (m_id != 0)
+            {
+                record(m_name, m_id, m_begin, now(), m_tag);
+                current() = m_saved;
+            }
+        }
+
+        Scope(const Scope &other) = delete;
+        Scope &operator=(const Scope &other) = delete;
+
+    private:
+        const char *m_name;
+        uint64_t m_id;
+        uint64_t m_tag;
+        uint64_t m_saved = 0;
+        int64_t m_begin = 0;
+    };
+
+    // 所有线程的区间写成 Chrome trace JSON (ph=X 的完整事件, 时间单位微秒)
+    // 写入线程不停, 复制过程中被覆盖的格子丢掉; 可以在任意线程调用
+    static bool dump(const std::string &path)
+    {
+        std::vector<Ring *> rings;
+        {
+            std::lock_guard<std::mutex> lock(registry().mutex);
+            for (auto &ring : registry().rings)
+            {
+                rings.push_back(ring.get());
+            }
+        }
+
+        std::ofstream out(path, std::ios::trunc);
+        if (!out)
+        {
+            return false;
+        }
+        pid_t pid = getpid();
+        char line[256];
+        out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n";
+        snprintf(line, sizeof(line), "{\"ph\":\"M\",\"name\":\"process_name\",\"pid\":%d,\"args\":{\"name\":\"chatroom-%d\"}}", pid, pid);
+        out << line;
+        for (Ring *ring : rings)
+        {
+            snprintf(line, sizeof(line), ",\n{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"%s\"}}", pid,
+                     ring->tid, ring->thread.c_str());
+            out << line;
+
+            uint64_t head = ring->head.load(std::memory_order_acquire);
+            uint64_t first = head > TRACE_RING ? head - TRACE_RING : 0;
+            std::vector<std::tuple<const char *, uint64_t, uint64_t, int64_t, int64_t>> copy;
+            copy.reserve(head - first);
+            for (uint64_t i = first; i < head; ++i)
+            {
+                const Span &span = ring->spans[i % TRACE_RING];
+                copy.emplace_back(span.name.load(std::memory_order_relaxed), span.id.load(std::memory_order_relaxed),
+                                  span.tag.load(std::memory_order_relaxed), span.begin.load(std::memory_order_relaxed),
+                                  span.duration.load(std::memory_order_relaxed));
+            }
+            // 复制期间写入线程又写了多少格, 最旧的那么多格可能已被覆盖
+            uint64_t after = ring->head.load(std::memory_order_acquire);
+            size_t skip = std::min<uint64_t>(copy.size(), after - head);
+            for (size_t i = skip; i < copy.size(); ++i)
+            {
+                auto [name, id, tag, begin, duration] = copy[i];
+                if (!name)
+                {
+                    continue;
+                }
+                char text[sizeof(tag) + 1] = {};
+                std::memcpy(text, &tag, sizeof(tag));
+                for (char &ch : text)
+                {
+                    // 命令名来自客户端, 只保留能直接放进 JSON 字符串的字符
+                    if (ch != '\0' && (ch < 0x20 || ch == '"' || ch == '\\' || static_cast<unsigned char>(ch) >= 0x7f))
+                    {
+                        ch = '?';
+                    }
+                }
+                snprintf(line, sizeof(line),
+                         ",\n{\"ph\":\"X\",\"name\":\"%s\",\"pid\":%d,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"id\":%llu%s%s%s}}",
+                         name, pid, ring->tid, begin / 1000.0, duration / 1000.0, static_cast<unsigned long long>(id),
+                         text[0] ? ",\"op\":\"" : "", text, text[0] ? "\"" : "");
+                out << line;
+            }
+        }
+        out << "\n]}\n";
+        return static_cast<bool>(out.flush());
+    }
+
+private:
+    struct Registry
+    {
+        std::mutex mutex;
+        std::vector<std::unique_ptr<Ring>> rings;
+    };
+
+    static std::atomic<uint32_t> &rate()
+    {
+        static std::atomic<uint32_t> n{0};
+        return n;
+    }
+
+    static std::atomic<uint64_t> &nextId()
+    {
+        static std::atomic<uint64_t> id{1};
+        return id;
+    }
+
+    static std::string &threadName()
+    {
+        thread_local std::string name;
+        return name;
+    }
+
+    static Registry &registry()
+    {
+        static Registry *r = new Registry; // 不析构: 进程退出时别的线程可能还在记录
+        return *r;
+    }
+
+    // 第一次记录时建本线程的环形缓冲区, 之后只是一次线程局部变量的读
+    static Ring &local()
+    {
+        thread_local Ring *ring = nullptr;
+        if (!ring)
+        {
+            auto owned = std::make_unique<Ring>();
+            owned->tid = static_cast<pid_t>(syscall(SYS_gettid));
+            owned->thread = threadName().empty() ? "thread-" + std::to_string(owned->tid) : threadName();
+            ring = owned.get();
+            std::lock_guard<std::mutex> lock(registry().mutex);
+            registry().rings.push_back(std::move(owned));
+        }
+        return *ring;
+    }
+};
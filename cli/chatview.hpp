@@ -0,0 +1,271 @@
+#pragma once
+#include "../include/headFile.hpp"
+#include "netcore.hpp"
+
+// 基于 ncurses 的聊天界面
+// 上面是消息区, 倒数第二行是状态栏, 最后一行是输入框
+// 推送消息只追加到消息区窗口, 由 ncurses 比对后输出变化的部分, 高频消息下每帧最多刷新一次屏幕
+class ChatView
+{
+public:
+    static constexpr int FRAME_MS = 16;        // 两次刷新屏幕的最小间隔
+    static constexpr int HISTORY_LINES = 1000; // 消息区保留的行数, 用于窗口大小变化后重绘
+
+    explicit ChatView(ClientIO &io) : m_io(io) {}
+
+    ~ChatView()
+    {
+        if (m_log)
+        {
+            delwin(m_log);
+            delwin(m_status);
+            delwin(m_input);
+        }
+    }
+
+    ChatView(const ChatView &other) = delete;
+    ChatView &operator=(const ChatView &other) = delete;
+
+    // 输入 "/to <用户>" 切换聊天对象, "/quit" 返回菜单
+    void run()
+    {
+        Screen screen; // 异常退出时也要恢复终端
+        layout();
+        append("/to <user> 选择聊天对象, /quit 返回菜单");
+
+        m_running = true;
+        while (m_running)
+        {
+            struct pollfd fds[2];
+            fds[0].fd = STDIN_FILENO;
+            fds[0].events = POLLIN;
+            fds[1].fd = m_io.notifyFd();
+            fds[1].events = POLLIN;
+
+            int timeout = -1;
+            if (m_dirty)
+            {
+                auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+                                   std::chrono::steady_clock::now() - m_lastFrame)
+                                   .count();
+                timeout = elapsed >= FRAME_MS ? 0 : static_cast<int>(FRAME_MS - elapsed);
+            }
+
+            int n = ::poll(fds, 2, timeout);
+            if (n == -1 && errno != EINTR)
+            {
+                throw std::runtime_error("poll failed: " + std::string(strerror(errno)));
+            }
+            if (n > 0 && (fds[1].revents & POLLIN))
+            {
+                drainMessages();
+            }
+            if (n > 0 && (fds[0].revents & POLLIN))
+            {
+                readKeys();
+            }
+            present();
+        }
+    }
+
+private:
+    struct Screen
+    {
+        Screen()
+        {
+            setlocale(LC_ALL, "");
+            initscr();
+            cbreak();
+            noecho();
+        }
+        ~Screen()
+        {
+            endwin();
+        }
+    };
+
+    void layout()
+    {
+        if (m_log)
+        {
+            delwin(m_log);
+            delwin(m_status);
+            delwin(m_input);
+        }
+        int rows = std::max(LINES, 3);
+        m_log = newwin(rows - 2, COLS, 0, 0);
+        m_status = newwin(1, COLS, rows - 2, 0);
+        m_input = newwin(1, COLS, rows - 1, 0);
+        scrollok(m_log, TRUE);
+        keypad(m_input, TRUE);
+        nodelay(m_input, TRUE);
+        wattron(m_status, A_REVERSE);
+
+        // 按新的宽度重排保留下来的消息
+        for (const std::string &line : m_lines)
+        {
+            waddstr(m_log, line.c_str());
+            waddch(m_log, '\n');
+        }
+        drawStatus();
+        drawInput();
+        clearok(curscr, TRUE);
+        m_dirty = true;
+    }
+
+    void append(const std::string &line)
+    {
+        m_lines.push_back(line);
+        if (m_lines.size() > static_cast<size_t>(HISTORY_LINES))
+        {
+            m_lines.pop_front();
+        }
+        waddstr(m_log, line.c_str());
+        waddch(m_log, '\n');
+        m_dirty = true;
+    }
+
+    void drainMessages()
+    {
+        m_io.clearNotify();
+        std::string msg;
+        while (m_io.poll(msg))
+        {
+            // "MSG <发送者> <内容>" 显示成 "<发送者>: <内容>"
+            if (msg.compare(0, 4, "MSG ") == 0)
+            {
+                size_t space = msg.find(' ', 4);
+                if (space != std::string::npos)
+                {
+                    msg = msg.substr(4, space - 4) + ": " + msg.substr(space + 1);
+                }
+            }
+            // "RECEIPT <读者> <已送达序号> <已读序号>" 显示成回执提示
+            else if (msg.compare(0, 8, "RECEIPT ") == 0)
+            {
+                std::istringstream in(msg.substr(8));
+                std::string reader;
+                uint64_t delivered = 0, read = 0;
+                in >> reader >> delivered >> read;
+                msg = "(" + reader + " 已收到 " + std::to_string(delivered) + " 条, 已读 " + std::to_string(read) + " 条)";
+            }
+            append(msg);
+        }
+        if (!m_io.connected())
+        {
+            throw std::runtime_error("Disconnected from server");
+        }
+    }
+
+    void readKeys()
+    {
+        int ch;
+        while ((ch = wgetch(m_input)) != ERR)
+        {
+            if (ch == KEY_RESIZE)
+            {
+                layout();
+            }
+            else if (ch == '\n' || ch == '\r' || ch == KEY_ENTER)
+            {
+                submit();
+                m_line.clear();
+            }
+            else if (ch == KEY_BACKSPACE || ch == 127 || ch == '\b')
+            {
+                // 按 UTF-8 字符删除, 先去掉续字节
+                while (!m_line.empty() && (static_cast<unsigned char>(m_line.back()) & 0xC0) == 0x80)
+                {
+                    m_line.pop_back();
+                }
+                if (!m_line.empty())
+                {
+                    m_line.pop_back();
+                }
+            }
+            else if (ch >= 0x20 && ch < 0x100 && ch != 127)
+            {
+                m_line.push_back(static_cast<char>(ch));
+            }
+            if (!m_running)
+            {
+                return;
+            }
+        }
+        drawInput();
+        m_dirty = true;
+    }
+
+    void submit()
+    {
+        if (m_line.empty())
+        {
+            return;
+        }
+        if (m_line == "/quit")
+        {
+            m_running = false;
+            return;
+        }
+        if (m_line.compare(0, 4, "/to ") == 0)
+        {
+            m_peer = m_line.substr(4);
+            drawStatus();
+            return;
+        }
+        if (m_peer.empty())
+        {
+            append("请先用 /to <user> 选择聊天对象");
+            return;
+        }
+        // 回复 (比如对方不在线) 作为推送消息回到消息区
+        m_io.send("SEND " + m_peer + " " + m_line);
+        append("me -> " + m_peer + ": " + m_line);
+    }
+
+    void drawStatus()
+    {
+        werase(m_status);
+        std::string text = m_peer.empty() ? " 未选择聊天对象" : " 正在和 " + m_peer + " 聊天";
+        waddstr(m_status, text.c_str());
+        for (int x = getcurx(m_status); x < COLS - 1; ++x)
+        {
+            waddch(m_status, ' ');
+        }
+        m_dirty = true;
+    }
+
+    void drawInput()
+    {
+        werase(m_input);
+        waddstr(m_input, "> ");
+        waddstr(m_input, m_line.c_str());
+    }
+
+    // 只把改过的窗口放进虚拟屏幕, 再一次性输出差异
+    void present()
+    {
+        auto now = std::chrono::steady_clock::now();
+        if (!m_dirty || now - m_lastFrame < std::chrono::milliseconds(FRAME_MS))
+        {
+            return;
+        }
+        wnoutrefresh(m_log);
+        wnoutrefresh(m_status);
+        wnoutrefresh(m_input); // 最后刷新输入框, 光标留在输入框里
+        doupdate();
+        m_lastFrame = now;
+        m_dirty = false;
+    }
+
+    ClientIO &m_io;
+    WINDOW *m_log = nullptr;
+    WINDOW *m_status = nullptr;
+    WINDOW *m_input = nullptr;
+    std::deque<std::string> m_lines;
+    std::string m_line; // 正在输入的内容
+    std::string m_peer;
+    bool m_running = false;
+    bool m_dirty = false;
+    std::chrono::steady_clock::time_point m_lastFrame{};
+};
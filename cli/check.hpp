@@ -0,0 +1,301 @@
+#pragma once
+#include "../include/headFile.hpp"
+#include "netcore.hpp"
+
+// 检查参数, 命令行里以 key=value 形式给出
+struct CheckOptions
+{
+    std::string host = "127.0.0.1";
+    int port = 8080;
+    int peer = 0;       // 同一集群里另一个节点的端口, 不为 0 时检查跨节点的行为
+    bool bench = false; // 服务器开启了 --bench-login
+    std::string accounts; // 分片检查用的账号名前缀, 不给时每次新建; 给出时已存在的账号直接沿用
+    int shardUsers = 32;  // 分片检查的账号数, 足够让键落到每个实例上
+    int timeoutMs = 3000; // 每个回复最多等这么久
+
+    bool parse(const std::string &arg)
+    {
+        size_t eq = arg.find('=');
+        if (eq == std::string::npos)
+        {
+            return false;
+        }
+        std::string key = arg.substr(0, eq);
+        std::string value = arg.substr(eq + 1);
+        try
+        {
+            if (key == "host")
+                host = value;
+            else if (key == "port")
+                port = std::stoi(value);
+            else if (key == "peer")
+                peer = std::stoi(value);
+            else if (key == "bench")
+                bench = value != "0";
+            else if (key == "accounts")
+                accounts = value;
+            else if (key == "users")
+                shardUsers = std::max(1, std::stoi(value));
+            else if (key == "timeout")
+                timeoutMs = std::max(1, std::stoi(value));
+            else
+                return false;
+        }
+        catch (const std::exception &e)
+        {
+            return false;
+        }
+        return true;
+    }
+};
+
+// 对着运行中的服务器 (和 Redis) 逐项检查协议行为, 每项打印 PASS/FAIL, 有失败时以非零状态退出
+// 用户名带上进程号和时间, 同一个 Redis 上反复运行不会撞上以前建的账号
+// 给出 peer 时再检查两个节点之间的行为: 一个节点上注册、另一个节点上登录 (两边的分片环一致才能找到账号),
+// 跨节点发消息、跨节点的上下线推送; 这部分要免验证注册, 两个节点都要开启 --bench-login
+// 分片检查: 一批账号轮流在两个节点上注册, 再到另一个节点上用密码登录, 账号的键分散在各个实例上,
+// 两个节点的分片环不一致或迁移丢了键时登录失败; 用 accounts 固定账号名, 增删实例前后各跑一次可以检查迁移
+class Check
+{
+public:
+    explicit Check(const CheckOptions &options) : m_options(options)
+    {
+        m_prefix = "chk" + std::to_string(getpid()) + "x" + std::to_string(time(nullptr) % 100000) + "u";
+    }
+
+    int run()
+    {
+        checkRegister();
+        if (m_options.peer != 0)
+        {
+            checkCluster();
+            checkShards();
+        }
+        std::cout << m_passed << " passed, " << m_failed << " failed" << std::endl;
+        return m_failed == 0 ? 0 : 1;
+    }
+
+private:
+    // 一条到服务器的连接, 收发交给 ClientIO
+    class Session
+    {
+    public:
+        Session(const std::string &host, int port, int timeoutMs) : m_timeoutMs(timeoutMs)
+        {
+            m_fd = socket(AF_INET, SOCK_STREAM, 0);
+            struct sockaddr_in server
+            {
+            };
+            server.sin_family = AF_INET;
+            server.sin_port = htons(port);
+            if (m_fd == -1 || inet_pton(AF_INET, host.c_str(), &server.sin_addr) <= 0 ||
+                connect(m_fd, (struct sockaddr *)&server, sizeof(server)) == -1)
+            {
+                int err = errno;
+                if (m_fd != -1)
+                {
+                    close(m_fd);
+                }
+                throw std::runtime_error(host + ":" + std::to_string(port) + ": " + strerror(err));
+            }
+            m_io = std::make_unique<ClientIO>(m_fd);
+            m_io->start();
+        }
+
+        ~Session()
+        {
+            m_io.reset();
+            close(m_fd);
+        }
+
+        // 等一条以 prefix 开头的推送, 之前的其他推送丢弃; 超时返回空串
+        std::string waitPush(const std::string &prefix)
+        {
+            auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(m_timeoutMs);
+            std::string message;
+            while (std::chrono::steady_clock::now() < deadline)
+            {
+                if (!m_io->poll(message))
+                {
+                    struct pollfd pfd = {m_io->notifyFd(), POLLIN, 0};
+                    ::poll(&pfd, 1, 50);
+                    m_io->clearNotify();
+                    continue;
+                }
+                if (message.compare(0, prefix.size(), prefix) == 0)
+                {
+                    return message;
+                }
+            }
+            return "";
+        }
+
+        // 超时或连接断开时返回空串
+        std::string ask(const std::string &request)
+        {
+            auto future = m_io->request(request);
+            if (future.wait_for(std::chrono::milliseconds(m_timeoutMs)) != std::future_status::ready)
+            {
+                return "";
+            }
+            try
+            {
+                return future.get();
+            }
+            catch (const std::exception &e)
+            {
+                return "";
+            }
+        }
+
+        void send(const std::string &frame)
+        {
+            m_io->send(frame);
+        }
+
+    private:
+        int m_fd = -1;
+        int m_timeoutMs;
+        std::unique_ptr<ClientIO> m_io;
+    };
+
+    void expect(const std::string &name, const std::string &reply, const std::string &prefix)
+    {
+        if (reply.compare(0, prefix.size(), prefix) == 0)
+        {
+            m_passed++;
+            std::cout << "PASS " << name << std::endl;
+            return;
+        }
+        m_failed++;
+        std::cout << "FAIL " << name << ": expected " << prefix << "..., got \"" << reply << "\"" << std::endl;
+    }
+
+    // 不带邮箱的 REGISTER 跳过了验证, 只有压测服务器接受
+    void checkRegister()
+    {
+        try
+        {
+            Session s(m_options.host, m_options.port, m_options.timeoutMs);
+            std::string user = m_prefix + "reg";
+            if (m_options.bench)
+            {
+                expect("register without email (bench)", s.ask("REGISTER " + user + " pw"), "REGISTERED");
+                expect("login after bench register", s.ask("LOGIN " + user + " pw"), "LOGGEDIN");
+            }
+            else
+            {
+                expect("register without email rejected", s.ask("REGISTER " + user + " pw"), "ERROR");
+                expect("rejected register creates no account", s.ask("LOGIN " + user + " pw"), "ERROR");
+            }
+            expect("register with bad code rejected", s.ask("REGISTER " + user + "c pw a@b.c 000000"), "ERROR");
+        }
+        catch (const std::exception &e)
+        {
+            m_failed++;
+            std::cout << "FAIL register: " << e.what() << std::endl;
+        }
+    }
+
+    // 两个节点之间: 账号、消息和上下线
+    void checkCluster()
+    {
+        if (!m_options.bench)
+        {
+            m_failed++;
+            std::cout << "FAIL cluster: needs bench=1 (both nodes started with --bench-login)" << std::endl;
+            return;
+        }
+        try
+        {
+            std::string a = m_prefix + "a", b = m_prefix + "b", w = m_prefix + "w";
+            {
+                Session setup(m_options.host, m_options.peer, m_options.timeoutMs);
+                expect("register on peer", setup.ask("REGISTER " + a + " pw"), "REGISTERED");
+                Session other(m_options.host, m_options.port, m_options.timeoutMs);
+                expect("register on node", other.ask("REGISTER " + b + " pw"), "REGISTERED");
+            }
+            Session sa(m_options.host, m_options.port, m_options.timeoutMs);
+            auto sb = std::make_unique<Session>(m_options.host, m_options.peer, m_options.timeoutMs);
+            expect("login on node with account registered on peer", sa.ask("LOGIN " + a + " pw"), "LOGGEDIN");
+            expect("login on peer with account registered on node", sb->ask("LOGIN " + b + " pw"), "LOGGEDIN");
+
+            sa.send("SEND " + b + " hello from " + a);
+            expect("message node -> peer", sb->waitPush("MSG " + a), "MSG " + a + " hello from " + a);
+            sb->send("SEND " + a + " hello from " + b);
+            expect("message peer -> node", sa.waitPush("MSG " + b), "MSG " + b + " hello from " + b);
+
+            Session sw(m_options.host, m_options.port, m_options.timeoutMs);
+            expect("login watcher", sw.ask("LOGIN " + w), "LOGGEDIN");
+            expect("watch user on peer", sw.ask("WATCH " + b), "PRESENCE " + b + ":1");
+            sb.reset(); // 断开连接就是下线
+            expect("offline on peer pushed to node", sw.waitPush("PRESENCE " + b), "PRESENCE " + b + ":0");
+        }
+        catch (const std::exception &e)
+        {
+            m_failed++;
+            std::cout << "FAIL cluster: " << e.what() << std::endl;
+        }
+    }
+
+    void checkShards()
+    {
+        if (!m_options.bench)
+        {
+            return; // checkCluster 已经报告过
+        }
+        try
+        {
+            std::string prefix = m_options.accounts.empty() ? m_prefix + "s" : m_options.accounts;
+            int registered = 0, loggedIn = 0;
+            std::string failure;
+            for (int i = 0; i < m_options.shardUsers; i++)
+            {
+                std::string user = prefix + std::to_string(i);
+                // REGISTER 和 LOGIN 是限速的昂贵命令, 每个账号用新连接
+                Session here(m_options.host, i % 2 == 0 ? m_options.port : m_options.peer, m_options.timeoutMs);
+                Session there(m_options.host, i % 2 == 0 ? m_options.peer : m_options.port, m_options.timeoutMs);
+                std::string reply = here.ask("REGISTER " + user + " pw");
+                if (reply.rfind("REGISTERED", 0) == 0 || (!m_options.accounts.empty() && reply == "ERROR user exists"))
+                {
+                    registered++;
+                }
+                else if (failure.empty())
+                {
+                    failure = "REGISTER " + user + ": \"" + reply + "\"";
+                }
+                reply = there.ask("LOGIN " + user + " pw");
+                if (reply == "LOGGEDIN")
+                {
+                    loggedIn++;
+                }
+                else if (failure.empty())
+                {
+                    failure = "LOGIN " + user + ": \"" + reply + "\"";
+                }
+            }
+            std::string name = "accounts across shards (" + std::to_string(m_options.shardUsers) + ")";
+            if (registered == m_options.shardUsers && loggedIn == m_options.shardUsers)
+            {
+                m_passed++;
+                std::cout << "PASS " << name << std::endl;
+            }
+            else
+            {
+                m_failed++;
+                std::cout << "FAIL " << name << ": " << registered << " registered, " << loggedIn << " logged in; " << failure
+                          << std::endl;
+            }
+        }
+        catch (const std::exception &e)
+        {
+            m_failed++;
+            std::cout << "FAIL shards: " << e.what() << std::endl;
+        }
+    }
+
+    CheckOptions m_options;
+    std::string m_prefix;
+    int m_passed = 0;
+    int m_failed = 0;
+};
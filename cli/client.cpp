@@ -1,10 +1,130 @@
 #include "../include/headFile.hpp"
+#include "check.hpp"
 #include "client.hpp"
+#include "codecbench.hpp"
+#include "loadtest.hpp"
+#include "replay.hpp"
+#include "tlsbench.hpp"
 
 #define PORT 8080
 
 int main(int argc, char **argv)
 {
+    // 压测模式: client --bench [users=N] [duration=S] [think=MS] [group=N] [size=B] [mix=80:5:15] [enroll=1] [host=IP] [port=P]
+    // 不接管终端, 直接在本进程里模拟大量用户
+    if (argc >= 2 && std::string(argv[1]) == "--bench")
+    {
+        LoadTestOptions options;
+        options.port = PORT;
+        for (int i = 2; i < argc; i++)
+        {
+            if (!options.parse(argv[i]))
+            {
+                std::cerr << "无效的压测参数: " << argv[i] << std::endl;
+                return 1;
+            }
+        }
+        LoadTest test(options);
+        return test.run();
+    }
+
+    // 协议检查: client --check [host=IP] [port=P] [peer=P] [bench=1] [accounts=PREFIX] [users=N] [timeout=MS], 对着运行中的服务器逐项检查
+    // 服务器开启了 --bench-login 时加 bench=1; peer 是同一集群里另一个节点的端口, 给出时检查跨节点投递和上下线
+    if (argc >= 2 && std::string(argv[1]) == "--check")
+    {
+        CheckOptions options;
+        options.port = PORT;
+        for (int i = 2; i < argc; i++)
+        {
+            if (!options.parse(argv[i]))
+            {
+                std::cerr << "无效的检查参数: " << argv[i] << std::endl;
+                return 1;
+            }
+        }
+        Check check(options);
+        return check.run();
+    }
+
+    // 压缩基准: client --codec-bench [corpus=FILE] [rounds=N] [train=OUT] [dict=BYTES]
+    if (argc >= 2 && std::string(argv[1]) == "--codec-bench")
+    {
+        CodecBenchOptions options;
+        for (int i = 2; i < argc; i++)
+        {
+            if (!options.parse(argv[i]))
+            {
+                std::cerr << "无效的基准参数: " << argv[i] << std::endl;
+                return 1;
+            }
+        }
+        CodecBench bench(options);
+        return bench.run();
+    }
+
+    // TLS 基准: client --tls-bench [size=B] [mb=N], 在本机回环上比较明文、用户态 TLS 和 kTLS
+    if (argc >= 2 && std::string(argv[1]) == "--tls-bench")
+    {
+        TlsBenchOptions options;
+        for (int i = 2; i < argc; i++)
+        {
+            if (!options.parse(argv[i]))
+            {
+                std::cerr << "无效的基准参数: " << argv[i] << std::endl;
+                return 1;
+            }
+        }
+        TlsBench bench(options);
+        return bench.run();
+    }
+
+    // 回放: client --replay capture=FILE [speed=X] [host=IP] [port=P] [drain=S] [save=OUT] [baseline=FILE] [tolerance=%] [min=N] [password=PW]
+    // 按服务器 --capture 录下的节奏重放流量; save 把结果存为基线, baseline 与旧结果比较, 有退化时退出码为 2
+    // 录制里的密码已去掉, REGISTER/LOGIN 统一换成 password (默认 "password")
+    if (argc >= 2 && std::string(argv[1]) == "--replay")
+    {
+        ReplayOptions options;
+        options.port = PORT;
+        for (int i = 2; i < argc; i++)
+        {
+            if (!options.parse(argv[i]))
+            {
+                std::cerr << "无效的回放参数: " << argv[i] << std::endl;
+                return 1;
+            }
+        }
+        if (options.capture.empty())
+        {
+            std::cerr << "缺少 capture=FILE" << std::endl;
+            return 1;
+        }
+        Replay replay(options);
+        return replay.run();
+    }
+
+    // 用法: client [host] [port] [--tls] [--tls-ca=FILE]
+    // --tls 用 TLS 1.3 连接, 默认用系统的 CA 校验服务器证书, 服务器用自签名证书时用 --tls-ca 指定
+    bool tls = false;
+    std::string caFile;
+    std::vector<std::string> positional;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--tls")
+        {
+            tls = true;
+        }
+        else if (arg.rfind("--tls-ca=", 0) == 0)
+        {
+            tls = true;
+            caFile = arg.substr(strlen("--tls-ca="));
+        }
+        else
+        {
+            positional.push_back(arg);
+        }
+    }
+
     // 禁用EOF
     // 可以考虑直接忽略 EOF
     // 目的: 防止EOF中断输入流   确保终端输入稳定
@@ -33,31 +153,31 @@ int main(int argc, char **argv)
 
     int port = PORT; // 默认端口
 
-    if (argc >= 2) // 自定义服务器地址
+    if (positional.size() >= 1) // 自定义服务器地址
     {
-        serverAddress = argv[1];
+        serverAddress = positional[0];
     }
 
-    if (argc >= 3) // 自定义端口
+    if (positional.size() >= 2) // 自定义端口
     {
         try
         {
-            port = std::stoi(argv[2]);
+            port = std::stoi(positional[1]);
             if (port <= 0 || port > 65535)
             {
-                std::cerr << "端口号超出有效范围 (1-65535): " << argv[2] << std::endl;
+                std::cerr << "端口号超出有效范围 (1-65535): " << positional[1] << std::endl;
                 return 1;
             }
         }
         catch (const std::invalid_argument &e)
         {
-            std::cerr << "无效的端口号: " << argv[2] << std::endl;
+            std::cerr << "无效的端口号: " << positional[1] << std::endl;
             return 1;
         }
     }
     try
     {
-        Client myClient(serverAddress, port);
+        Client myClient(serverAddress, port, tls, caFile);
         myClient.run();
     }
     catch (const std::exception &e)
@@ -1,5 +1,8 @@
+#pragma once
 #include "../include/headFile.hpp"
+#include "chatview.hpp"
 #include "menu.hpp"
+#include "netcore.hpp"
 #include "user.hpp"
 
 
@@ -23,7 +26,8 @@ private:
 class Client : public Menu
 {
 public:
-    Client(const std::string &serverAddress, int port)
+    // tls 为 true 时握手后再交给网络线程, caFile 为空时用系统的 CA 校验服务器证书
+    Client(const std::string &serverAddress, int port, bool tls = false, const std::string &caFile = "")
         : serverAddress(serverAddress), socketPtr(std::make_unique<Socket>())
     {
         int fd = socket(AF_INET, SOCK_STREAM, 0);
@@ -56,12 +60,28 @@ public:
         }
         std::cout << "Connected to server " << serverAddress << ":" << port << std::endl;
 
-        startReceiveThread();
+        // socket 此时还是阻塞的, 握手一次完成; 密码之类的内容此后都只在加密连接上传输
+        if (tls)
+        {
+            signal(SIGPIPE, SIG_IGN); // 连接断开后 OpenSSL 和 kTLS 的写不能杀死进程
+            tlsContext = std::make_unique<TlsContext>(TlsContext::Client, caFile);
+            tlsStream = std::make_unique<TlsStream>(*tlsContext, socketPtr->get(), serverAddress);
+            if (tlsStream->handshake() != 1)
+            {
+                std::cerr << "TLS handshake failed: " << TlsContext::lastError() << std::endl;
+                throw std::runtime_error("TLS handshake failed");
+            }
+            std::cout << "TLS established (" << tlsStream->mode() << ")" << std::endl;
+        }
+
+        // 所有收发都交给网络线程
+        io = std::make_unique<ClientIO>(socketPtr->get(), tlsStream.get());
+        io->start();
     }
 
     ~Client()
     {
-        stopReceiveThread();
+        io->stop();
     }
 
     void run()
@@ -72,6 +92,8 @@ public:
             do
             {
                 this->ShowMenu();
+                showPushedMessages();
+                std::cout << "> " << std::flush;
                 std::cin >> selectStr;
 
                 int select = 0;
@@ -93,7 +115,7 @@ public:
                 }
 
                 // 成功后进行操作
-                if (select < 0 || select > 4)
+                if (select < 0 || select > 5)
                 {
                     // 输入超出选项
                     std::cerr << "Invalid select, please try again." << std::endl;
@@ -103,34 +125,34 @@ public:
                 switch (select)
                 {
                 case 1:
-                    system("clear");
                     this->LoginMenu();
-                    this->myUser.Login(socketPtr->get());
+                    this->myUser.Login(*io);
                     break;
 
                 case 2:
                     std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
-                    system("clear");
                     this->EnrollMenu();
-                    this->myUser.Enroll(socketPtr->get());
+                    this->myUser.Enroll(*io);
                     break;
 
                 case 3:
                     std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
-                    system("clear");
                     this->LogoutMenu();
-                    this->myUser.Logout(socketPtr->get());
+                    this->myUser.Logout(*io);
                     break;
 
                 case 4:
-                    system("clear");
                     this->ExitMenu();
-                    this->myUser.Exit(socketPtr->get());
+                    this->myUser.Exit(*io);
                     select = 0;
                     break;
 
+                case 5:
+                    ChatView(*io).run();
+                    break;
+
                 default:
-                    system("clear");
+                    Menu::ClearScreen();
                     std::cout << "Invalid select" << std::endl;
                     break;
                 }
@@ -144,47 +166,18 @@ public:
     }
 
 private:
-    void startReceiveThread()
+    // 显示网络线程转来的推送消息
+    void showPushedMessages()
     {
-        stopThread = false;
-        receiveThread = std::thread(&Client::receiveMessages, this);
-    }
-
-    void stopReceiveThread()
-    {
-        stopThread = true;
-        if (receiveThread.joinable())
+        io->clearNotify();
+        std::string msg;
+        while (io->poll(msg))
         {
-            receiveThread.join();
+            std::cout << msg << std::endl;
         }
-    }
-
-    void receiveMessages()
-    {
-        while (stopThread)
+        if (!io->connected())
         {
-            char buffer[1024];
-            ssize_t bytesReceived = recv(socketPtr->get(), buffer, sizeof(buffer) - 1, 0);
-            if (bytesReceived > 0)
-            {
-                buffer[bytesReceived] = '\0';
-                {
-                    std::unique_lock<std::mutex> lock(mutex);
-                    message.push(std::string(buffer));
-                }
-                condVar.notify_one();
-            }
-            else if (bytesReceived == 0)
-            {
-                // 服务器关闭连接
-                std::cerr << "Server closed the connection" << std::endl;
-                stopThread = true;
-            }
-            else
-            {
-                std::cerr << "recv failed: " << strerror(errno) << std::endl;
-                stopThread = true;
-            }
+            throw std::runtime_error("Disconnected from server");
         }
     }
 
@@ -193,10 +186,7 @@ private:
     Users myUser;
     std::string serverAddress;
     std::unique_ptr<Socket> socketPtr;
-
-    std::thread receiveThread;
-    std::atomic<bool> stopThread{false};
-    std::mutex mutex;
-    std::condition_variable condVar;
-    std::queue<std::string> message;
+    std::unique_ptr<TlsContext> tlsContext;
+    std::unique_ptr<TlsStream> tlsStream;
+    std::unique_ptr<ClientIO> io;
 };
\ No newline at end of file
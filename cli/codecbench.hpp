@@ -0,0 +1,303 @@
+#pragma once
+#include "../include/headFile.hpp"
+#include "../Cli_Ser_Connection/Codec.hpp"
+
+// 压缩基准参数, 命令行里以 key=value 形式给出
+struct CodecBenchOptions
+{
+    std::string corpus;   // 聊天记录样本, 每行一条消息; 为空时用内置的合成样本
+    std::string train;    // 非空时从样本训练字典并写到这个文件
+    int rounds = 20;      // 每种情况重复的次数, 取 CPU 时间总和
+    size_t dictSize = 4096;
+
+    bool parse(const std::string &arg)
+    {
+        size_t eq = arg.find('=');
+        if (eq == std::string::npos)
+        {
+            return false;
+        }
+        std::string key = arg.substr(0, eq);
+        std::string value = arg.substr(eq + 1);
+        try
+        {
+            if (key == "corpus")
+                corpus = value;
+            else if (key == "train")
+                train = value;
+            else if (key == "rounds")
+                rounds = std::max(1, std::stoi(value));
+            else if (key == "dict")
+                dictSize = std::stoul(value);
+            else
+                return false;
+        }
+        catch (const std::exception &e)
+        {
+            return false;
+        }
+        return true;
+    }
+};
+
+// 比较 不压缩 / deflate / deflate+共享字典 在几类典型负载上的效果:
+// 省下的字节数和为此花掉的 CPU 时间 (线程 CPU 时间, 不受调度影响)
+class CodecBench
+{
+public:
+    explicit CodecBench(const CodecBenchOptions &options) : m_options(options) {}
+
+    int run()
+    {
+        std::vector<std::string> lines = loadCorpus();
+        if (lines.empty())
+        {
+            std::cerr << "样本为空" << std::endl;
+            return 1;
+        }
+        if (!m_options.train.empty())
+        {
+            return train(lines);
+        }
+
+        // 单条聊天消息, 服务器转发时的形式
+        std::vector<std::string> shortMsgs, longMsgs;
+        for (size_t i = 0; i < lines.size(); ++i)
+        {
+            std::string frame = "MSG user" + std::to_string(i % 97) + " " + lines[i];
+            (frame.size() < 256 ? shortMsgs : longMsgs).push_back(frame);
+        }
+        // 历史记录一页 50 条, 合成一帧
+        std::vector<std::string> pages;
+        std::string page;
+        for (size_t i = 0; i < lines.size(); ++i)
+        {
+            page += "HIST 1700000000000-" + std::to_string(i) + " user" + std::to_string(i % 7) + " " + lines[i] + "\n";
+            if (i % 50 == 49)
+            {
+                pages.push_back(page + "HISTEND (1700000000000-" + std::to_string(i));
+                page.clear();
+            }
+        }
+        // 文件分块: 文本文件和已经压缩过的文件 (随机字节) 各一种
+        std::vector<std::string> textChunks, binaryChunks;
+        std::string all;
+        for (const std::string &line : lines)
+        {
+            all += line + "\n";
+        }
+        for (size_t off = 0; off + 64 * 1024 <= all.size() && textChunks.size() < 16; off += 64 * 1024)
+        {
+            textChunks.push_back(all.substr(off, 64 * 1024));
+        }
+        std::mt19937 rng(42);
+        for (int i = 0; i < 4; ++i)
+        {
+            std::string chunk(64 * 1024, '\0');
+            for (char &ch : chunk)
+            {
+                ch = static_cast<char>(rng());
+            }
+            binaryChunks.push_back(chunk);
+        }
+
+        std::cout << std::left << std::setw(14) << "payload" << std::setw(14) << "mode" << std::right
+                  << std::setw(8) << "frames" << std::setw(12) << "raw(B)" << std::setw(12) << "wire(B)"
+                  << std::setw(8) << "saved" << std::setw(12) << "comp(ns/B)" << std::setw(12) << "dec(ns/B)"
+                  << std::setw(14) << "ns/saved B" << std::endl;
+        report("msg<256B", shortMsgs);
+        report("msg>=256B", longMsgs);
+        report("history", pages);
+        report("file/text", textChunks);
+        report("file/binary", binaryChunks);
+        return 0;
+    }
+
+private:
+    std::vector<std::string> loadCorpus()
+    {
+        std::vector<std::string> lines;
+        if (!m_options.corpus.empty())
+        {
+            std::ifstream in(m_options.corpus);
+            std::string line;
+            while (std::getline(in, line))
+            {
+                if (!line.empty())
+                {
+                    lines.push_back(line);
+                }
+            }
+            return lines;
+        }
+
+        // 合成样本: 常用短句随机拼接, 偶尔带数字和链接
+        static const char *phrases[] = {
+            "ok", "好的", "收到", "哈哈哈", "明天见", "在吗", "我到了", "等一下",
+            "What time is the meeting tomorrow?", "I'll send you the file later.",
+            "Did you see the new release notes?", "晚上一起吃饭吗", "这个问题我再看看",
+            "The build is failing on the main branch again.", "刚才网络有点卡",
+            "Can you review my pull request when you have time?", "今天的会议改到下午三点了",
+            "https://example.com/docs/getting-started", "Thanks!", "没问题, 我来处理"};
+        std::mt19937 rng(7);
+        for (int i = 0; i < 20000; ++i)
+        {
+            std::string line = phrases[rng() % std::size(phrases)];
+            int extra = rng() % 4;
+            for (int j = 0; j < extra; ++j)
+            {
+                line += " ";
+                line += phrases[rng() % std::size(phrases)];
+            }
+            if (rng() % 5 == 0)
+            {
+                line += " #" + std::to_string(rng() % 10000);
+            }
+            lines.push_back(line);
+        }
+        return lines;
+    }
+
+    static int64_t cpuNanos()
+    {
+        struct timespec ts;
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+        return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+    }
+
+    void report(const char *label, const std::vector<std::string> &frames)
+    {
+        if (frames.empty())
+        {
+            return;
+        }
+        FrameCodec &codec = FrameCodec::local();
+        const char *modes[] = {"none", "deflate", "deflate+dict"};
+        for (int mode = 0; mode < 3; ++mode)
+        {
+            bool dict = mode == 2;
+            size_t raw = 0, wire = 0;
+            int64_t compNs = 0, decNs = 0;
+            std::string packed, unpacked;
+            for (int round = 0; round < m_options.rounds; ++round)
+            {
+                for (const std::string &frame : frames)
+                {
+                    size_t n = 0;
+                    if (mode != 0 && frame.size() >= COMPRESS_MIN)
+                    {
+                        packed.resize(codec.bound(frame.size()));
+                        int64_t start = cpuNanos();
+                        n = codec.compress(frame.data(), frame.size(), packed.data(), packed.size(), dict);
+                        compNs += cpuNanos() - start;
+                        if (n > 0)
+                        {
+                            start = cpuNanos();
+                            bool ok = codec.decompress(packed.data(), n, unpacked, frame.size(), dict);
+                            decNs += cpuNanos() - start;
+                            if (!ok || unpacked != frame)
+                            {
+                                std::cerr << "round trip mismatch in " << label << std::endl;
+                            }
+                        }
+                    }
+                    if (round == 0)
+                    {
+                        raw += frame.size() + sizeof(uint32_t);
+                        wire += (n > 0 ? n : frame.size()) + sizeof(uint32_t);
+                    }
+                }
+            }
+            double rawAll = static_cast<double>(raw) * m_options.rounds;
+            double savedAll = static_cast<double>(raw - wire) * m_options.rounds;
+            std::cout << std::left << std::setw(14) << (mode == 0 ? label : "") << std::setw(14) << modes[mode]
+                      << std::right << std::fixed << std::setprecision(2)
+                      << std::setw(8) << frames.size() << std::setw(12) << raw << std::setw(12) << wire
+                      << std::setw(7) << 100.0 * (raw - wire) / raw << "%"
+                      << std::setw(12) << compNs / rawAll << std::setw(12) << decNs / rawAll;
+            if (savedAll > 0)
+            {
+                std::cout << std::setw(14) << (compNs + decNs) / savedAll;
+            }
+            else
+            {
+                std::cout << std::setw(14) << "-";
+            }
+            std::cout << std::endl;
+        }
+    }
+
+    // 训练字典: 统计 1~3 个词的片段, 按 出现次数 x 长度 打分, 取高分片段拼到 dictSize 字节
+    // 分数低的放前面, deflate 对靠近数据的字典内容编码更短
+    int train(const std::vector<std::string> &lines)
+    {
+        std::unordered_map<std::string, size_t> counts;
+        for (const std::string &line : lines)
+        {
+            std::vector<std::string> words;
+            std::istringstream in(line);
+            std::string word;
+            while (in >> word)
+            {
+                words.push_back(word);
+            }
+            for (size_t i = 0; i < words.size(); ++i)
+            {
+                std::string piece;
+                for (size_t n = 0; n < 3 && i + n < words.size(); ++n)
+                {
+                    piece += (n ? " " : "") + words[i + n];
+                    if (piece.size() >= 3)
+                    {
+                        counts[piece + " "]++;
+                    }
+                }
+            }
+        }
+
+        std::vector<std::pair<size_t, std::string>> scored;
+        for (auto &[piece, count] : counts)
+        {
+            if (count > 1)
+            {
+                scored.emplace_back(count * piece.size(), piece);
+            }
+        }
+        std::sort(scored.begin(), scored.end(), std::greater<>());
+
+        std::vector<std::string> chosen;
+        size_t total = 0;
+        for (auto &[score, piece] : scored)
+        {
+            if (total + piece.size() > m_options.dictSize)
+            {
+                continue;
+            }
+            // 已经被更高分的片段包含的不再重复放
+            bool covered = false;
+            for (const std::string &c : chosen)
+            {
+                if (c.find(piece) != std::string::npos)
+                {
+                    covered = true;
+                    break;
+                }
+            }
+            if (!covered)
+            {
+                chosen.push_back(piece);
+                total += piece.size();
+            }
+        }
+
+        std::ofstream out(m_options.train);
+        for (auto it = chosen.rbegin(); it != chosen.rend(); ++it)
+        {
+            out << *it;
+        }
+        std::cout << "wrote " << total << " byte dictionary from " << lines.size() << " lines to " << m_options.train << std::endl;
+        return out ? 0 : 1;
+    }
+
+    CodecBenchOptions m_options;
+};
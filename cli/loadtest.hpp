@@ -0,0 +1,538 @@
+#pragma once
+#include "../include/headFile.hpp"
+#include "../Cli_Ser_Connection/Affinity.hpp"
+#include "../Cli_Ser_Connection/Connection.hpp"
+#include "user.hpp"
+
+// 压测参数, 命令行里以 key=value 形式给出
+struct LoadTestOptions
+{
+    std::string host = "127.0.0.1";
+    int port = 8080;
+    int users = 1000;      // 模拟的用户数
+    int duration = 30;     // 压测时长 (秒), 包含连接和登录阶段
+    int thinkMs = 500;     // 两次操作之间的平均间隔, 按指数分布随机
+    int groupSize = 10;    // 用户按组划分, 消息只发给同组的人
+    int messageSize = 64;  // 聊天消息的字节数
+    int sendWeight = 80;   // 操作比例: 发消息 / 拉历史 / 回显
+    int historyWeight = 5;
+    int echoWeight = 15;
+    bool enroll = false;   // 登录前先走一遍注册请求 (不带邮箱); 两种方式都需要服务器开启 --bench-login
+
+    // 解析 key=value, 未知参数返回 false
+    bool parse(const std::string &arg)
+    {
+        size_t eq = arg.find('=');
+        if (eq == std::string::npos)
+        {
+            return false;
+        }
+        std::string key = arg.substr(0, eq);
+        std::string value = arg.substr(eq + 1);
+        try
+        {
+            if (key == "host")
+                host = value;
+            else if (key == "port")
+                port = std::stoi(value);
+            else if (key == "users")
+                users = std::stoi(value);
+            else if (key == "duration")
+                duration = std::stoi(value);
+            else if (key == "think")
+                thinkMs = std::stoi(value);
+            else if (key == "group")
+                groupSize = std::max(2, std::stoi(value));
+            else if (key == "size")
+                messageSize = std::max(24, std::stoi(value));
+            else if (key == "enroll")
+                enroll = value != "0";
+            else if (key == "mix")
+            {
+                // mix=发消息:拉历史:回显
+                if (sscanf(value.c_str(), "%d:%d:%d", &sendWeight, &historyWeight, &echoWeight) != 3)
+                {
+                    return false;
+                }
+            }
+            else
+                return false;
+        }
+        catch (const std::exception &e)
+        {
+            return false;
+        }
+        return true;
+    }
+};
+
+// 无界面压测模式: 一个进程里用同一个 epoll 循环驱动大量脚本化用户
+// 注册和登录使用 Users 的请求报文, 收发使用 Sen/Rec 的帧格式, 与交互客户端走完全相同的协议
+// 结束时按操作类型报告延迟分位数
+class LoadTest
+{
+public:
+    explicit LoadTest(const LoadTestOptions &options)
+        : m_options(options), m_rng(std::random_device{}())
+    {
+    }
+
+    int run()
+    {
+        m_epollFd = epoll_create1(0);
+        if (m_epollFd == -1)
+        {
+            perror("epoll_create1");
+            return 1;
+        }
+
+        m_users.resize(m_options.users);
+        for (int i = 0; i < m_options.users; i++)
+        {
+            startConnect(i);
+        }
+
+        auto start = now();
+        m_deadline = start + uint64_t(m_options.duration) * 1000000000ull;
+        m_placement = PlacementStats();
+        std::cout << "Load test: " << m_options.users << " users, " << m_options.duration << "s" << std::endl;
+
+        struct epoll_event events[256];
+        while (now() < m_deadline)
+        {
+            int nfds = epoll_wait(m_epollFd, events, 256, nextTimeoutMs());
+            if (nfds == -1 && errno != EINTR)
+            {
+                perror("epoll_wait");
+                break;
+            }
+            for (int i = 0; i < nfds; i++)
+            {
+                VUser &u = m_users[events[i].data.u32];
+                if (events[i].events & (EPOLLERR | EPOLLHUP))
+                {
+                    fail(u);
+                    continue;
+                }
+                if (events[i].events & EPOLLOUT)
+                {
+                    onWritable(u);
+                }
+                if ((events[i].events & EPOLLIN) && u.state != DEAD)
+                {
+                    onReadable(u);
+                }
+            }
+            runTimers();
+        }
+
+        report(now() - start);
+        for (auto &u : m_users)
+        {
+            if (u.fd != -1)
+            {
+                close(u.fd);
+            }
+        }
+        close(m_epollFd);
+        return 0;
+    }
+
+private:
+    enum Op
+    {
+        OP_CONNECT,
+        OP_ENROLL,
+        OP_LOGIN,
+        OP_SEND, // 从发出到对方收到的端到端延迟
+        OP_HISTORY,
+        OP_ECHO,
+        OP_COUNT
+    };
+
+    enum State
+    {
+        CONNECTING,
+        ENROLLING,
+        LOGGING_IN,
+        ACTIVE,
+        DEAD
+    };
+
+    struct Pending
+    {
+        Op op;
+        uint64_t start;
+    };
+
+    struct VUser
+    {
+        int fd = -1;
+        int index = 0;
+        State state = CONNECTING;
+        uint64_t connectStart = 0;
+        uint32_t events = 0;
+        std::string id;
+        std::string in;
+        std::string out;
+        std::unordered_map<uint32_t, Pending> pending;
+    };
+
+    struct Stats
+    {
+        std::vector<uint32_t> samplesUs;
+        uint64_t errors = 0;
+    };
+
+    static uint64_t now()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   std::chrono::steady_clock::now().time_since_epoch())
+            .count();
+    }
+
+    void startConnect(int index)
+    {
+        VUser &u = m_users[index];
+        u.index = index;
+        u.id = "bench" + std::to_string(index);
+        u.fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+        if (u.fd == -1)
+        {
+            perror("socket");
+            u.state = DEAD;
+            m_stats[OP_CONNECT].errors++;
+            return;
+        }
+
+        struct sockaddr_in server{};
+        server.sin_family = AF_INET;
+        server.sin_port = htons(m_options.port);
+        inet_pton(AF_INET, m_options.host.c_str(), &server.sin_addr);
+
+        u.connectStart = now();
+        if (connect(u.fd, (struct sockaddr *)&server, sizeof(server)) == -1 && errno != EINPROGRESS)
+        {
+            fail(u);
+            return;
+        }
+        u.events = EPOLLIN | EPOLLOUT;
+        struct epoll_event ev{};
+        ev.events = u.events;
+        ev.data.u32 = index;
+        epoll_ctl(m_epollFd, EPOLL_CTL_ADD, u.fd, &ev);
+    }
+
+    // 带请求号发出, 收到同号回复时记录延迟
+    void request(VUser &u, Op op, const std::string &payload)
+    {
+        uint32_t rid = m_nextId++;
+        u.pending[rid] = {op, now()};
+        std::string framed = "#" + std::to_string(rid) + " " + payload;
+        Sen s;
+        s.packFrame(u.out, framed.data(), framed.size());
+        onWritable(u);
+    }
+
+    void onWritable(VUser &u)
+    {
+        if (u.state == CONNECTING)
+        {
+            int err = 0;
+            socklen_t len = sizeof(err);
+            getsockopt(u.fd, SOL_SOCKET, SO_ERROR, &err, &len);
+            if (err != 0)
+            {
+                fail(u);
+                return;
+            }
+            record(OP_CONNECT, now() - u.connectStart);
+            if (m_options.enroll)
+            {
+                u.state = ENROLLING;
+                request(u, OP_ENROLL, Users::EnrollRequest(u.id, "password"));
+            }
+            else
+            {
+                // 不注册时用压测专用的免密登录, 服务器要带 --bench-login
+                u.state = LOGGING_IN;
+                request(u, OP_LOGIN, "LOGIN " + u.id);
+            }
+            return;
+        }
+
+        while (!u.out.empty())
+        {
+            ssize_t sent = send(u.fd, u.out.data(), u.out.size(), MSG_NOSIGNAL);
+            if (sent > 0)
+            {
+                u.out.erase(0, sent);
+                continue;
+            }
+            if (sent == -1 && errno == EINTR)
+            {
+                continue;
+            }
+            if (sent == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            {
+                setEvents(u, EPOLLIN | EPOLLOUT);
+                return;
+            }
+            fail(u);
+            return;
+        }
+        setEvents(u, EPOLLIN);
+    }
+
+    void onReadable(VUser &u)
+    {
+        char buffer[16 * 1024];
+        while (true)
+        {
+            ssize_t n = recv(u.fd, buffer, sizeof(buffer), 0);
+            if (n > 0)
+            {
+                u.in.append(buffer, n);
+                continue;
+            }
+            if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR))
+            {
+                fail(u);
+                return;
+            }
+            if (errno != EINTR)
+            {
+                break;
+            }
+        }
+
+        Rec r;
+        size_t off = 0;
+        std::string_view frame;
+        while (u.state != DEAD && r.unpackFrame(u.in, off, frame))
+        {
+            onFrame(u, frame);
+        }
+        u.in.erase(0, off);
+    }
+
+    void onFrame(VUser &u, std::string_view frame)
+    {
+        uint64_t t = now();
+        if (!frame.empty() && frame[0] == '#')
+        {
+            size_t space = frame.find(' ');
+            uint32_t rid = std::strtoul(std::string(frame.substr(1, space - 1)).c_str(), nullptr, 10);
+            auto it = u.pending.find(rid);
+            if (it == u.pending.end())
+            {
+                return;
+            }
+            Pending p = it->second;
+            u.pending.erase(it);
+            std::string_view body = space == std::string_view::npos ? std::string_view() : frame.substr(space + 1);
+            // 没开 --streams 的服务器不认识 HISTORY, 原样回显; 过载时回 BUSY/LIMITED; 这些都不算一次成功的查询
+            // 带请求号的 HISTORY 回复是一整帧, 以 "HIST " 开头, 没有记录时只有 "HISTEND"
+            if (p.op == OP_HISTORY && body.substr(0, 5) != "HIST " && body.substr(0, 7) != "HISTEND")
+            {
+                m_stats[OP_HISTORY].errors++;
+                return;
+            }
+            record(p.op, t - p.start);
+
+            if (p.op == OP_ENROLL)
+            {
+                u.state = LOGGING_IN;
+                request(u, OP_LOGIN, Users::LoginRequest(u.id, "password"));
+            }
+            else if (p.op == OP_LOGIN)
+            {
+                if (body != "LOGGEDIN")
+                {
+                    m_stats[OP_LOGIN].errors++;
+                    fail(u);
+                    return;
+                }
+                u.state = ACTIVE;
+                schedule(u.index);
+            }
+            return;
+        }
+
+        // 推送的聊天消息: "MSG from t=<发送时刻> ..."
+        if (frame.substr(0, 4) == "MSG ")
+        {
+            size_t pos = frame.find(" t=");
+            if (pos != std::string_view::npos)
+            {
+                uint64_t sentAt = std::strtoull(std::string(frame.substr(pos + 3, 20)).c_str(), nullptr, 10);
+                record(OP_SEND, t - sentAt);
+            }
+            return;
+        }
+        if (frame.substr(0, 8) == "OFFLINE ")
+        {
+            m_stats[OP_SEND].errors++;
+        }
+    }
+
+    // 按权重随机选一个操作
+    void act(VUser &u)
+    {
+        int total = m_options.sendWeight + m_options.historyWeight + m_options.echoWeight;
+        int pick = std::uniform_int_distribution<int>(0, std::max(total, 1) - 1)(m_rng);
+
+        int group = u.index / m_options.groupSize;
+        int first = group * m_options.groupSize;
+        int last = std::min(first + m_options.groupSize, m_options.users) - 1;
+        int peer = u.index;
+        while (last > first && peer == u.index)
+        {
+            peer = std::uniform_int_distribution<int>(first, last)(m_rng);
+        }
+
+        if (pick < m_options.sendWeight)
+        {
+            if (peer == u.index)
+            {
+                return; // 组里只有自己
+            }
+            std::string text = "t=" + std::to_string(now()) + " ";
+            text.resize(std::max<size_t>(text.size(), m_options.messageSize), 'x');
+            std::string payload = "SEND " + m_users[peer].id + " " + text;
+            Sen s;
+            s.packFrame(u.out, payload.data(), payload.size());
+            onWritable(u);
+        }
+        else if (pick < m_options.sendWeight + m_options.historyWeight)
+        {
+            request(u, OP_HISTORY, "HISTORY " + m_users[peer].id + " - 20");
+        }
+        else
+        {
+            request(u, OP_ECHO, "ECHO " + u.id);
+        }
+    }
+
+    void schedule(int index)
+    {
+        std::exponential_distribution<double> think(1.0 / std::max(1, m_options.thinkMs));
+        uint64_t delay = static_cast<uint64_t>(think(m_rng) * 1000000.0);
+        m_timers.push({now() + delay, index});
+    }
+
+    void runTimers()
+    {
+        uint64_t t = now();
+        while (!m_timers.empty() && m_timers.top().first <= t)
+        {
+            int index = m_timers.top().second;
+            m_timers.pop();
+            VUser &u = m_users[index];
+            if (u.state != ACTIVE)
+            {
+                continue;
+            }
+            act(u);
+            if (u.state == ACTIVE)
+            {
+                schedule(index);
+            }
+        }
+    }
+
+    int nextTimeoutMs()
+    {
+        uint64_t t = now();
+        uint64_t until = m_deadline;
+        if (!m_timers.empty())
+        {
+            until = std::min(until, m_timers.top().first);
+        }
+        return until <= t ? 0 : static_cast<int>((until - t) / 1000000 + 1);
+    }
+
+    void setEvents(VUser &u, uint32_t events)
+    {
+        if (u.events == events)
+        {
+            return;
+        }
+        u.events = events;
+        struct epoll_event ev{};
+        ev.events = events;
+        ev.data.u32 = u.index;
+        epoll_ctl(m_epollFd, EPOLL_CTL_MOD, u.fd, &ev);
+    }
+
+    void fail(VUser &u)
+    {
+        if (u.state == DEAD)
+        {
+            return;
+        }
+        Op op = u.state == CONNECTING ? OP_CONNECT : u.state == ENROLLING ? OP_ENROLL
+                                                 : u.state == LOGGING_IN  ? OP_LOGIN
+                                                                          : OP_ECHO;
+        m_stats[op].errors++;
+        u.state = DEAD;
+        epoll_ctl(m_epollFd, EPOLL_CTL_DEL, u.fd, NULL);
+        close(u.fd);
+        u.fd = -1;
+        m_dead++;
+    }
+
+    void record(Op op, uint64_t ns)
+    {
+        m_stats[op].samplesUs.push_back(static_cast<uint32_t>(std::min<uint64_t>(ns / 1000, UINT32_MAX)));
+    }
+
+    void report(uint64_t elapsedNs)
+    {
+        static const char *names[OP_COUNT] = {"connect", "enroll", "login", "send", "history", "echo"};
+        double seconds = elapsedNs / 1e9;
+        std::cout << std::left << std::setw(10) << "op" << std::right
+                  << std::setw(10) << "count" << std::setw(8) << "errors" << std::setw(10) << "ops/s"
+                  << std::setw(10) << "p50(ms)" << std::setw(10) << "p90(ms)" << std::setw(10) << "p99(ms)"
+                  << std::setw(10) << "p999(ms)" << std::setw(10) << "max(ms)" << std::endl;
+        for (int op = 0; op < OP_COUNT; op++)
+        {
+            auto &samples = m_stats[op].samplesUs;
+            if (samples.empty() && m_stats[op].errors == 0)
+            {
+                continue;
+            }
+            std::sort(samples.begin(), samples.end());
+            auto pct = [&](double p) -> double
+            {
+                if (samples.empty())
+                {
+                    return 0;
+                }
+                size_t i = std::min(samples.size() - 1, static_cast<size_t>(p * samples.size()));
+                return samples[i] / 1000.0;
+            };
+            std::cout << std::left << std::setw(10) << names[op] << std::right << std::fixed << std::setprecision(2)
+                      << std::setw(10) << samples.size() << std::setw(8) << m_stats[op].errors
+                      << std::setw(10) << samples.size() / seconds
+                      << std::setw(10) << pct(0.50) << std::setw(10) << pct(0.90) << std::setw(10) << pct(0.99)
+                      << std::setw(10) << pct(0.999) << std::setw(10) << (samples.empty() ? 0 : samples.back() / 1000.0)
+                      << std::endl;
+        }
+        std::cout << "disconnected users: " << m_dead << std::endl;
+        // 服务器和压测在同一台机器上时, 能看出事件循环和工作线程是否绑在预期的核上、有没有跨节点分配内存
+        m_placement.report(std::cout);
+    }
+
+    LoadTestOptions m_options;
+    std::mt19937_64 m_rng;
+    int m_epollFd = -1;
+    uint64_t m_deadline = 0;
+    uint32_t m_nextId = 1;
+    size_t m_dead = 0;
+    PlacementStats m_placement;
+    std::vector<VUser> m_users;
+    Stats m_stats[OP_COUNT];
+    // 按时间排序的待执行操作: (时刻, 用户下标)
+    std::priority_queue<std::pair<uint64_t, int>, std::vector<std::pair<uint64_t, int>>, std::greater<>> m_timers;
+};
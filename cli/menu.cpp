@@ -1,37 +1,178 @@
 #include "menu.hpp"
 #include "../include/headFile.hpp"
+#include <term.h>
+
+namespace
+{
+    // 5 行高的点阵字体, 只收大写字母, 小写字母按大写绘制, 其他字符画成空白
+    const int GLYPH_ROWS = 5;
+    const char *const GLYPHS[26][GLYPH_ROWS] = {
+        {" ### ", "#   #", "#####", "#   #", "#   #"}, // A
+        {"#### ", "#   #", "#### ", "#   #", "#### "}, // B
+        {" ####", "#    ", "#    ", "#    ", " ####"}, // C
+        {"#### ", "#   #", "#   #", "#   #", "#### "}, // D
+        {"#####", "#    ", "#### ", "#    ", "#####"}, // E
+        {"#####", "#    ", "#### ", "#    ", "#    "}, // F
+        {" ####", "#    ", "#  ##", "#   #", " ####"}, // G
+        {"#   #", "#   #", "#####", "#   #", "#   #"}, // H
+        {"#####", "  #  ", "  #  ", "  #  ", "#####"}, // I
+        {"#####", "   # ", "   # ", "#  # ", " ##  "}, // J
+        {"#   #", "#  # ", "###  ", "#  # ", "#   #"}, // K
+        {"#    ", "#    ", "#    ", "#    ", "#####"}, // L
+        {"#   #", "## ##", "# # #", "#   #", "#   #"}, // M
+        {"#   #", "##  #", "# # #", "#  ##", "#   #"}, // N
+        {" ### ", "#   #", "#   #", "#   #", " ### "}, // O
+        {"#### ", "#   #", "#### ", "#    ", "#    "}, // P
+        {" ### ", "#   #", "# # #", "#  # ", " ## #"}, // Q
+        {"#### ", "#   #", "#### ", "#  # ", "#   #"}, // R
+        {" ####", "#    ", " ### ", "    #", "#### "}, // S
+        {"#####", "  #  ", "  #  ", "  #  ", "  #  "}, // T
+        {"#   #", "#   #", "#   #", "#   #", " ### "}, // U
+        {"#   #", "#   #", "#   #", " # # ", "  #  "}, // V
+        {"#   #", "#   #", "# # #", "## ##", "#   #"}, // W
+        {"#   #", " # # ", "  #  ", " # # ", "#   #"}, // X
+        {"#   #", " # # ", "  #  ", "  #  ", "  #  "}, // Y
+        {"#####", "   # ", "  #  ", " #   ", "#####"}, // Z
+    };
+
+    // 终端能力只查询一次; 查不到 terminfo 时退回到通用的 ANSI 序列
+    struct TermCaps
+    {
+        std::string clear = "\033[H\033[2J";
+        std::string reset;
+        std::string setaf;
+        int colors = 0;
+
+        TermCaps()
+        {
+            int err = 0;
+            if (!isatty(STDOUT_FILENO) || setupterm(nullptr, STDOUT_FILENO, &err) != OK)
+            {
+                return;
+            }
+            char *cap = tigetstr("clear");
+            if (cap && cap != (char *)-1)
+            {
+                clear = cap;
+            }
+            cap = tigetstr("setaf");
+            char *sgr0 = tigetstr("sgr0");
+            if (cap && cap != (char *)-1 && sgr0 && sgr0 != (char *)-1)
+            {
+                setaf = cap;
+                reset = sgr0;
+                colors = tigetnum("colors");
+            }
+        }
+
+        // 和 lolcat 一样按对角线取彩虹色
+        std::string color(int row, int col) const
+        {
+            double x = 0.1 * (col + row * 2);
+            int r = static_cast<int>(std::sin(x) * 127 + 128);
+            int g = static_cast<int>(std::sin(x + 2 * M_PI / 3) * 127 + 128);
+            int b = static_cast<int>(std::sin(x + 4 * M_PI / 3) * 127 + 128);
+            int index;
+            if (colors >= 256)
+            {
+                index = 16 + 36 * (r * 6 / 256) + 6 * (g * 6 / 256) + (b * 6 / 256);
+            }
+            else
+            {
+                // 只有 8 色时在 红黄绿青蓝品 之间轮转
+                static const int basic[] = {1, 3, 2, 6, 4, 5};
+                index = basic[(col + row * 2) / 4 % 6];
+            }
+            return tiparm(setaf.c_str(), index);
+        }
+    };
+
+    const TermCaps &caps()
+    {
+        static TermCaps instance;
+        return instance;
+    }
+
+    // 文字 -> 点阵 -> C 注释风格的边框 (boxes -d c) -> 彩虹色
+    std::string renderBanner(const std::string &text)
+    {
+        std::vector<std::string> rows(GLYPH_ROWS);
+        for (char ch : text)
+        {
+            int c = std::toupper(static_cast<unsigned char>(ch));
+            for (int r = 0; r < GLYPH_ROWS; ++r)
+            {
+                rows[r] += (c >= 'A' && c <= 'Z') ? GLYPHS[c - 'A'][r] : "   ";
+                rows[r] += ' ';
+            }
+        }
+
+        size_t width = rows[0].size() + 2;
+        std::vector<std::string> box;
+        box.push_back("/*" + std::string(width, '*') + "*/");
+        box.push_back("/*" + std::string(width, ' ') + "*/");
+        for (const std::string &row : rows)
+        {
+            box.push_back("/* " + row + " */");
+        }
+        box.push_back("/*" + std::string(width, ' ') + "*/");
+        box.push_back("/*" + std::string(width, '*') + "*/");
+
+        const TermCaps &term = caps();
+        std::string out;
+        for (size_t r = 0; r < box.size(); ++r)
+        {
+            std::string last;
+            for (size_t c = 0; c < box[r].size(); ++c)
+            {
+                if (!term.setaf.empty() && term.colors >= 8 && box[r][c] != ' ')
+                {
+                    std::string color = term.color(r, c);
+                    if (color != last)
+                    {
+                        out += color;
+                        last = color;
+                    }
+                }
+                out += box[r][c];
+            }
+            out += term.reset;
+            out += '\n';
+        }
+        return out;
+    }
+}
+
+void Menu::ClearScreen() {
+    std::cout << caps().clear << std::flush;
+}
+
+void Menu::Show(const std::string &text, const char *footer) {
+    static std::unordered_map<std::string, std::string> cache;
+    auto it = cache.find(text);
+    if (it == cache.end())
+    {
+        it = cache.emplace(text, renderBanner(text)).first;
+    }
+    std::cout << caps().clear << it->second << footer << std::flush;
+}
 
 void Menu::ShowMenu() {
-    const char* text = "There is Menu";
-    char command[256];
-    snprintf(command, sizeof(command), "echo \"%s\" | figlet | boxes -d c | lolcat", text);
-    int result = system(command);
+    Show("There is Menu", "1. Login  2. Enroll  3. Logout  4. Exit  5. Chat\n");
 }
 
 void Menu::LoginMenu() {
-    const char* text = "L O G I N";
-    char command[256];
-    snprintf(command, sizeof(command), "echo \"%s\" | figlet | boxes -d c | lolcat", text);
-    int result = system(command);
+    Show("L O G I N");
 }
 
 void Menu::EnrollMenu() {
-    const char* text = "E N R O L L";
-    char command[256];
-    snprintf(command, sizeof(command), "echo \"%s\" | figlet | boxes -d c | lolcat", text);
-    int result = system(command);
+    Show("E N R O L L");
 }
 
 void Menu::LogoutMenu() {
-    const char* text = "L O G O U T";
-    char command[256];
-    snprintf(command, sizeof(command), "echo \"%s\" | figlet | boxes -d c | lolcat", text);
-    int result = system(command);
+    Show("L O G O U T");
 }
 
 void Menu::ExitMenu() {
-    const char* text = "E X I T";
-    char command[256];
-    snprintf(command, sizeof(command), "echo \"%s\" | figlet | boxes -d c | lolcat", text);
-    int result = system(command);
-}
\ No newline at end of file
+    Show("E X I T");
+}
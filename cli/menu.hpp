@@ -1,5 +1,8 @@
+#pragma once
 #include "../include/headFile.hpp"
 
+// 菜单横幅在进程内绘制, 不再调用 figlet / boxes / lolcat
+// 每个横幅第一次显示时渲染成一整段带颜色的字符串并缓存, 之后每次只是一次 write
 class Menu
 {
 public:
@@ -12,4 +15,10 @@ public:
     void LogoutMenu();
 
     void ExitMenu();
-};
\ No newline at end of file
+
+    // 清屏, 代替 system("clear")
+    static void ClearScreen();
+
+private:
+    static void Show(const std::string &text, const char *footer = "");
+};
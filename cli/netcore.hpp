@@ -0,0 +1,607 @@
+#pragma once
+#include "../include/headFile.hpp"
+#include "../Cli_Ser_Connection/Codec.hpp"
+#include "../Cli_Ser_Connection/Tls.hpp"
+
+// 单生产者单消费者的无锁环形队列
+// 生产者只写 m_tail, 消费者只写 m_head, 两个下标分在不同的缓存行上
+template <typename T, size_t N>
+class SpscQueue
+{
+    static_assert((N & (N - 1)) == 0, "capacity must be a power of two");
+
+public:
+    // 队列满时返回 false, value 保持不变
+    bool push(T &value)
+    {
+        size_t tail = m_tail.load(std::memory_order_relaxed);
+        if (tail - m_head.load(std::memory_order_acquire) == N)
+        {
+            return false;
+        }
+        m_slots[tail & (N - 1)] = std::move(value);
+        m_tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(T &value)
+    {
+        size_t head = m_head.load(std::memory_order_relaxed);
+        if (head == m_tail.load(std::memory_order_acquire))
+        {
+            return false;
+        }
+        value = std::move(m_slots[head & (N - 1)]);
+        m_head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool empty() const
+    {
+        return m_head.load(std::memory_order_acquire) == m_tail.load(std::memory_order_acquire);
+    }
+
+private:
+    T m_slots[N];
+    alignas(64) std::atomic<size_t> m_head{0};
+    alignas(64) std::atomic<size_t> m_tail{0};
+};
+
+// 客户端唯一的网络线程
+// 负责把字节流重组成带长度前缀的帧, 带请求号的回复交给等待它的 future,
+// 其他帧 (服务器推送的聊天消息) 经无锁队列交给界面线程
+// 请求格式: "#<请求号> <内容>", 服务器原样带回请求号
+// 握手时声明支持回执, 聊天消息带会话内的序号; 网络线程记下收到的序号, 界面线程取走时记为已读,
+// 定时把有变化的累计值合成一帧 ACK 发给服务器, 不逐条确认
+class ClientIO
+{
+public:
+    static constexpr size_t PUSH_CAPACITY = 4096;
+    static constexpr long ACK_INTERVAL_MS = 500;
+    static constexpr size_t OVERFLOW_LIMIT = 64 * 1024; // 积压超过这个数量就暂停读 socket
+    static constexpr size_t MAX_INBOUND_FRAME = 16 * 1024 * 1024; // 解压后的上限
+
+    // fd 是已连接的 socket, 所有权仍归调用方
+    // tls 非空时经它收发 (已完成握手), 同样归调用方所有
+    explicit ClientIO(int fd, TlsStream *tls = nullptr) : m_fd(fd), m_tls(tls)
+    {
+        int opts = fcntl(m_fd, F_GETFL);
+        fcntl(m_fd, F_SETFL, opts | O_NONBLOCK);
+
+        m_epollFd = epoll_create1(EPOLL_CLOEXEC);
+        m_wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        m_notifyFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        m_ackFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        if (m_epollFd == -1 || m_wakeFd == -1 || m_notifyFd == -1 || m_ackFd == -1)
+        {
+            throw std::runtime_error("ClientIO init failed: " + std::string(strerror(errno)));
+        }
+
+        m_events = EPOLLIN;
+        struct epoll_event ev{};
+        ev.events = m_events;
+        ev.data.fd = m_fd;
+        epoll_ctl(m_epollFd, EPOLL_CTL_ADD, m_fd, &ev);
+        ev.events = EPOLLIN;
+        ev.data.fd = m_wakeFd;
+        epoll_ctl(m_epollFd, EPOLL_CTL_ADD, m_wakeFd, &ev);
+        ev.data.fd = m_ackFd;
+        epoll_ctl(m_epollFd, EPOLL_CTL_ADD, m_ackFd, &ev);
+    }
+
+    ~ClientIO()
+    {
+        stop();
+        close(m_epollFd);
+        close(m_wakeFd);
+        close(m_notifyFd);
+        close(m_ackFd);
+    }
+
+    ClientIO(const ClientIO &other) = delete;
+    ClientIO &operator=(const ClientIO &other) = delete;
+
+    // 连上后先协商压缩、回执和分段, 服务器回复之前收发的都是不压缩的帧
+    void start()
+    {
+        enqueue(std::string("HELLO ") + FrameCodec::OFFER + " receipts lanes");
+        m_running = true;
+        m_thread = std::thread(&ClientIO::loop, this);
+    }
+
+    void stop()
+    {
+        if (!m_running.exchange(false))
+        {
+            return;
+        }
+        wake();
+        if (m_thread.joinable())
+        {
+            m_thread.join();
+        }
+    }
+
+    bool connected() const { return m_connected; }
+
+    // 发出请求, 回复到达后 future 就绪; 连接断开时 future 抛出异常
+    std::future<std::string> request(const std::string &payload)
+    {
+        std::promise<std::string> promise;
+        std::future<std::string> future = promise.get_future();
+        uint32_t rid = m_nextId.fetch_add(1);
+        {
+            // 和 disconnect 在同一把锁下检查并登记, 否则断开可能先清空 m_pending, 这个 future 永远不会就绪
+            std::unique_lock<std::mutex> lock(m_mutex);
+            if (!m_connected)
+            {
+                promise.set_exception(std::make_exception_ptr(std::runtime_error("Not connected")));
+                return future;
+            }
+            m_pending.emplace(rid, std::move(promise));
+        }
+        enqueue("#" + std::to_string(rid) + " " + payload);
+        return future;
+    }
+
+    // 发出不需要回复的帧
+    void send(const std::string &payload)
+    {
+        enqueue(payload);
+    }
+
+    // 界面线程取出一条推送消息, 没有时返回 false
+    // 带序号的 "MSGSEQ seq from text" 记为已读, 交给界面时还原成 "MSG from text"
+    bool poll(std::string &message)
+    {
+        if (!m_pushes.pop(message))
+        {
+            return false;
+        }
+        if (message.compare(0, 7, "MSGSEQ ") == 0)
+        {
+            char *end = nullptr;
+            uint64_t seq = std::strtoull(message.c_str() + 7, &end, 10);
+            size_t from = end - message.c_str() + 1;
+            size_t space = message.find(' ', from);
+            if (*end == ' ' && space != std::string::npos)
+            {
+                mark(message.substr(from, space - from), seq, true);
+            }
+            message.replace(0, std::min(from, message.size()), "MSG ");
+        }
+        // 网络线程手里还有没放进队列的消息, 腾出空间后叫醒它
+        if (m_stalled.load(std::memory_order_acquire))
+        {
+            wake();
+        }
+        return true;
+    }
+
+    // 有推送消息时可读, 界面线程可以和标准输入一起 poll
+    int notifyFd() const { return m_notifyFd; }
+
+    // 清掉 notifyFd 上的计数
+    void clearNotify()
+    {
+        uint64_t value;
+        while (read(m_notifyFd, &value, sizeof(value)) > 0)
+        {
+        }
+    }
+
+private:
+    // 协商了压缩时, 较大的帧在调用方线程里压缩好再交给网络线程
+    void enqueue(std::string frame)
+    {
+        uint32_t header = static_cast<uint32_t>(frame.size());
+        if (m_codec.load(std::memory_order_acquire) != FrameCodecId::None && frame.size() >= COMPRESS_MIN)
+        {
+            FrameCodec &codec = FrameCodec::local();
+            std::string packed(codec.bound(frame.size()), '\0');
+            size_t n = codec.compress(frame.data(), frame.size(), packed.data(), packed.size());
+            if (n > 0)
+            {
+                packed.resize(n);
+                frame.swap(packed);
+                header = FRAME_COMPRESSED | static_cast<uint32_t>(n);
+            }
+        }
+        uint32_t len = htonl(header);
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_outbox.append(reinterpret_cast<char *>(&len), sizeof(len));
+            m_outbox.append(frame);
+        }
+        wake();
+    }
+
+    void wake()
+    {
+        uint64_t one = 1;
+        write(m_wakeFd, &one, sizeof(one));
+    }
+
+    void loop()
+    {
+        struct epoll_event events[4];
+        while (m_running)
+        {
+            int nfds = epoll_wait(m_epollFd, events, 4, -1);
+            if (nfds == -1)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                break;
+            }
+            for (int i = 0; i < nfds && m_connected; ++i)
+            {
+                if (events[i].data.fd == m_wakeFd)
+                {
+                    uint64_t value;
+                    read(m_wakeFd, &value, sizeof(value));
+                    retryStalled();
+                    flushOutbox();
+                    updateReadInterest();
+                    continue;
+                }
+                if (events[i].data.fd == m_ackFd)
+                {
+                    sendAcks();
+                    continue;
+                }
+                if (events[i].events & (EPOLLERR | EPOLLHUP))
+                {
+                    disconnect("connection error");
+                    break;
+                }
+                if (events[i].events & EPOLLOUT)
+                {
+                    flushOutbox();
+                }
+                if (events[i].events & EPOLLIN)
+                {
+                    onReadable();
+                }
+            }
+            if (!m_connected)
+            {
+                break;
+            }
+        }
+    }
+
+    void onReadable()
+    {
+        char buffer[64 * 1024];
+        while (!m_paused)
+        {
+            ssize_t n = m_tls ? m_tls->read(buffer, sizeof(buffer)) : recv(m_fd, buffer, sizeof(buffer), 0);
+            if (n > 0)
+            {
+                m_inbox.append(buffer, n);
+                parseFrames();
+                continue;
+            }
+            if (n == 0)
+            {
+                disconnect("Server closed the connection");
+                return;
+            }
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+            {
+                disconnect(strerror(errno));
+            }
+            return;
+        }
+    }
+
+    void parseFrames()
+    {
+        size_t off = 0;
+        while (m_inbox.size() - off >= sizeof(uint32_t))
+        {
+            uint32_t header = 0;
+            std::memcpy(&header, m_inbox.data() + off, sizeof(header));
+            header = ntohl(header);
+            uint32_t len = header & FRAME_LENGTH_MASK;
+            if (m_inbox.size() - off - sizeof(len) < len)
+            {
+                break;
+            }
+            const char *payload = m_inbox.data() + off + sizeof(len);
+            off += sizeof(len) + len;
+            // 大帧的各段先拼起来, 中间插进来的完整帧照常处理
+            if (header & FRAME_CHUNK)
+            {
+                if (m_chunks.size() + len > MAX_INBOUND_FRAME)
+                {
+                    disconnect("Chunked frame from server too large");
+                    return;
+                }
+                m_chunks.append(payload, len);
+                if (header & FRAME_MORE)
+                {
+                    continue;
+                }
+                payload = m_chunks.data();
+                len = static_cast<uint32_t>(m_chunks.size());
+            }
+            std::string frame;
+            if (header & FRAME_COMPRESSED)
+            {
+                if (!FrameCodec::local().decompress(payload, len, frame, MAX_INBOUND_FRAME))
+                {
+                    disconnect("Bad compressed frame from server");
+                    return;
+                }
+            }
+            else
+            {
+                frame.assign(payload, len);
+            }
+            dispatch(std::move(frame));
+            // 只有拼完的分段帧才清空, 插在分段之间的完整帧不能丢掉还没拼完的部分
+            if (header & FRAME_CHUNK)
+            {
+                m_chunks.clear();
+            }
+        }
+        m_inbox.erase(0, off);
+    }
+
+    void dispatch(std::string frame)
+    {
+        // 压缩协商的回复不带请求号, 也不交给界面
+        // 不认识 HELLO 的旧服务器会原样回显, 这时保持不压缩
+        if (!m_negotiated && (frame.compare(0, 6, "CODEC ") == 0 || frame.compare(0, 6, "HELLO ") == 0))
+        {
+            m_negotiated = true;
+            if (frame[0] == 'C')
+            {
+                m_codec.store(FrameCodec::negotiate(std::string_view(frame).substr(6)), std::memory_order_release);
+                if ((frame + " ").find(" receipts ") != std::string::npos)
+                {
+                    struct itimerspec spec{};
+                    spec.it_value.tv_nsec = ACK_INTERVAL_MS * 1000000L;
+                    spec.it_interval = spec.it_value;
+                    timerfd_settime(m_ackFd, 0, &spec, nullptr);
+                }
+            }
+            return;
+        }
+        // 聊天消息到达网络线程就算已送达
+        if (frame.compare(0, 7, "MSGSEQ ") == 0)
+        {
+            char *end = nullptr;
+            uint64_t seq = std::strtoull(frame.c_str() + 7, &end, 10);
+            size_t from = end - frame.c_str() + 1;
+            size_t space = frame.find(' ', from);
+            if (*end == ' ' && space != std::string::npos)
+            {
+                mark(frame.substr(from, space - from), seq, false);
+            }
+        }
+        // 回复: "#<请求号> <内容>"
+        if (!frame.empty() && frame[0] == '#')
+        {
+            size_t space = frame.find(' ');
+            uint32_t rid = std::strtoul(frame.c_str() + 1, nullptr, 10);
+            std::promise<std::string> promise;
+            bool found = false;
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                auto it = m_pending.find(rid);
+                if (it != m_pending.end())
+                {
+                    promise = std::move(it->second);
+                    m_pending.erase(it);
+                    found = true;
+                }
+            }
+            if (found)
+            {
+                promise.set_value(space == std::string::npos ? std::string() : frame.substr(space + 1));
+                return;
+            }
+        }
+        pushToUi(frame);
+    }
+
+    // 队列满时不丢消息: 先放进网络线程自己的积压队列, 保持顺序, 等界面线程腾出空间
+    void pushToUi(std::string &frame)
+    {
+        if (m_overflow.empty() && m_pushes.push(frame))
+        {
+            uint64_t one = 1;
+            write(m_notifyFd, &one, sizeof(one));
+            return;
+        }
+        m_overflow.push_back(std::move(frame));
+        m_stalled.store(true, std::memory_order_release);
+        updateReadInterest();
+    }
+
+    void retryStalled()
+    {
+        bool moved = false;
+        while (!m_overflow.empty() && m_pushes.push(m_overflow.front()))
+        {
+            m_overflow.pop_front();
+            moved = true;
+        }
+        if (m_overflow.empty())
+        {
+            m_stalled.store(false, std::memory_order_release);
+        }
+        if (moved)
+        {
+            uint64_t one = 1;
+            write(m_notifyFd, &one, sizeof(one));
+        }
+    }
+
+    // 记下 peer 发来的第 seq 条已送达/已读, 由网络线程和界面线程调用
+    void mark(const std::string &peer, uint64_t seq, bool read)
+    {
+        std::unique_lock<std::mutex> lock(m_ackMutex);
+        Progress &progress = m_progress[peer];
+        uint64_t &mark = read ? progress.read : progress.delivered;
+        if (seq > mark)
+        {
+            mark = seq;
+            progress.changed = true;
+            m_acksChanged = true;
+        }
+    }
+
+    // 定时器到期: 有变化的会话合成一帧 "ACK peer:delivered:read ..."
+    void sendAcks()
+    {
+        uint64_t expirations;
+        read(m_ackFd, &expirations, sizeof(expirations));
+        std::string frame = "ACK";
+        {
+            std::unique_lock<std::mutex> lock(m_ackMutex);
+            if (!m_acksChanged)
+            {
+                return;
+            }
+            m_acksChanged = false;
+            for (auto &[peer, progress] : m_progress)
+            {
+                if (progress.changed)
+                {
+                    frame += " " + peer + ":" + std::to_string(progress.delivered) + ":" + std::to_string(progress.read);
+                    progress.changed = false;
+                }
+            }
+        }
+        enqueue(std::move(frame));
+    }
+
+    // 积压太多时暂停读 socket, 让 TCP 把压力传回服务器
+    // 但有请求在等回复时必须继续读, 否则回复被堵在推送消息后面, 等待方就会死锁
+    void updateReadInterest()
+    {
+        bool waiting = false;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            waiting = !m_pending.empty();
+        }
+        bool paused = m_overflow.size() >= OVERFLOW_LIMIT && !waiting;
+        if (paused == m_paused)
+        {
+            return;
+        }
+        m_paused = paused;
+        setEvents(paused ? (m_events & ~EPOLLIN) : (m_events | EPOLLIN));
+        if (!paused)
+        {
+            onReadable();
+        }
+    }
+
+    void flushOutbox()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while (!m_outbox.empty())
+        {
+            ssize_t sent = m_tls ? m_tls->write(m_outbox.data(), m_outbox.size())
+                                 : ::send(m_fd, m_outbox.data(), m_outbox.size(), MSG_NOSIGNAL);
+            if (sent > 0)
+            {
+                m_outbox.erase(0, sent);
+                continue;
+            }
+            if (sent == -1 && errno == EINTR)
+            {
+                continue;
+            }
+            if (sent == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            {
+                lock.unlock();
+                setEvents(m_events | EPOLLOUT);
+                return;
+            }
+            lock.unlock();
+            disconnect(strerror(errno));
+            return;
+        }
+        lock.unlock();
+        setEvents(m_events & ~EPOLLOUT);
+    }
+
+    void setEvents(uint32_t events)
+    {
+        if (events == m_events)
+        {
+            return;
+        }
+        m_events = events;
+        struct epoll_event ev{};
+        ev.events = events;
+        ev.data.fd = m_fd;
+        epoll_ctl(m_epollFd, EPOLL_CTL_MOD, m_fd, &ev);
+    }
+
+    // 连接断开后所有等待中的请求都以异常结束
+    void disconnect(const std::string &reason)
+    {
+        std::cerr << reason << std::endl;
+        std::unordered_map<uint32_t, std::promise<std::string>> pending;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_connected = false;
+            pending.swap(m_pending);
+        }
+        for (auto &[rid, promise] : pending)
+        {
+            promise.set_exception(std::make_exception_ptr(std::runtime_error(reason)));
+        }
+        uint64_t one = 1;
+        write(m_notifyFd, &one, sizeof(one));
+    }
+
+    int m_fd;
+    TlsStream *m_tls;
+    int m_epollFd = -1;
+    int m_wakeFd = -1;   // 其他线程叫醒网络线程
+    int m_notifyFd = -1; // 网络线程通知界面线程
+    int m_ackFd = -1;    // 定时发送回执
+    uint32_t m_events = 0;
+    std::thread m_thread;
+    std::atomic<bool> m_running{false};
+    std::atomic<bool> m_connected{true};
+
+    std::string m_inbox; // 只由网络线程访问
+    std::string m_chunks; // 正在拼接的分段大帧, 只由网络线程访问
+    bool m_negotiated = false;                          // 只由网络线程访问
+    std::atomic<FrameCodecId> m_codec{FrameCodecId::None}; // 网络线程写, 发送方读
+
+    std::mutex m_mutex; // 保护 m_outbox 和 m_pending, m_connected 置为 false 也在锁内
+    std::string m_outbox;
+    std::unordered_map<uint32_t, std::promise<std::string>> m_pending;
+    std::atomic<uint32_t> m_nextId{1};
+
+    SpscQueue<std::string, PUSH_CAPACITY> m_pushes;
+    std::deque<std::string> m_overflow;  // 队列满时的积压, 只由网络线程访问
+    std::atomic<bool> m_stalled{false};  // m_overflow 非空
+    bool m_paused = false;               // 是否暂停读 socket
+
+    struct Progress
+    {
+        uint64_t delivered = 0;
+        uint64_t read = 0;
+        bool changed = false;
+    };
+    std::mutex m_ackMutex; // 保护 m_progress, 网络线程记送达, 界面线程记已读
+    std::unordered_map<std::string, Progress> m_progress; // 对方 -> 收到/读到的序号
+    bool m_acksChanged = false;
+};
@@ -0,0 +1,708 @@
+#pragma once
+#include "../include/headFile.hpp"
+#include "../Cli_Ser_Connection/Capture.hpp"
+#include "../Cli_Ser_Connection/Codec.hpp"
+#include "../Cli_Ser_Connection/Connection.hpp"
+
+// 回放参数, 命令行里以 key=value 形式给出
+struct ReplayOptions
+{
+    std::string capture;     // 服务器 --capture 录下的文件
+    std::string host = "127.0.0.1";
+    int port = 8080;
+    double speed = 1;        // 回放倍速, 0 表示不等间隔, 尽快发完 (每条连接内仍按原顺序)
+    int drainSec = 5;        // 全部发完后最多再等这么久收回复
+    std::string save;        // 结果另存为文本, 作为以后比较的基线
+    std::string baseline;    // 和这个基线比较, 有退化时以非零状态退出
+    double tolerance = 10;   // 允许的退化百分比
+    size_t minSamples = 20;  // 样本少于这个数的命令不参与比较
+    std::string password = "password"; // 录制时凭据已去掉, REGISTER/LOGIN 统一用这个密码 (和 --bench enroll=1 建的账号一致)
+
+    bool parse(const std::string &arg)
+    {
+        size_t eq = arg.find('=');
+        if (eq == std::string::npos)
+        {
+            return false;
+        }
+        std::string key = arg.substr(0, eq);
+        std::string value = arg.substr(eq + 1);
+        try
+        {
+            if (key == "capture")
+                capture = value;
+            else if (key == "host")
+                host = value;
+            else if (key == "port")
+                port = std::stoi(value);
+            else if (key == "speed")
+                speed = std::max(0.0, std::stod(value));
+            else if (key == "drain")
+                drainSec = std::max(0, std::stoi(value));
+            else if (key == "save")
+                save = value;
+            else if (key == "baseline")
+                baseline = value;
+            else if (key == "tolerance")
+                tolerance = std::max(0.0, std::stod(value));
+            else if (key == "min")
+                minSamples = std::stoul(value);
+            else if (key == "password")
+                password = value;
+            else
+                return false;
+        }
+        catch (const std::exception &e)
+        {
+            return false;
+        }
+        return true;
+    }
+};
+
+// 流量回放: 按录制时的相对时间 (除以倍速) 重建每条连接, 原样发出每一帧
+// 每帧的请求号换成回放自己的, 收到同号的第一帧回复时记下这条命令的延迟; 没有回复的命令 (比如 SEND) 只计数
+// HELLO 和 LOGIN 改变连接状态, 它们的回复到达之前同一连接后面的帧先攒着, 加速或全速回放时才不会在登录前就发消息
+// 连接之间的先后只靠时间保证: 全速回放时发给别人的消息可能赶在对方登录之前, 得到 OFFLINE, 比较版本时应使用相同的倍速
+// 收帧和 ClientIO 一样拼接分段、解开压缩帧, 所以录下的 HELLO 协商了什么, 回放时服务器就按什么发
+// 录制里的用户名原样使用, 密码录制时已去掉, 回放时换成 password 参数; 应该对着一个和录制时初始数据相同、
+// 账号都用这个密码的 Redis 回放 (录制里的 REGISTER 会用它建号), 结果才有可比性
+// 结束时按命令报告吞吐和延迟分位数, 可以另存为基线, 或者和旧版本的基线逐项比较
+class Replay
+{
+public:
+    explicit Replay(const ReplayOptions &options) : m_options(options) {}
+
+    int run()
+    {
+        std::vector<CaptureRecord> records;
+        std::unique_ptr<CaptureReader> reader;
+        try
+        {
+            reader = std::make_unique<CaptureReader>(m_options.capture);
+        }
+        catch (const std::exception &e)
+        {
+            std::cerr << e.what() << std::endl;
+            return 1;
+        }
+        CaptureRecord record;
+        while (reader->next(record))
+        {
+            records.push_back(record);
+        }
+        if (records.empty())
+        {
+            std::cerr << "Capture is empty" << std::endl;
+            return 1;
+        }
+
+        m_epollFd = epoll_create1(0);
+        if (m_epollFd == -1)
+        {
+            perror("epoll_create1");
+            return 1;
+        }
+        double span = records.back().at / 1e6;
+        std::cout << "Replaying " << records.size() << " records (" << std::fixed << std::setprecision(1) << span
+                  << "s captured) at " << (m_options.speed > 0 ? std::to_string(m_options.speed) + "x" : "full speed") << std::endl;
+
+        uint64_t start = now();
+        size_t next = 0;
+        uint64_t drainDeadline = 0;
+        struct epoll_event events[256];
+        while (true)
+        {
+            // 到点的记录全部发出; 落后于计划的时间记为调度延迟, 延迟大说明回放端或服务器跟不上录制时的节奏
+            uint64_t t = now();
+            while (next < records.size() && (m_options.speed == 0 || due(start, records[next]) <= t))
+            {
+                if (m_options.speed > 0)
+                {
+                    m_maxLagUs = std::max(m_maxLagUs, (t - due(start, records[next])) / 1000);
+                }
+                apply(records[next++]);
+            }
+            if (next == records.size())
+            {
+                if (drainDeadline == 0)
+                {
+                    m_sentDone = now();
+                    drainDeadline = m_sentDone + uint64_t(m_options.drainSec) * 1000000000ull;
+                }
+                if (m_open == 0 || m_waiting == 0 || now() >= drainDeadline)
+                {
+                    break;
+                }
+            }
+
+            int timeoutMs = 100;
+            if (next < records.size() && m_options.speed > 0)
+            {
+                uint64_t until = due(start, records[next]);
+                t = now();
+                timeoutMs = until <= t ? 0 : static_cast<int>(std::min<uint64_t>((until - t) / 1000000 + 1, 100));
+            }
+            else if (next < records.size())
+            {
+                timeoutMs = 0;
+            }
+            int nfds = epoll_wait(m_epollFd, events, 256, timeoutMs);
+            if (nfds == -1 && errno != EINTR)
+            {
+                perror("epoll_wait");
+                break;
+            }
+            for (int i = 0; i < nfds; i++)
+            {
+                auto it = m_sessions.find(events[i].data.u64);
+                if (it == m_sessions.end())
+                {
+                    continue;
+                }
+                Session &s = it->second;
+                if (events[i].events & EPOLLOUT)
+                {
+                    onWritable(s);
+                }
+                if ((events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP)) && s.fd != -1)
+                {
+                    onReadable(s);
+                }
+            }
+        }
+
+        // 吞吐按发出的帧数除以最后一个回复到达 (或全部发完) 的时间, 不含最后等待回复的空闲
+        uint64_t end = std::max(m_sentDone, m_lastReply);
+        for (auto &[conn, s] : m_sessions)
+        {
+            if (s.fd != -1)
+            {
+                close(s.fd);
+            }
+        }
+        close(m_epollFd);
+
+        Result result = summarize(m_sentDone - start, end - start);
+        print(result);
+        if (!m_options.save.empty() && !saveResult(result, m_options.save))
+        {
+            std::cerr << "Cannot write " << m_options.save << std::endl;
+            return 1;
+        }
+        if (!m_options.baseline.empty())
+        {
+            return compare(result);
+        }
+        return 0;
+    }
+
+private:
+    struct Pending
+    {
+        std::string op;
+        uint64_t start;
+        uint64_t conn;
+    };
+
+    struct Session
+    {
+        uint64_t conn = 0;
+        int fd = -1;
+        bool connected = false;
+        bool closing = false; // 录制里这条连接已关闭, 发完后半关闭, 等服务器关掉
+        uint32_t events = 0;
+        std::string in;
+        std::string out;
+        std::string chunks; // 正在拼接的分段大帧
+        uint64_t barrier = 0;                 // 在等回复的 HELLO/LOGIN 的请求号
+        std::deque<std::string_view> held;    // 等它期间到点的帧, 指向录制文件的内容
+    };
+
+    struct OpStats
+    {
+        std::vector<uint32_t> samplesUs;
+        uint64_t sent = 0;
+        uint64_t rejected = 0; // BUSY / LIMITED
+    };
+
+    // 一次回放的结果, 也是基线文件的内容
+    struct Row
+    {
+        uint64_t sent = 0, replied = 0, rejected = 0;
+        double p50 = 0, p90 = 0, p99 = 0, p999 = 0, max = 0; // 毫秒
+    };
+    struct Result
+    {
+        double framesPerSec = 0;
+        double sendSec = 0;
+        uint64_t frames = 0;
+        uint64_t maxLagUs = 0;
+        uint64_t failedConns = 0;
+        std::map<std::string, Row> ops;
+    };
+
+    static uint64_t now()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   std::chrono::steady_clock::now().time_since_epoch())
+            .count();
+    }
+
+    uint64_t due(uint64_t start, const CaptureRecord &record) const
+    {
+        return start + static_cast<uint64_t>(record.at * 1000.0 / m_options.speed);
+    }
+
+    void apply(const CaptureRecord &record)
+    {
+        if (record.type == CaptureEvent::Open)
+        {
+            connect(record.conn);
+            return;
+        }
+        auto it = m_sessions.find(record.conn);
+        if (record.type == CaptureEvent::Close)
+        {
+            if (it != m_sessions.end() && it->second.fd != -1)
+            {
+                // 还没连上时等 EPOLLOUT 再发完、半关闭
+                it->second.closing = true;
+                if (it->second.connected)
+                {
+                    onWritable(it->second);
+                }
+            }
+            return;
+        }
+        // 录制开始前就建立的连接 (比如接管来的) 在第一帧时再连
+        Session *s = it != m_sessions.end() ? &it->second : connect(record.conn);
+        if (!s || s->fd == -1)
+        {
+            return;
+        }
+        send(*s, record.payload);
+    }
+
+    Session *connect(uint64_t conn)
+    {
+        Session &s = m_sessions[conn];
+        s.conn = conn;
+        s.fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        struct sockaddr_in server{};
+        server.sin_family = AF_INET;
+        server.sin_port = htons(m_options.port);
+        inet_pton(AF_INET, m_options.host.c_str(), &server.sin_addr);
+        if (s.fd == -1 || (::connect(s.fd, (struct sockaddr *)&server, sizeof(server)) == -1 && errno != EINPROGRESS))
+        {
+            m_failedConns++;
+            if (s.fd != -1)
+            {
+                close(s.fd);
+                s.fd = -1;
+            }
+            return &s;
+        }
+        s.events = EPOLLIN | EPOLLOUT;
+        struct epoll_event ev{};
+        ev.events = s.events;
+        ev.data.u64 = conn;
+        epoll_ctl(m_epollFd, EPOLL_CTL_ADD, s.fd, &ev);
+        m_open++;
+        return &s;
+    }
+
+    // 去掉录下的请求号, 换上回放自己的, 回复据此对应到这一帧
+    void send(Session &s, std::string_view payload)
+    {
+        if (s.barrier != 0)
+        {
+            s.held.push_back(payload);
+            return;
+        }
+        if (!payload.empty() && payload[0] == '#')
+        {
+            size_t space = payload.find(' ');
+            payload.remove_prefix(space == std::string_view::npos ? payload.size() : space + 1);
+        }
+        std::string op(payload.substr(0, payload.find(' ')));
+        if (op.empty() || op.size() > 16 || !std::all_of(op.begin(), op.end(), [](char ch)
+                                                        { return ch >= 'A' && ch <= 'Z'; }))
+        {
+            op = "other"; // 注册对话里的验证码这类不是命令的帧
+        }
+        uint64_t rid = m_nextId++;
+        m_pending[rid] = {op, now(), s.conn};
+        if (op == "HELLO" || op == "LOGIN")
+        {
+            s.barrier = rid;
+        }
+        m_waiting++;
+        m_stats[op].sent++;
+        m_frames++;
+
+        std::string framed = "#" + std::to_string(rid) + " ";
+        size_t begin, end;
+        if (captureCredentials(payload, begin, end) && payload.substr(begin, end - begin) == CAPTURE_REDACTED)
+        {
+            framed.append(payload.substr(0, begin));
+            framed += m_options.password;
+            framed.append(payload.substr(end));
+        }
+        else
+        {
+            framed.append(payload.data(), payload.size());
+        }
+        Sen sen;
+        sen.packFrame(s.out, framed.data(), framed.size());
+        if (s.connected)
+        {
+            onWritable(s);
+        }
+    }
+
+    void onWritable(Session &s)
+    {
+        if (!s.connected)
+        {
+            int err = 0;
+            socklen_t len = sizeof(err);
+            getsockopt(s.fd, SOL_SOCKET, SO_ERROR, &err, &len);
+            if (err != 0)
+            {
+                fail(s);
+                return;
+            }
+            s.connected = true;
+        }
+        while (!s.out.empty())
+        {
+            ssize_t sent = ::send(s.fd, s.out.data(), s.out.size(), MSG_NOSIGNAL);
+            if (sent > 0)
+            {
+                s.out.erase(0, sent);
+                continue;
+            }
+            if (sent == -1 && errno == EINTR)
+            {
+                continue;
+            }
+            if (sent == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            {
+                setEvents(s, EPOLLIN | EPOLLOUT);
+                return;
+            }
+            fail(s);
+            return;
+        }
+        if (s.closing && s.held.empty())
+        {
+            shutdown(s.fd, SHUT_WR);
+        }
+        setEvents(s, EPOLLIN);
+    }
+
+    void onReadable(Session &s)
+    {
+        char buffer[64 * 1024];
+        while (true)
+        {
+            ssize_t n = recv(s.fd, buffer, sizeof(buffer), 0);
+            if (n > 0)
+            {
+                s.in.append(buffer, n);
+                continue;
+            }
+            if (n == -1 && errno == EINTR)
+            {
+                continue;
+            }
+            if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK))
+            {
+                parseFrames(s);
+                // 回放里关闭的连接由服务器关掉是正常的, 否则算连接失败
+                if (!s.closing)
+                {
+                    m_failedConns++;
+                }
+                finish(s);
+                return;
+            }
+            break;
+        }
+        parseFrames(s);
+    }
+
+    // 和 ClientIO 一样: 分段的大帧先拼起来, 压缩帧解开后再看请求号
+    void parseFrames(Session &s)
+    {
+        size_t off = 0;
+        while (s.in.size() - off >= sizeof(uint32_t))
+        {
+            uint32_t header = 0;
+            std::memcpy(&header, s.in.data() + off, sizeof(header));
+            header = ntohl(header);
+            uint32_t len = header & FRAME_LENGTH_MASK;
+            if (s.in.size() - off - sizeof(len) < len)
+            {
+                break;
+            }
+            std::string_view frame(s.in.data() + off + sizeof(len), len);
+            off += sizeof(len) + len;
+            if (header & FRAME_CHUNK)
+            {
+                s.chunks.append(frame.data(), frame.size());
+                if (header & FRAME_MORE)
+                {
+                    continue;
+                }
+                frame = s.chunks;
+            }
+            if (header & FRAME_COMPRESSED)
+            {
+                if (!FrameCodec::local().decompress(frame.data(), frame.size(), m_unpacked, 64 * 1024 * 1024))
+                {
+                    if (header & FRAME_CHUNK)
+                    {
+                        s.chunks.clear();
+                    }
+                    continue;
+                }
+                frame = m_unpacked;
+            }
+            onFrame(frame);
+            // 插在分段之间的完整帧不能清掉还没拼完的部分
+            if (header & FRAME_CHUNK)
+            {
+                s.chunks.clear();
+            }
+        }
+        s.in.erase(0, off);
+    }
+
+    // 只看带请求号的回复, 推送的消息和在线状态不计
+    void onFrame(std::string_view frame)
+    {
+        if (frame.empty() || frame[0] != '#')
+        {
+            return;
+        }
+        size_t space = frame.find(' ');
+        uint64_t rid = std::strtoull(std::string(frame.substr(1, space - 1)).c_str(), nullptr, 10);
+        auto it = m_pending.find(rid);
+        if (it == m_pending.end())
+        {
+            return; // 同一请求的后续帧 (比如历史记录的后几行)
+        }
+        std::string_view body = space == std::string_view::npos ? std::string_view() : frame.substr(space + 1);
+        OpStats &stats = m_stats[it->second.op];
+        if (body == "BUSY" || body == "LIMITED")
+        {
+            stats.rejected++;
+        }
+        else
+        {
+            stats.samplesUs.push_back(static_cast<uint32_t>(std::min<uint64_t>((now() - it->second.start) / 1000, UINT32_MAX)));
+        }
+        uint64_t conn = it->second.conn;
+        m_pending.erase(it);
+        m_waiting--;
+        m_lastReply = now();
+        release(conn, rid);
+    }
+
+    // 连接状态变好了, 发出攒着的帧, 直到又遇到一个 HELLO/LOGIN
+    void release(uint64_t conn, uint64_t rid)
+    {
+        auto it = m_sessions.find(conn);
+        if (it == m_sessions.end() || it->second.barrier != rid)
+        {
+            return;
+        }
+        Session &s = it->second;
+        s.barrier = 0;
+        while (!s.held.empty() && s.barrier == 0 && s.fd != -1)
+        {
+            std::string_view payload = s.held.front();
+            s.held.pop_front();
+            send(s, payload);
+        }
+        if (s.held.empty() && s.closing && s.connected && s.fd != -1)
+        {
+            onWritable(s);
+        }
+    }
+
+    void setEvents(Session &s, uint32_t events)
+    {
+        if (s.events == events || s.fd == -1)
+        {
+            return;
+        }
+        s.events = events;
+        struct epoll_event ev{};
+        ev.events = events;
+        ev.data.u64 = s.conn;
+        epoll_ctl(m_epollFd, EPOLL_CTL_MOD, s.fd, &ev);
+    }
+
+    void fail(Session &s)
+    {
+        m_failedConns++;
+        finish(s);
+    }
+
+    void finish(Session &s)
+    {
+        if (s.fd == -1)
+        {
+            return;
+        }
+        epoll_ctl(m_epollFd, EPOLL_CTL_DEL, s.fd, NULL);
+        close(s.fd);
+        s.fd = -1;
+        s.out.clear();
+        m_open--;
+    }
+
+    Result summarize(uint64_t sendNs, uint64_t totalNs)
+    {
+        Result r;
+        r.frames = m_frames;
+        r.sendSec = sendNs / 1e9;
+        r.framesPerSec = m_frames / std::max(totalNs / 1e9, 1e-9);
+        r.maxLagUs = m_maxLagUs;
+        r.failedConns = m_failedConns;
+        for (auto &[op, stats] : m_stats)
+        {
+            auto &samples = stats.samplesUs;
+            std::sort(samples.begin(), samples.end());
+            auto pct = [&](double p) -> double
+            {
+                if (samples.empty())
+                {
+                    return 0;
+                }
+                size_t i = std::min(samples.size() - 1, static_cast<size_t>(p * samples.size()));
+                return samples[i] / 1000.0;
+            };
+            Row &row = r.ops[op];
+            row.sent = stats.sent;
+            row.replied = samples.size();
+            row.rejected = stats.rejected;
+            row.p50 = pct(0.50);
+            row.p90 = pct(0.90);
+            row.p99 = pct(0.99);
+            row.p999 = pct(0.999);
+            row.max = samples.empty() ? 0 : samples.back() / 1000.0;
+        }
+        return r;
+    }
+
+    static void print(const Result &r)
+    {
+        std::cout << std::left << std::setw(10) << "op" << std::right << std::setw(10) << "sent" << std::setw(10) << "replied"
+                  << std::setw(8) << "busy" << std::setw(10) << "p50(ms)" << std::setw(10) << "p90(ms)" << std::setw(10) << "p99(ms)"
+                  << std::setw(10) << "p999(ms)" << std::setw(10) << "max(ms)" << std::endl;
+        for (auto &[op, row] : r.ops)
+        {
+            std::cout << std::left << std::setw(10) << op << std::right << std::fixed << std::setprecision(2) << std::setw(10)
+                      << row.sent << std::setw(10) << row.replied << std::setw(8) << row.rejected << std::setw(10) << row.p50
+                      << std::setw(10) << row.p90 << std::setw(10) << row.p99 << std::setw(10) << row.p999 << std::setw(10)
+                      << row.max << std::endl;
+        }
+        std::cout << "frames: " << r.frames << ", sent in " << std::setprecision(2) << r.sendSec << "s, " << std::setprecision(0)
+                  << r.framesPerSec << " frames/s, max schedule lag " << std::setprecision(2) << r.maxLagUs / 1000.0
+                  << "ms, failed connections: " << r.failedConns << std::endl;
+    }
+
+    // 基线文件: 第一行 "throughput <帧/秒> <帧数>", 之后每行 "<命令> <发出> <回复> <拒绝> <p50> <p90> <p99> <p999> <max>"
+    static bool saveResult(const Result &r, const std::string &path)
+    {
+        std::ofstream out(path, std::ios::trunc);
+        out << std::fixed << std::setprecision(3) << "throughput " << r.framesPerSec << " " << r.frames << "\n";
+        for (auto &[op, row] : r.ops)
+        {
+            out << op << " " << row.sent << " " << row.replied << " " << row.rejected << " " << row.p50 << " " << row.p90 << " "
+                << row.p99 << " " << row.p999 << " " << row.max << "\n";
+        }
+        return static_cast<bool>(out.flush());
+    }
+
+    static bool loadResult(Result &r, const std::string &path)
+    {
+        std::ifstream in(path);
+        std::string key;
+        if (!(in >> key >> r.framesPerSec >> r.frames) || key != "throughput")
+        {
+            return false;
+        }
+        Row row;
+        while (in >> key >> row.sent >> row.replied >> row.rejected >> row.p50 >> row.p90 >> row.p99 >> row.p999 >> row.max)
+        {
+            r.ops[key] = row;
+        }
+        return true;
+    }
+
+    // 吞吐下降或 p50/p99 上升超过 tolerance% 算退化, 返回 2; 两边样本都够多的命令才比较
+    int compare(const Result &current)
+    {
+        Result base;
+        if (!loadResult(base, m_options.baseline))
+        {
+            std::cerr << "Cannot read baseline " << m_options.baseline << std::endl;
+            return 1;
+        }
+        auto change = [](double before, double after)
+        {
+            return before > 0 ? (after - before) / before * 100 : 0;
+        };
+        bool regressed = false;
+        auto mark = [&](double pct)
+        {
+            bool bad = pct > m_options.tolerance;
+            regressed |= bad;
+            return bad ? "  <- regression" : "";
+        };
+
+        std::cout << std::endl << "vs baseline " << m_options.baseline << " (tolerance " << m_options.tolerance << "%)" << std::endl;
+        double tput = change(base.framesPerSec, current.framesPerSec);
+        std::cout << std::left << std::setw(10) << "frames/s" << std::right << std::fixed << std::setprecision(0) << std::setw(10)
+                  << base.framesPerSec << " -> " << std::setw(10) << current.framesPerSec << std::setprecision(1) << std::setw(8)
+                  << tput << "%" << mark(-tput) << std::endl;
+        for (auto &[op, row] : current.ops)
+        {
+            auto it = base.ops.find(op);
+            if (it == base.ops.end() || row.replied < m_options.minSamples || it->second.replied < m_options.minSamples)
+            {
+                continue;
+            }
+            const Row &before = it->second;
+            double p50 = change(before.p50, row.p50);
+            double p99 = change(before.p99, row.p99);
+            std::cout << std::left << std::setw(10) << op << std::right << std::setprecision(2) << " p50 " << std::setw(8) << before.p50
+                      << " -> " << std::setw(8) << row.p50 << std::setprecision(1) << std::setw(8) << p50 << "%" << mark(p50)
+                      << std::endl;
+            std::cout << std::setw(10) << "" << std::setprecision(2) << " p99 " << std::setw(8) << before.p99 << " -> " << std::setw(8)
+                      << row.p99 << std::setprecision(1) << std::setw(8) << p99 << "%" << mark(p99) << std::endl;
+        }
+        std::cout << (regressed ? "REGRESSION" : "OK") << std::endl;
+        return regressed ? 2 : 0;
+    }
+
+    ReplayOptions m_options;
+    int m_epollFd = -1;
+    std::unordered_map<uint64_t, Session> m_sessions; // 录制里的连接号 -> 回放的连接
+    std::unordered_map<uint64_t, Pending> m_pending;  // 请求号 -> 还没收到回复的请求
+    std::map<std::string, OpStats> m_stats;
+    std::string m_unpacked;
+    uint64_t m_nextId = 1;
+    uint64_t m_frames = 0;
+    uint64_t m_waiting = 0; // 还在等回复的请求数, 没有回复的命令会一直留在这里
+    uint64_t m_maxLagUs = 0;
+    uint64_t m_failedConns = 0;
+    uint64_t m_sentDone = 0;
+    uint64_t m_lastReply = 0;
+    size_t m_open = 0;
+};
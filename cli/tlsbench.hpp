@@ -0,0 +1,268 @@
+#pragma once
+#include "../include/headFile.hpp"
+#include "../Cli_Ser_Connection/Tls.hpp"
+
+// TLS 基准参数, 命令行里以 key=value 形式给出
+struct TlsBenchOptions
+{
+    size_t frame = 16 * 1024; // writev 时每帧的负载大小
+    size_t megabytes = 256;   // 每种情况发送的总量
+
+    bool parse(const std::string &arg)
+    {
+        size_t eq = arg.find('=');
+        if (eq == std::string::npos)
+        {
+            return false;
+        }
+        std::string key = arg.substr(0, eq);
+        std::string value = arg.substr(eq + 1);
+        try
+        {
+            if (key == "size")
+                frame = std::max<size_t>(1, std::stoul(value));
+            else if (key == "mb")
+                megabytes = std::max<size_t>(1, std::stoul(value));
+            else
+                return false;
+        }
+        catch (const std::exception &e)
+        {
+            return false;
+        }
+        return true;
+    }
+};
+
+// 在本机回环上比较 明文 / 用户态 TLS / kTLS 的吞吐
+// 发送方像服务器一样用 writev 发带长度头的帧, 或者用 sendfile 发文件; 接收方在另一个线程里读完全部数据
+// 吞吐按墙钟时间算, CPU 取发送线程的 CPU 时间 (含内核态, kTLS 的加密就算在这里)
+// 内核不支持 kTLS 时 "ktls" 一行的实际模式会显示为 user, 结果和用户态 TLS 一样
+class TlsBench
+{
+public:
+    explicit TlsBench(const TlsBenchOptions &options) : m_options(options), m_total(options.megabytes << 20) {}
+
+    ~TlsBench()
+    {
+        if (m_file != -1)
+        {
+            close(m_file);
+        }
+    }
+
+    int run()
+    {
+        signal(SIGPIPE, SIG_IGN);
+        if (!makeFile())
+        {
+            std::cerr << "无法创建临时文件: " << strerror(errno) << std::endl;
+            return 1;
+        }
+
+        static const char *modes[] = {"plain", "user-tls", "ktls"};
+        std::cout << std::left << std::setw(10) << "mode" << std::setw(10) << "path" << std::setw(10) << "actual" << std::right
+                  << std::setw(12) << "MB/s" << std::setw(14) << "send ns/B" << std::endl;
+        for (int mode = 0; mode < 3; ++mode)
+        {
+            for (bool file : {false, true})
+            {
+                Result r;
+                try
+                {
+                    r = measure(mode, file);
+                }
+                catch (const std::exception &e)
+                {
+                    std::cerr << modes[mode] << ": " << e.what() << std::endl;
+                    return 1;
+                }
+                std::cout << std::left << std::setw(10) << modes[mode] << std::setw(10) << (file ? "sendfile" : "writev")
+                          << std::setw(10) << r.actual << std::right << std::fixed << std::setprecision(1) << std::setw(12)
+                          << r.mbps << std::setprecision(3) << std::setw(14) << r.nsPerByte << std::endl;
+            }
+        }
+        return 0;
+    }
+
+private:
+    struct Result
+    {
+        std::string actual;
+        double mbps = 0;
+        double nsPerByte = 0;
+    };
+
+    // 随机内容的临时文件, 建好就删掉名字, 只留 fd
+    bool makeFile()
+    {
+        char path[] = "/tmp/tlsbench-XXXXXX";
+        m_file = mkstemp(path);
+        if (m_file == -1)
+        {
+            return false;
+        }
+        unlink(path);
+        std::mt19937_64 rng(1);
+        std::vector<uint64_t> block(1 << 13);
+        for (size_t written = 0; written < m_total; written += block.size() * sizeof(uint64_t))
+        {
+            for (uint64_t &word : block)
+            {
+                word = rng();
+            }
+            if (::write(m_file, block.data(), block.size() * sizeof(uint64_t)) == -1)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // mode: 0 明文, 1 用户态 TLS, 2 kTLS
+    Result measure(int mode, bool file)
+    {
+        std::unique_ptr<TlsContext> serverCtx, clientCtx;
+        if (mode != 0)
+        {
+            serverCtx = std::make_unique<TlsContext>(TlsContext::Server, "", "", true, mode == 2);
+            clientCtx = std::make_unique<TlsContext>(TlsContext::Client, "", "", false, mode == 2);
+        }
+
+        int listenFd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        struct sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        socklen_t len = sizeof(addr);
+        if (listenFd == -1 || bind(listenFd, (struct sockaddr *)&addr, sizeof(addr)) == -1 || listen(listenFd, 1) == -1 ||
+            getsockname(listenFd, (struct sockaddr *)&addr, &len) == -1)
+        {
+            throw std::runtime_error(std::string("listen: ") + strerror(errno));
+        }
+
+        // writev 时按整帧发, 总量向上取整到帧
+        size_t frameBytes = sizeof(uint32_t) + m_options.frame;
+        size_t expected = file ? m_total : (m_total + frameBytes - 1) / frameBytes * frameBytes;
+        std::atomic<bool> received{false};
+        std::thread receiver([&]()
+                             {
+                                 int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+                                 if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1)
+                                 {
+                                     close(fd);
+                                     return;
+                                 }
+                                 std::unique_ptr<TlsStream> tls;
+                                 if (clientCtx)
+                                 {
+                                     tls = std::make_unique<TlsStream>(*clientCtx, fd);
+                                     if (tls->handshake() != 1)
+                                     {
+                                         close(fd);
+                                         return;
+                                     }
+                                 }
+                                 std::vector<char> buf(256 * 1024);
+                                 size_t got = 0;
+                                 while (got < expected)
+                                 {
+                                     ssize_t n = tls ? tls->read(buf.data(), buf.size()) : ::read(fd, buf.data(), buf.size());
+                                     if (n <= 0)
+                                     {
+                                         break;
+                                     }
+                                     got += n;
+                                 }
+                                 received = got >= expected;
+                                 tls.reset();
+                                 close(fd); });
+
+        int fd = accept4(listenFd, NULL, NULL, SOCK_CLOEXEC);
+        close(listenFd);
+        std::unique_ptr<TlsStream> tls;
+        Result r;
+        r.actual = "plain";
+        if (fd != -1 && serverCtx)
+        {
+            tls = std::make_unique<TlsStream>(*serverCtx, fd);
+            r.actual = tls->handshake() == 1 ? tls->mode() : "failed";
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        int64_t cpuStart = cpuNanos();
+        bool ok = fd != -1 && r.actual != "failed" && (file ? sendFile(fd, tls.get()) : sendFrames(fd, tls.get(), expected / frameBytes));
+        int64_t cpu = cpuNanos() - cpuStart;
+        if (!ok)
+        {
+            // 发送失败时关掉连接, 接收线程才能退出
+            shutdown(fd, SHUT_RDWR);
+        }
+        receiver.join();
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        tls.reset();
+        if (fd != -1)
+        {
+            close(fd);
+        }
+        if (!ok || !received)
+        {
+            throw std::runtime_error(std::string("transfer failed: ") + strerror(errno));
+        }
+        r.mbps = expected / seconds / (1 << 20);
+        r.nsPerByte = static_cast<double>(cpu) / expected;
+        return r;
+    }
+
+    // 服务器发帧的方式: 长度头和负载一次 writev
+    bool sendFrames(int fd, TlsStream *tls, size_t frames)
+    {
+        std::string payload(m_options.frame, 'x');
+        uint32_t header = htonl(static_cast<uint32_t>(payload.size()));
+        std::string frame = std::string(reinterpret_cast<const char *>(&header), sizeof(header)) + payload;
+        for (size_t i = 0; i < frames; ++i)
+        {
+            struct iovec iov[2];
+            iov[0].iov_base = &header;
+            iov[0].iov_len = sizeof(header);
+            iov[1].iov_base = payload.data();
+            iov[1].iov_len = payload.size();
+            ssize_t n = tls ? tls->writev(iov, 2) : ::writev(fd, iov, 2);
+            // 阻塞 socket 上很少写一半, 写了一半时剩下的补完
+            for (size_t done = n > 0 ? n : 0; n > 0 && done < frame.size(); done += n)
+            {
+                n = tls ? tls->write(frame.data() + done, frame.size() - done) : ::write(fd, frame.data() + done, frame.size() - done);
+            }
+            if (n <= 0)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool sendFile(int fd, TlsStream *tls)
+    {
+        off_t offset = 0;
+        while (static_cast<size_t>(offset) < m_total)
+        {
+            size_t rest = m_total - offset;
+            ssize_t n = tls ? tls->sendfile(m_file, &offset, rest) : ::sendfile(fd, m_file, &offset, rest);
+            if (n <= 0)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    static int64_t cpuNanos()
+    {
+        struct timespec ts;
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+        return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+    }
+
+    TlsBenchOptions m_options;
+    size_t m_total;
+    int m_file = -1;
+};
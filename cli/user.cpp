@@ -1,16 +1,14 @@
 #include "user.hpp"
-#include "../Cli&Ser_Connection/Connection.hpp"
 
 
 void Users::ClientEcho()
 {
 }
-void Users::Enroll(int fd)
+void Users::Enroll(ClientIO &io)
 {
     std::string userName;
     std::string password;
     std::string Email;
-    std::string telephoneNumber;
 
     std::cout << "请输入你的昵称" << std::endl;
     std::cin >> userName;
@@ -18,56 +16,108 @@ void Users::Enroll(int fd)
     std::cin >> password;
     std::cout << "请输入你的邮箱" << std::endl;
     std::cin >> Email;
-    std::cout << "请输入你的电话" << std::endl;
-    std::cin >> telephoneNumber;
 
-    std::string To = "<" + Email + ">";
-    int code = Users::sendCode(To);
-    std::string userCodeStr;
-    int userCodeNum;
+    // 注册是一段对话: 服务器发出验证码后回复 CODESENT, 之后发的每一帧都是验证码, 输错时回复 RETRY
+    // 不等发送结果, 用户可以直接开始输入
+    std::future<std::string> codeSent = io.request(EnrollRequest(userName, password, Email));
     std::cout << "验证码已发送, 请输入验证码" << std::endl;
-tryAgain:
-    std::cin >> userCodeStr;
+
+    int status = FAIL;
     try
     {
-        userCodeNum = std::stoi(userCodeStr);
-        if (userCodeNum <= 99999 || userCodeNum > 999999)
+        std::string reply = "RETRY";
+        bool first = true;
+        while (reply == "RETRY")
+        {
+            std::string userCodeStr;
+            std::cin >> userCodeStr;
+            if (userCodeStr.size() != 6 || !std::all_of(userCodeStr.begin(), userCodeStr.end(), ::isdigit))
+            {
+                std::cout << "验证码为六位数字, 请重新输入" << std::endl;
+                continue;
+            }
+            if (first)
+            {
+                std::string sent = codeSent.get();
+                if (sent != "CODESENT")
+                {
+                    std::cout << "验证码发送失败: " << sent << std::endl;
+                    return;
+                }
+                first = false;
+            }
+            // 回复由网络线程按请求号转交, 不再和接收线程抢同一个 fd
+            reply = io.request(userCodeStr).get();
+            if (reply == "RETRY")
+            {
+                std::cout << "验证码错误, 请重新输入" << std::endl;
+            }
+        }
+        status = (reply.rfind("REGISTERED", 0) == 0) ? SUCCESS : FAIL;
+        if (status != SUCCESS)
         {
-            std::cout << "验证码为六位数字, 请重新操作" << std::endl;
-            goto tryAgain;
+            std::cout << "注册失败: " << reply << std::endl;
         }
     }
-    catch (const std::invalid_argument &e)
+    catch (const std::exception &e)
     {
-        std::cout << "验证码输入错误, 请重新操作" << std::endl;
-        goto tryAgain;
+        std::cerr << "注册请求失败: " << e.what() << std::endl;
     }
-    if (userCodeNum == code)
+
+    if (status == SUCCESS)
     {
-        nlohmann::json EnrollRequest = {{"username", userName},
-                                        {"password", password},
-                                        {"Email", Email},
-                                        {"telephoneNumber", telephoneNumber}};
-        Sen s;
-        s.sendToCli(fd, EnrollRequest.dump());
+        std::cout << "注册成功" << std::endl;
+    }
+}
 
-        Rec r;
-        int status = r.recvStatusOfInt(fd);
-        std::cout << "The status is" << status << std::endl;
+void Users::Login(ClientIO &io)
+{
+    std::string ID;
+    std::string password;
+    std::cout << "请输入你的ID" << std::endl;
+    std::cin >> ID;
+    std::cout << "请输入你的密码" << std::endl;
+    std::cin >> password;
 
-        if (status == SUCCESS)
+    try
+    {
+        std::string reply = io.request(LoginRequest(ID, password)).get();
+        if (reply == "LOGGEDIN")
         {
-            std::cout << "注册成功" << std::endl;
-
-            std::string ID;
-
-
+            std::cout << "登录成功" << std::endl;
         }
+        else
+        {
+            std::cout << "登录失败: " << reply << std::endl;
+        }
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << "登录请求失败: " << e.what() << std::endl;
     }
 }
 
-void Users::Login(int fd)
+std::string Users::EnrollRequest(const std::string &userName, const std::string &password,
+                                 const std::string &Email, const std::string &code)
 {
-    std::string ID;
-    std::cout << "" << std::endl;
+    std::string request = "REGISTER " + userName + " " + password;
+    if (!Email.empty())
+    {
+        request += " " + Email;
+    }
+    if (!Email.empty() && !code.empty())
+    {
+        request += " " + code;
+    }
+    return request;
+}
+
+std::string Users::CodeRequest(const std::string &Email)
+{
+    return "CODE " + Email;
+}
+
+std::string Users::LoginRequest(const std::string &ID, const std::string &password)
+{
+    return "LOGIN " + ID + " " + password;
 }
@@ -1,6 +1,8 @@
+#pragma once
 #include "../include/headFile.hpp"
 #include "../include/define.hpp"
 #include "menu.hpp"
+#include "netcore.hpp"
 
 
 class Users : public Menu
@@ -8,17 +10,18 @@ class Users : public Menu
 public:
     void ClientEcho();
 
-    void Enroll(int fd);
+    void Enroll(ClientIO &io);
 
-    void Login(int fd);
+    void Login(ClientIO &io);
 
-    void Logout(int fd);
+    void Logout(ClientIO &io);
 
-    void Exit(int fd);
+    void Exit(ClientIO &io);
 
-    int sendCode(const std::string To);
-
-    int creatCode(int length);
-
-    std::string CreatID();
+    // 请求报文, 交互模式和压测模式共用
+    // 邮箱为空时不带验证码, 只用于压测; 只带邮箱时服务器进入验证码对话
+    static std::string EnrollRequest(const std::string &userName, const std::string &password,
+                                     const std::string &Email = "", const std::string &code = "");
+    static std::string CodeRequest(const std::string &Email);
+    static std::string LoginRequest(const std::string &ID, const std::string &password);
 };
\ No newline at end of file
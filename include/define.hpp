@@ -0,0 +1,5 @@
+#pragma once
+
+// 服务器回复的状态码
+#define SUCCESS 0
+#define FAIL 1
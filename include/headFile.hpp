@@ -1,45 +1,76 @@
 #include <algorithm>
+#include <array>
 #include <arpa/inet.h>
 #include <atomic>
 #include <bits/posix_opt.h>
 #include <boost/asio.hpp>
+#include <charconv>
 #include <chrono>
 #include <condition_variable>
+#include <coroutine>
+#include <crypt.h>
+#include <cstdarg>
 #include <csignal>
 #include <cstddef>
 #include <cstdlib>
 #include <cstring>
+#include <deque>
 #include <exception>
 #include <fcntl.h>
 #include <filesystem>
 #include <fstream>
 #include <functional>
+#include <future>
 #include <hiredis/hiredis.h>
 #include <hiredis/read.h>
 #include <iomanip>
 #include <iostream>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+#include <linux/filter.h>
+#include <linux/mempolicy.h>
+#include <map>
 #include <memory>
 #include <mysql/mysql.h>
 #include <mutex>
 #include <ncurses.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <new>
 #include <nlohmann/json.hpp>
+#include <openssl/err.h>
+#include <openssl/ssl.h>
+#include <openssl/x509.h>
+#include <pthread.h>
 #include <queue>
 #include <random>
+#include <sched.h>
 #include <set>
 #include <sstream>
 #include <stdexcept>
 #include <string>
+#include <string_view>
 #include <sys/epoll.h>
+#include <sys/random.h>
 #include <sys/eventfd.h>
+#include <sys/mman.h>
 #include <sys/select.h>
 #include <sys/sendfile.h>
+#include <sys/signalfd.h>
 #include <sys/socket.h>
 #include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/timerfd.h>
 #include <sys/types.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <sys/wait.h>
 #include <termios.h>
 #include <thread>
 #include <unistd.h>
 #include <unordered_map>
+#include <unordered_set>
 #include <utility>
 #include <vector>
+#include <zlib.h>
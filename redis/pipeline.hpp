@@ -0,0 +1,94 @@
+#pragma once
+#include "../include/headFile.hpp"
+
+// 不等回复的命令连接, 给挂起等待 Redis 的协程用
+// 命令写完就返回, fd 交给调用方的 epoll, 回复到达后在 OnReadable 中按发出顺序回调
+// 和订阅连接一样只在可读时读一次 socket, 不会阻塞事件循环; 命令很短, 写入仍是同步的
+class RedisPipeline
+{
+public:
+    // reply 为空表示连接出错; 回调返回后 reply 即被释放
+    using Callback = std::function<void(redisReply*)>;
+
+    RedisPipeline(const std::string& host = "127.0.0.1", int port = 6379)
+        : m_connection(redisConnect(host.c_str(), port), &redisFree)
+    {
+        if (!m_connection || m_connection->err)
+        {
+            throw std::runtime_error("Failed to connect to Redis: " +
+                                     std::string(m_connection ? m_connection->errstr : "can't allocate redis context"));
+        }
+    }
+
+    RedisPipeline(const RedisPipeline& other) = delete;
+    RedisPipeline& operator=(const RedisPipeline& other) = delete;
+
+    int Fd() const { return m_connection->fd; }
+
+    // 发出一条命令, 回复到达时回调 onReply
+    void Send(const std::vector<std::string>& args, Callback onReply)
+    {
+        std::vector<const char*> argv(args.size());
+        std::vector<size_t> argvlen(args.size());
+        for (size_t i = 0; i < args.size(); ++i)
+        {
+            argv[i] = args[i].data();
+            argvlen[i] = args[i].size();
+        }
+        redisAppendCommandArgv(m_connection.get(), argv.size(), argv.data(), argvlen.data());
+        m_callbacks.push_back(std::move(onReply));
+
+        int done = 0;
+        while (!done)
+        {
+            if (redisBufferWrite(m_connection.get(), &done) == REDIS_ERR)
+            {
+                // 连接断开后 fd 随即可读, 等待中的命令在 OnReadable 里统一失败, 这里不重入回调
+                std::cerr << "Redis pipeline error: " << m_connection->errstr << std::endl;
+                return;
+            }
+        }
+    }
+
+    // 取出已到达的回复并回调, 连接出错时所有等待中的命令以空回复结束并返回 -1
+    int OnReadable()
+    {
+        if (redisBufferRead(m_connection.get()) == REDIS_ERR)
+        {
+            std::cerr << "Redis pipeline error: " << m_connection->errstr << std::endl;
+            Fail();
+            return -1;
+        }
+
+        int count = 0;
+        void* raw = nullptr;
+        while (!m_callbacks.empty() && redisReaderGetReply(m_connection->reader, &raw) == REDIS_OK && raw)
+        {
+            // 先出队再回调, 回调里可以接着发下一条命令
+            Callback onReply = std::move(m_callbacks.front());
+            m_callbacks.pop_front();
+            redisReply* reply = static_cast<redisReply*>(raw);
+            onReply(reply);
+            freeReplyObject(reply);
+            raw = nullptr;
+            count++;
+        }
+        return count;
+    }
+
+    size_t Pending() const { return m_callbacks.size(); }
+
+private:
+    void Fail()
+    {
+        std::deque<Callback> callbacks;
+        callbacks.swap(m_callbacks);
+        for (Callback& onReply : callbacks)
+        {
+            onReply(nullptr);
+        }
+    }
+
+    std::unique_ptr<redisContext, decltype(&redisFree)> m_connection;
+    std::deque<Callback> m_callbacks;
+};
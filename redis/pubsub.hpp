@@ -0,0 +1,69 @@
+#pragma once
+#include "../include/headFile.hpp"
+
+// 订阅专用的 Redis 连接
+// 进入订阅状态后这条连接不能再执行普通命令, 所以和 RedisAsyncContext 分开
+// fd 交给调用方的 epoll 监听, 可读时调用 OnReadable 取出已到达的消息
+class RedisSubscriber
+{
+public:
+    RedisSubscriber(const std::string& host = "127.0.0.1", int port = 6379)
+        : m_connection(redisConnect(host.c_str(), port), &redisFree)
+    {
+        if (!m_connection || m_connection->err)
+        {
+            throw std::runtime_error("Failed to connect to Redis: " +
+                                     std::string(m_connection ? m_connection->errstr : "can't allocate redis context"));
+        }
+    }
+
+    int Fd() const { return m_connection->fd; }
+
+    // 只发出 SUBSCRIBE, 确认回复在 OnReadable 里和普通消息一起被跳过
+    void Subscribe(const std::string& channel)
+    {
+        redisAppendCommand(m_connection.get(), "subscribe %s", channel.c_str());
+        int done = 0;
+        while (!done)
+        {
+            if (redisBufferWrite(m_connection.get(), &done) == REDIS_ERR)
+            {
+                throw std::runtime_error("Redis subscribe failed: " + std::string(m_connection->errstr));
+            }
+        }
+    }
+
+    // 每次可读只读一次 socket, 不会阻塞; 对每条消息回调 onMessage(channel, payload)
+    // 连接出错时返回 -1
+    template <typename F>
+    int OnReadable(F&& onMessage)
+    {
+        if (redisBufferRead(m_connection.get()) == REDIS_ERR)
+        {
+            std::cerr << "Redis subscriber error: " << m_connection->errstr << std::endl;
+            return -1;
+        }
+
+        int count = 0;
+        void* raw = nullptr;
+        while (redisReaderGetReply(m_connection->reader, &raw) == REDIS_OK && raw)
+        {
+            redisReply* reply = static_cast<redisReply*>(raw);
+            // 消息格式: ["message", channel, payload]
+            if (reply->type == REDIS_REPLY_ARRAY && reply->elements == 3 &&
+                reply->element[0]->type == REDIS_REPLY_STRING &&
+                std::strcmp(reply->element[0]->str, "message") == 0)
+            {
+                onMessage(std::string_view(reply->element[1]->str, reply->element[1]->len),
+                          std::string_view(reply->element[2]->str, reply->element[2]->len));
+                count++;
+            }
+            freeReplyObject(reply);
+            raw = nullptr;
+        }
+        return count;
+    }
+
+private:
+    std::unique_ptr<redisContext, decltype(&redisFree)> m_connection;
+};
@@ -2,7 +2,7 @@
 #include "../redis/redis.hpp"
 
 // 哈希表的相关操作
-inline int RedisAsyncContext::HashSet(const std::string& key, const std::string& field, const std::string& value)
+int RedisAsyncContext::HashSet(const std::string& key, const std::string& field, const std::string& value)
 {
     auto reply = ExecuteCommand("hmset %s %s %s", key.c_str(), field.c_str(), value.c_str());
     int type = reply->type;
@@ -10,7 +10,30 @@ inline int RedisAsyncContext::HashSet(const std::string& key, const std::string&
     return type;
 }
 
-inline int RedisAsyncContext::HashDele(const std::string& key, const std::string& field)
+// 每个哈希表一条 HSET, 整批一次往返; 返回成功的条数
+int RedisAsyncContext::HashSetBatch(const std::vector<HashUpdate>& updates)
+{
+    for (auto& update : updates)
+    {
+        std::vector<std::string> args = {"HSET", update.key};
+        for (auto& [field, value] : update.fields)
+        {
+            args.push_back(field);
+            args.push_back(value);
+        }
+        AppendArgv(args);
+    }
+    int ok = 0;
+    for (size_t i = 0; i < updates.size(); ++i)
+    {
+        auto reply = GetReply();
+        ok += reply->type == REDIS_REPLY_INTEGER;
+        freeReplyObject(reply);
+    }
+    return ok;
+}
+
+int RedisAsyncContext::HashDele(const std::string& key, const std::string& field)
 {
     auto reply = ExecuteCommand("hdel %s %s", key.c_str(), field.c_str());
     int num = reply->integer;
@@ -18,7 +41,7 @@ inline int RedisAsyncContext::HashDele(const std::string& key, const std::string
     return num;
 }
 
-inline bool RedisAsyncContext::HashExists(const std::string& key, const std::string& field) const
+bool RedisAsyncContext::HashExists(const std::string& key, const std::string& field) const
 {
     auto reply = ExecuteCommand("hexists %s %s", key.c_str(), field.c_str());
     bool exists = (reply->integer == 1);
@@ -26,7 +49,7 @@ inline bool RedisAsyncContext::HashExists(const std::string& key, const std::str
     return exists;
 }
 
-inline std::string RedisAsyncContext::HashGet(const std::string& key, const std::string& field) const
+std::string RedisAsyncContext::HashGet(const std::string& key, const std::string& field) const
 {
     auto reply = ExecuteCommand("hget %s %s", key.c_str(), field.c_str());
     std::string value = reply->str ? reply->str : "";
@@ -34,24 +57,46 @@ inline std::string RedisAsyncContext::HashGet(const std::string& key, const std:
     return value;
 }
 
-inline std::unordered_map<std::string, std::string> RedisAsyncContext::HashGetAll(const std::string& key) const
+std::unordered_map<std::string, std::string> RedisAsyncContext::HashGetAll(const std::string& key) const
 {
-    std::unordered_map<std::string, std::string> result;
     auto reply = ExecuteCommand("HGETALL %s", key.c_str());
+    auto result = ParseHash(reply);
+    freeReplyObject(reply);
+    return result;
+}
 
-    if (reply->type == REDIS_REPLY_ARRAY)
+// HGETALL 的回复: [field, value, ...]
+std::unordered_map<std::string, std::string> RedisAsyncContext::ParseHash(const redisReply* reply)
+{
+    std::unordered_map<std::string, std::string> result;
+    if (reply && reply->type == REDIS_REPLY_ARRAY)
     {
-        for (size_t i = 0; i < reply->elements; i += 2)
+        for (size_t i = 0; i + 1 < reply->elements; i += 2)
         {
             result[reply->element[i]->str] = reply->element[i + 1]->str;
         }
     }
+    return result;
+}
 
-    freeReplyObject(reply);
+// 多个 HGETALL 一次往返, 结果和 keys 一一对应
+std::vector<std::unordered_map<std::string, std::string>> RedisAsyncContext::HashGetAllBatch(const std::vector<std::string>& keys)
+{
+    for (auto& key : keys)
+    {
+        AppendArgv({"HGETALL", key});
+    }
+    std::vector<std::unordered_map<std::string, std::string>> result(keys.size());
+    for (size_t i = 0; i < keys.size(); ++i)
+    {
+        auto reply = GetReply();
+        result[i] = ParseHash(reply);
+        freeReplyObject(reply);
+    }
     return result;
 }
 
-inline int RedisAsyncContext::HashClear(const std::string& key)
+int RedisAsyncContext::HashClear(const std::string& key)
 {
     auto reply = ExecuteCommand("DEL %s", key.c_str());
     int type = reply->type;
@@ -60,7 +105,7 @@ inline int RedisAsyncContext::HashClear(const std::string& key)
 }
 
 // 集合的相关操作
-inline int RedisAsyncContext::Insert(const std::string& key, const std::string& member)
+int RedisAsyncContext::Insert(const std::string& key, const std::string& member)
 {
     auto reply = ExecuteCommand("sadd %s %s", key.c_str(), member.c_str());
     int type = reply->type;
@@ -68,7 +113,7 @@ inline int RedisAsyncContext::Insert(const std::string& key, const std::string&
     return type;
 }
 
-inline bool RedisAsyncContext::MemberExists(const std::string& key, const std::string& member) const
+bool RedisAsyncContext::MemberExists(const std::string& key, const std::string& member) const
 {
     auto reply = ExecuteCommand("sismember %s %s", key.c_str(), member.c_str());
     bool exists = (reply->integer == 1);
@@ -76,7 +121,7 @@ inline bool RedisAsyncContext::MemberExists(const std::string& key, const std::s
     return exists;
 }
 
-inline int RedisAsyncContext::DeleteValue(const std::string& key, const std::string& value)
+int RedisAsyncContext::DeleteValue(const std::string& key, const std::string& value)
 {
     auto reply = ExecuteCommand("srem %s %s", key.c_str(), value.c_str());
     int num = reply->integer;
@@ -84,7 +129,7 @@ inline int RedisAsyncContext::DeleteValue(const std::string& key, const std::str
     return num;
 }
 
-inline int RedisAsyncContext::DeleteAll(const std::string& key)
+int RedisAsyncContext::DeleteAll(const std::string& key)
 {
     auto reply = ExecuteCommand("DEL %s", key.c_str());
     int type = reply->type;
@@ -93,15 +138,7 @@ inline int RedisAsyncContext::DeleteAll(const std::string& key)
 }
 
 // 有序集合的相关操作
-inline int RedisAsyncContext::ZAdd(const std::string& key, int score, const std::string& member)
-{
-    auto reply = ExecuteCommand("zadd %s %d %s", key.c_str(), score, member.c_str());
-    int type = reply->type;
-    freeReplyObject(reply);
-    return type;
-}
-
-inline int RedisAsyncContext::ZAdd(const std::string& key, const std::string& score, const std::string& member)
+int RedisAsyncContext::ZAdd(const std::string& key, const std::string& score, const std::string& member)
 {
     auto reply = ExecuteCommand("zadd %s %s %s", key.c_str(), score.c_str(), member.c_str());
     int type = reply->type;
@@ -109,7 +146,7 @@ inline int RedisAsyncContext::ZAdd(const std::string& key, const std::string& sc
     return type;
 }
 
-inline std::vector<std::string> RedisAsyncContext::ZRange(const std::string& key, int start, int stop) const
+std::vector<std::string> RedisAsyncContext::ZRange(const std::string& key, int start, int stop) const
 {
     std::vector<std::string> members;
     auto reply = ExecuteCommand("zrange %s %d %d", key.c_str(), start, stop);
@@ -126,7 +163,7 @@ inline std::vector<std::string> RedisAsyncContext::ZRange(const std::string& key
     return members;
 }
 
-inline int RedisAsyncContext::ZRem(const std::string& key, const std::string& member)
+int RedisAsyncContext::ZRem(const std::string& key, const std::string& member)
 {
     auto reply = ExecuteCommand("zrem %s %s", key.c_str(), member.c_str());
     int type = reply->type;
@@ -134,7 +171,7 @@ inline int RedisAsyncContext::ZRem(const std::string& key, const std::string& me
     return type;
 }
 
-inline bool RedisAsyncContext::ZMemberExists(const std::string& key, const std::string& member) const
+bool RedisAsyncContext::ZMemberExists(const std::string& key, const std::string& member) const
 {
     auto reply = ExecuteCommand("zrank %s %s", key.c_str(), member.c_str());
     bool exists = (reply->type != REDIS_REPLY_NIL);
@@ -142,7 +179,7 @@ inline bool RedisAsyncContext::ZMemberExists(const std::string& key, const std::
     return exists;
 }
 
-inline int RedisAsyncContext::ZClear(const std::string& key)
+int RedisAsyncContext::ZClear(const std::string& key)
 {
     auto reply = ExecuteCommand("del %s", key.c_str());
     int status = reply->type;
@@ -150,8 +187,54 @@ inline int RedisAsyncContext::ZClear(const std::string& key)
     return status;
 }
 
+std::string RedisAsyncContext::ZIdMember(uint64_t id, const std::string& member)
+{
+    char prefix[24];
+    snprintf(prefix, sizeof(prefix), "%020llu:", static_cast<unsigned long long>(id));
+    return prefix + member;
+}
+
+int RedisAsyncContext::ZAddId(const std::string& key, uint64_t id, const std::string& member)
+{
+    auto reply = ExecuteArgv({"ZADD", key, "0", ZIdMember(id, member)});
+    int type = reply->type;
+    freeReplyObject(reply);
+    return type;
+}
+
+int RedisAsyncContext::ZRemId(const std::string& key, uint64_t id, const std::string& member)
+{
+    auto reply = ExecuteArgv({"ZREM", key, ZIdMember(id, member)});
+    int type = reply->type;
+    freeReplyObject(reply);
+    return type;
+}
+
+std::vector<std::pair<uint64_t, std::string>> RedisAsyncContext::ZRangeById(const std::string& key, uint64_t minId,
+                                                                            uint64_t maxId, int count) const
+{
+    std::vector<std::pair<uint64_t, std::string>> members;
+    // 上界的 ':' 之后接 0xff, 大于同一 ID 下的任何成员
+    auto reply = ExecuteArgv({"ZRANGEBYLEX", key, "[" + ZIdMember(minId, ""), "[" + ZIdMember(maxId, "\xff"), "LIMIT", "0",
+                              std::to_string(count)});
+    if (reply->type == REDIS_REPLY_ARRAY)
+    {
+        for (size_t i = 0; i < reply->elements; ++i)
+        {
+            std::string member(reply->element[i]->str, reply->element[i]->len);
+            if (member.size() < 21 || member[20] != ':')
+            {
+                continue; // 不是 ZAddId 写入的成员
+            }
+            members.emplace_back(std::stoull(member.substr(0, 20)), member.substr(21));
+        }
+    }
+    freeReplyObject(reply);
+    return members;
+}
+
 // 列表的相关操作
-inline int RedisAsyncContext::LPush(const std::string& key, const std::string& value)
+int RedisAsyncContext::LPush(const std::string& key, const std::string& value)
 {
     auto reply = ExecuteCommand("lpush %s %s", key.c_str(), value.c_str());
 
@@ -167,7 +250,7 @@ inline int RedisAsyncContext::LPush(const std::string& key, const std::string& v
     return num;
 }
 
-inline int RedisAsyncContext::LLen(const std::string& key) const
+int RedisAsyncContext::LLen(const std::string& key) const
 {
     auto reply = ExecuteCommand("llen %s", key.c_str());
     int num = reply->integer;
@@ -175,7 +258,7 @@ inline int RedisAsyncContext::LLen(const std::string& key) const
     return num;
 }
 
-inline std::vector<std::string> RedisAsyncContext::LRange(const std::string& key, int start, int stop) const
+std::vector<std::string> RedisAsyncContext::LRange(const std::string& key, int start, int stop) const
 {
     std::vector<std::string> values;
     auto reply = ExecuteCommand("lrange %s %d %d", key.c_str(), start, stop);
@@ -192,7 +275,7 @@ inline std::vector<std::string> RedisAsyncContext::LRange(const std::string& key
     return values;
 }
 
-inline int RedisAsyncContext::LTrim(const std::string& key, int start, int stop)
+int RedisAsyncContext::LTrim(const std::string& key, int start, int stop)
 {
     auto reply = ExecuteCommand("ltrim %s %d %d", key.c_str(), start, stop);
     int status = reply->type;
@@ -200,10 +283,263 @@ inline int RedisAsyncContext::LTrim(const std::string& key, int start, int stop)
     return status;
 }
 
-inline std::string RedisAsyncContext::LPop(const std::string& key)
+std::string RedisAsyncContext::LPop(const std::string& key)
 {
     auto reply = ExecuteCommand("lpop %s", key.c_str());
     std::string value = (reply->type == REDIS_REPLY_STRING) ? reply->str : "";
     freeReplyObject(reply);
     return value;
-}
\ No newline at end of file
+}
+
+// 字符串的相关操作
+int RedisAsyncContext::SetEx(const std::string& key, int seconds, const std::string& value)
+{
+    auto reply = ExecuteCommand("set %s %b ex %d", key.c_str(), value.data(), value.size(), seconds);
+    int type = reply->type;
+    freeReplyObject(reply);
+    return type;
+}
+
+// 键不存在时才写入, 带过期时间; 写入了返回 true
+bool RedisAsyncContext::SetNx(const std::string& key, int seconds, const std::string& value)
+{
+    auto reply = ExecuteCommand("set %s %b nx ex %d", key.c_str(), value.data(), value.size(), seconds);
+    bool set = reply->type == REDIS_REPLY_STATUS;
+    freeReplyObject(reply);
+    return set;
+}
+
+long long RedisAsyncContext::Incr(const std::string& key)
+{
+    auto reply = ExecuteCommand("incr %s", key.c_str());
+    long long value = (reply->type == REDIS_REPLY_INTEGER) ? reply->integer : -1;
+    freeReplyObject(reply);
+    return value;
+}
+
+// 读出后立即删除, 一次性的值 (如验证码) 不会被用两次
+std::string RedisAsyncContext::GetDel(const std::string& key)
+{
+    auto reply = ExecuteCommand("getdel %s", key.c_str());
+    std::string value = (reply->type == REDIS_REPLY_STRING) ? std::string(reply->str, reply->len) : "";
+    freeReplyObject(reply);
+    return value;
+}
+
+// 发布订阅的相关操作
+int RedisAsyncContext::Publish(const std::string& channel, const std::string& message)
+{
+    // 消息内容可能是二进制, 用 %b 按长度传递
+    auto reply = ExecuteCommand("publish %s %b", channel.c_str(), message.data(), message.size());
+    int num = (reply->type == REDIS_REPLY_INTEGER) ? reply->integer : -1;
+    freeReplyObject(reply);
+    return num;
+}
+
+// 流的相关操作
+std::vector<std::string> RedisAsyncContext::XAddArgs(const std::string& key, size_t maxLen,
+                                                     const std::vector<std::pair<std::string, std::string>>& fields,
+                                                     const std::string& id)
+{
+    std::vector<std::string> args = {"XADD", key};
+    if (maxLen > 0)
+    {
+        // 近似裁剪, Redis 只在整个宏节点可删时才删除, 开销远小于精确裁剪
+        args.insert(args.end(), {"MAXLEN", "~", std::to_string(maxLen)});
+    }
+    args.push_back(id);
+    for (auto& [field, value] : fields)
+    {
+        args.push_back(field);
+        args.push_back(value);
+    }
+    return args;
+}
+
+std::string RedisAsyncContext::XAdd(const std::string& key, size_t maxLen,
+                                    const std::vector<std::pair<std::string, std::string>>& fields)
+{
+    auto reply = ExecuteArgv(XAddArgs(key, maxLen, fields));
+    std::string id = (reply->type == REDIS_REPLY_STRING) ? std::string(reply->str, reply->len) : "";
+    freeReplyObject(reply);
+    return id;
+}
+
+// 所有 XADD 先写进输出缓冲区再统一读回复, 整批只有一次往返
+std::vector<std::string> RedisAsyncContext::XAddBatch(const std::vector<StreamAppend>& entries)
+{
+    std::vector<std::string> ids;
+    ids.reserve(entries.size());
+    for (auto& entry : entries)
+    {
+        AppendArgv(XAddArgs(entry.key, entry.maxLen, entry.fields, entry.id));
+    }
+    for (size_t i = 0; i < entries.size(); ++i)
+    {
+        auto reply = GetReply();
+        ids.push_back((reply->type == REDIS_REPLY_STRING) ? std::string(reply->str, reply->len) : "");
+        freeReplyObject(reply);
+    }
+    return ids;
+}
+
+int RedisAsyncContext::XGroupCreate(const std::string& key, const std::string& group, const std::string& startId)
+{
+    auto reply = ExecuteArgv({"XGROUP", "CREATE", key, group, startId, "MKSTREAM"});
+    // 组已存在时返回 BUSYGROUP 错误, 视为成功
+    int ok = (reply->type != REDIS_REPLY_ERROR || std::strncmp(reply->str, "BUSYGROUP", 9) == 0) ? 0 : -1;
+    freeReplyObject(reply);
+    return ok;
+}
+
+std::vector<StreamEntry> RedisAsyncContext::XReadGroup(const std::string& key, const std::string& group,
+                                                       const std::string& consumer, int count, const std::string& id)
+{
+    std::vector<StreamEntry> entries;
+    auto reply = ExecuteArgv({"XREADGROUP", "GROUP", group, consumer, "COUNT", std::to_string(count),
+                              "STREAMS", key, id});
+
+    // 回复格式: [[key, [[id, [field, value, ...]], ...]]]
+    if (reply->type == REDIS_REPLY_ARRAY && reply->elements > 0 &&
+        reply->element[0]->type == REDIS_REPLY_ARRAY && reply->element[0]->elements == 2)
+    {
+        entries = ParseStreamEntries(reply->element[0]->element[1]);
+    }
+
+    freeReplyObject(reply);
+    return entries;
+}
+
+// 一条 XACK 确认一批记录
+int RedisAsyncContext::XAck(const std::string& key, const std::string& group, const std::vector<std::string>& ids)
+{
+    if (ids.empty())
+    {
+        return 0;
+    }
+    std::vector<std::string> args = {"XACK", key, group};
+    args.insert(args.end(), ids.begin(), ids.end());
+    auto reply = ExecuteArgv(args);
+    int num = (reply->type == REDIS_REPLY_INTEGER) ? reply->integer : -1;
+    freeReplyObject(reply);
+    return num;
+}
+
+std::vector<StreamEntry> RedisAsyncContext::XRange(const std::string& key, const std::string& start,
+                                                   const std::string& end, int count) const
+{
+    auto reply = ExecuteArgv({"XRANGE", key, start, end, "COUNT", std::to_string(count)});
+    std::vector<StreamEntry> entries = ParseStreamEntries(reply);
+    freeReplyObject(reply);
+    return entries;
+}
+
+// 把闲置超过 minIdleMs 的待确认记录转给 consumer, 从 cursor 开始扫描, 返回时 cursor 是下一次的起点
+// 扫描完一轮时 cursor 为 "0-0", 出错时为空
+std::vector<StreamEntry> RedisAsyncContext::XAutoClaim(const std::string& key, const std::string& group,
+                                                       const std::string& consumer, long long minIdleMs,
+                                                       std::string& cursor, int count)
+{
+    std::vector<StreamEntry> entries;
+    auto reply = ExecuteArgv({"XAUTOCLAIM", key, group, consumer, std::to_string(minIdleMs), cursor,
+                              "COUNT", std::to_string(count)});
+
+    // 回复格式: [next, [[id, [field, value, ...]], ...]] (7.0 起后面还有被删除记录的 ID)
+    if (reply->type == REDIS_REPLY_ARRAY && reply->elements >= 2 && reply->element[0]->type == REDIS_REPLY_STRING)
+    {
+        cursor.assign(reply->element[0]->str, reply->element[0]->len);
+        entries = ParseStreamEntries(reply->element[1]);
+    }
+    else
+    {
+        cursor.clear();
+    }
+
+    freeReplyObject(reply);
+    return entries;
+}
+
+std::vector<StreamEntry> RedisAsyncContext::ParseStreamEntries(const redisReply* reply)
+{
+    std::vector<StreamEntry> entries;
+    if (!reply || reply->type != REDIS_REPLY_ARRAY)
+    {
+        return entries;
+    }
+
+    for (size_t i = 0; i < reply->elements; ++i)
+    {
+        const redisReply* item = reply->element[i];
+        if (item->type != REDIS_REPLY_ARRAY || item->elements != 2)
+        {
+            continue;
+        }
+        StreamEntry entry;
+        entry.id.assign(item->element[0]->str, item->element[0]->len);
+        // 已被裁剪掉的待确认记录, 字段部分为 nil
+        const redisReply* fields = item->element[1];
+        if (fields->type == REDIS_REPLY_ARRAY)
+        {
+            for (size_t j = 0; j + 1 < fields->elements; j += 2)
+            {
+                entry.fields.emplace_back(std::string(fields->element[j]->str, fields->element[j]->len),
+                                          std::string(fields->element[j + 1]->str, fields->element[j + 1]->len));
+            }
+        }
+        entries.push_back(std::move(entry));
+    }
+    return entries;
+}
+
+// 脚本的相关操作
+std::string RedisAsyncContext::ScriptLoad(const std::string& script)
+{
+    auto reply = ExecuteArgv({"SCRIPT", "LOAD", script});
+    std::string sha = (reply->type == REDIS_REPLY_STRING) ? std::string(reply->str, reply->len) : "";
+    freeReplyObject(reply);
+    return sha;
+}
+
+// 只处理返回整数的脚本; 出错 (包括 NOSCRIPT) 时返回 -1
+long long RedisAsyncContext::EvalSha(const std::string& sha, const std::vector<std::string>& keys,
+                                     const std::vector<std::string>& args)
+{
+    std::vector<std::string> argv = {"EVALSHA", sha, std::to_string(keys.size())};
+    argv.insert(argv.end(), keys.begin(), keys.end());
+    argv.insert(argv.end(), args.begin(), args.end());
+    auto reply = ExecuteArgv(argv);
+    long long num = (reply->type == REDIS_REPLY_INTEGER) ? reply->integer : -1;
+    if (reply->type == REDIS_REPLY_ERROR)
+    {
+        std::cerr << "Error: EVALSHA failed: " << reply->str << std::endl;
+    }
+    freeReplyObject(reply);
+    return num;
+}
+
+// 返回字符串数组的脚本, 结果追加到 out; 出错 (包括 NOSCRIPT) 时返回 false
+bool RedisAsyncContext::EvalShaList(const std::string& sha, const std::vector<std::string>& keys,
+                                    const std::vector<std::string>& args, std::vector<std::string>& out)
+{
+    std::vector<std::string> argv = {"EVALSHA", sha, std::to_string(keys.size())};
+    argv.insert(argv.end(), keys.begin(), keys.end());
+    argv.insert(argv.end(), args.begin(), args.end());
+    auto reply = ExecuteArgv(argv);
+    bool ok = reply->type == REDIS_REPLY_ARRAY;
+    if (ok)
+    {
+        for (size_t i = 0; i < reply->elements; ++i)
+        {
+            if (reply->element[i]->type == REDIS_REPLY_STRING)
+            {
+                out.emplace_back(reply->element[i]->str, reply->element[i]->len);
+            }
+        }
+    }
+    else if (reply->type == REDIS_REPLY_ERROR)
+    {
+        std::cerr << "Error: EVALSHA failed: " << reply->str << std::endl;
+    }
+    freeReplyObject(reply);
+    return ok;
+}
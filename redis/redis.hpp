@@ -1,10 +1,34 @@
 #pragma once
 #include "../include/headFile.hpp"
+#include "../Cli_Ser_Connection/Trace.hpp"
+
+// 流中的一条记录
+struct StreamEntry
+{
+    std::string id;
+    std::vector<std::pair<std::string, std::string>> fields;
+};
+
+// 待追加到流中的一条记录, 用于批量 XADD
+struct StreamAppend
+{
+    std::string key;
+    size_t maxLen; // 近似上限, 0 表示不裁剪
+    std::vector<std::pair<std::string, std::string>> fields;
+    std::string id = "*"; // 显式指定的记录 ID, 必须大于流里现有的最大 ID
+};
+
+// 一个哈希表要写入的一组字段, 用于批量 HSET
+struct HashUpdate
+{
+    std::string key;
+    std::vector<std::pair<std::string, std::string>> fields;
+};
 
 class RedisAsyncContext
 {
 public:
-    RedisAsyncContext();
+    RedisAsyncContext(const std::string& host = "127.0.0.1", int port = 6379);
     ~RedisAsyncContext();
 
     // 哈希表的相关操作
@@ -14,6 +38,8 @@ public:
     std::string HashGet(const std::string& key, const std::string& field) const;
     std::unordered_map<std::string, std::string> HashGetAll(const std::string& key) const;
     int HashClear(const std::string& key);
+    int HashSetBatch(const std::vector<HashUpdate>& updates);
+    std::vector<std::unordered_map<std::string, std::string>> HashGetAllBatch(const std::vector<std::string>& keys);
 
     // 集合的相关操作
     int Insert(const std::string& key, const std::string& member);
@@ -22,12 +48,19 @@ public:
     int DeleteAll(const std::string& key);
 
     // 有序集合的相关操作
-    int ZAdd(const std::string& key, int score, const std::string& member);
     int ZAdd(const std::string& key, const std::string& score, const std::string& member);
     std::vector<std::string> ZRange(const std::string& key, int start, int stop) const;
     int ZRem(const std::string& key, const std::string& member);
     bool ZMemberExists(const std::string& key, const std::string& member) const;
     int ZClear(const std::string& key);
+    // 按 64 位 ID 排序: Redis 的分数是 double, 超过 2^53 的雪花 ID 会被舍入, 相邻 ID 排序会乱
+    // 所以分数一律为 0, 成员写成 "<20 位补零的 ID>:<member>", 按字典序排序与按 ID 排序一致, 用 ZRANGEBYLEX 取范围
+    int ZAddId(const std::string& key, uint64_t id, const std::string& member);
+    int ZRemId(const std::string& key, uint64_t id, const std::string& member);
+    // 取 ID 在 [minId, maxId] 内的成员, 按 ID 升序, 最多 count 个
+    std::vector<std::pair<uint64_t, std::string>> ZRangeById(const std::string& key, uint64_t minId, uint64_t maxId,
+                                                             int count) const;
+    static std::string ZIdMember(uint64_t id, const std::string& member);
 
     // 列表的相关操作
     int LPush(const std::string& key, const std::string& value);
@@ -36,18 +69,57 @@ public:
     int LTrim(const std::string& key, int start, int stop);
     std::string LPop(const std::string& key);
 
+    // 字符串的相关操作
+    int SetEx(const std::string& key, int seconds, const std::string& value);
+    bool SetNx(const std::string& key, int seconds, const std::string& value);
+    long long Incr(const std::string& key);
+    std::string GetDel(const std::string& key);
+
+    // 发布订阅的相关操作
+    int Publish(const std::string& channel, const std::string& message);
+
+    // 流的相关操作
+    std::string XAdd(const std::string& key, size_t maxLen, const std::vector<std::pair<std::string, std::string>>& fields);
+    std::vector<std::string> XAddBatch(const std::vector<StreamAppend>& entries);
+    int XGroupCreate(const std::string& key, const std::string& group, const std::string& startId = "$");
+    std::vector<StreamEntry> XReadGroup(const std::string& key, const std::string& group, const std::string& consumer,
+                                        int count, const std::string& id = ">");
+    int XAck(const std::string& key, const std::string& group, const std::vector<std::string>& ids);
+    std::vector<StreamEntry> XRange(const std::string& key, const std::string& start, const std::string& end, int count) const;
+    std::vector<StreamEntry> XAutoClaim(const std::string& key, const std::string& group, const std::string& consumer,
+                                        long long minIdleMs, std::string& cursor, int count);
+
+    // 脚本的相关操作
+    std::string ScriptLoad(const std::string& script);
+    long long EvalSha(const std::string& sha, const std::vector<std::string>& keys, const std::vector<std::string>& args);
+    bool EvalShaList(const std::string& sha, const std::vector<std::string>& keys, const std::vector<std::string>& args,
+                     std::vector<std::string>& out);
+
+    // 解析 XRANGE 格式的记录数组, XREADGROUP 的回复要先取出对应流的部分
+    static std::vector<StreamEntry> ParseStreamEntries(const redisReply* reply);
+    static std::vector<std::string> XAddArgs(const std::string& key, size_t maxLen,
+                                             const std::vector<std::pair<std::string, std::string>>& fields,
+                                             const std::string& id = "*");
+    static std::unordered_map<std::string, std::string> ParseHash(const redisReply* reply);
+
 private:
+    friend class RedisShards; // 分片层把多个实例的批量命令先全部写出再统一收回复
+
     redisReply* ExecuteCommand(const char* format, ...) const;
+    redisReply* ExecuteArgv(const std::vector<std::string>& args) const;
+    void AppendArgv(const std::vector<std::string>& args);
+    redisReply* GetReply();
 
     std::unique_ptr<redisContext, decltype(&redisFree)> m_connection;
 };
 
-inline RedisAsyncContext::RedisAsyncContext()
-    : m_connection(redisConnect("127.0.0.1", 6379), &redisFree)
+inline RedisAsyncContext::RedisAsyncContext(const std::string& host, int port)
+    : m_connection(redisConnect(host.c_str(), port), &redisFree)
 {
-    if (m_connection->err)
+    if (!m_connection || m_connection->err)
     {
-        throw std::runtime_error("Failed to connect to Redis: " + std::string(m_connection->errstr));
+        throw std::runtime_error("Failed to connect to Redis: " +
+                                 std::string(m_connection ? m_connection->errstr : "can't allocate redis context"));
     }
 }
 
@@ -55,6 +127,7 @@ inline RedisAsyncContext::~RedisAsyncContext() = default;
 
 inline redisReply* RedisAsyncContext::ExecuteCommand(const char* format, ...) const
 {
+    Trace::Scope span("redis", Trace::tagOf(format)); // 抽中的请求记下这条命令的往返
     va_list args;
     va_start(args, format);
     redisReply* reply = (redisReply*)redisvCommand(m_connection.get(), format, args);
@@ -67,4 +140,49 @@ inline redisReply* RedisAsyncContext::ExecuteCommand(const char* format, ...) co
     }
 
     return reply;
+}
+
+inline redisReply* RedisAsyncContext::ExecuteArgv(const std::vector<std::string>& args) const
+{
+    Trace::Scope span("redis", args.empty() ? 0 : Trace::tagOf(args[0]));
+    std::vector<const char*> argv(args.size());
+    std::vector<size_t> argvlen(args.size());
+    for (size_t i = 0; i < args.size(); ++i)
+    {
+        argv[i] = args[i].data();
+        argvlen[i] = args[i].size();
+    }
+
+    redisReply* reply = (redisReply*)redisCommandArgv(m_connection.get(), argv.size(), argv.data(), argvlen.data());
+    if (!reply)
+    {
+        std::cerr << "Error: redisCommandArgv returned NULL" << std::endl;
+        throw std::runtime_error("Redis command failed.");
+    }
+
+    return reply;
+}
+
+// 只写入输出缓冲区, 配合 GetReply 做流水线
+inline void RedisAsyncContext::AppendArgv(const std::vector<std::string>& args)
+{
+    std::vector<const char*> argv(args.size());
+    std::vector<size_t> argvlen(args.size());
+    for (size_t i = 0; i < args.size(); ++i)
+    {
+        argv[i] = args[i].data();
+        argvlen[i] = args[i].size();
+    }
+    redisAppendCommandArgv(m_connection.get(), argv.size(), argv.data(), argvlen.data());
+}
+
+inline redisReply* RedisAsyncContext::GetReply()
+{
+    void* reply = nullptr;
+    if (redisGetReply(m_connection.get(), &reply) != REDIS_OK || !reply)
+    {
+        std::cerr << "Error: redisGetReply failed" << std::endl;
+        throw std::runtime_error("Redis command failed.");
+    }
+    return (redisReply*)reply;
 }
\ No newline at end of file
@@ -0,0 +1,549 @@
+#pragma once
+#include "redis.hpp"
+#include "pipeline.hpp"
+#include "pubsub.hpp"
+
+#define SHARD_VNODES 160                // 每个实例在环上的虚拟节点数
+#define SHARD_CONTROL_CHANNEL "shards"  // 增删实例的控制频道, 消息为 "add host:port" 或 "remove host:port"
+#define SHARD_MIGRATE_BATCH 200         // 迁移时每次 SCAN 的键数
+#define SHARD_MIGRATE_BUDGET_US 2000    // 每次迁移步骤最多占用事件循环的时间
+#define SHARD_MIGRATE_TICK_MS 10        // 迁移期间两次步骤的间隔
+#define SHARD_MIGRATE_TIMEOUT_MS 5000   // MIGRATE 命令的超时
+
+// 一致性哈希环, 每个实例按地址放 SHARD_VNODES 个虚拟节点
+// 增删一个实例只影响环上相邻的一段, 其余键的归属不变
+class HashRing
+{
+public:
+    // 键里有 "{tag}" 时只按 tag 计算, 同一个 tag 的键总在同一个实例上
+    static std::string_view RoutingKey(std::string_view key)
+    {
+        size_t open = key.find('{');
+        if (open != std::string_view::npos)
+        {
+            size_t close = key.find('}', open + 1);
+            if (close != std::string_view::npos && close > open + 1)
+            {
+                return key.substr(open + 1, close - open - 1);
+            }
+        }
+        return key;
+    }
+
+    // FNV-1a 再做一次 splitmix64 的末端混合; 不用 std::hash, 各节点、各版本必须算出同样的环
+    static uint64_t Hash(std::string_view data)
+    {
+        uint64_t h = 14695981039346656037ULL;
+        for (unsigned char ch : data)
+        {
+            h = (h ^ ch) * 1099511628211ULL;
+        }
+        h ^= h >> 30;
+        h *= 0xbf58476d1ce4e5b9ULL;
+        h ^= h >> 27;
+        h *= 0x94d049bb133111ebULL;
+        h ^= h >> 31;
+        return h;
+    }
+
+    void Add(const std::string& name, size_t shard)
+    {
+        for (int i = 0; i < SHARD_VNODES; ++i)
+        {
+            m_points.emplace_back(Hash(name + "#" + std::to_string(i)), shard);
+        }
+        std::sort(m_points.begin(), m_points.end());
+    }
+
+    void Remove(size_t shard)
+    {
+        m_points.erase(std::remove_if(m_points.begin(), m_points.end(),
+                                      [shard](const std::pair<uint64_t, size_t>& point)
+                                      { return point.second == shard; }),
+                       m_points.end());
+    }
+
+    // 顺时针方向第一个虚拟节点所属的实例
+    size_t Locate(std::string_view key) const
+    {
+        uint64_t h = Hash(RoutingKey(key));
+        auto it = std::upper_bound(m_points.begin(), m_points.end(), std::make_pair(h, SIZE_MAX));
+        return it == m_points.end() ? m_points.front().second : it->second;
+    }
+
+private:
+    std::vector<std::pair<uint64_t, size_t>> m_points; // (哈希值, 实例下标), 按哈希值排序
+};
+
+// 按键分片到多个 Redis 实例, 接口和 RedisAsyncContext 的同名方法一致
+// 批量命令按实例分组, 先把所有实例的命令都写出去再逐个收回复, 各实例并行处理, 总耗时约等于最慢的一个
+// 在线增删实例: 控制频道上的消息让所有节点按同样的顺序修改环, 之后后台分批 SCAN + MIGRATE 搬走归属变化的键;
+// 迁移期间访问一个归属变了的键时先同步把它搬过去, 读写都只落在新的实例上
+// 只迁移 prefixes 里列出的键, 同一实例上的集群路由表和频道不受影响
+class RedisShards
+{
+public:
+    RedisShards(const std::vector<std::string>& addresses, std::vector<std::string> prefixes,
+                const std::string& controlHost = "127.0.0.1", int controlPort = 6379)
+        : m_prefixes(std::move(prefixes)), m_control(controlHost, controlPort)
+    {
+        for (const std::string& address : addresses)
+        {
+            size_t shard = Open(address);
+            m_ring.Add(address, shard);
+        }
+        if (m_shards.empty())
+        {
+            throw std::runtime_error("No Redis shards configured");
+        }
+        m_control.Subscribe(SHARD_CONTROL_CHANNEL);
+
+        m_tickFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        if (m_tickFd == -1)
+        {
+            throw std::runtime_error("timerfd_create: " + std::string(strerror(errno)));
+        }
+    }
+
+    ~RedisShards()
+    {
+        close(m_tickFd);
+    }
+
+    RedisShards(const RedisShards& other) = delete;
+    RedisShards& operator=(const RedisShards& other) = delete;
+
+    // 每个实例的不等回复连接都要交给事件循环监听; 新增实例时回调 opened, 实例下线后回调 closed
+    void OnPipeline(std::function<void(RedisPipeline&)> opened, std::function<void(RedisPipeline&)> closed)
+    {
+        m_pipelineOpened = std::move(opened);
+        m_pipelineClosed = std::move(closed);
+        for (Shard& shard : m_shards)
+        {
+            m_pipelineOpened(*shard.pipeline);
+        }
+    }
+
+    // 控制频道, 可读时调用 OnControl; 连接出错时返回 -1
+    int ControlFd() const { return m_control.Fd(); }
+
+    int OnControl()
+    {
+        int n = m_control.OnReadable([this](std::string_view, std::string_view message)
+                                     { m_changes.emplace_back(message); });
+        Arm();
+        return n;
+    }
+
+    // 有待应用的变更或正在迁移时周期性可读, 可读时调用 Step
+    int StepFd() const { return m_tickFd; }
+
+    void Step()
+    {
+        uint64_t expirations;
+        read(m_tickFd, &expirations, sizeof(expirations));
+        if (!m_migrating)
+        {
+            ApplyChange();
+        }
+        auto start = std::chrono::steady_clock::now();
+        while (m_migrating && std::chrono::steady_clock::now() - start < std::chrono::microseconds(SHARD_MIGRATE_BUDGET_US))
+        {
+            ScanOnce();
+        }
+        Arm();
+    }
+
+    RedisAsyncContext& For(const std::string& key) { return *m_shards[Route(key)].redis; }
+    RedisPipeline& PipelineFor(const std::string& key) { return *m_shards[Route(key)].pipeline; }
+
+    std::vector<StreamEntry> XRange(const std::string& key, const std::string& start, const std::string& end, int count)
+    {
+        return For(key).XRange(key, start, end, count);
+    }
+
+    std::unordered_map<std::string, std::string> HashGetAll(const std::string& key)
+    {
+        return For(key).HashGetAll(key);
+    }
+
+    std::vector<std::string> XAddBatch(const std::vector<StreamAppend>& entries)
+    {
+        std::vector<std::string> ids(entries.size());
+        FanOut(
+            entries.size(), [&](size_t i)
+            { return entries[i].key; },
+            [&](size_t i)
+            { return RedisAsyncContext::XAddArgs(entries[i].key, entries[i].maxLen, entries[i].fields, entries[i].id); },
+            [&](size_t i, redisReply* reply)
+            { ids[i] = reply->type == REDIS_REPLY_STRING ? std::string(reply->str, reply->len) : ""; });
+        return ids;
+    }
+
+    int HashSetBatch(const std::vector<HashUpdate>& updates)
+    {
+        int ok = 0;
+        FanOut(
+            updates.size(), [&](size_t i)
+            { return updates[i].key; },
+            [&](size_t i)
+            {
+                std::vector<std::string> args = {"HSET", updates[i].key};
+                for (auto& [field, value] : updates[i].fields)
+                {
+                    args.push_back(field);
+                    args.push_back(value);
+                }
+                return args; },
+            [&](size_t, redisReply* reply)
+            { ok += reply->type == REDIS_REPLY_INTEGER; });
+        return ok;
+    }
+
+    std::vector<std::unordered_map<std::string, std::string>> HashGetAllBatch(const std::vector<std::string>& keys)
+    {
+        std::vector<std::unordered_map<std::string, std::string>> result(keys.size());
+        FanOut(
+            keys.size(), [&](size_t i)
+            { return keys[i]; },
+            [&](size_t i)
+            { return std::vector<std::string>{"HGETALL", keys[i]}; },
+            [&](size_t i, redisReply* reply)
+            { result[i] = RedisAsyncContext::ParseHash(reply); });
+        return result;
+    }
+
+    int Insert(const std::string& key, const std::string& member) { return For(key).Insert(key, member); }
+    int DeleteValue(const std::string& key, const std::string& value) { return For(key).DeleteValue(key, value); }
+
+    std::vector<std::vector<std::string>> SetMembersBatch(const std::vector<std::string>& keys)
+    {
+        std::vector<std::vector<std::string>> result(keys.size());
+        FanOut(
+            keys.size(), [&](size_t i)
+            { return keys[i]; },
+            [&](size_t i)
+            { return std::vector<std::string>{"SMEMBERS", keys[i]}; },
+            [&](size_t i, redisReply* reply)
+            {
+                if (reply->type == REDIS_REPLY_ARRAY)
+                {
+                    for (size_t j = 0; j < reply->elements; ++j)
+                    {
+                        result[i].emplace_back(reply->element[j]->str, reply->element[j]->len);
+                    }
+                } });
+        return result;
+    }
+
+    // 所有实例上以 prefix 开头的键, 每批回调一次 onKeys(keys); 只在启动时加载数据用
+    template <typename F>
+    void ScanKeys(const std::string& prefix, F&& onKeys)
+    {
+        for (Shard& shard : m_shards)
+        {
+            if (!shard.redis)
+            {
+                continue;
+            }
+            std::string cursor = "0";
+            do
+            {
+                redisReply* reply = shard.redis->ExecuteArgv({"SCAN", cursor, "MATCH", prefix + "*",
+                                                              "COUNT", std::to_string(SHARD_MIGRATE_BATCH)});
+                if (reply->type != REDIS_REPLY_ARRAY || reply->elements != 2)
+                {
+                    freeReplyObject(reply);
+                    throw std::runtime_error("SCAN failed on " + shard.address);
+                }
+                cursor.assign(reply->element[0]->str, reply->element[0]->len);
+                std::vector<std::string> keys;
+                for (size_t i = 0; i < reply->element[1]->elements; ++i)
+                {
+                    keys.emplace_back(reply->element[1]->element[i]->str, reply->element[1]->element[i]->len);
+                }
+                freeReplyObject(reply);
+                onKeys(keys);
+            } while (cursor != "0");
+        }
+    }
+
+    // 脚本加载到每个实例上, SHA 只取决于脚本内容
+    std::string ScriptLoad(const std::string& script)
+    {
+        std::string sha;
+        for (Shard& shard : m_shards)
+        {
+            if (shard.redis)
+            {
+                sha = shard.redis->ScriptLoad(script);
+            }
+        }
+        return sha;
+    }
+
+    // 按第一个键路由, 多个键时必须用同一个 tag
+    long long EvalSha(const std::string& sha, const std::vector<std::string>& keys, const std::vector<std::string>& args)
+    {
+        return For(keys.at(0)).EvalSha(sha, keys, args);
+    }
+
+private:
+    struct Shard
+    {
+        std::string address;
+        std::string host;
+        int port = 0;
+        std::unique_ptr<RedisAsyncContext> redis; // 下线并迁移完后释放, 下标保留
+        std::unique_ptr<RedisPipeline> pipeline;
+    };
+
+    struct Scan
+    {
+        size_t shard;
+        size_t prefix;
+        std::string cursor = "0";
+        bool started = false;
+    };
+
+    size_t Open(const std::string& address)
+    {
+        size_t colon = address.rfind(':');
+        Shard shard;
+        shard.address = address;
+        shard.host = address.substr(0, colon);
+        shard.port = colon == std::string::npos ? 6379 : std::atoi(address.c_str() + colon + 1);
+        shard.redis = std::make_unique<RedisAsyncContext>(shard.host, shard.port);
+        shard.pipeline = std::make_unique<RedisPipeline>(shard.host, shard.port);
+        m_shards.push_back(std::move(shard));
+        return m_shards.size() - 1;
+    }
+
+    // 迁移期间归属变了的键先同步搬到新实例; 键不存在时 MIGRATE 回复 NOKEY, 同样算搬完
+    size_t Route(const std::string& key)
+    {
+        size_t shard = m_ring.Locate(key);
+        if (m_migrating)
+        {
+            size_t from = m_previous.Locate(key);
+            if (from != shard && m_moved.insert(key).second)
+            {
+                Migrate(from, shard, {key});
+            }
+        }
+        return shard;
+    }
+
+    void Migrate(size_t from, size_t to, const std::vector<std::string>& keys)
+    {
+        const Shard& target = m_shards[to];
+        std::vector<std::string> args = {"MIGRATE", target.host, std::to_string(target.port), "", "0",
+                                         std::to_string(SHARD_MIGRATE_TIMEOUT_MS), "KEYS"};
+        args.insert(args.end(), keys.begin(), keys.end());
+        redisReply* reply = m_shards[from].redis->ExecuteArgv(args);
+        if (reply->type == REDIS_REPLY_ERROR)
+        {
+            std::cerr << "MIGRATE " << m_shards[from].address << " -> " << target.address << " failed: " << reply->str << std::endl;
+        }
+        else
+        {
+            m_migrated += keys.size();
+        }
+        freeReplyObject(reply);
+    }
+
+    // 多个实例的流水线: 全部写出后再按实例顺序收回复, 回调 onReply(下标, 回复)
+    template <typename Key, typename Args, typename OnReply>
+    void FanOut(size_t n, Key&& keyOf, Args&& argsOf, OnReply&& onReply)
+    {
+        std::vector<std::vector<size_t>> groups(m_shards.size());
+        for (size_t i = 0; i < n; ++i)
+        {
+            groups[Route(keyOf(i))].push_back(i);
+        }
+        for (size_t s = 0; s < groups.size(); ++s)
+        {
+            for (size_t i : groups[s])
+            {
+                m_shards[s].redis->AppendArgv(argsOf(i));
+            }
+        }
+        for (size_t s = 0; s < groups.size(); ++s)
+        {
+            for (size_t i : groups[s])
+            {
+                redisReply* reply = m_shards[s].redis->GetReply();
+                onReply(i, reply);
+                freeReplyObject(reply);
+            }
+        }
+    }
+
+    // 一次只应用一个变更; 要等所有不等回复的连接都收完回复, 否则还在路上的写入可能落到搬走之后的旧实例上
+    void ApplyChange()
+    {
+        if (m_changes.empty())
+        {
+            return;
+        }
+        for (Shard& shard : m_shards)
+        {
+            if (shard.pipeline && shard.pipeline->Pending() > 0)
+            {
+                return;
+            }
+        }
+        std::string change = std::move(m_changes.front());
+        m_changes.pop_front();
+        size_t space = change.find(' ');
+        std::string op = change.substr(0, space);
+        std::string address = space == std::string::npos ? "" : change.substr(space + 1);
+        auto existing = std::find_if(m_shards.begin(), m_shards.end(), [&](const Shard& shard)
+                                     { return shard.address == address && shard.redis; });
+        size_t active = std::count_if(m_shards.begin(), m_shards.end(), [](const Shard& shard)
+                                      { return shard.redis != nullptr; });
+
+        m_previous = m_ring;
+        if (op == "add" && !address.empty() && existing == m_shards.end())
+        {
+            size_t shard;
+            try
+            {
+                shard = Open(address);
+            }
+            catch (const std::exception& e)
+            {
+                std::cerr << "Cannot add shard " << address << ": " << e.what() << std::endl;
+                return;
+            }
+            if (m_pipelineOpened)
+            {
+                m_pipelineOpened(*m_shards[shard].pipeline);
+            }
+            m_ring.Add(address, shard);
+        }
+        else if (op == "remove" && existing != m_shards.end() && active > 1)
+        {
+            m_removed = existing - m_shards.begin();
+            m_ring.Remove(m_removed);
+        }
+        else
+        {
+            std::cerr << "Ignored shard change: " << change << std::endl;
+            return;
+        }
+
+        // 归属可能变化的键只在原有的实例上
+        m_scans.clear();
+        for (size_t s = 0; s < m_shards.size(); ++s)
+        {
+            if (m_shards[s].redis && m_shards[s].address != address)
+            {
+                for (size_t p = 0; p < m_prefixes.size(); ++p)
+                {
+                    m_scans.push_back({s, p});
+                }
+            }
+        }
+        if (op == "remove")
+        {
+            for (size_t p = 0; p < m_prefixes.size(); ++p)
+            {
+                m_scans.push_back({m_removed, p});
+            }
+        }
+        m_migrating = true;
+        m_migrated = 0;
+        m_migrateStart = std::chrono::steady_clock::now();
+        std::cout << "Shard change: " << change << ", migrating keys" << std::endl;
+    }
+
+    // 扫一批键, 归属变了的按目标实例分组搬走
+    void ScanOnce()
+    {
+        if (m_scans.empty())
+        {
+            FinishMigration();
+            return;
+        }
+        Scan& scan = m_scans.back();
+        Shard& source = m_shards[scan.shard];
+        redisReply* reply = source.redis->ExecuteArgv({"SCAN", scan.cursor, "MATCH", m_prefixes[scan.prefix] + "*",
+                                                       "COUNT", std::to_string(SHARD_MIGRATE_BATCH)});
+        if (reply->type != REDIS_REPLY_ARRAY || reply->elements != 2)
+        {
+            std::cerr << "SCAN failed on " << source.address << std::endl;
+            freeReplyObject(reply);
+            m_scans.pop_back();
+            return;
+        }
+        scan.cursor.assign(reply->element[0]->str, reply->element[0]->len);
+        std::map<size_t, std::vector<std::string>> moves;
+        for (size_t i = 0; i < reply->element[1]->elements; ++i)
+        {
+            std::string key(reply->element[1]->element[i]->str, reply->element[1]->element[i]->len);
+            size_t target = m_ring.Locate(key);
+            if (target != scan.shard)
+            {
+                moves[target].push_back(std::move(key));
+            }
+        }
+        freeReplyObject(reply);
+        for (auto& [target, keys] : moves)
+        {
+            Migrate(scan.shard, target, keys);
+        }
+        if (scan.cursor == "0")
+        {
+            m_scans.pop_back();
+        }
+    }
+
+    void FinishMigration()
+    {
+        m_migrating = false;
+        m_moved.clear();
+        if (m_removed != SIZE_MAX)
+        {
+            Shard& shard = m_shards[m_removed];
+            if (m_pipelineClosed)
+            {
+                m_pipelineClosed(*shard.pipeline);
+            }
+            shard.pipeline.reset();
+            shard.redis.reset();
+            m_removed = SIZE_MAX;
+        }
+        auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - m_migrateStart).count();
+        std::cout << "Shard migration finished: " << m_migrated << " keys moved in " << ms << " ms" << std::endl;
+    }
+
+    // 有事要做时每隔 SHARD_MIGRATE_TICK_MS 可读一次, 否则停掉
+    void Arm()
+    {
+        struct itimerspec spec{};
+        if (m_migrating || !m_changes.empty())
+        {
+            spec.it_value.tv_nsec = SHARD_MIGRATE_TICK_MS * 1000000L;
+            spec.it_interval = spec.it_value;
+        }
+        timerfd_settime(m_tickFd, 0, &spec, nullptr);
+    }
+
+    std::vector<Shard> m_shards;
+    std::vector<std::string> m_prefixes;
+    HashRing m_ring;
+    HashRing m_previous; // 迁移开始前的环
+    RedisSubscriber m_control;
+    int m_tickFd = -1;
+    std::deque<std::string> m_changes;
+    std::function<void(RedisPipeline&)> m_pipelineOpened;
+    std::function<void(RedisPipeline&)> m_pipelineClosed;
+
+    bool m_migrating = false;
+    std::vector<Scan> m_scans;
+    std::unordered_set<std::string> m_moved; // 迁移期间已按需搬过的键
+    size_t m_removed = SIZE_MAX;             // 正在下线的实例
+    size_t m_migrated = 0;
+    std::chrono::steady_clock::time_point m_migrateStart;
+};
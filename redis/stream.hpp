@@ -0,0 +1,131 @@
+#pragma once
+#include "redis.hpp"
+
+// 以消费组方式阻塞读取一个流的专用连接
+// XREADGROUP ... BLOCK 0 只发出请求不等待, fd 交给调用方的 epoll, 回复到达后在 OnReadable 中解析,
+// 处理完一批再发下一个请求; 启动时先读出本消费者之前已领取但未确认的记录
+class RedisStreamReader
+{
+public:
+    RedisStreamReader(const std::string& key, const std::string& group, const std::string& consumer,
+                      int count = 512, const std::string& host = "127.0.0.1", int port = 6379)
+        : m_key(key), m_group(group), m_consumer(consumer), m_count(count),
+          m_connection(redisConnect(host.c_str(), port), &redisFree)
+    {
+        if (!m_connection || m_connection->err)
+        {
+            throw std::runtime_error("Failed to connect to Redis: " +
+                                     std::string(m_connection ? m_connection->errstr : "can't allocate redis context"));
+        }
+
+        // 启动阶段还是同步连接, 顺便把消费组建好
+        auto reply = (redisReply*)redisCommand(m_connection.get(), "XGROUP CREATE %s %s $ MKSTREAM",
+                                               m_key.c_str(), m_group.c_str());
+        if (!reply)
+        {
+            throw std::runtime_error("Redis command failed.");
+        }
+        bool ok = reply->type != REDIS_REPLY_ERROR || std::strncmp(reply->str, "BUSYGROUP", 9) == 0;
+        freeReplyObject(reply);
+        if (!ok)
+        {
+            throw std::runtime_error("Failed to create consumer group " + m_group + " on " + m_key);
+        }
+
+        Request();
+    }
+
+    int Fd() const { return m_connection->fd; }
+    const std::string& Key() const { return m_key; }
+    const std::string& Group() const { return m_group; }
+
+    // 回复到达时对每批记录回调 onEntries(entries), 回调返回后才发下一个读请求
+    // 连接出错时返回 -1
+    template <typename F>
+    int OnReadable(F&& onEntries)
+    {
+        if (redisBufferRead(m_connection.get()) == REDIS_ERR)
+        {
+            std::cerr << "Redis stream reader error: " << m_connection->errstr << std::endl;
+            return -1;
+        }
+
+        int count = 0;
+        void* raw = nullptr;
+        while (redisReaderGetReply(m_connection->reader, &raw) == REDIS_OK && raw)
+        {
+            redisReply* reply = static_cast<redisReply*>(raw);
+            std::vector<StreamEntry> entries;
+            // 回复格式: [[key, [[id, [field, value, ...]], ...]]]
+            if (reply->type == REDIS_REPLY_ARRAY && reply->elements > 0 &&
+                reply->element[0]->type == REDIS_REPLY_ARRAY && reply->element[0]->elements == 2)
+            {
+                entries = RedisAsyncContext::ParseStreamEntries(reply->element[0]->element[1]);
+            }
+            else if (reply->type == REDIS_REPLY_ERROR)
+            {
+                std::cerr << "XREADGROUP failed: " << reply->str << std::endl;
+            }
+            freeReplyObject(reply);
+            raw = nullptr;
+
+            if (m_backlog)
+            {
+                if (entries.empty())
+                {
+                    m_backlog = false; // 积压处理完, 开始读新记录
+                }
+                else
+                {
+                    m_backlogId = entries.back().id;
+                }
+            }
+            if (!entries.empty())
+            {
+                onEntries(entries);
+                count += entries.size();
+            }
+            Request();
+        }
+        return count;
+    }
+
+private:
+    void Request()
+    {
+        // 积压阶段读的是本消费者的待确认列表, 不会阻塞
+        std::vector<std::string> args = {"XREADGROUP", "GROUP", m_group, m_consumer,
+                                         "COUNT", std::to_string(m_count)};
+        if (!m_backlog)
+        {
+            args.insert(args.end(), {"BLOCK", "0"});
+        }
+        args.insert(args.end(), {"STREAMS", m_key, m_backlog ? m_backlogId : ">"});
+
+        std::vector<const char*> argv(args.size());
+        std::vector<size_t> argvlen(args.size());
+        for (size_t i = 0; i < args.size(); ++i)
+        {
+            argv[i] = args[i].data();
+            argvlen[i] = args[i].size();
+        }
+        redisAppendCommandArgv(m_connection.get(), argv.size(), argv.data(), argvlen.data());
+
+        int done = 0;
+        while (!done)
+        {
+            if (redisBufferWrite(m_connection.get(), &done) == REDIS_ERR)
+            {
+                throw std::runtime_error("Redis stream request failed: " + std::string(m_connection->errstr));
+            }
+        }
+    }
+
+    std::string m_key;
+    std::string m_group;
+    std::string m_consumer;
+    int m_count;
+    bool m_backlog = true;         // 是否还在处理崩溃前未确认的记录
+    std::string m_backlogId = "0"; // 积压记录的读取位置
+    std::unique_ptr<redisContext, decltype(&redisFree)> m_connection;
+};
@@ -0,0 +1,47 @@
+#pragma once
+#include "../include/headFile.hpp"
+
+// 节点之间和进程之间传递的二进制记录
+// 每个字段是 4 字节网络序长度加内容, 字段按约定的顺序依次排列
+class Msg
+{
+public:
+    static void putField(std::string &out, std::string_view field)
+    {
+        uint32_t len = htonl(static_cast<uint32_t>(field.size()));
+        out.append(reinterpret_cast<const char *>(&len), sizeof(len));
+        out.append(field.data(), field.size());
+    }
+
+    static void putU32(std::string &out, uint32_t value)
+    {
+        value = htonl(value);
+        out.append(reinterpret_cast<const char *>(&value), sizeof(value));
+    }
+
+    // 取出一个字段并从 in 中移除, 数据不完整时返回 false
+    static bool getField(std::string_view &in, std::string_view &field)
+    {
+        std::string_view rest = in;
+        uint32_t len = 0;
+        if (!getU32(rest, len) || rest.size() < len)
+        {
+            return false;
+        }
+        field = rest.substr(0, len);
+        in = rest.substr(len);
+        return true;
+    }
+
+    static bool getU32(std::string_view &in, uint32_t &value)
+    {
+        if (in.size() < sizeof(value))
+        {
+            return false;
+        }
+        std::memcpy(&value, in.data(), sizeof(value));
+        value = ntohl(value);
+        in.remove_prefix(sizeof(value));
+        return true;
+    }
+};
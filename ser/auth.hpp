@@ -0,0 +1,147 @@
+#pragma once
+#include "../include/headFile.hpp"
+#include "thread.hpp"
+
+#define AUTH_THREADS 4
+#define AUTH_MAX_PENDING 1024 // 排队和执行中的任务上限, 超过后直接回复繁忙
+#define AUTH_CODE_TTL 300     // 验证码有效期, 秒
+#define AUTH_CODE_PREFIX "code:"
+#define AUTH_CODE_ATTEMPTS 3  // 注册对话里验证码最多输错的次数
+
+// 鉴权相关的慢操作 (密码哈希, 校验, 发邮件) 放到独立的线程池里执行, 不占用事件循环
+// 工作线程执行完后返回一个回调, 经 eventfd 交回事件循环线程执行, 回调里才能访问连接和 Redis
+class AuthService
+{
+public:
+    using Completion = std::function<void()>;
+
+    explicit AuthService(int threads = AUTH_THREADS, size_t maxPending = AUTH_MAX_PENDING)
+        : m_workers(threads), m_maxPending(maxPending)
+    {
+        m_eventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (m_eventFd == -1)
+        {
+            throw std::runtime_error("eventfd: " + std::string(strerror(errno)));
+        }
+        m_workers.init();
+    }
+
+    ~AuthService()
+    {
+        m_workers.shutdown();
+        close(m_eventFd);
+    }
+
+    AuthService(const AuthService &other) = delete;
+    AuthService &operator=(const AuthService &other) = delete;
+
+    // 有完成的任务时可读, 由事件循环监听
+    int fd() const { return m_eventFd; }
+
+    // 只在事件循环线程调用; 积压已满时返回 false, 调用方应立即回复繁忙
+    bool submit(std::function<Completion()> work)
+    {
+        if (m_pending >= m_maxPending)
+        {
+            return false;
+        }
+        ++m_pending;
+        m_workers.submit([this, work = std::move(work)]()
+                         {
+                             Completion done;
+                             try
+                             {
+                                 done = work();
+                             }
+                             catch (const std::exception &e)
+                             {
+                                 std::cerr << "Auth task failed: " << e.what() << std::endl;
+                             }
+                             {
+                                 std::unique_lock<std::mutex> lock(m_mutex);
+                                 m_done.push_back(std::move(done));
+                             }
+                             uint64_t one = 1;
+                             write(m_eventFd, &one, sizeof(one)); });
+        return true;
+    }
+
+    // 在事件循环线程执行所有已完成任务的回调
+    void drain()
+    {
+        uint64_t value;
+        read(m_eventFd, &value, sizeof(value));
+        std::vector<Completion> done;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            done.swap(m_done);
+        }
+        for (Completion &fn : done)
+        {
+            --m_pending;
+            if (fn)
+            {
+                fn();
+            }
+        }
+    }
+
+    size_t pending() const { return m_pending; }
+
+    // 加盐的慢哈希, 用 libcrypt 的默认算法 (yescrypt), 结果里带着算法和盐
+    static std::string hashPassword(const std::string &password)
+    {
+        char setting[CRYPT_GENSALT_OUTPUT_SIZE];
+        if (!crypt_gensalt_rn(nullptr, 0, nullptr, 0, setting, sizeof(setting)))
+        {
+            throw std::runtime_error("crypt_gensalt: " + std::string(strerror(errno)));
+        }
+        auto data = std::make_unique<struct crypt_data>();
+        const char *hash = crypt_r(password.c_str(), setting, data.get());
+        if (!hash || hash[0] == '*')
+        {
+            throw std::runtime_error("crypt failed");
+        }
+        return hash;
+    }
+
+    static bool verifyPassword(const std::string &password, const std::string &stored)
+    {
+        if (stored.empty() || stored[0] != '$')
+        {
+            return false;
+        }
+        auto data = std::make_unique<struct crypt_data>();
+        const char *hash = crypt_r(password.c_str(), stored.c_str(), data.get());
+        if (!hash || std::strlen(hash) != stored.size())
+        {
+            return false;
+        }
+        // 逐字节比较完, 不因提前返回泄露匹配长度
+        unsigned char diff = 0;
+        for (size_t i = 0; i < stored.size(); ++i)
+        {
+            diff |= static_cast<unsigned char>(hash[i] ^ stored[i]);
+        }
+        return diff == 0;
+    }
+
+    // 六位数字验证码, 取自内核随机数
+    static std::string makeCode()
+    {
+        uint32_t value = 0;
+        if (getrandom(&value, sizeof(value), 0) != sizeof(value))
+        {
+            throw std::runtime_error("getrandom: " + std::string(strerror(errno)));
+        }
+        return std::to_string(100000 + value % 900000);
+    }
+
+private:
+    ThreadPool m_workers;
+    size_t m_maxPending;
+    size_t m_pending = 0; // 只由事件循环线程访问
+    int m_eventFd = -1;
+    std::mutex m_mutex; // 保护 m_done
+    std::vector<Completion> m_done;
+};
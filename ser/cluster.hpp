@@ -0,0 +1,460 @@
+#pragma once
+#include "../include/headFile.hpp"
+#include "../redis/redis.hpp"
+#include "../redis/pubsub.hpp"
+#include "../redis/stream.hpp"
+#include "Msg.hpp"
+
+#define CLUSTER_ONLINE_KEY "online"      // 哈希表: 用户 ID -> 所在节点
+#define CLUSTER_NODE_USERS "online:"     // 每个节点一个哈希, 记着登记在这个节点的用户
+#define CLUSTER_NODES_KEY "cluster:nodes" // 登记过用户的节点集合
+#define CLUSTER_ALIVE_PREFIX "cluster:alive:" // 节点的存活租约
+#define CLUSTER_ALIVE_TTL 15             // 租约有效期 (秒), 节点崩溃后最多这么久它的用户就被清掉
+#define CLUSTER_ALIVE_RENEW 5            // 续约间隔 (秒), 续约时顺便清理租约已过期的节点
+#define CLUSTER_CHANNEL_PREFIX "node:"   // 每个节点订阅自己的频道
+#define CLUSTER_ROUTE_TTL_MS 1000        // 路由缓存的有效期
+#define CLUSTER_BATCH_LIMIT (256 * 1024) // 单个批次超过这个大小就立即发布
+#define CLUSTER_STREAM_PREFIX "stream:node:" // 可靠模式下每个节点的投递流
+#define CLUSTER_STREAM_GROUP "delivery"
+#define CLUSTER_STREAM_MAXLEN 100000
+#define CLUSTER_RETRY_MS 5000            // 可靠模式下未确认的记录闲置这么久后重新认领投递
+#define CLUSTER_RETRY_COUNT 256          // 每次认领的记录数
+#define CLUSTER_PRESENCE_CHANNEL "presence" // 所有节点共用的上下线广播频道
+
+// 多节点部署时的跨节点投递
+// 每个节点在 Redis 中登记自己的在线用户, 发往其他节点的消息按目标节点攒成批次,
+// 一轮事件处理结束后每个节点只 PUBLISH 一次; 订阅连接的 fd 挂在本节点的 epoll 上
+// durable 模式下批次改为写入目标节点的 Redis 流, 目标节点用消费组读取, 投递后批量 XACK,
+// 节点崩溃后重启会先重放未确认的批次, 实现至少一次投递
+// 接收方已经不在本节点的消息重新查路由: 换了节点的转过去, 确认推迟到转发写进流之后, 转发失败就不确认;
+// 已经下线的照常确认 (发送方已写入会话记录); 路由仍指向本节点却找不到连接的整条记录留着不确认
+// 没确认的记录由 retryFd() 定时用 XAUTOCLAIM 认领回来重新投递, 不用等进程重启
+// 用户登记挂在节点的存活租约上: 每个节点定时续约, 续约时把租约已过期 (崩溃) 的节点的登记清掉并广播这些用户下线,
+// 崩溃的节点上的用户不会一直被当成在线、消息也不会一直发往不存在的节点
+class Cluster
+{
+public:
+    // resume 为 true 表示从同一节点的旧进程接管, 旧进程的登记由接管来的连接沿用; 否则先清掉这个节点上次留下的登记
+    Cluster(const std::string &nodeId, RedisAsyncContext &redis, bool durable = false, bool resume = false)
+        : m_nodeId(nodeId), m_redis(redis), m_durable(durable)
+    {
+        loadScripts();
+        if (!resume)
+        {
+            m_swept = sweep(m_nodeId); // 第一次续约时再广播下线, 那时事件循环已经在跑
+        }
+        renewAlive();
+        m_aliveFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        if (m_aliveFd == -1)
+        {
+            throw std::runtime_error("timerfd_create: " + std::string(strerror(errno)));
+        }
+        struct itimerspec alive{};
+        alive.it_value.tv_sec = CLUSTER_ALIVE_RENEW;
+        alive.it_interval = alive.it_value;
+        timerfd_settime(m_aliveFd, 0, &alive, nullptr);
+        if (m_durable)
+        {
+            m_reader = std::make_unique<RedisStreamReader>(CLUSTER_STREAM_PREFIX + m_nodeId, CLUSTER_STREAM_GROUP, m_nodeId);
+            m_retryFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+            if (m_retryFd == -1)
+            {
+                throw std::runtime_error("timerfd_create: " + std::string(strerror(errno)));
+            }
+            struct itimerspec spec{};
+            spec.it_value.tv_sec = CLUSTER_RETRY_MS / 1000;
+            spec.it_value.tv_nsec = (CLUSTER_RETRY_MS % 1000) * 1000000L;
+            spec.it_interval = spec.it_value;
+            timerfd_settime(m_retryFd, 0, &spec, nullptr);
+        }
+        else
+        {
+            m_subscriber = std::make_unique<RedisSubscriber>();
+            m_subscriber->Subscribe(CLUSTER_CHANNEL_PREFIX + m_nodeId);
+        }
+        // 上下线状态是瞬时的, 两种模式都走发布订阅, 用单独的连接
+        m_presence = std::make_unique<RedisSubscriber>();
+        m_presence->Subscribe(CLUSTER_PRESENCE_CHANNEL);
+    }
+
+    ~Cluster()
+    {
+        close(m_aliveFd);
+        if (m_retryFd != -1)
+        {
+            close(m_retryFd);
+        }
+    }
+
+    Cluster(const Cluster &other) = delete;
+    Cluster &operator=(const Cluster &other) = delete;
+
+    const std::string &nodeId() const { return m_nodeId; }
+    int fd() const { return m_durable ? m_reader->Fd() : m_subscriber->Fd(); }
+    int retryFd() const { return m_retryFd; } // 只在可靠模式下有效, 否则为 -1
+    int aliveFd() const { return m_aliveFd; }
+
+    // 续约定时器到期: 续上本节点的租约, 清理租约已过期的节点, 对被清掉的每个用户回调 offline(user)
+    // 本节点的租约曾经过期 (比如和 Redis 断开太久) 时返回 true, 本节点的登记可能已被别的节点清掉, 调用方要重新登记
+    template <typename F>
+    bool onAliveTimer(F &&offline)
+    {
+        uint64_t expirations;
+        read(m_aliveFd, &expirations, sizeof(expirations));
+        bool lapsed = renewAlive() == 1;
+        std::vector<std::string> users = sweep("");
+        users.insert(users.end(), m_swept.begin(), m_swept.end());
+        m_swept.clear();
+        for (const std::string &user : users)
+        {
+            m_routes.erase(user);
+            offline(user);
+        }
+        return lapsed;
+    }
+    int presenceFd() const { return m_presence->Fd(); }
+
+    void registerUser(const std::string &user)
+    {
+        eval(REGISTER_SCRIPT, m_registerSha, {CLUSTER_ONLINE_KEY, CLUSTER_NODE_USERS + m_nodeId, CLUSTER_NODES_KEY},
+             {user, m_nodeId});
+    }
+
+    void unregisterUser(const std::string &user)
+    {
+        // 用户可能已经在别的节点重新登录, 只删除仍指向本节点的登记; 比较和删除在脚本里一步完成
+        eval(UNREGISTER_SCRIPT, m_unregisterSha, {CLUSTER_ONLINE_KEY, CLUSTER_NODE_USERS + m_nodeId}, {user, m_nodeId});
+        m_routes.erase(user);
+    }
+
+    // 查询用户所在节点, 不在线返回空串
+    // 结果缓存一小段时间, 避免每条消息都去 Redis 查一次
+    std::string locate(const std::string &user)
+    {
+        auto now = std::chrono::steady_clock::now();
+        auto it = m_routes.find(user);
+        if (it != m_routes.end() && it->second.expire > now)
+        {
+            return it->second.node;
+        }
+        std::string node = m_redis.HashGet(CLUSTER_ONLINE_KEY, user);
+        m_routes[user] = {node, now + std::chrono::milliseconds(CLUSTER_ROUTE_TTL_MS)};
+        return node;
+    }
+
+    void forget(const std::string &user)
+    {
+        m_routes.erase(user);
+    }
+
+    // 把一条消息放进发往 node 的批次, 四个字段依次按 Msg::putField 编码, seq 是会话内的序号
+    void forward(const std::string &node, std::string_view from, std::string_view to, std::string_view text, uint64_t seq)
+    {
+        std::string &batch = m_batches[node];
+        Msg::putField(batch, from);
+        Msg::putField(batch, to);
+        Msg::putField(batch, text);
+        Msg::putField(batch, std::to_string(seq));
+        if (batch.size() >= CLUSTER_BATCH_LIMIT)
+        {
+            publish(node, batch);
+        }
+    }
+
+    // 发布所有攒下的批次, 每轮 epoll 结束时调用一次
+    void flush()
+    {
+        if (m_durable)
+        {
+            // 所有目标节点的批次一次流水线写完
+            m_appends.clear();
+            m_appendNodes.clear();
+            for (auto &[node, batch] : m_batches)
+            {
+                if (!batch.empty())
+                {
+                    m_appends.push_back({CLUSTER_STREAM_PREFIX + node, CLUSTER_STREAM_MAXLEN, {{"batch", batch}}});
+                    m_appendNodes.push_back(&node);
+                    batch.clear();
+                }
+            }
+            if (!m_appends.empty())
+            {
+                std::vector<std::string> ids = m_redis.XAddBatch(m_appends);
+                for (size_t i = 0; i < m_appendNodes.size(); ++i)
+                {
+                    if (i >= ids.size() || ids[i].empty())
+                    {
+                        m_lostNodes.insert(*m_appendNodes[i]);
+                    }
+                }
+            }
+            // 重新转发的消息已经写进别的节点的流, 这时才确认原来的记录; 转发没写成功的留着等下次认领
+            m_ackIds.clear();
+            for (auto &ack : m_acks)
+            {
+                if (std::none_of(ack.nodes.begin(), ack.nodes.end(), [this](const std::string &node)
+                                 { return m_lostNodes.count(node) != 0; }))
+                {
+                    m_ackIds.push_back(std::move(ack.id));
+                }
+            }
+            m_redis.XAck(m_reader->Key(), m_reader->Group(), m_ackIds);
+            m_acks.clear();
+            m_lostNodes.clear();
+            return;
+        }
+        for (auto &[node, batch] : m_batches)
+        {
+            if (!batch.empty())
+            {
+                publish(node, batch);
+            }
+        }
+    }
+
+    // 订阅连接可读, 对批次中的每条消息回调 deliver(from, to, text, seq), 接收方不在本节点时 deliver 返回 false
+    // 连接出错时返回 -1
+    template <typename F>
+    int onReadable(F &&deliver)
+    {
+        if (!m_durable)
+        {
+            return m_subscriber->OnReadable([&](std::string_view, std::string_view batch)
+                                            { decode(batch, deliver, nullptr); });
+        }
+        return m_reader->OnReadable([&](std::vector<StreamEntry> &entries)
+                                    { consume(entries, deliver); });
+    }
+
+    // 重试定时器到期: 认领本节点闲置超过 CLUSTER_RETRY_MS 的未确认记录, 和新读到的记录一样处理
+    template <typename F>
+    void retry(F &&deliver)
+    {
+        uint64_t expirations;
+        while (read(m_retryFd, &expirations, sizeof(expirations)) > 0)
+        {
+        }
+        std::string cursor = "0-0";
+        do
+        {
+            std::vector<StreamEntry> entries = m_redis.XAutoClaim(m_reader->Key(), m_reader->Group(), m_nodeId,
+                                                                  CLUSTER_RETRY_MS, cursor, CLUSTER_RETRY_COUNT);
+            consume(entries, deliver);
+        } while (!cursor.empty() && cursor != "0-0");
+    }
+
+    // 广播本节点一个窗口内的上下线变化, batch 是 (用户, "1"/"0") 字段对, 前面加上本节点 ID
+    void publishPresence(std::string_view batch)
+    {
+        m_presenceBatch.clear();
+        Msg::putField(m_presenceBatch, m_nodeId);
+        m_presenceBatch.append(batch);
+        m_redis.Publish(CLUSTER_PRESENCE_CHANNEL, m_presenceBatch);
+    }
+
+    // 上下线频道可读, 对其他节点的每个变化回调 apply(user, online), 自己发的跳过
+    // 连接出错时返回 -1
+    template <typename F>
+    int onPresence(F &&apply)
+    {
+        return m_presence->OnReadable([&](std::string_view, std::string_view batch)
+                                      {
+                                          std::string_view origin, user, state;
+                                          if (!Msg::getField(batch, origin) || origin == m_nodeId)
+                                          {
+                                              return;
+                                          }
+                                          while (Msg::getField(batch, user) && Msg::getField(batch, state))
+                                          {
+                                              apply(user, state == "1");
+                                          } });
+    }
+
+private:
+    // 等 flush 时确认的记录, nodes 是记录里的消息重新转发去的节点
+    struct PendingAck
+    {
+        std::string id;
+        std::vector<std::string> nodes;
+    };
+
+    // 解出批次里的每条消息交给 deliver; 可靠模式下投递失败的重新查路由, 转走的节点记进 forwarded
+    // 返回 false 表示有消息既没投递也没转走, 这条记录不能确认
+    template <typename F>
+    bool decode(std::string_view batch, F &deliver, std::vector<std::string> *forwarded)
+    {
+        bool done = true;
+        std::string_view from, to, text, seq;
+        while (Msg::getField(batch, from) && Msg::getField(batch, to) && Msg::getField(batch, text) &&
+               Msg::getField(batch, seq))
+        {
+            uint64_t n = std::strtoull(std::string(seq).c_str(), nullptr, 10);
+            if (deliver(from, to, text, n) || !forwarded)
+            {
+                continue;
+            }
+            std::string target(to);
+            forget(target);
+            std::string node = locate(target);
+            if (node == m_nodeId)
+            {
+                done = false; // 登记还在本节点, 可能正在上下线, 留给重试
+            }
+            else if (!node.empty())
+            {
+                forward(node, from, to, text, n);
+                if (std::find(forwarded->begin(), forwarded->end(), node) == forwarded->end())
+                {
+                    forwarded->push_back(node);
+                }
+            }
+        }
+        return done;
+    }
+
+    // 处理完的记录攒到 flush 里确认, 排在重新转发的批次之后
+    template <typename F>
+    void consume(std::vector<StreamEntry> &entries, F &deliver)
+    {
+        for (auto &entry : entries)
+        {
+            PendingAck ack;
+            bool done = true;
+            for (auto &[field, value] : entry.fields)
+            {
+                if (field == "batch")
+                {
+                    done &= decode(value, deliver, &ack.nodes);
+                }
+            }
+            if (done)
+            {
+                ack.id = std::move(entry.id);
+                m_acks.push_back(std::move(ack));
+            }
+        }
+    }
+
+    // 登记用户: 全局索引和本节点的哈希一起写, 顺带把本节点放进节点集合
+    static constexpr const char *REGISTER_SCRIPT =
+        "redis.call('HSET', KEYS[1], ARGV[1], ARGV[2]) "
+        "redis.call('HSET', KEYS[2], ARGV[1], '1') "
+        "redis.call('SADD', KEYS[3], ARGV[2]) "
+        "return 1";
+    // 全局索引只在仍指向本节点时删除, 本节点的哈希总是删除
+    static constexpr const char *UNREGISTER_SCRIPT =
+        "redis.call('HDEL', KEYS[2], ARGV[1]) "
+        "if redis.call('HGET', KEYS[1], ARGV[1]) == ARGV[2] then "
+        "  return redis.call('HDEL', KEYS[1], ARGV[1]) "
+        "end "
+        "return 0";
+    // 续约; 租约原来不存在 (已过期) 时返回 1
+    static constexpr const char *ALIVE_SCRIPT =
+        "if redis.call('SET', KEYS[1], '1', 'EX', ARGV[1], 'NX') then return 1 end "
+        "redis.call('EXPIRE', KEYS[1], ARGV[1]) "
+        "return 0";
+    // 清掉 ARGV[3] 指定的节点 (可以为空) 和所有租约已过期的节点的登记, 返回被清掉的用户
+    // 用户已经换到别的节点登记的不动
+    static constexpr const char *SWEEP_SCRIPT =
+        "local removed = {} "
+        "local function drop(node) "
+        "  for _, user in ipairs(redis.call('HKEYS', ARGV[2] .. node)) do "
+        "    if redis.call('HGET', KEYS[1], user) == node then "
+        "      redis.call('HDEL', KEYS[1], user) "
+        "      removed[#removed + 1] = user "
+        "    end "
+        "  end "
+        "  redis.call('DEL', ARGV[2] .. node) "
+        "end "
+        "if ARGV[3] ~= '' then drop(ARGV[3]) end "
+        "for _, node in ipairs(redis.call('SMEMBERS', KEYS[2])) do "
+        "  if node ~= ARGV[3] and redis.call('EXISTS', ARGV[1] .. node) == 0 then "
+        "    drop(node) "
+        "    redis.call('SREM', KEYS[2], node) "
+        "  end "
+        "end "
+        "return removed";
+
+    void loadScripts()
+    {
+        m_registerSha = m_redis.ScriptLoad(REGISTER_SCRIPT);
+        m_unregisterSha = m_redis.ScriptLoad(UNREGISTER_SCRIPT);
+        m_aliveSha = m_redis.ScriptLoad(ALIVE_SCRIPT);
+        m_sweepSha = m_redis.ScriptLoad(SWEEP_SCRIPT);
+    }
+
+    // Redis 重启后脚本缓存会丢, 出错时重新加载再试一次
+    long long eval(const char *script, std::string &sha, const std::vector<std::string> &keys,
+                   const std::vector<std::string> &args)
+    {
+        long long result = m_redis.EvalSha(sha, keys, args);
+        if (result == -1)
+        {
+            sha = m_redis.ScriptLoad(script);
+            result = m_redis.EvalSha(sha, keys, args);
+        }
+        return result;
+    }
+
+    long long renewAlive()
+    {
+        return eval(ALIVE_SCRIPT, m_aliveSha, {CLUSTER_ALIVE_PREFIX + m_nodeId}, {std::to_string(CLUSTER_ALIVE_TTL)});
+    }
+
+    std::vector<std::string> sweep(const std::string &node)
+    {
+        std::vector<std::string> keys = {CLUSTER_ONLINE_KEY, CLUSTER_NODES_KEY};
+        std::vector<std::string> args = {CLUSTER_ALIVE_PREFIX, CLUSTER_NODE_USERS, node};
+        std::vector<std::string> removed;
+        if (!m_redis.EvalShaList(m_sweepSha, keys, args, removed))
+        {
+            m_sweepSha = m_redis.ScriptLoad(SWEEP_SCRIPT);
+            m_redis.EvalShaList(m_sweepSha, keys, args, removed);
+        }
+        return removed;
+    }
+
+    void publish(const std::string &node, std::string &batch)
+    {
+        if (m_durable)
+        {
+            if (m_redis.XAdd(CLUSTER_STREAM_PREFIX + node, CLUSTER_STREAM_MAXLEN, {{"batch", batch}}).empty())
+            {
+                m_lostNodes.insert(node);
+            }
+            batch.clear();
+            return;
+        }
+        m_redis.Publish(CLUSTER_CHANNEL_PREFIX + node, batch);
+        batch.clear(); // 保留容量, 下一轮复用
+    }
+
+    struct Route
+    {
+        std::string node;
+        std::chrono::steady_clock::time_point expire;
+    };
+
+    std::string m_nodeId;
+    RedisAsyncContext &m_redis;
+    bool m_durable;
+    std::unique_ptr<RedisSubscriber> m_subscriber;  // 发布订阅模式
+    std::unique_ptr<RedisStreamReader> m_reader;    // 可靠模式
+    std::unique_ptr<RedisSubscriber> m_presence;    // 上下线广播
+    std::string m_presenceBatch;
+    std::vector<StreamAppend> m_appends;
+    std::vector<const std::string *> m_appendNodes;  // m_appends 每一项的目标节点
+    std::vector<PendingAck> m_acks;                  // 可靠模式下已处理完、等 flush 时确认的记录
+    std::vector<std::string> m_ackIds;
+    std::unordered_set<std::string> m_lostNodes;     // 这一轮写流失败的目标节点
+    int m_retryFd = -1;
+    int m_aliveFd = -1;
+    std::string m_registerSha;
+    std::string m_unregisterSha;
+    std::string m_aliveSha;
+    std::string m_sweepSha;
+    std::vector<std::string> m_swept; // 启动时清掉的本节点上次的登记, 还没广播下线
+    std::unordered_map<std::string, std::string> m_batches; // 目标节点 -> 编码后的批次
+    std::unordered_map<std::string, Route> m_routes;        // 用户 -> 所在节点的缓存
+};
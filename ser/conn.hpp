@@ -0,0 +1,31 @@
+#pragma once
+#include "../include/headFile.hpp"
+#include "../Cli_Ser_Connection/Codec.hpp"
+#include "../Cli_Ser_Connection/Tls.hpp"
+#include "lanes.hpp"
+#include "pool.hpp"
+#include "ratelimit.hpp"
+
+// 单条连接的状态, 存放在 FdSlab 中以 fd 为下标
+// 缓冲区只在有残留数据时才向 BufferPool 借用
+struct Conn
+{
+    int fd = -1;
+    uint32_t events = 0; // 当前注册到 epoll 的事件
+    PoolBuf in;          // 未凑齐一帧的输入
+    PoolBuf out;         // 正在写的输出, 最多一批 (LANE_BATCH), 写完再从通道里取
+    OutLanes lanes;      // 排队的帧, 按通道分开
+    std::string user;    // 登录后的用户 ID
+    uint64_t serial = 0; // 连接序号, fd 被复用后据此判断异步结果是否还属于这条连接
+    TokenBucket msgRate;    // 帧数限流
+    TokenBucket byteRate;   // 字节数限流
+    TokenBucket costlyRate; // 昂贵命令限流
+    uint32_t userLease = 0; // 集群模式下从全局桶预取的剩余令牌
+    FrameCodecId codec = FrameCodecId::None; // 握手时协商的压缩编码
+    bool receipts = false;                   // 握手时声明支持回执, 收到的消息带序号
+    bool lanesOn = false;                    // 握手时声明支持分段, 大帧切段发送, 各通道交错; 否则全走 Control, 保持原有顺序
+    std::unique_ptr<TlsStream> tls;          // TLS 连接; 明文连接, 以及热升级时接过来的 kTLS 连接为空
+    uint64_t traceId = 0;    // 抽中追踪的请求的回复还没写完时, 记下它的追踪号和开始排队的时间, 写完时记一段 send
+    int64_t traceSince = 0;
+    uint16_t tasks = 0; // 在途的协程任务数, 它们的状态在本进程的协程帧里, 热升级时交不出去
+};
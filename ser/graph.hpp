@@ -0,0 +1,781 @@
+#pragma once
+#include "../include/headFile.hpp"
+#include "../redis/pubsub.hpp"
+#include "../redis/shard.hpp"
+
+#define GRAPH_FRIENDS_PREFIX "friends:" // "friends:{user:<name>}" 好友集合, 双向各存一份
+#define GRAPH_BLOCKS_PREFIX "blocks:"   // "blocks:{user:<name>}" 该用户屏蔽的人
+#define GRAPH_GROUP_PREFIX "group:"     // "group:<name>" 群成员集合
+#define GRAPH_CHANNEL "graph"           // 关系变化的广播频道, 各节点据此同步内存里的图
+#define GRAPH_LOAD_BATCH 1000           // 启动加载时每批 SMEMBERS 的集合数
+#define GRAPH_DELTA_MIN 4096            // 增量边数超过这个值和基础边数的 1/8 时合并进 CSR
+#define GRAPH_SUGGEST_LIMIT 10
+#define GRAPH_SUGGEST_SCAN 10000 // 推荐好友时最多看多少条二度边
+
+// 有序 uint32 集合求交, 两个输入都必须严格递增, out 至少要有 min(na, nb) + 4 个位置
+// 长度相差悬殊时对短的一侧逐个二分查找; 否则 x86-64 上用 SSSE3 每次比较 4x4 个元素, 其他情况逐个归并
+struct SortedIntersect
+{
+    static size_t run(const uint32_t *a, size_t na, const uint32_t *b, size_t nb, uint32_t *out)
+    {
+        if (na > nb)
+        {
+            std::swap(a, b);
+            std::swap(na, nb);
+        }
+        if (na == 0)
+        {
+            return 0;
+        }
+        if (nb / na >= 32)
+        {
+            return gallop(a, na, b, nb, out);
+        }
+#if defined(__x86_64__)
+        static const bool hardware = __builtin_cpu_supports("ssse3");
+        if (hardware)
+        {
+            return ssse3(a, na, b, nb, out);
+        }
+#endif
+        return merge(a, na, b, nb, out, 0);
+    }
+
+private:
+    static size_t merge(const uint32_t *a, size_t na, const uint32_t *b, size_t nb, uint32_t *out, size_t k)
+    {
+        size_t i = 0, j = 0;
+        while (i < na && j < nb)
+        {
+            if (a[i] < b[j])
+            {
+                ++i;
+            }
+            else if (b[j] < a[i])
+            {
+                ++j;
+            }
+            else
+            {
+                out[k++] = a[i];
+                ++i;
+                ++j;
+            }
+        }
+        return k;
+    }
+
+    static size_t gallop(const uint32_t *a, size_t na, const uint32_t *b, size_t nb, uint32_t *out)
+    {
+        size_t k = 0;
+        const uint32_t *lo = b;
+        const uint32_t *end = b + nb;
+        for (size_t i = 0; i < na && lo != end; ++i)
+        {
+            lo = std::lower_bound(lo, end, a[i]);
+            if (lo != end && *lo == a[i])
+            {
+                out[k++] = a[i];
+            }
+        }
+        return k;
+    }
+
+#if defined(__x86_64__)
+    // a 的 4 个元素和 b 的 4 个元素的所有循环移位逐一比较, 命中的掩码查表得到压紧用的字节重排
+    __attribute__((target("ssse3"))) static size_t ssse3(const uint32_t *a, size_t na, const uint32_t *b, size_t nb,
+                                                         uint32_t *out)
+    {
+        static const std::array<std::array<uint8_t, 16>, 16> shuffles = makeShuffles();
+        size_t i = 0, j = 0, k = 0;
+        size_t na4 = na & ~size_t(3), nb4 = nb & ~size_t(3);
+        while (i < na4 && j < nb4)
+        {
+            __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i *>(a + i));
+            __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + j));
+            __m128i c0 = _mm_cmpeq_epi32(va, vb);
+            __m128i c1 = _mm_cmpeq_epi32(va, _mm_shuffle_epi32(vb, _MM_SHUFFLE(0, 3, 2, 1)));
+            __m128i c2 = _mm_cmpeq_epi32(va, _mm_shuffle_epi32(vb, _MM_SHUFFLE(1, 0, 3, 2)));
+            __m128i c3 = _mm_cmpeq_epi32(va, _mm_shuffle_epi32(vb, _MM_SHUFFLE(2, 1, 0, 3)));
+            __m128i hits = _mm_or_si128(_mm_or_si128(c0, c1), _mm_or_si128(c2, c3));
+            int mask = _mm_movemask_ps(_mm_castsi128_ps(hits));
+            __m128i shuffle = _mm_loadu_si128(reinterpret_cast<const __m128i *>(shuffles[mask].data()));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(out + k), _mm_shuffle_epi8(va, shuffle));
+            k += __builtin_popcount(mask);
+            uint32_t amax = a[i + 3], bmax = b[j + 3];
+            if (amax <= bmax)
+            {
+                i += 4;
+            }
+            if (bmax <= amax)
+            {
+                j += 4;
+            }
+        }
+        return merge(a + i, na - i, b + j, nb - j, out, k);
+    }
+
+    static std::array<std::array<uint8_t, 16>, 16> makeShuffles()
+    {
+        std::array<std::array<uint8_t, 16>, 16> table{};
+        for (int mask = 0; mask < 16; ++mask)
+        {
+            table[mask].fill(0x80);
+            int n = 0;
+            for (int lane = 0; lane < 4; ++lane)
+            {
+                if (mask & (1 << lane))
+                {
+                    for (int byte = 0; byte < 4; ++byte)
+                    {
+                        table[mask][n * 4 + byte] = static_cast<uint8_t>(lane * 4 + byte);
+                    }
+                    n++;
+                }
+            }
+        }
+        return table;
+    }
+#endif
+};
+
+// 一种关系的邻接表, 顶点是 SocialGraph 分配的连续编号
+// 基础部分是 CSR: m_offsets[v] 到 m_offsets[v + 1] 是 v 的邻居, 有序存放在一整块数组里, 查询不跳指针;
+// 之后的增删先记在按顶点分开的有序增量里, 增量积累到一定规模再整体合并成新的 CSR
+class Adjacency
+{
+public:
+    // 用边表一次建好, 会丢弃已有的内容
+    void build(std::vector<std::pair<uint32_t, uint32_t>> &edges)
+    {
+        std::sort(edges.begin(), edges.end());
+        edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+        uint32_t vertices = edges.empty() ? 0 : edges.back().first + 1;
+        m_offsets.assign(vertices + 1, 0);
+        m_edges.resize(edges.size());
+        for (size_t i = 0; i < edges.size(); ++i)
+        {
+            m_offsets[edges[i].first + 1]++;
+            m_edges[i] = edges[i].second;
+        }
+        for (uint32_t v = 0; v < vertices; ++v)
+        {
+            m_offsets[v + 1] += m_offsets[v];
+        }
+        m_delta.clear();
+        m_deltaEdges = 0;
+        m_count = m_edges.size();
+    }
+
+    // 边有变化时返回 true
+    bool add(uint32_t from, uint32_t to)
+    {
+        if (contains(from, to))
+        {
+            return false;
+        }
+        Delta &d = m_delta[from];
+        if (!eraseSorted(d.removed, to))
+        {
+            insertSorted(d.added, to);
+        }
+        m_count++;
+        changed();
+        return true;
+    }
+
+    bool remove(uint32_t from, uint32_t to)
+    {
+        if (!contains(from, to))
+        {
+            return false;
+        }
+        Delta &d = m_delta[from];
+        if (!eraseSorted(d.added, to))
+        {
+            insertSorted(d.removed, to);
+        }
+        m_count--;
+        changed();
+        return true;
+    }
+
+    bool contains(uint32_t from, uint32_t to) const
+    {
+        auto it = m_delta.find(from);
+        if (it != m_delta.end())
+        {
+            if (std::binary_search(it->second.added.begin(), it->second.added.end(), to))
+            {
+                return true;
+            }
+            if (std::binary_search(it->second.removed.begin(), it->second.removed.end(), to))
+            {
+                return false;
+            }
+        }
+        auto [first, count] = base(from);
+        return std::binary_search(first, first + count, to);
+    }
+
+    // v 的邻居, 有序; 没有增量时直接指向 CSR, 否则合并到 scratch 里
+    std::pair<const uint32_t *, size_t> list(uint32_t v, std::vector<uint32_t> &scratch) const
+    {
+        auto [first, count] = base(v);
+        auto it = m_delta.find(v);
+        if (it == m_delta.end())
+        {
+            return {first, count};
+        }
+        const Delta &d = it->second;
+        scratch.clear();
+        size_t r = 0, a = 0;
+        for (size_t i = 0; i < count; ++i)
+        {
+            while (a < d.added.size() && d.added[a] < first[i])
+            {
+                scratch.push_back(d.added[a++]);
+            }
+            while (r < d.removed.size() && d.removed[r] < first[i])
+            {
+                ++r;
+            }
+            if (r == d.removed.size() || d.removed[r] != first[i])
+            {
+                scratch.push_back(first[i]);
+            }
+        }
+        scratch.insert(scratch.end(), d.added.begin() + a, d.added.end());
+        return {scratch.data(), scratch.size()};
+    }
+
+    size_t edges() const { return m_count; }
+
+    // 把增量合并进 CSR
+    void compact()
+    {
+        if (m_delta.empty())
+        {
+            return;
+        }
+        std::vector<std::pair<uint32_t, uint32_t>> all;
+        all.reserve(m_count);
+        uint32_t vertices = static_cast<uint32_t>(m_offsets.empty() ? 0 : m_offsets.size() - 1);
+        for (auto &[v, d] : m_delta)
+        {
+            vertices = std::max(vertices, v + 1);
+        }
+        std::vector<uint32_t> scratch;
+        for (uint32_t v = 0; v < vertices; ++v)
+        {
+            auto [first, count] = list(v, scratch);
+            for (size_t i = 0; i < count; ++i)
+            {
+                all.emplace_back(v, first[i]);
+            }
+        }
+        build(all);
+    }
+
+private:
+    struct Delta
+    {
+        std::vector<uint32_t> added;   // 不在 CSR 里的新边
+        std::vector<uint32_t> removed; // CSR 里已删掉的边
+    };
+
+    std::pair<const uint32_t *, size_t> base(uint32_t v) const
+    {
+        if (v + 1 >= m_offsets.size())
+        {
+            return {nullptr, 0};
+        }
+        return {m_edges.data() + m_offsets[v], m_offsets[v + 1] - m_offsets[v]};
+    }
+
+    static void insertSorted(std::vector<uint32_t> &v, uint32_t x)
+    {
+        v.insert(std::lower_bound(v.begin(), v.end(), x), x);
+    }
+
+    static bool eraseSorted(std::vector<uint32_t> &v, uint32_t x)
+    {
+        auto it = std::lower_bound(v.begin(), v.end(), x);
+        if (it == v.end() || *it != x)
+        {
+            return false;
+        }
+        v.erase(it);
+        return true;
+    }
+
+    void changed()
+    {
+        m_deltaEdges++;
+        if (m_deltaEdges > GRAPH_DELTA_MIN && m_deltaEdges > m_edges.size() / 8)
+        {
+            compact();
+        }
+    }
+
+    std::vector<uint32_t> m_offsets;
+    std::vector<uint32_t> m_edges;
+    std::unordered_map<uint32_t, Delta> m_delta;
+    size_t m_deltaEdges = 0; // 上次合并以来的增删次数, 用来决定何时合并
+    size_t m_count = 0;
+};
+
+// 屏蔽关系的位图过滤器: 每对 (屏蔽者, 被屏蔽者) 在位图里置两位
+// 每条消息都要查, 绝大多数发送方没被屏蔽, 位图说没有就直接放行, 只有两位都命中时才去查邻接表
+// 位只置不清, 解除屏蔽后残留的位由下次重建清掉; 屏蔽数超过容量的 1/16 时加倍重建
+class BlockFilter
+{
+public:
+    BlockFilter() : m_bits(1 << 16) {}
+
+    void add(uint32_t blocker, uint32_t blocked)
+    {
+        uint64_t h = hash(blocker, blocked);
+        set(h);
+        set(h >> 32);
+        m_count++;
+    }
+
+    bool mayContain(uint32_t blocker, uint32_t blocked) const
+    {
+        uint64_t h = hash(blocker, blocked);
+        return test(h) && test(h >> 32);
+    }
+
+    // 屏蔽数 count 需要的容量不够, 或者残留的位太多时需要重建
+    bool needsRebuild(size_t count) const
+    {
+        return count * 16 > m_bits.size() * 64 || m_count > count * 2 + 1024;
+    }
+
+    template <typename F>
+    void rebuild(size_t count, F &&forEach)
+    {
+        size_t words = 1 << 16;
+        while (words * 64 < count * 16 * 2)
+        {
+            words *= 2;
+        }
+        m_bits.assign(words, 0);
+        m_count = 0;
+        forEach([this](uint32_t blocker, uint32_t blocked)
+                { add(blocker, blocked); });
+    }
+
+private:
+    static uint64_t hash(uint32_t a, uint32_t b)
+    {
+        uint64_t h = (static_cast<uint64_t>(a) << 32) | b;
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 33;
+        h *= 0xc4ceb9fe1a85ec53ULL;
+        h ^= h >> 33;
+        return h;
+    }
+
+    void set(uint64_t h) { m_bits[(h >> 6) & (m_bits.size() - 1)] |= 1ULL << (h & 63); }
+    bool test(uint64_t h) const { return m_bits[(h >> 6) & (m_bits.size() - 1)] & (1ULL << (h & 63)); }
+
+    std::vector<uint64_t> m_bits; // 字数是 2 的幂
+    size_t m_count = 0;           // 置位过的对数, 含已解除的
+};
+
+// 好友、屏蔽和群成员关系的内存索引
+// Redis 集合是持久化的数据, 启动时全部加载; 变化先写 Redis, 再在 GRAPH_CHANNEL 上广播, 各节点据此更新自己的索引
+// 用户名和群名各自映射到连续编号, 邻接表里只存编号
+// 每条消息的屏蔽检查是两次哈希查找加一次位图访问, 不访问 Redis
+class SocialGraph
+{
+public:
+    SocialGraph(RedisShards &shards, RedisAsyncContext &control) : m_shards(shards), m_control(control)
+    {
+        std::random_device rd;
+        m_origin = std::to_string((static_cast<uint64_t>(rd()) << 32) | rd());
+        m_subscriber.Subscribe(GRAPH_CHANNEL);
+        load();
+    }
+
+    SocialGraph(const SocialGraph &other) = delete;
+    SocialGraph &operator=(const SocialGraph &other) = delete;
+
+    // 广播频道, 可读时调用 onChange; 连接出错时返回 -1
+    int fd() const { return m_subscriber.Fd(); }
+
+    int onChange()
+    {
+        return m_subscriber.OnReadable([this](std::string_view, std::string_view message)
+                                       {
+                                           // 格式: origin op a b, 本节点发出的已经应用过
+                                           std::string_view fields[4];
+                                           for (std::string_view &field : fields)
+                                           {
+                                               size_t space = message.find(' ');
+                                               field = message.substr(0, space);
+                                               message.remove_prefix(space == std::string_view::npos ? message.size() : space + 1);
+                                           }
+                                           if (fields[0] != m_origin && !fields[3].empty())
+                                           {
+                                               apply(fields[1], fields[2], fields[3]);
+                                           } });
+    }
+
+    // 关系变化: 写 Redis, 更新本节点的索引, 再通知其他节点; 已经是这个状态时返回 false
+    // op: friend/unfriend (a 和 b 两个用户), block/unblock (a 屏蔽 b), join/leave (用户 a, 群 b)
+    bool change(std::string_view op, const std::string &a, const std::string &b)
+    {
+        if (!apply(op, a, b))
+        {
+            return false;
+        }
+        if (op == "friend" || op == "unfriend")
+        {
+            bool add = op == "friend";
+            store(add, friendsKey(a), b);
+            store(add, friendsKey(b), a);
+        }
+        else if (op == "block" || op == "unblock")
+        {
+            store(op == "block", blocksKey(a), b);
+        }
+        else
+        {
+            store(op == "join", GRAPH_GROUP_PREFIX + b, a);
+        }
+        m_control.Publish(GRAPH_CHANNEL, m_origin + " " + std::string(op) + " " + a + " " + b);
+        return true;
+    }
+
+    // blocker 屏蔽了 sender 时返回 true
+    bool blocked(std::string_view blocker, std::string_view sender) const
+    {
+        auto a = m_users.find(blocker);
+        if (a == m_users.end())
+        {
+            return false;
+        }
+        auto b = m_users.find(sender);
+        if (b == m_users.end() || !m_filter.mayContain(a->second, b->second))
+        {
+            return false;
+        }
+        return m_blocks.contains(a->second, b->second);
+    }
+
+    bool friends(std::string_view a, std::string_view b) const
+    {
+        auto x = m_users.find(a);
+        auto y = m_users.find(b);
+        return x != m_users.end() && y != m_users.end() && m_friends.contains(x->second, y->second);
+    }
+
+    std::vector<std::string> friendsOf(std::string_view user)
+    {
+        auto it = m_users.find(user);
+        return it == m_users.end() ? std::vector<std::string>() : names(m_friends, it->second, m_userNames);
+    }
+
+    std::vector<std::string> members(std::string_view group)
+    {
+        auto it = m_groups.find(group);
+        return it == m_groups.end() ? std::vector<std::string>() : names(m_members, it->second, m_userNames);
+    }
+
+    // 共同好友
+    std::vector<std::string> mutual(std::string_view a, std::string_view b)
+    {
+        auto x = m_users.find(a);
+        auto y = m_users.find(b);
+        if (x == m_users.end() || y == m_users.end())
+        {
+            return {};
+        }
+        auto [pa, na] = m_friends.list(x->second, m_scratchA);
+        auto [pb, nb] = m_friends.list(y->second, m_scratchB);
+        m_scratchOut.resize(std::min(na, nb) + 4);
+        size_t n = SortedIntersect::run(pa, na, pb, nb, m_scratchOut.data());
+        std::vector<std::string> result;
+        for (size_t i = 0; i < n; ++i)
+        {
+            result.push_back(m_userNames[m_scratchOut[i]]);
+        }
+        return result;
+    }
+
+    // 好友的好友, 按共同好友数从多到少, 排除已是好友的和任一方屏蔽了对方的
+    std::vector<std::pair<std::string, uint32_t>> suggest(std::string_view user)
+    {
+        auto it = m_users.find(user);
+        if (it == m_users.end())
+        {
+            return {};
+        }
+        uint32_t self = it->second;
+        std::vector<uint32_t> direct;
+        {
+            auto [p, n] = m_friends.list(self, m_scratchA);
+            direct.assign(p, p + n);
+        }
+        std::unordered_map<uint32_t, uint32_t> counts;
+        size_t scanned = 0;
+        for (uint32_t f : direct)
+        {
+            auto [p, n] = m_friends.list(f, m_scratchB);
+            for (size_t i = 0; i < n && scanned < GRAPH_SUGGEST_SCAN; ++i, ++scanned)
+            {
+                uint32_t candidate = p[i];
+                if (candidate != self && !std::binary_search(direct.begin(), direct.end(), candidate) &&
+                    !m_blocks.contains(self, candidate) && !m_blocks.contains(candidate, self))
+                {
+                    counts[candidate]++;
+                }
+            }
+        }
+        std::vector<std::pair<uint32_t, uint32_t>> ranked(counts.begin(), counts.end());
+        size_t keep = std::min<size_t>(ranked.size(), GRAPH_SUGGEST_LIMIT);
+        std::partial_sort(ranked.begin(), ranked.begin() + keep, ranked.end(), [this](auto &x, auto &y)
+                          { return x.second != y.second ? x.second > y.second : m_userNames[x.first] < m_userNames[y.first]; });
+        std::vector<std::pair<std::string, uint32_t>> result;
+        for (size_t i = 0; i < keep; ++i)
+        {
+            result.emplace_back(m_userNames[ranked[i].first], ranked[i].second);
+        }
+        return result;
+    }
+
+private:
+    // 支持按 string_view 查找, 查询时不构造临时字符串
+    struct NameHash
+    {
+        using is_transparent = void;
+        size_t operator()(std::string_view s) const { return std::hash<std::string_view>()(s); }
+    };
+    using NameTable = std::unordered_map<std::string, uint32_t, NameHash, std::equal_to<>>;
+
+    static std::string friendsKey(const std::string &user) { return GRAPH_FRIENDS_PREFIX "{user:" + user + "}"; }
+    static std::string blocksKey(const std::string &user) { return GRAPH_BLOCKS_PREFIX "{user:" + user + "}"; }
+
+    static uint32_t intern(NameTable &table, std::vector<std::string> &names, std::string_view name)
+    {
+        auto it = table.find(name);
+        if (it != table.end())
+        {
+            return it->second;
+        }
+        uint32_t id = static_cast<uint32_t>(names.size());
+        names.emplace_back(name);
+        table.emplace(names.back(), id);
+        return id;
+    }
+
+    static bool find(const NameTable &table, std::string_view name, uint32_t &id)
+    {
+        auto it = table.find(name);
+        if (it == table.end())
+        {
+            return false;
+        }
+        id = it->second;
+        return true;
+    }
+
+    std::vector<std::string> names(const Adjacency &adj, uint32_t v, const std::vector<std::string> &table)
+    {
+        auto [p, n] = adj.list(v, m_scratchA);
+        std::vector<std::string> result;
+        for (size_t i = 0; i < n; ++i)
+        {
+            result.push_back(table[p[i]]);
+        }
+        return result;
+    }
+
+    void store(bool add, const std::string &key, const std::string &member)
+    {
+        if (add)
+        {
+            m_shards.Insert(key, member);
+        }
+        else
+        {
+            m_shards.DeleteValue(key, member);
+        }
+    }
+
+    // 只改内存里的索引
+    // 删除关系时只查名字表, 不认识的名字本来就没有这条关系, 不为它分配编号
+    bool apply(std::string_view op, std::string_view a, std::string_view b)
+    {
+        bool remove = op == "unfriend" || op == "unblock" || op == "leave";
+        if (op == "join" || op == "leave")
+        {
+            uint32_t group, user;
+            if (remove)
+            {
+                return find(m_groups, b, group) && find(m_users, a, user) && m_members.remove(group, user);
+            }
+            group = intern(m_groups, m_groupNames, b);
+            user = intern(m_users, m_userNames, a);
+            return m_members.add(group, user);
+        }
+        uint32_t x, y;
+        if (remove)
+        {
+            if (!find(m_users, a, x) || !find(m_users, b, y))
+            {
+                return false;
+            }
+        }
+        else
+        {
+            x = intern(m_users, m_userNames, a);
+            y = intern(m_users, m_userNames, b);
+        }
+        if (x == y)
+        {
+            return false;
+        }
+        if (op == "friend")
+        {
+            return m_friends.add(x, y) | m_friends.add(y, x);
+        }
+        if (op == "unfriend")
+        {
+            return m_friends.remove(x, y) | m_friends.remove(y, x);
+        }
+        if (op == "block")
+        {
+            if (!m_blocks.add(x, y))
+            {
+                return false;
+            }
+            m_filter.add(x, y);
+            if (m_filter.needsRebuild(m_blocks.edges()))
+            {
+                rebuildFilter();
+            }
+            return true;
+        }
+        if (op == "unblock")
+        {
+            if (!m_blocks.remove(x, y))
+            {
+                return false;
+            }
+            if (m_filter.needsRebuild(m_blocks.edges()))
+            {
+                rebuildFilter();
+            }
+            return true;
+        }
+        return false;
+    }
+
+    void rebuildFilter()
+    {
+        m_blocks.compact();
+        m_filter.rebuild(m_blocks.edges(), [this](auto &&add)
+                         {
+                             std::vector<uint32_t> scratch;
+                             for (uint32_t v = 0; v < m_userNames.size(); ++v)
+                             {
+                                 auto [p, n] = m_blocks.list(v, scratch);
+                                 for (size_t i = 0; i < n; ++i)
+                                 {
+                                     add(v, p[i]);
+                                 }
+                             } });
+    }
+
+    // 从 Redis 加载全部关系, 直接建成 CSR
+    void load()
+    {
+        auto start = std::chrono::steady_clock::now();
+        std::vector<std::pair<uint32_t, uint32_t>> friendEdges, blockEdges, memberEdges;
+        size_t sets = 0;
+        loadPrefix(GRAPH_FRIENDS_PREFIX, [&](std::string_view owner, const std::vector<std::string> &members)
+                   {
+                       uint32_t x = intern(m_users, m_userNames, owner);
+                       for (const std::string &m : members)
+                       {
+                           uint32_t y = intern(m_users, m_userNames, m);
+                           if (x != y)
+                           {
+                               friendEdges.emplace_back(x, y);
+                               friendEdges.emplace_back(y, x); // 只写了一半的好友关系按双向处理
+                           }
+                       }
+                       sets++; });
+        loadPrefix(GRAPH_BLOCKS_PREFIX, [&](std::string_view owner, const std::vector<std::string> &members)
+                   {
+                       uint32_t x = intern(m_users, m_userNames, owner);
+                       for (const std::string &m : members)
+                       {
+                           blockEdges.emplace_back(x, intern(m_users, m_userNames, m));
+                       }
+                       sets++; });
+        loadPrefix(GRAPH_GROUP_PREFIX, [&](std::string_view group, const std::vector<std::string> &members)
+                   {
+                       uint32_t g = intern(m_groups, m_groupNames, group);
+                       for (const std::string &m : members)
+                       {
+                           memberEdges.emplace_back(g, intern(m_users, m_userNames, m));
+                       }
+                       sets++; });
+        m_friends.build(friendEdges);
+        m_blocks.build(blockEdges);
+        m_members.build(memberEdges);
+        rebuildFilter();
+        if (sets > 0)
+        {
+            auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+            std::cout << "Loaded social graph: " << m_userNames.size() << " users, " << m_friends.edges() / 2 << " friendships, "
+                      << m_blocks.edges() << " blocks, " << m_groupNames.size() << " groups in " << ms << " ms" << std::endl;
+        }
+    }
+
+    // 对 prefix 下的每个集合回调 f(所有者, 成员); 键里的 "{user:name}" 取出 name
+    template <typename F>
+    void loadPrefix(const std::string &prefix, F &&f)
+    {
+        m_shards.ScanKeys(prefix, [&](const std::vector<std::string> &keys)
+                          {
+                              for (size_t i = 0; i < keys.size(); i += GRAPH_LOAD_BATCH)
+                              {
+                                  std::vector<std::string> batch(keys.begin() + i, keys.begin() + std::min(keys.size(), i + GRAPH_LOAD_BATCH));
+                                  auto members = m_shards.SetMembersBatch(batch);
+                                  for (size_t j = 0; j < batch.size(); ++j)
+                                  {
+                                      std::string_view owner(batch[j]);
+                                      owner.remove_prefix(prefix.size());
+                                      if (owner.substr(0, 6) == "{user:" && owner.back() == '}')
+                                      {
+                                          owner = owner.substr(6, owner.size() - 7);
+                                      }
+                                      f(owner, members[j]);
+                                  }
+                              } });
+    }
+
+    RedisShards &m_shards;
+    RedisAsyncContext &m_control;
+    RedisSubscriber m_subscriber;
+    std::string m_origin; // 本进程发出的广播的标记
+
+    NameTable m_users;
+    std::vector<std::string> m_userNames;
+    NameTable m_groups;
+    std::vector<std::string> m_groupNames;
+
+    Adjacency m_friends; // 双向各一条边
+    Adjacency m_blocks;  // 屏蔽者 -> 被屏蔽者
+    Adjacency m_members; // 群 -> 成员
+    BlockFilter m_filter;
+
+    std::vector<uint32_t> m_scratchA, m_scratchB, m_scratchOut;
+};
@@ -0,0 +1,173 @@
+#pragma once
+#include "../include/headFile.hpp"
+#include "../Cli_Ser_Connection/Connection.hpp"
+
+#define HANDOFF_MAX_FDS 200 // 单条消息携带的 fd 数, 内核上限是 253
+#define HANDOFF_TIMEOUT_SEC 10 // 交接时旧进程写给新进程的超时
+#define HANDOFF_DRAIN_MS 3000   // 交接前最多等这么久, 让在途的协程任务结束
+#define HANDOFF_DRAIN_POLL_MS 10
+
+// 热升级时新旧进程之间的 UNIX socket 通道
+// 每条消息是 4 字节长度加内容, fd 通过 SCM_RIGHTS 附在长度头上一起发送
+class Handoff
+{
+public:
+    // 旧进程在 path 上监听升级请求, socket 文件只有本用户能读写
+    static int listenOn(const std::string &path)
+    {
+        int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd == -1)
+        {
+            perror("socket: handoff");
+            return -1;
+        }
+        struct sockaddr_un addr = makeAddr(path);
+        unlink(path.c_str());
+        // 用 umask 让 socket 文件一创建就是 0600, 避免 bind 之后再 chmod 的空档
+        mode_t mask = umask(0077);
+        int bound = bind(fd, (struct sockaddr *)&addr, sizeof(addr));
+        umask(mask);
+        if (bound == -1 || listen(fd, 1) == -1)
+        {
+            perror("bind: handoff");
+            close(fd);
+            return -1;
+        }
+        return fd;
+    }
+
+    // 新进程连接旧进程
+    static int connectTo(const std::string &path)
+    {
+        int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd == -1)
+        {
+            perror("socket: handoff");
+            return -1;
+        }
+        struct sockaddr_un addr = makeAddr(path);
+        if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1)
+        {
+            perror("connect: handoff");
+            close(fd);
+            return -1;
+        }
+        return fd;
+    }
+
+    // 发送一条消息, fds 最多 HANDOFF_MAX_FDS 个
+    static int sendMsg(int sock, std::string_view payload, const std::vector<int> &fds = {})
+    {
+        uint32_t len = htonl(static_cast<uint32_t>(payload.size()));
+        struct iovec iov[2];
+        iov[0].iov_base = &len;
+        iov[0].iov_len = sizeof(len);
+        iov[1].iov_base = const_cast<char *>(payload.data());
+        iov[1].iov_len = payload.size();
+
+        struct msghdr msg{};
+        msg.msg_iov = iov;
+        msg.msg_iovlen = 2;
+
+        std::vector<char> control;
+        if (!fds.empty())
+        {
+            control.resize(CMSG_SPACE(sizeof(int) * fds.size()));
+            msg.msg_control = control.data();
+            msg.msg_controllen = control.size();
+            struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+            cmsg->cmsg_level = SOL_SOCKET;
+            cmsg->cmsg_type = SCM_RIGHTS;
+            cmsg->cmsg_len = CMSG_LEN(sizeof(int) * fds.size());
+            std::memcpy(CMSG_DATA(cmsg), fds.data(), sizeof(int) * fds.size());
+        }
+
+        // fd 随第一段数据一起送达, 之后剩下的部分按普通数据发完
+        ssize_t sent;
+        do
+        {
+            sent = sendmsg(sock, &msg, MSG_NOSIGNAL);
+        } while (sent == -1 && errno == EINTR);
+        if (sent == -1)
+        {
+            perror("sendmsg: handoff");
+            return -1;
+        }
+
+        size_t total = sizeof(len) + payload.size();
+        if (static_cast<size_t>(sent) < total)
+        {
+            Sen s;
+            if (static_cast<size_t>(sent) < sizeof(len))
+            {
+                if (s.writen(sock, reinterpret_cast<char *>(&len) + sent, sizeof(len) - sent) == -1)
+                {
+                    return -1;
+                }
+                sent = sizeof(len);
+            }
+            size_t done = sent - sizeof(len);
+            if (s.writen(sock, payload.data() + done, payload.size() - done) == -1)
+            {
+                return -1;
+            }
+        }
+        return 0;
+    }
+
+    // 接收一条消息及其附带的 fd, 对端关闭或出错时返回 -1
+    static int recvMsg(int sock, std::string &payload, std::vector<int> &fds)
+    {
+        fds.clear();
+        uint32_t len = 0;
+        struct iovec iov;
+        iov.iov_base = &len;
+        iov.iov_len = sizeof(len);
+
+        char control[CMSG_SPACE(sizeof(int) * HANDOFF_MAX_FDS)];
+        struct msghdr msg{};
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+
+        ssize_t received;
+        do
+        {
+            received = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC | MSG_WAITALL);
+        } while (received == -1 && errno == EINTR);
+        if (received != sizeof(len))
+        {
+            return -1;
+        }
+
+        for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg))
+        {
+            if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS)
+            {
+                size_t n = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+                size_t base = fds.size();
+                fds.resize(base + n);
+                std::memcpy(fds.data() + base, CMSG_DATA(cmsg), n * sizeof(int));
+            }
+        }
+
+        len = ntohl(len);
+        payload.resize(len);
+        Rec r;
+        if (len > 0 && r.readBuf(sock, payload.data(), len) != static_cast<ssize_t>(len))
+        {
+            return -1;
+        }
+        return 0;
+    }
+
+private:
+    static struct sockaddr_un makeAddr(const std::string &path)
+    {
+        struct sockaddr_un addr{};
+        addr.sun_family = AF_UNIX;
+        std::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+        return addr;
+    }
+};
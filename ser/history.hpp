@@ -0,0 +1,121 @@
+#pragma once
+#include "../include/headFile.hpp"
+#include "../redis/shard.hpp"
+#include "snowflake.hpp"
+
+#define HISTORY_KEY_PREFIX "conv:"
+#define HISTORY_MAXLEN 10000 // 每个会话保留的大致条数
+#define HISTORY_DEDUP_SCAN 256 // 显式 ID 被拒绝时, 往后最多查这么多条找同一条消息
+
+// 存放在 Redis 流中的会话记录
+// 每个会话一个流, 记录 ID 通常就是消息的 Snowflake ID 换算成的流 ID, 按 ID 取一段历史只需一次 XRANGE
+// 消息的 Snowflake ID 同时存在 id 字段里: 别的节点时钟偏快、先写了更新的记录时, 显式 ID 会被拒绝,
+// 这条改由 Redis 分配一个更大的流 ID; 重放本地日志时同一条消息带着同样的 ID 再写一次,
+// 先按流 ID、再在其后的一小段记录里按 id 字段查找, 找到就是写过的, 不会写两次
+// 写入先攒在本轮事件循环里, 结束时一次流水线写完
+class History
+{
+public:
+    explicit History(RedisShards &redis) : m_redis(redis) {}
+
+    // 两个用户的会话共用一个流, 键与双方顺序无关
+    static std::string key(std::string_view a, std::string_view b)
+    {
+        std::string k = HISTORY_KEY_PREFIX;
+        if (b < a)
+        {
+            std::swap(a, b);
+        }
+        k.append(a).append(":").append(b);
+        return k;
+    }
+
+    // id 为 0 时由 Redis 分配 (旧版本日志里的记录没有 ID)
+    void append(uint64_t id, std::string_view from, std::string_view to, std::string_view text)
+    {
+        if (id == 0)
+        {
+            m_pending.push_back({key(from, to), HISTORY_MAXLEN, {{"from", std::string(from)}, {"text", std::string(text)}}, "*"});
+            return;
+        }
+        m_pending.push_back({key(from, to), HISTORY_MAXLEN,
+                             {{"from", std::string(from)}, {"text", std::string(text)}, {"id", std::to_string(id)}},
+                             IdGenerator::streamId(id)});
+    }
+
+    void flush()
+    {
+        if (m_pending.empty())
+        {
+            return;
+        }
+        std::vector<std::string> ids = m_redis.XAddBatch(m_pending);
+        std::vector<StreamAppend> retry;
+        for (size_t i = 0; i < ids.size(); ++i)
+        {
+            if (!ids[i].empty())
+            {
+                continue;
+            }
+            if (m_pending[i].id == "*")
+            {
+                m_failed = true;
+                continue;
+            }
+            // 显式 ID 不大于流里最大的 ID: 要么是重放时已经写过的同一条 (去重),
+            // 要么是别的节点时钟偏快先写了更新的消息, 这时改由 Redis 分配 ID, id 字段仍是 Snowflake ID
+            if (written(m_pending[i]))
+            {
+                continue;
+            }
+            retry.push_back(std::move(m_pending[i]));
+            retry.back().id = "*";
+        }
+        if (!retry.empty())
+        {
+            std::vector<std::string> retried = m_redis.XAddBatch(retry);
+            if (std::find(retried.begin(), retried.end(), std::string()) != retried.end())
+            {
+                m_failed = true;
+            }
+        }
+        m_pending.clear();
+    }
+
+    // 到目前为止的写入是否都成功了; 有一次失败后一直返回 false, 本地日志据此停止确认
+    bool intact() const { return !m_failed; }
+
+    // 从 start (含) 开始最多取 count 条, start 为 "-" 表示从头开始
+    std::vector<StreamEntry> range(std::string_view a, std::string_view b, const std::string &start, int count)
+    {
+        flush(); // 先让本轮还没写出的消息可见
+        return m_redis.XRange(key(a, b), start, "+", count);
+    }
+
+private:
+    // 这条消息是否已经在流里: 流 ID 相同, 或者在它之后的记录里有同样的 id 字段 (当初改由 Redis 分配了 ID)
+    // Redis 分配的 ID 大于当时流里最大的 ID, 只会落在显式 ID 之后不远处
+    bool written(const StreamAppend &entry)
+    {
+        const std::string &id = entry.fields.back().second;
+        for (const StreamEntry &stored : m_redis.XRange(entry.key, entry.id, "+", HISTORY_DEDUP_SCAN))
+        {
+            if (stored.id == entry.id)
+            {
+                return true;
+            }
+            for (auto &[field, value] : stored.fields)
+            {
+                if (field == "id" && value == id)
+                {
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+    RedisShards &m_redis;
+    std::vector<StreamAppend> m_pending;
+    bool m_failed = false;
+};
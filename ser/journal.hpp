@@ -0,0 +1,475 @@
+#pragma once
+#include "../include/headFile.hpp"
+#include "../Cli_Ser_Connection/Affinity.hpp"
+#include "Msg.hpp"
+
+#define JOURNAL_SEGMENT_SIZE (64 * 1024 * 1024) // 每个段文件的大小, 创建时一次分配好
+#define JOURNAL_HEADER_SIZE 4096                // 段头占一页, 记录从这之后开始
+#define JOURNAL_MAGIC "CJL1"
+
+// 本地预写日志
+// 收到的消息在写进 Redis 之前先追加到 mmap 的段文件里, 追加只是一次 memcpy 加 CRC, 不进内核;
+// 下一个段由后台线程提前建好并预先写脏每一页, 换段时事件循环只交换指针
+// 进程崩溃时映射里的数据已经在页缓存中, 不会丢; 为了挺过断电, 后台线程每轮事件循环
+// 做一次 fdatasync (组提交), 事件循环不等它
+// Redis 写入成功后推进确认位置, 确认位置记在当前段的段头里, 跟着下一次同步落盘
+// 重启时重放确认位置之后的记录; 全部记录都已确认的旧段直接删除
+// 记录格式 (本机字节序): JournalRecord 头, 然后是 Msg::putField 编码的 from, to, text 和十进制的消息 ID, 按 8 字节对齐
+// 旧记录没有消息 ID 字段, 重放时按 0 处理
+// 全零的记录头表示段的结尾, 段文件预先填零
+// CRC32C (Castagnoli), x86-64 上用 SSE4.2 的 crc32 指令一次处理 8 字节, 其他情况查表
+// zlib 的 crc32 在短记录上比 memcpy 慢一个数量级, 会成为追加的主要开销
+struct Crc32c
+{
+    static uint32_t compute(uint32_t crc, const void *data, size_t len)
+    {
+#if defined(__x86_64__)
+        static const bool hardware = __builtin_cpu_supports("sse4.2");
+        if (hardware)
+        {
+            return sse42(crc, static_cast<const uint8_t *>(data), len);
+        }
+#endif
+        static const std::array<uint32_t, 256> table = makeTable();
+        const uint8_t *p = static_cast<const uint8_t *>(data);
+        crc = ~crc;
+        for (size_t i = 0; i < len; ++i)
+        {
+            crc = table[(crc ^ p[i]) & 0xff] ^ (crc >> 8);
+        }
+        return ~crc;
+    }
+
+private:
+#if defined(__x86_64__)
+    __attribute__((target("sse4.2"))) static uint32_t sse42(uint32_t crc, const uint8_t *p, size_t len)
+    {
+        uint64_t c = ~crc;
+        for (; len >= 8; p += 8, len -= 8)
+        {
+            uint64_t word;
+            std::memcpy(&word, p, sizeof(word));
+            c = __builtin_ia32_crc32di(c, word);
+        }
+        uint32_t c32 = static_cast<uint32_t>(c);
+        for (; len > 0; ++p, --len)
+        {
+            c32 = __builtin_ia32_crc32qi(c32, *p);
+        }
+        return ~c32;
+    }
+#endif
+
+    static std::array<uint32_t, 256> makeTable()
+    {
+        std::array<uint32_t, 256> table{};
+        for (uint32_t i = 0; i < 256; ++i)
+        {
+            uint32_t c = i;
+            for (int k = 0; k < 8; ++k)
+            {
+                c = (c & 1) ? (c >> 1) ^ 0x82f63b78u : c >> 1;
+            }
+            table[i] = c;
+        }
+        return table;
+    }
+};
+
+struct JournalHeader
+{
+    char magic[4];
+    uint32_t reserved;
+    uint64_t seq;
+    uint64_t ackedLsn; // 这个编号及之前的记录都已写入 Redis
+};
+
+struct JournalRecord
+{
+    uint32_t crc;    // 覆盖 length, lsn 和负载
+    uint32_t length; // 负载长度
+    uint64_t lsn;
+};
+
+class Journal
+{
+public:
+    // 打开目录里已有的段, 记下未确认的记录供 replay 使用, 新记录总是写进新段
+    explicit Journal(const std::string &dir) : m_dir(dir)
+    {
+        std::filesystem::create_directories(m_dir);
+        recover();
+        m_syncer = std::thread([this]()
+                               { syncLoop(); });
+    }
+
+    ~Journal()
+    {
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_stopping = true;
+            m_syncRequested = true;
+        }
+        m_cond.notify_one();
+        m_syncer.join();
+        if (m_spare)
+        {
+            unlink(m_spare->path.c_str());
+        }
+    }
+
+    Journal(const Journal &other) = delete;
+    Journal &operator=(const Journal &other) = delete;
+
+    // 对每条未确认的记录回调 f(id, from, to, text), 返回条数; 之后应把它们写进 Redis 再 ack(lastLsn())
+    template <typename F>
+    size_t replay(F &&f)
+    {
+        size_t count = 0;
+        for (auto &segment : m_segments)
+        {
+            scan(*segment, [&](const JournalRecord &record, std::string_view payload)
+                 {
+                     std::string_view from, to, text, idField;
+                     if (record.lsn > m_acked && Msg::getField(payload, from) && Msg::getField(payload, to) &&
+                         Msg::getField(payload, text))
+                     {
+                         uint64_t id = 0;
+                         if (Msg::getField(payload, idField))
+                         {
+                             std::from_chars(idField.data(), idField.data() + idField.size(), id);
+                         }
+                         f(id, from, to, text);
+                         count++;
+                     } });
+        }
+        return count;
+    }
+
+    // 追加一条记录, 返回它的编号
+    uint64_t append(uint64_t id, std::string_view from, std::string_view to, std::string_view text)
+    {
+        char idBuf[20];
+        std::string_view idField(idBuf, std::to_chars(idBuf, idBuf + sizeof(idBuf), id).ptr - idBuf);
+        uint32_t length = 4 * sizeof(uint32_t) + from.size() + to.size() + text.size() + idField.size();
+        size_t need = (sizeof(JournalRecord) + length + 7) & ~size_t(7);
+        if (!m_current || m_offset + need > JOURNAL_SEGMENT_SIZE)
+        {
+            roll(need);
+        }
+
+        char *base = m_current->base + m_offset;
+        char *p = base + sizeof(JournalRecord);
+        for (std::string_view field : {from, to, text, idField})
+        {
+            uint32_t len = htonl(static_cast<uint32_t>(field.size()));
+            std::memcpy(p, &len, sizeof(len));
+            std::memcpy(p + sizeof(len), field.data(), field.size());
+            p += sizeof(len) + field.size();
+        }
+        JournalRecord record{0, length, m_nextLsn++};
+        uint32_t crc = Crc32c::compute(0, &record.length, sizeof(record.length) + sizeof(record.lsn));
+        record.crc = Crc32c::compute(crc, base + sizeof(JournalRecord), length);
+        std::memcpy(base, &record, sizeof(record));
+
+        m_offset += need;
+        m_current->lastLsn = record.lsn;
+        m_dirty = true;
+        return record.lsn;
+    }
+
+    uint64_t lastLsn() const { return m_nextLsn - 1; }
+
+    // lsn 及之前的记录已写入 Redis
+    void ack(uint64_t lsn)
+    {
+        if (lsn <= m_acked)
+        {
+            return;
+        }
+        m_acked = lsn;
+        if (m_current)
+        {
+            reinterpret_cast<JournalHeader *>(m_current->base)->ackedLsn = m_acked;
+            m_dirty = true;
+        }
+        // 除当前段外, 记录全部确认过的段不再需要
+        std::unique_lock<std::mutex> lock(m_mutex);
+        for (auto it = m_segments.begin(); it != m_segments.end();)
+        {
+            if (*it != m_current && (*it)->lastLsn <= m_acked)
+            {
+                unlink((*it)->path.c_str());
+                it = m_segments.erase(it);
+            }
+            else
+            {
+                ++it;
+            }
+        }
+    }
+
+    // 每轮事件循环结束时调用, 唤醒后台线程把这一轮的追加和确认一起落盘
+    void commit()
+    {
+        if (!m_dirty)
+        {
+            return;
+        }
+        m_dirty = false;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_syncRequested = true;
+        }
+        m_cond.notify_one();
+    }
+
+private:
+    struct Segment
+    {
+        std::string path;
+        int fd = -1;
+        char *base = nullptr;
+        uint64_t seq = 0;
+        uint64_t lastLsn = 0;
+
+        ~Segment()
+        {
+            if (base)
+            {
+                munmap(base, JOURNAL_SEGMENT_SIZE);
+            }
+            if (fd != -1)
+            {
+                close(fd);
+            }
+        }
+    };
+
+    static std::shared_ptr<Segment> map(const std::string &path, bool create)
+    {
+        auto segment = std::make_shared<Segment>();
+        segment->path = path;
+        segment->fd = ::open(path.c_str(), O_RDWR | O_CLOEXEC | (create ? O_CREAT | O_EXCL : 0), 0644);
+        if (segment->fd == -1)
+        {
+            throw std::runtime_error("open " + path + ": " + strerror(errno));
+        }
+        if (create)
+        {
+            // 先分配好磁盘块, 写映射时不会因为磁盘满收到 SIGBUS
+            int err = posix_fallocate(segment->fd, 0, JOURNAL_SEGMENT_SIZE);
+            if (err != 0)
+            {
+                unlink(path.c_str());
+                throw std::runtime_error("fallocate " + path + ": " + strerror(err));
+            }
+        }
+        else
+        {
+            struct stat st{};
+            if (fstat(segment->fd, &st) == -1 || st.st_size != JOURNAL_SEGMENT_SIZE)
+            {
+                throw std::runtime_error("bad journal segment size: " + path);
+            }
+        }
+        int flags = MAP_SHARED | (create ? MAP_POPULATE : 0);
+        void *base = mmap(nullptr, JOURNAL_SEGMENT_SIZE, PROT_READ | PROT_WRITE, flags, segment->fd, 0);
+        if (base == MAP_FAILED)
+        {
+            throw std::runtime_error("mmap " + path + ": " + strerror(errno));
+        }
+        segment->base = static_cast<char *>(base);
+        if (create)
+        {
+            // 每页先写一次, 提前走完写缺页和脏页登记; 否则追加时每 4KB 一次缺页, 比 memcpy 本身贵得多
+            for (size_t offset = 0; offset < JOURNAL_SEGMENT_SIZE; offset += 4096)
+            {
+                segment->base[offset] = 0;
+            }
+        }
+        return segment;
+    }
+
+    // 顺序遍历段里的记录, 遇到段尾或校验失败 (写了一半) 就停
+    template <typename F>
+    static void scan(const Segment &segment, F &&f)
+    {
+        size_t offset = JOURNAL_HEADER_SIZE;
+        uint64_t prev = 0;
+        while (offset + sizeof(JournalRecord) <= JOURNAL_SEGMENT_SIZE)
+        {
+            JournalRecord record;
+            std::memcpy(&record, segment.base + offset, sizeof(record));
+            const char *payload = segment.base + offset + sizeof(JournalRecord);
+            if (record.length == 0 || record.length > JOURNAL_SEGMENT_SIZE - offset - sizeof(JournalRecord) ||
+                record.lsn <= prev)
+            {
+                break;
+            }
+            uint32_t crc = Crc32c::compute(0, &record.length, sizeof(record.length) + sizeof(record.lsn));
+            crc = Crc32c::compute(crc, payload, record.length);
+            if (crc != record.crc)
+            {
+                break;
+            }
+            f(record, std::string_view(payload, record.length));
+            prev = record.lsn;
+            offset += (sizeof(JournalRecord) + record.length + 7) & ~size_t(7);
+        }
+    }
+
+    void recover()
+    {
+        std::vector<std::shared_ptr<Segment>> found;
+        for (const auto &entry : std::filesystem::directory_iterator(m_dir))
+        {
+            if (entry.path().extension() != ".wal")
+            {
+                continue;
+            }
+            std::shared_ptr<Segment> segment = map(entry.path().string(), false);
+            JournalHeader header;
+            std::memcpy(&header, segment->base, sizeof(header));
+            if (std::memcmp(header.magic, JOURNAL_MAGIC, 4) != 0)
+            {
+                // 创建后还没写完段头就崩溃了, 里面不会有记录
+                unlink(segment->path.c_str());
+                continue;
+            }
+            segment->seq = header.seq;
+            m_acked = std::max(m_acked, header.ackedLsn);
+            scan(*segment, [&](const JournalRecord &record, std::string_view)
+                 { segment->lastLsn = record.lsn; });
+            m_nextLsn = std::max(m_nextLsn, segment->lastLsn + 1);
+            m_nextSeq = std::max(m_nextSeq, segment->seq + 1);
+            found.push_back(segment);
+        }
+        m_nextLsn = std::max(m_nextLsn, m_acked + 1);
+        std::sort(found.begin(), found.end(), [](const auto &a, const auto &b)
+                  { return a->seq < b->seq; });
+        m_segments.assign(found.begin(), found.end());
+    }
+
+    // 换一个新段; 旧段的剩余部分保持全零, 读的时候就是段尾
+    // 后台线程通常已经备好了下一个段, 这里只是交换指针; 还没备好时 (刚启动) 当场创建
+    void roll(size_t need)
+    {
+        if (need + JOURNAL_HEADER_SIZE > JOURNAL_SEGMENT_SIZE)
+        {
+            throw std::runtime_error("journal record too large");
+        }
+        std::shared_ptr<Segment> segment;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            segment.swap(m_spare);
+        }
+        if (!segment)
+        {
+            segment = create();
+        }
+        JournalHeader header{};
+        std::memcpy(header.magic, JOURNAL_MAGIC, 4);
+        header.seq = segment->seq;
+        header.ackedLsn = m_acked;
+        std::memcpy(segment->base, &header, sizeof(header));
+
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            if (m_current)
+            {
+                m_unsynced.push_back(m_current); // 旧段最后一部分还没落盘
+            }
+            m_current = segment;
+            m_segments.push_back(segment);
+            m_offset = JOURNAL_HEADER_SIZE;
+        }
+        m_cond.notify_one(); // 让后台线程准备下一个
+    }
+
+    // 新建一个空段, 段头全零, 启用时才写入; 崩溃时留下的空段在恢复时删除
+    std::shared_ptr<Segment> create()
+    {
+        uint64_t seq;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            seq = m_nextSeq++;
+        }
+        char name[32];
+        snprintf(name, sizeof(name), "%012llu.wal", static_cast<unsigned long long>(seq));
+        std::shared_ptr<Segment> segment = map((std::filesystem::path(m_dir) / name).string(), true);
+        segment->seq = seq;
+        return segment;
+    }
+
+    // 后台线程: 有请求时把当前段和刚换下来的段同步到磁盘, 多轮请求合并成一次;
+    // 当前段启用后顺便备好下一个段
+    void syncLoop()
+    {
+        Affinity::pinWorker();
+        while (true)
+        {
+            std::vector<std::shared_ptr<Segment>> targets;
+            bool stopping, prepare;
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_cond.wait(lock, [this]
+                            { return m_syncRequested || (m_current && !m_spare); });
+                stopping = m_stopping;
+                prepare = m_current && !m_spare && !stopping;
+                if (m_syncRequested)
+                {
+                    m_syncRequested = false;
+                    targets.swap(m_unsynced);
+                    if (m_current)
+                    {
+                        targets.push_back(m_current);
+                    }
+                }
+            }
+            for (auto &segment : targets)
+            {
+                if (fdatasync(segment->fd) == -1)
+                {
+                    perror("fdatasync: journal");
+                }
+            }
+            if (stopping)
+            {
+                return;
+            }
+            if (prepare)
+            {
+                try
+                {
+                    std::shared_ptr<Segment> spare = create();
+                    std::unique_lock<std::mutex> lock(m_mutex);
+                    m_spare = std::move(spare);
+                }
+                catch (const std::exception &e)
+                {
+                    // 事件循环换段时会自己再试一次, 那里失败才是真正的错误
+                    std::cerr << "Journal: " << e.what() << std::endl;
+                    std::this_thread::sleep_for(std::chrono::seconds(1));
+                }
+            }
+        }
+    }
+
+    std::string m_dir;
+    uint64_t m_nextLsn = 1;
+    uint64_t m_nextSeq = 1; // 受 m_mutex 保护
+    uint64_t m_acked = 0;
+    std::shared_ptr<Segment> m_current; // 正在追加的段, 只由事件循环线程切换 (持锁)
+    size_t m_offset = 0;
+    bool m_dirty = false;
+
+    std::mutex m_mutex; // 保护下面几项和 m_segments, m_current 的切换
+    std::condition_variable m_cond;
+    bool m_syncRequested = false;
+    bool m_stopping = false;
+    std::vector<std::shared_ptr<Segment>> m_unsynced;
+    std::shared_ptr<Segment> m_spare; // 备好的下一个段, 还不在 m_segments 里
+    std::deque<std::shared_ptr<Segment>> m_segments; // 按 seq 递增, 包括当前段
+    std::thread m_syncer;
+};
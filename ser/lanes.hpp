@@ -0,0 +1,94 @@
+#pragma once
+#include "../include/headFile.hpp"
+#include "../Cli_Ser_Connection/Codec.hpp"
+#include "pool.hpp"
+
+#define LANE_QUANTUM 4096        // 每轮按权重发给各通道的字节额度的单位
+#define LANE_CHUNK (16 * 1024)   // 批量通道里超过这个长度的帧切段发送
+#define LANE_BATCH (64 * 1024)   // 每次从通道搬进待写缓冲区的字节数, 新到的聊天消息最多排在这么多数据后面
+
+// 输出通道, 按重要程度排列
+enum class Lane : uint8_t
+{
+    Control, // 握手、错误、限流、在线状态、回执
+    Chat,    // 推送的聊天消息
+    Bulk,    // 历史记录、检索结果这类大块回复
+};
+
+// 一条连接的输出排队
+// 每个通道一个缓冲区, 存放带长度头的完整帧; socket 可写时按差额轮询 (DRR) 从各通道取整帧,
+// 每轮给通道的额度和权重成正比, 所以下载历史记录时聊天消息只需等当前这一批写完, 不必等整个下载
+// 通道内保持先后顺序, 同一个大帧的各段在同一个通道里, 不会被别的段插队
+struct OutLanes
+{
+    PoolBuf queue[3];
+    int32_t deficit[3] = {};
+    uint8_t next = 0; // 轮到的通道
+
+    bool empty() const
+    {
+        return queue[0].empty() && queue[1].empty() && queue[2].empty();
+    }
+
+    void push(BufferPool &pool, Lane lane, uint32_t header, std::string_view payload)
+    {
+        uint32_t len = htonl(header);
+        PoolBuf &q = queue[static_cast<int>(lane)];
+        q.append(pool, reinterpret_cast<const char *>(&len), sizeof(len));
+        q.append(pool, payload.data(), payload.size());
+    }
+
+    // 从各通道取整帧追加到 out, 直到 out 里有 budget 字节或通道都空了
+    void refill(BufferPool &pool, PoolBuf &out, size_t budget)
+    {
+        static const int32_t weight[3] = {8, 4, 1};
+        while (out.size() < budget && !empty())
+        {
+            PoolBuf &q = queue[next];
+            if (!q.empty())
+            {
+                deficit[next] += weight[next] * LANE_QUANTUM;
+                while (!q.empty())
+                {
+                    uint32_t header = 0;
+                    std::memcpy(&header, q.begin(), sizeof(header));
+                    size_t n = sizeof(header) + (ntohl(header) & FRAME_LENGTH_MASK);
+                    if (static_cast<int32_t>(n) > deficit[next])
+                    {
+                        break;
+                    }
+                    out.append(pool, q.begin(), n);
+                    q.consume(pool, n);
+                    deficit[next] -= static_cast<int32_t>(n);
+                }
+            }
+            // 空了的通道不能攒额度, 否则之后来一大批会一口气占满
+            if (q.empty())
+            {
+                deficit[next] = 0;
+            }
+            next = (next + 1) % 3;
+        }
+    }
+
+    // 按通道顺序拼起来, 热升级时作为未写完的输出交给新进程; 各帧 (段) 仍然完整, 同一大帧的段仍然有序
+    void drainTo(BufferPool &pool, PoolBuf &out)
+    {
+        for (PoolBuf &q : queue)
+        {
+            if (!q.empty())
+            {
+                out.append(pool, q.begin(), q.size());
+                q.reset(pool);
+            }
+        }
+    }
+
+    void reset(BufferPool &pool)
+    {
+        for (PoolBuf &q : queue)
+        {
+            q.reset(pool);
+        }
+    }
+};
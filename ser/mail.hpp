@@ -0,0 +1,152 @@
+#pragma once
+#include "../include/headFile.hpp"
+
+#define MAIL_TIMEOUT_SEC 5
+
+// 最小的 SMTP 客户端, 把邮件交给本机的 SMTP 服务 (开发环境可以是 MailHog 之类的收件桩)
+// 由中继负责真正的投递, 这里只走 HELO / MAIL / RCPT / DATA / QUIT
+// send 是阻塞调用, 只在鉴权工作线程里使用
+class Mailer
+{
+public:
+    Mailer(const std::string &host, int port, const std::string &from)
+        : m_host(host), m_port(port), m_from(from) {}
+
+    bool send(const std::string &to, const std::string &subject, const std::string &body) const
+    {
+        int fd = connectRelay();
+        if (fd == -1)
+        {
+            return false;
+        }
+
+        std::string data = "From: <" + m_from + ">\r\nTo: <" + to + ">\r\nSubject: " + subject +
+                           "\r\nContent-Type: text/plain; charset=utf-8\r\n\r\n";
+        // 行首的 "." 要转义成 "..", 否则会被当成正文结束
+        size_t start = 0;
+        while (start <= body.size())
+        {
+            size_t end = body.find('\n', start);
+            std::string line = body.substr(start, end == std::string::npos ? std::string::npos : end - start);
+            if (!line.empty() && line.back() == '\r')
+            {
+                line.pop_back();
+            }
+            if (!line.empty() && line[0] == '.')
+            {
+                data += '.';
+            }
+            data += line + "\r\n";
+            if (end == std::string::npos)
+            {
+                break;
+            }
+            start = end + 1;
+        }
+        data += ".";
+
+        bool ok = expect(fd, 220) &&
+                  command(fd, "HELO chatroom", 250) &&
+                  command(fd, "MAIL FROM:<" + m_from + ">", 250) &&
+                  command(fd, "RCPT TO:<" + to + ">", 250) &&
+                  command(fd, "DATA", 354) &&
+                  command(fd, data, 250);
+        if (ok)
+        {
+            command(fd, "QUIT", 221);
+        }
+        close(fd);
+        return ok;
+    }
+
+    // 地址会原样写进 SMTP 命令, 不能带空白和尖括号
+    static bool validAddress(std::string_view address)
+    {
+        if (address.size() < 3 || address.size() > 254)
+        {
+            return false;
+        }
+        size_t at = address.find('@');
+        if (at == std::string_view::npos || at == 0 || at + 1 == address.size())
+        {
+            return false;
+        }
+        for (char ch : address)
+        {
+            if (static_cast<unsigned char>(ch) <= ' ' || ch == '<' || ch == '>' || ch == 0x7f)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+private:
+    int connectRelay() const
+    {
+        int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd == -1)
+        {
+            perror("socket: smtp");
+            return -1;
+        }
+        struct timeval tv{};
+        tv.tv_sec = MAIL_TIMEOUT_SEC;
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+        struct sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(m_port);
+        if (inet_pton(AF_INET, m_host.c_str(), &addr.sin_addr) != 1 ||
+            connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1)
+        {
+            std::cerr << "SMTP relay " << m_host << ":" << m_port << " unreachable: " << strerror(errno) << std::endl;
+            close(fd);
+            return -1;
+        }
+        return fd;
+    }
+
+    bool command(int fd, const std::string &line, int code) const
+    {
+        std::string out = line + "\r\n";
+        if (::send(fd, out.data(), out.size(), MSG_NOSIGNAL) != static_cast<ssize_t>(out.size()))
+        {
+            return false;
+        }
+        return expect(fd, code);
+    }
+
+    // 读一条回复 (多行回复以 "250-" 续行, 以 "250 " 结束) 并检查状态码
+    bool expect(int fd, int code) const
+    {
+        std::string reply;
+        char buf[512];
+        while (true)
+        {
+            size_t lineStart = reply.rfind('\n', reply.size() >= 2 ? reply.size() - 2 : 0);
+            lineStart = (lineStart == std::string::npos) ? 0 : lineStart + 1;
+            if (reply.size() >= 2 && reply.compare(reply.size() - 2, 2, "\r\n") == 0 &&
+                reply.size() - lineStart >= 4 && reply[lineStart + 3] != '-')
+            {
+                int status = std::atoi(reply.c_str() + lineStart);
+                if (status != code)
+                {
+                    std::cerr << "SMTP relay replied: " << reply.substr(lineStart);
+                }
+                return status == code;
+            }
+            ssize_t n = recv(fd, buf, sizeof(buf), 0);
+            if (n <= 0)
+            {
+                return false;
+            }
+            reply.append(buf, n);
+        }
+    }
+
+    std::string m_host;
+    int m_port;
+    std::string m_from;
+};
@@ -0,0 +1,86 @@
+#pragma once
+#include "../include/headFile.hpp"
+
+#define ACCEPT_BATCH 64 // 监听 socket 每次可读时最多接受的连接数, 剩下的留到下一轮, 不让连接风暴饿死已有连接
+
+// 过载保护的配置, 0 表示不启用对应的限制
+struct OverloadLimits
+{
+    size_t maxConns = 10000;       // 连接数上限, 超过后新连接收到 BUSY 就被关闭
+    int64_t lagUs = 50000;         // 事件循环每轮处理耗时 (平滑后) 的上限, 微秒
+    size_t queueBytes = 256 << 20; // 各连接收发缓冲区积压的总字节数上限
+};
+
+// 负载等级, 越高丢弃的请求越多
+enum class Load
+{
+    Normal,   // 全部处理
+    Elevated, // 丢弃低优先级请求
+    Critical, // 只处理高优先级请求
+};
+
+// 请求优先级: 已登录用户的收发消息最重要, 其次是新会话 (新连接和未登录连接的请求), 历史记录、检索这类昂贵命令最先丢弃
+enum class Priority
+{
+    Low,
+    Normal,
+    High,
+};
+
+// 按负载信号分级丢弃请求, 过载时先保住已建立会话的消息收发
+// 信号有两个: 事件循环每轮的处理耗时 (按 1/8 平滑) 反映排队等待的延迟, 缓冲区积压反映下游跟不上的程度
+// 任一信号超过阈值进入 Elevated, 超过两倍进入 Critical; 降到当前等级阈值的一半以下才退回一级, 避免在边界上来回切换
+class LoadShedder
+{
+public:
+    explicit LoadShedder(const OverloadLimits &limits) : m_limits(limits) {}
+
+    // 每轮事件处理完调用一次
+    void sample(int64_t roundUs, size_t queuedBytes)
+    {
+        m_lag += (static_cast<double>(roundUs) - m_lag) / 8;
+        double pressure = std::max(ratio(m_lag, static_cast<double>(m_limits.lagUs)),
+                                   ratio(static_cast<double>(queuedBytes), static_cast<double>(m_limits.queueBytes)));
+        Load target = pressure >= 2 ? Load::Critical : pressure >= 1 ? Load::Elevated : Load::Normal;
+        if (target > m_load)
+        {
+            change(target, pressure);
+        }
+        else if (m_load != Load::Normal && pressure * 2 < static_cast<int>(m_load))
+        {
+            change(static_cast<Load>(static_cast<int>(m_load) - 1), pressure);
+        }
+    }
+
+    // 当前负载下是否处理这个优先级的请求, 不处理的计入丢弃数
+    bool admit(Priority priority)
+    {
+        if (static_cast<int>(priority) >= static_cast<int>(m_load))
+        {
+            return true;
+        }
+        m_shed++;
+        return false;
+    }
+
+    Load load() const { return m_load; }
+
+private:
+    static double ratio(double value, double limit)
+    {
+        return limit > 0 ? value / limit : 0;
+    }
+
+    void change(Load load, double pressure)
+    {
+        static const char *const names[] = {"normal", "elevated", "critical"};
+        std::cerr << "Load " << names[static_cast<int>(load)] << " (lag " << static_cast<int64_t>(m_lag) << " us, pressure "
+                  << pressure << "), shed " << m_shed << " requests so far" << std::endl;
+        m_load = load;
+    }
+
+    OverloadLimits m_limits;
+    Load m_load = Load::Normal;
+    double m_lag = 0;    // 平滑后的每轮耗时, 微秒
+    uint64_t m_shed = 0; // 累计丢弃的请求和连接数
+};
@@ -0,0 +1,389 @@
+#pragma once
+#include "../include/headFile.hpp"
+
+// 按 2 的幂分级的缓冲区池, 每个尺寸级别维护一条空闲链表
+// 只给单个 reactor 线程使用, 因此不加锁
+class BufferPool
+{
+public:
+    static constexpr size_t MIN_SHIFT = 6;  // 最小块 64 字节
+    static constexpr size_t MAX_SHIFT = 20; // 最大块 1 MB, 更大的直接走 malloc
+    static constexpr size_t CLASSES = MAX_SHIFT - MIN_SHIFT + 1;
+
+    explicit BufferPool(size_t maxCachedPerClass = 1024) : m_limit(maxCachedPerClass) {}
+    ~BufferPool()
+    {
+        for (size_t i = 0; i < CLASSES; i++)
+        {
+            while (m_free[i])
+            {
+                Node *next = m_free[i]->next;
+                std::free(m_free[i]);
+                m_free[i] = next;
+            }
+        }
+    }
+
+    BufferPool(const BufferPool &other) = delete;
+    BufferPool &operator=(const BufferPool &other) = delete;
+
+    // 借出至少 size 字节的块, 实际容量通过 capacity 返回
+    char *acquire(size_t size, size_t &capacity)
+    {
+        size_t cls = classOf(size);
+        if (cls >= CLASSES)
+        {
+            // 超大块不进池
+            capacity = size;
+            m_lent += capacity;
+            return static_cast<char *>(std::malloc(size));
+        }
+        capacity = size_t(1) << (cls + MIN_SHIFT);
+        m_lent += capacity;
+        if (m_free[cls])
+        {
+            Node *node = m_free[cls];
+            m_free[cls] = node->next;
+            m_count[cls]--;
+            return reinterpret_cast<char *>(node);
+        }
+        return static_cast<char *>(std::malloc(capacity));
+    }
+
+    // 归还块, capacity 必须是 acquire 时拿到的容量
+    void release(char *buf, size_t capacity)
+    {
+        if (!buf)
+        {
+            return;
+        }
+        m_lent -= capacity;
+        size_t cls = classOf(capacity);
+        if (cls >= CLASSES || m_count[cls] >= m_limit)
+        {
+            std::free(buf);
+            return;
+        }
+        Node *node = reinterpret_cast<Node *>(buf);
+        node->next = m_free[cls];
+        m_free[cls] = node;
+        m_count[cls]++;
+    }
+
+    // 启动时预热某个尺寸级别, 避免稳态下再去 malloc
+    void reserve(size_t size, size_t count)
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            size_t cap = 0;
+            char *buf = acquire(size, cap);
+            m_warm.push_back({buf, cap});
+        }
+        for (auto &[buf, cap] : m_warm)
+        {
+            release(buf, cap);
+        }
+        m_warm.clear();
+    }
+
+    // 空闲链表中缓存的总字节数
+    size_t cachedBytes() const
+    {
+        size_t total = 0;
+        for (size_t i = 0; i < CLASSES; i++)
+        {
+            total += m_count[i] << (i + MIN_SHIFT);
+        }
+        return total;
+    }
+
+    // 借出还没归还的总字节数, 也就是各连接收发缓冲区里积压的数据
+    size_t lentBytes() const { return m_lent; }
+
+private:
+    struct Node
+    {
+        Node *next;
+    };
+
+    static size_t classOf(size_t size)
+    {
+        size_t shift = MIN_SHIFT;
+        while ((size_t(1) << shift) < size)
+        {
+            shift++;
+        }
+        return shift - MIN_SHIFT;
+    }
+
+    Node *m_free[CLASSES] = {};  // 每级的空闲链表
+    size_t m_count[CLASSES] = {}; // 每级缓存的块数
+    size_t m_limit;               // 每级最多缓存的块数
+    size_t m_lent = 0;            // 借出的字节数
+    std::vector<std::pair<char *, size_t>> m_warm;
+};
+
+// 从 BufferPool 借来的可增长缓冲区
+// 数据为空时立即归还内存, 空闲连接因此不占缓冲区
+struct PoolBuf
+{
+    char *data = nullptr;
+    uint32_t cap = 0; // 容量
+    uint32_t off = 0; // 已消费的位置
+    uint32_t len = 0; // 已写入的位置
+
+    bool empty() const { return off == len; }
+    size_t size() const { return len - off; }
+    const char *begin() const { return data + off; }
+
+    // 追加数据, 空间不够时先压缩再换更大的块
+    void append(BufferPool &pool, const char *src, size_t n)
+    {
+        if (len + n > cap && off > 0)
+        {
+            std::memmove(data, data + off, len - off);
+            len -= off;
+            off = 0;
+        }
+        if (len + n > cap)
+        {
+            size_t newCap = 0;
+            char *bigger = pool.acquire(len + n, newCap);
+            if (len > 0)
+            {
+                std::memcpy(bigger, data, len);
+            }
+            pool.release(data, cap);
+            data = bigger;
+            cap = static_cast<uint32_t>(newCap);
+        }
+        std::memcpy(data + len, src, n);
+        len += static_cast<uint32_t>(n);
+    }
+
+    // 丢弃前 n 个字节, 全部消费后归还内存
+    void consume(BufferPool &pool, size_t n)
+    {
+        off += static_cast<uint32_t>(n);
+        if (off >= len)
+        {
+            reset(pool);
+        }
+    }
+
+    void reset(BufferPool &pool)
+    {
+        pool.release(data, cap);
+        data = nullptr;
+        cap = off = len = 0;
+    }
+};
+
+// 单次请求用的临时内存, 按块向后切分, 每轮事件处理完整体 reset
+// 块在 reset 后保留复用, 稳态下不再申请内存
+class Arena
+{
+public:
+    explicit Arena(size_t chunkSize = 64 * 1024) : m_chunkSize(chunkSize) {}
+    ~Arena()
+    {
+        for (auto &chunk : m_chunks)
+        {
+            std::free(chunk.data);
+        }
+    }
+
+    Arena(const Arena &other) = delete;
+    Arena &operator=(const Arena &other) = delete;
+
+    void *alloc(size_t size, size_t align = alignof(std::max_align_t))
+    {
+        while (m_index < m_chunks.size())
+        {
+            Chunk &chunk = m_chunks[m_index];
+            size_t start = (m_offset + align - 1) & ~(align - 1);
+            if (start + size <= chunk.size)
+            {
+                m_offset = start + size;
+                return chunk.data + start;
+            }
+            m_index++;
+            m_offset = 0;
+        }
+        size_t chunkSize = std::max(m_chunkSize, size + align);
+        m_chunks.push_back({static_cast<char *>(std::malloc(chunkSize)), chunkSize});
+        m_index = m_chunks.size() - 1;
+        m_offset = 0;
+        return alloc(size, align);
+    }
+
+    // 只允许平凡析构的类型, reset 时不会调用析构函数
+    template <typename T, typename... Args>
+    T *make(Args &&...args)
+    {
+        static_assert(std::is_trivially_destructible<T>::value, "Arena only holds trivially destructible types");
+        return new (alloc(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+    }
+
+    // 把字符串拷进 arena, 结尾补 '\0' 方便传给 C 接口
+    std::string_view copy(std::string_view s)
+    {
+        char *dst = static_cast<char *>(alloc(s.size() + 1, 1));
+        std::memcpy(dst, s.data(), s.size());
+        dst[s.size()] = '\0';
+        return std::string_view(dst, s.size());
+    }
+
+    // 格式化到 arena 中
+    std::string_view format(const char *fmt, ...) __attribute__((format(printf, 2, 3)))
+    {
+        va_list args;
+        va_start(args, fmt);
+        va_list again;
+        va_copy(again, args);
+        int n = vsnprintf(nullptr, 0, fmt, args);
+        va_end(args);
+        char *dst = static_cast<char *>(alloc(n + 1, 1));
+        vsnprintf(dst, n + 1, fmt, again);
+        va_end(again);
+        return std::string_view(dst, n);
+    }
+
+    void reset()
+    {
+        m_index = 0;
+        m_offset = 0;
+    }
+
+    size_t capacity() const
+    {
+        size_t total = 0;
+        for (auto &chunk : m_chunks)
+        {
+            total += chunk.size;
+        }
+        return total;
+    }
+
+private:
+    struct Chunk
+    {
+        char *data;
+        size_t size;
+    };
+
+    size_t m_chunkSize;
+    std::vector<Chunk> m_chunks;
+    size_t m_index = 0;  // 当前使用的块
+    size_t m_offset = 0; // 当前块内的偏移
+};
+
+// 以 fd 为下标的连接对象槽位, 按页分配, 页一旦分配就不再释放
+// 对象地址在连接存续期间保持不变
+template <typename T>
+class FdSlab
+{
+public:
+    static constexpr int PAGE = 256;
+
+    FdSlab() = default;
+    ~FdSlab()
+    {
+        for (auto &page : m_pages)
+        {
+            if (!page)
+            {
+                continue;
+            }
+            for (int i = 0; i < PAGE; i++)
+            {
+                if (page[i].used)
+                {
+                    page[i].get()->~T();
+                }
+            }
+        }
+    }
+
+    FdSlab(const FdSlab &other) = delete;
+    FdSlab &operator=(const FdSlab &other) = delete;
+
+    // 在 fd 对应的槽位上构造对象
+    T *open(int fd)
+    {
+        size_t pageIndex = fd / PAGE;
+        if (pageIndex >= m_pages.size())
+        {
+            m_pages.resize(pageIndex + 1);
+        }
+        if (!m_pages[pageIndex])
+        {
+            m_pages[pageIndex] = std::make_unique<Slot[]>(PAGE);
+        }
+        Slot &slot = m_pages[pageIndex][fd % PAGE];
+        if (slot.used)
+        {
+            slot.get()->~T();
+            m_open--;
+        }
+        new (slot.storage) T();
+        slot.used = true;
+        m_open++;
+        return slot.get();
+    }
+
+    // fd 未打开时返回 nullptr
+    T *get(int fd)
+    {
+        size_t pageIndex = fd / PAGE;
+        if (fd < 0 || pageIndex >= m_pages.size() || !m_pages[pageIndex])
+        {
+            return nullptr;
+        }
+        Slot &slot = m_pages[pageIndex][fd % PAGE];
+        return slot.used ? slot.get() : nullptr;
+    }
+
+    void close(int fd)
+    {
+        T *obj = get(fd);
+        if (obj)
+        {
+            obj->~T();
+            m_pages[fd / PAGE][fd % PAGE].used = false;
+            m_open--;
+        }
+    }
+
+    template <typename F>
+    void forEach(F &&func)
+    {
+        for (auto &page : m_pages)
+        {
+            if (!page)
+            {
+                continue;
+            }
+            for (int i = 0; i < PAGE; i++)
+            {
+                if (page[i].used)
+                {
+                    func(*page[i].get());
+                }
+            }
+        }
+    }
+
+    size_t size() const { return m_open; }
+
+private:
+    struct Slot
+    {
+        bool used = false;
+        alignas(T) unsigned char storage[sizeof(T)];
+        T *get() { return std::launder(reinterpret_cast<T *>(storage)); }
+    };
+
+    std::vector<std::unique_ptr<Slot[]>> m_pages;
+    size_t m_open = 0;
+};
@@ -0,0 +1,211 @@
+#pragma once
+#include "../include/headFile.hpp"
+#include "Msg.hpp"
+
+#define PRESENCE_WINDOW_MS 100 // 状态变化攒批的时间窗口
+#define PRESENCE_MAX_WATCH 1000 // 每条连接最多关注的用户数
+
+// 在线状态推送
+// 连接用 WATCH 关注一组用户, 被关注的用户上下线时推送 "PRESENCE user:1 user:0 ..." 帧
+// 上下线事件先进入一个短时间窗口, 窗口内同一用户的多次变化只比较窗口开始和结束时的状态,
+// 来回闪断的用户不产生推送; 窗口结束时每个关注者最多收到一帧
+// 只跟踪被关注的用户, 状态保存在内存里, 不读写 Redis
+class Presence
+{
+public:
+    Presence()
+    {
+        m_timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        if (m_timerFd == -1)
+        {
+            throw std::runtime_error("timerfd_create: " + std::string(strerror(errno)));
+        }
+    }
+
+    ~Presence()
+    {
+        close(m_timerFd);
+    }
+
+    Presence(const Presence &other) = delete;
+    Presence &operator=(const Presence &other) = delete;
+
+    // 窗口到期时可读, 由事件循环监听
+    int fd() const { return m_timerFd; }
+
+    // fd 关注 user, online 是关注时的状态; 超过上限时返回 false
+    bool watch(int fd, const std::string &user, bool online)
+    {
+        std::vector<std::string> &watching = m_watching[fd];
+        if (watching.size() >= PRESENCE_MAX_WATCH)
+        {
+            return false;
+        }
+        Watched &entry = m_watched[user];
+        if (entry.watchers.empty())
+        {
+            entry.online = online;
+        }
+        if (std::find(entry.watchers.begin(), entry.watchers.end(), fd) == entry.watchers.end())
+        {
+            entry.watchers.push_back(fd);
+            watching.push_back(user);
+        }
+        return true;
+    }
+
+    void unwatch(int fd, const std::string &user)
+    {
+        auto it = m_watching.find(fd);
+        if (it == m_watching.end())
+        {
+            return;
+        }
+        auto &watching = it->second;
+        watching.erase(std::remove(watching.begin(), watching.end(), user), watching.end());
+        dropWatcher(user, fd);
+    }
+
+    // 连接关闭时清掉它的所有关注
+    void removeWatcher(int fd)
+    {
+        auto it = m_watching.find(fd);
+        if (it == m_watching.end())
+        {
+            return;
+        }
+        for (const std::string &user : it->second)
+        {
+            dropWatcher(user, fd);
+        }
+        m_watching.erase(it);
+    }
+
+    // fd 关注的用户, 热升级时交给新进程
+    const std::vector<std::string> *watching(int fd) const
+    {
+        auto it = m_watching.find(fd);
+        return it == m_watching.end() ? nullptr : &it->second;
+    }
+
+    // 当前已知的状态, 没人关注的用户返回 false
+    bool online(const std::string &user) const
+    {
+        auto it = m_watched.find(user);
+        return it != m_watched.end() && it->second.online;
+    }
+
+    // 记录一次上下线; local 表示事件发生在本节点, 需要转告其他节点
+    void change(const std::string &user, bool online, bool local = true)
+    {
+        auto watched = m_watched.find(user);
+        auto it = m_window.find(user);
+        if (it == m_window.end())
+        {
+            // 窗口里第一次出现, 记下窗口开始时的状态
+            // 没人关注的用户不知道之前的状态, 窗口结束时总是转告其他节点: 那边的关注者可能已经从 Redis 的登记
+            // 看到了窗口中间的状态, 来回闪断也要把最终状态告诉它们
+            bool known = watched != m_watched.end();
+            bool before = known ? watched->second.online : !online;
+            it = m_window.emplace(user, Change{before, online, local, known}).first;
+        }
+        it->second.after = online;
+        it->second.local = it->second.local || local;
+        if (!m_armed)
+        {
+            struct itimerspec spec{};
+            spec.it_value.tv_nsec = PRESENCE_WINDOW_MS * 1000000L;
+            timerfd_settime(m_timerFd, 0, &spec, nullptr);
+            m_armed = true;
+        }
+    }
+
+    // 窗口到期: 对每个关注者回调 send(fd, frame), 本节点发生的变化编码后回调 publish(batch) 一次
+    template <typename Send, typename Publish>
+    void flush(Send &&send, Publish &&publish)
+    {
+        uint64_t expirations;
+        read(m_timerFd, &expirations, sizeof(expirations));
+        m_armed = false;
+
+        m_published.clear();
+        for (auto &[user, change] : m_window)
+        {
+            if (change.before == change.after && change.known)
+            {
+                continue; // 窗口内来回变化, 等于没变
+            }
+            if (change.local)
+            {
+                Msg::putField(m_published, user);
+                Msg::putField(m_published, change.after ? "1" : "0");
+            }
+            auto it = m_watched.find(user);
+            if (it == m_watched.end())
+            {
+                continue;
+            }
+            it->second.online = change.after;
+            for (int fd : it->second.watchers)
+            {
+                std::string &frame = m_frames[fd];
+                frame += frame.empty() ? "PRESENCE " : " ";
+                frame += user;
+                frame += change.after ? ":1" : ":0";
+            }
+        }
+        m_window.clear();
+
+        for (auto &[fd, frame] : m_frames)
+        {
+            if (!frame.empty())
+            {
+                send(fd, std::string_view(frame));
+                frame.clear(); // 保留容量, 下个窗口复用
+            }
+        }
+        if (!m_published.empty())
+        {
+            publish(std::string_view(m_published));
+        }
+    }
+
+private:
+    struct Watched
+    {
+        bool online = false;
+        std::vector<int> watchers;
+    };
+
+    struct Change
+    {
+        bool before;
+        bool after;
+        bool local;
+        bool known; // before 是否是已知的状态
+    };
+
+    void dropWatcher(const std::string &user, int fd)
+    {
+        auto it = m_watched.find(user);
+        if (it == m_watched.end())
+        {
+            return;
+        }
+        auto &watchers = it->second.watchers;
+        watchers.erase(std::remove(watchers.begin(), watchers.end(), fd), watchers.end());
+        if (watchers.empty())
+        {
+            m_watched.erase(it);
+        }
+        m_frames.erase(fd);
+    }
+
+    int m_timerFd = -1;
+    bool m_armed = false;
+    std::unordered_map<std::string, Watched> m_watched;            // 被关注的用户 -> 状态和关注者
+    std::unordered_map<int, std::vector<std::string>> m_watching;  // 连接 -> 它关注的用户
+    std::unordered_map<std::string, Change> m_window;              // 当前窗口内有变化的用户
+    std::unordered_map<int, std::string> m_frames;                 // 关注者 -> 本窗口要推送的内容
+    std::string m_published;
+};
@@ -0,0 +1,109 @@
+#pragma once
+#include "../include/headFile.hpp"
+#include "../redis/shard.hpp"
+
+#define RATE_USER_PREFIX "rate:"
+#define RATE_LEASE 10 // 集群模式下每次从 Redis 预取的全局令牌数
+
+// 令牌桶的速率和容量, rate <= 0 表示不限制
+struct RateLimit
+{
+    double rate = 0;  // 每秒补充的令牌数
+    double burst = 0; // 桶容量, 允许的突发量
+};
+
+// 服务器的限流配置
+struct RateLimits
+{
+    RateLimit messages{50, 100};            // 每条连接每秒的帧数
+    RateLimit bytes{1 << 20, 2 << 20};      // 每条连接每秒的字节数
+    RateLimit costly{2, 5};                 // 每条连接每秒的昂贵命令数 (历史记录, 鉴权)
+    RateLimit userMessages{100, 200};       // 集群模式下每个用户在所有节点上每秒的消息数
+};
+
+// 令牌桶, 直接嵌在连接对象里, 不额外分配内存
+// 首次使用时装满, 之后按经过的时间补充
+struct TokenBucket
+{
+    double tokens = -1; // 小于 0 表示还没用过
+    int64_t stamp = 0;  // 上次补充的时间, 微秒
+
+    bool take(double cost, const RateLimit &limit, int64_t now)
+    {
+        if (limit.rate <= 0)
+        {
+            return true;
+        }
+        if (tokens < 0)
+        {
+            tokens = limit.burst;
+            stamp = now;
+        }
+        tokens = std::min(limit.burst, tokens + (now - stamp) * limit.rate / 1e6);
+        stamp = now;
+        // 比桶还大的帧按装满的桶计价, 否则永远发不出去
+        cost = std::min(cost, limit.burst);
+        if (tokens < cost)
+        {
+            return false;
+        }
+        tokens -= cost;
+        return true;
+    }
+};
+
+// 集群模式下的用户级全局限流
+// 令牌桶状态放在 Redis 哈希 "rate:{user:<user>}" 里, 分片时和用户信息在同一个实例上, 由 Lua 脚本原子地补充和扣减
+// 时间取 Redis 服务器的时钟, 各节点的时钟偏差不影响结果; 用毫秒是为了 Lua 数字转字符串时不丢精度
+// 每次预取 RATE_LEASE 个令牌放在连接上, 用完再取, 不必每条消息都访问 Redis
+class UserRateLimiter
+{
+public:
+    UserRateLimiter(RedisShards &redis, const RateLimit &limit) : m_redis(redis), m_limit(limit) {}
+
+    // 从全局桶里取 want 个令牌, 返回实际取到的数量
+    uint32_t lease(const std::string &user, uint32_t want)
+    {
+        if (m_limit.rate <= 0)
+        {
+            return want;
+        }
+        std::vector<std::string> keys = {RATE_USER_PREFIX "{user:" + user + "}"};
+        std::vector<std::string> args = {std::to_string(m_limit.rate), std::to_string(m_limit.burst), std::to_string(want)};
+        if (m_sha.empty())
+        {
+            m_sha = m_redis.ScriptLoad(SCRIPT);
+        }
+        long long granted = m_redis.EvalSha(m_sha, keys, args);
+        if (granted < 0)
+        {
+            // Redis 重启后脚本缓存会丢失, 重新加载一次
+            m_sha = m_redis.ScriptLoad(SCRIPT);
+            granted = m_redis.EvalSha(m_sha, keys, args);
+        }
+        // Redis 不可用时不因限流拒绝正常用户
+        return granted < 0 ? want : static_cast<uint32_t>(granted);
+    }
+
+private:
+    static constexpr const char *SCRIPT = R"(
+local rate = tonumber(ARGV[1])
+local burst = tonumber(ARGV[2])
+local want = tonumber(ARGV[3])
+local t = redis.call('TIME')
+local now = tonumber(t[1]) * 1000 + math.floor(tonumber(t[2]) / 1000)
+local state = redis.call('HMGET', KEYS[1], 'tokens', 'ts')
+local tokens = tonumber(state[1]) or burst
+local ts = tonumber(state[2]) or now
+tokens = math.min(burst, tokens + (now - ts) * rate / 1000)
+local granted = math.min(want, math.floor(tokens))
+tokens = tokens - granted
+redis.call('HSET', KEYS[1], 'tokens', tostring(tokens), 'ts', tostring(now))
+redis.call('PEXPIRE', KEYS[1], math.ceil(burst / rate * 1000) + 1000)
+return granted
+)";
+
+    RedisShards &m_redis;
+    RateLimit m_limit;
+    std::string m_sha;
+};
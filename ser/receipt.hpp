@@ -0,0 +1,335 @@
+#pragma once
+#include "../include/headFile.hpp"
+#include "../redis/shard.hpp"
+#include "history.hpp"
+
+#define RECEIPT_KEY_PREFIX "rcpt:"
+#define RECEIPT_WINDOW_MS 1000      // 回执攒批写 Redis 的窗口
+#define RECEIPT_CACHE_LIMIT 100000  // 缓存的会话数超过这个值时, 写完一批后清空重新加载
+
+// 送达和已读回执
+// 会话里每个方向的消息有递增的序号, 由发送者所在的节点分配; 回执只记高水位,
+// 即某人收到/读到了对方发来的第几条, 客户端定时发累计值, 不逐条确认
+// 一个会话的状态是 Redis 哈希 "rcpt:{<会话键>}", 用会话键做 tag, 分片时和会话记录在同一个实例上: "<用户>:s" 是该用户发出的最后一条的序号,
+// "<用户>:d" / "<用户>:r" 是该用户收到/读到的对方消息的序号
+// 变化先记在内存里, 每个窗口每个会话最多一次 HSET, 所有会话一次往返写完
+// 每个字段只由一个节点写 (发送者或读者登录的节点), 集群下不会互相覆盖
+// 未读数 = 对方发出的序号 - 自己已读的序号, 不需要逐条状态
+class Receipts
+{
+public:
+    struct Marks
+    {
+        uint64_t sent = 0;
+        uint64_t delivered = 0;
+        uint64_t read = 0;
+    };
+
+    explicit Receipts(RedisShards &redis) : m_redis(redis)
+    {
+        m_timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        if (m_timerFd == -1)
+        {
+            throw std::runtime_error("timerfd_create: " + std::string(strerror(errno)));
+        }
+    }
+
+    ~Receipts()
+    {
+        close(m_timerFd);
+    }
+
+    Receipts(const Receipts &other) = delete;
+    Receipts &operator=(const Receipts &other) = delete;
+
+    // 窗口到期时可读, 由事件循环监听
+    int fd() const { return m_timerFd; }
+
+    static std::string key(std::string_view a, std::string_view b)
+    {
+        return RECEIPT_KEY_PREFIX "{" + History::key(a, b) + "}";
+    }
+
+    // 给 from 发往 to 的下一条消息分配序号
+    uint64_t nextSeq(std::string_view from, std::string_view to)
+    {
+        std::string convKey = key(from, to);
+        Conv &conv = load(convKey);
+        std::string user(from);
+        m_byUser[user].insert(convKey);
+        uint64_t seq = ++conv.users[user].sent;
+        conv.dirty[user] |= SENT;
+        arm();
+        return seq;
+    }
+
+    // reader 收到/读到了 peer 发来的第 delivered/read 条, 只会往前推; 有推进时返回 true
+    bool mark(std::string_view reader, std::string_view peer, uint64_t delivered, uint64_t read)
+    {
+        std::string convKey = key(reader, peer);
+        Conv &conv = load(convKey);
+        std::string user(reader);
+        m_byUser[user].insert(convKey);
+        Marks &m = conv.users[user];
+        delivered = std::max(delivered, read); // 读到了就一定收到了
+        uint8_t changed = 0;
+        if (delivered > m.delivered)
+        {
+            m.delivered = delivered;
+            changed |= DELIVERED;
+        }
+        if (read > m.read)
+        {
+            m.read = read;
+            changed |= READ;
+        }
+        if (!changed)
+        {
+            return false;
+        }
+        conv.dirty[user] |= changed;
+        m_notify[{std::string(peer), user}] = {0, m.delivered, m.read};
+        arm();
+        return true;
+    }
+
+    // 窗口到期: 写 Redis, 再对每个有推进的回执回调 notify(sender, reader, marks), 同一对只回调一次
+    template <typename F>
+    void flush(F &&notify)
+    {
+        uint64_t expirations;
+        read(m_timerFd, &expirations, sizeof(expirations));
+        m_armed = false;
+
+        std::vector<HashUpdate> updates;
+        for (auto &[convKey, conv] : m_convs)
+        {
+            if (conv.dirty.empty())
+            {
+                continue;
+            }
+            HashUpdate update{convKey, {}};
+            for (auto &[user, bits] : conv.dirty)
+            {
+                const Marks &m = conv.users[user];
+                if (bits & SENT)
+                {
+                    update.fields.emplace_back(user + ":s", std::to_string(m.sent));
+                }
+                if (bits & DELIVERED)
+                {
+                    update.fields.emplace_back(user + ":d", std::to_string(m.delivered));
+                }
+                if (bits & READ)
+                {
+                    update.fields.emplace_back(user + ":r", std::to_string(m.read));
+                }
+            }
+            conv.dirty.clear();
+            updates.push_back(std::move(update));
+        }
+        bool stored = true;
+        if (!updates.empty())
+        {
+            stored = m_redis.HashSetBatch(updates) == static_cast<int>(updates.size());
+            if (!stored)
+            {
+                std::cerr << "Failed to store some receipts" << std::endl;
+            }
+        }
+
+        for (auto &[pair, marks] : m_notify)
+        {
+            notify(pair.first, pair.second, marks);
+        }
+        m_notify.clear();
+
+        // 缓存里的都已写回, 可以整个丢掉, 下次用到再从 Redis 加载
+        // 写失败时不能丢, 否则重新加载的发送序号会倒退
+        if (stored && m_convs.size() > RECEIPT_CACHE_LIMIT)
+        {
+            m_convs.clear();
+            m_byUser.clear();
+            m_evict.clear();
+        }
+        if (stored)
+        {
+            for (const std::string &convKey : m_evict)
+            {
+                m_convs.erase(convKey);
+            }
+            m_evict.clear();
+        }
+    }
+
+    // user 在本节点登出: 丢掉这个用户用过的会话的缓存
+    // 之后可能在别的节点登录并继续发消息, 再回到本节点时要从 Redis 重新加载, 否则发送序号会倒退、回执会被旧值覆盖
+    // 还有没写出的变化的会话等下次写完再丢
+    void forget(const std::string &user)
+    {
+        auto it = m_byUser.find(user);
+        if (it == m_byUser.end())
+        {
+            return;
+        }
+        for (const std::string &convKey : it->second)
+        {
+            auto conv = m_convs.find(convKey);
+            if (conv == m_convs.end())
+            {
+                continue;
+            }
+            if (conv->second.dirty.empty())
+            {
+                m_convs.erase(conv);
+            }
+            else
+            {
+                m_evict.insert(convKey);
+            }
+        }
+        m_byUser.erase(it);
+    }
+
+    // reader 和每个 peer 的会话里的未读数, 从 Redis 取最新的序号 (对方可能在别的节点发消息)
+    std::vector<uint64_t> unread(std::string_view reader, const std::vector<std::string> &peers)
+    {
+        std::vector<uint64_t> counts;
+        std::vector<Marks> theirs = fetch(reader, peers, counts);
+        for (size_t i = 0; i < peers.size(); ++i)
+        {
+            counts[i] = theirs[i].sent > counts[i] ? theirs[i].sent - counts[i] : 0;
+        }
+        return counts;
+    }
+
+    // peer 对 user 发出的消息的送达/已读进度
+    Marks status(std::string_view user, const std::string &peer)
+    {
+        std::vector<uint64_t> ignored;
+        return fetch(user, {peer}, ignored)[0];
+    }
+
+private:
+    enum : uint8_t
+    {
+        SENT = 1,
+        DELIVERED = 2,
+        READ = 4,
+    };
+
+    struct Conv
+    {
+        std::unordered_map<std::string, Marks> users;
+        std::unordered_map<std::string, uint8_t> dirty; // 用户 -> 待写的字段
+    };
+
+    struct PairHash
+    {
+        size_t operator()(const std::pair<std::string, std::string> &p) const
+        {
+            return std::hash<std::string>()(p.first) * 31 + std::hash<std::string>()(p.second);
+        }
+    };
+
+    static uint64_t number(const std::unordered_map<std::string, std::string> &fields, const std::string &name)
+    {
+        auto it = fields.find(name);
+        return it == fields.end() ? 0 : std::strtoull(it->second.c_str(), nullptr, 10);
+    }
+
+    // 第一次用到一个会话时从 Redis 加载
+    Conv &load(const std::string &convKey)
+    {
+        auto it = m_convs.find(convKey);
+        if (it != m_convs.end())
+        {
+            return it->second;
+        }
+        Conv &conv = m_convs[convKey];
+        for (auto &[field, value] : m_redis.HashGetAll(convKey))
+        {
+            size_t colon = field.rfind(':');
+            if (colon == std::string::npos || colon + 2 != field.size())
+            {
+                continue;
+            }
+            Marks &m = conv.users[field.substr(0, colon)];
+            uint64_t v = std::strtoull(value.c_str(), nullptr, 10);
+            switch (field.back())
+            {
+            case 's':
+                m.sent = v;
+                break;
+            case 'd':
+                m.delivered = v;
+                break;
+            case 'r':
+                m.read = v;
+                break;
+            }
+        }
+        return conv;
+    }
+
+    // 一次往返取出各个会话, 和本节点还没写出的值取较大者
+    // 返回每个 peer 的进度, ownRead 里是 user 在每个会话里的已读序号
+    std::vector<Marks> fetch(std::string_view user, const std::vector<std::string> &peers, std::vector<uint64_t> &ownRead)
+    {
+        std::vector<std::string> keys;
+        for (const std::string &peer : peers)
+        {
+            keys.push_back(key(user, peer));
+        }
+        auto stored = m_redis.HashGetAllBatch(keys);
+        std::vector<Marks> result(peers.size());
+        ownRead.assign(peers.size(), 0);
+        std::string self(user);
+        for (size_t i = 0; i < peers.size(); ++i)
+        {
+            Marks &m = result[i];
+            m.sent = number(stored[i], peers[i] + ":s");
+            m.delivered = number(stored[i], peers[i] + ":d");
+            m.read = number(stored[i], peers[i] + ":r");
+            ownRead[i] = number(stored[i], self + ":r");
+            auto it = m_convs.find(keys[i]);
+            if (it != m_convs.end())
+            {
+                auto mine = it->second.users.find(self);
+                if (mine != it->second.users.end())
+                {
+                    ownRead[i] = std::max(ownRead[i], mine->second.read);
+                }
+                auto theirs = it->second.users.find(peers[i]);
+                if (theirs != it->second.users.end())
+                {
+                    m.sent = std::max(m.sent, theirs->second.sent);
+                    m.delivered = std::max(m.delivered, theirs->second.delivered);
+                    m.read = std::max(m.read, theirs->second.read);
+                }
+            }
+        }
+        return result;
+    }
+
+    void arm()
+    {
+        if (m_armed)
+        {
+            return;
+        }
+        struct itimerspec spec{};
+        spec.it_value.tv_sec = RECEIPT_WINDOW_MS / 1000;
+        spec.it_value.tv_nsec = (RECEIPT_WINDOW_MS % 1000) * 1000000L;
+        timerfd_settime(m_timerFd, 0, &spec, nullptr);
+        m_armed = true;
+    }
+
+    RedisShards &m_redis;
+    int m_timerFd = -1;
+    bool m_armed = false;
+    std::unordered_map<std::string, Conv> m_convs; // 会话键 -> 各用户的序号
+    std::unordered_map<std::string, std::unordered_set<std::string>> m_byUser; // 用户 -> 在本节点用过的会话键
+    std::unordered_set<std::string> m_evict;                                   // 写完这一批后要丢掉的会话
+    std::unordered_map<std::pair<std::string, std::string>, Marks, PairHash> m_notify; // (发送者, 读者) -> 最新进度
+};
@@ -0,0 +1,1160 @@
+#pragma once
+#include "../include/headFile.hpp"
+#include "thread.hpp"
+
+#define SEARCH_FLUSH_DOCS 100000          // 内存索引攒到这么多条消息就写成一个段文件
+#define SEARCH_FLUSH_BYTES (64 * 1024 * 1024)
+#define SEARCH_MERGE_FANIN 8              // 末尾这么多个大小相近的段合并成一个
+#define SEARCH_MERGE_RATIO 4              // "大小相近": 最大段不超过最小段的这么多倍
+#define SEARCH_MAX_RESULTS 100
+
+// 聊天记录全文检索
+// 每条消息分词后, 词前面加上会话键作为索引项, 所以每个会话各有一份倒排表, 查询只碰自己会话的数据
+// 倒排表里是递增的消息编号, 存相邻编号的差值并用 varint 编码
+// 新消息先进内存索引, 攒满后由后台线程写成不可变的段文件 (mmap 读), 段多了再在后台合并
+// 进内存索引的消息同时追加到目录里的 .log 文件 (每轮事件循环一次 write), 段写完后删掉对应的日志;
+// 进程崩溃后重启时从日志重建内存索引, 断电时最多丢掉还在页缓存里的部分
+// 内存索引和各个段覆盖的消息编号互不重叠, 查询时从新到旧逐个查, 凑够条数就停
+
+// 无符号整数的变长编码, 每字节 7 位, 最高位表示后面还有
+struct Varint
+{
+    static void put(std::string &out, uint64_t value)
+    {
+        while (value >= 0x80)
+        {
+            out.push_back(static_cast<char>((value & 0x7f) | 0x80));
+            value >>= 7;
+        }
+        out.push_back(static_cast<char>(value));
+    }
+
+    static bool get(const char *&p, const char *end, uint64_t &value)
+    {
+        value = 0;
+        for (int shift = 0; shift < 64 && p < end; shift += 7)
+        {
+            uint8_t byte = static_cast<uint8_t>(*p++);
+            value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+            if (!(byte & 0x80))
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // 解开一段差值编码的倒排表, 追加到 ids
+    static void decodePostings(std::string_view postings, std::vector<uint64_t> &ids)
+    {
+        const char *p = postings.data();
+        const char *end = p + postings.size();
+        uint64_t id = 0, delta;
+        while (p < end && get(p, end, delta))
+        {
+            id += delta;
+            ids.push_back(id);
+        }
+    }
+};
+
+// 分词
+// ASCII 字母数字 (以及其他非 CJK 文字) 的连续段转小写后作为一个词
+// 连续的 CJK 字符切成重叠的二元组, 段末的字符再单独作为一个词; 查询单个汉字时按前缀匹配,
+// 二元组的首字加上段末字正好覆盖这个字出现的所有位置
+// 其余字符 (空白, 标点, 全角符号) 都是分隔符
+class Tokenizer
+{
+public:
+    // 对每个连续段回调 run(text, cjk), ASCII 段已转小写
+    template <typename F>
+    static void runs(std::string_view text, F &&run)
+    {
+        std::string current;
+        bool cjk = false;
+        size_t i = 0;
+        while (i < text.size())
+        {
+            size_t len;
+            uint32_t cp = decode(text, i, len);
+            int kind = classify(cp);
+            if (kind == SEPARATOR || (!current.empty() && (kind == CJK) != cjk))
+            {
+                if (!current.empty())
+                {
+                    run(std::string_view(current), cjk);
+                    current.clear();
+                }
+            }
+            if (kind != SEPARATOR)
+            {
+                cjk = kind == CJK;
+                if (cp < 0x80)
+                {
+                    current.push_back(static_cast<char>(std::tolower(static_cast<unsigned char>(cp))));
+                }
+                else
+                {
+                    current.append(text.substr(i, len));
+                }
+            }
+            i += len;
+        }
+        if (!current.empty())
+        {
+            run(std::string_view(current), cjk);
+        }
+    }
+
+    // 建索引用: 对每个词回调 emit(term)
+    template <typename F>
+    static void terms(std::string_view text, F &&emit)
+    {
+        runs(text, [&](std::string_view run, bool cjk)
+             {
+                 if (!cjk)
+                 {
+                     emit(run);
+                     return;
+                 }
+                 std::vector<size_t> starts = charStarts(run);
+                 for (size_t k = 0; k + 2 < starts.size(); ++k)
+                 {
+                     emit(run.substr(starts[k], starts[k + 2] - starts[k]));
+                 }
+                 size_t last = starts[starts.size() - 2];
+                 emit(run.substr(last)); });
+    }
+
+    // 查询用: 对每个词回调 emit(term, prefix), prefix 为 true 时匹配所有以 term 开头的词
+    template <typename F>
+    static void queryTerms(std::string_view run, bool cjk, F &&emit)
+    {
+        if (!cjk)
+        {
+            emit(run, false);
+            return;
+        }
+        std::vector<size_t> starts = charStarts(run);
+        if (starts.size() == 2)
+        {
+            emit(run, true); // 单个汉字
+            return;
+        }
+        for (size_t k = 0; k + 2 < starts.size(); ++k)
+        {
+            emit(run.substr(starts[k], starts[k + 2] - starts[k]), false);
+        }
+    }
+
+    // ASCII 转小写, 用于校验候选消息确实包含查询的原文
+    static std::string fold(std::string_view text)
+    {
+        std::string out(text);
+        for (char &ch : out)
+        {
+            ch = static_cast<char>(std::tolower(static_cast<unsigned char>(ch)));
+        }
+        return out;
+    }
+
+private:
+    enum
+    {
+        SEPARATOR,
+        WORD,
+        CJK,
+    };
+
+    // 解一个 UTF-8 字符, 非法字节按单字节分隔符处理
+    static uint32_t decode(std::string_view text, size_t i, size_t &len)
+    {
+        uint8_t b = static_cast<uint8_t>(text[i]);
+        len = b < 0x80 ? 1 : b >= 0xf0 ? 4 : b >= 0xe0 ? 3 : b >= 0xc0 ? 2 : 0;
+        if (len == 0 || i + len > text.size())
+        {
+            len = 1;
+            return 0;
+        }
+        uint32_t cp = len == 1 ? b : b & (0x3f >> (len - 1));
+        for (size_t k = 1; k < len; ++k)
+        {
+            uint8_t c = static_cast<uint8_t>(text[i + k]);
+            if ((c & 0xc0) != 0x80)
+            {
+                len = 1;
+                return 0;
+            }
+            cp = (cp << 6) | (c & 0x3f);
+        }
+        return cp;
+    }
+
+    static int classify(uint32_t cp)
+    {
+        if (cp < 0x80)
+        {
+            return std::isalnum(static_cast<int>(cp)) ? WORD : SEPARATOR;
+        }
+        if ((cp >= 0x3040 && cp <= 0x30ff) ||   // 假名
+            (cp >= 0x3400 && cp <= 0x4dbf) ||   // 扩展 A
+            (cp >= 0x4e00 && cp <= 0x9fff) ||   // 基本汉字
+            (cp >= 0xac00 && cp <= 0xd7af) ||   // 谚文
+            (cp >= 0xf900 && cp <= 0xfaff) ||   // 兼容汉字
+            (cp >= 0x20000 && cp <= 0x2ffff))   // 扩展 B 以后
+        {
+            return CJK;
+        }
+        if (cp < 0xc0 ||                        // Latin-1 符号
+            (cp >= 0x2000 && cp <= 0x2bff) ||   // 通用标点, 符号, 箭头
+            (cp >= 0x3000 && cp <= 0x303f) ||   // 中文标点
+            (cp >= 0xfe30 && cp <= 0xfe4f) ||
+            (cp >= 0xff00 && cp <= 0xff65) ||   // 全角符号
+            cp >= 0x1f000)                      // 表情
+        {
+            return SEPARATOR;
+        }
+        return WORD;
+    }
+
+    // 每个字符的起始偏移, 末尾再加上总长度
+    static std::vector<size_t> charStarts(std::string_view run)
+    {
+        std::vector<size_t> starts;
+        for (size_t i = 0; i < run.size(); ++i)
+        {
+            if ((static_cast<uint8_t>(run[i]) & 0xc0) != 0x80)
+            {
+                starts.push_back(i);
+            }
+        }
+        starts.push_back(run.size());
+        return starts;
+    }
+};
+
+// 一条被索引的消息
+struct SearchDoc
+{
+    uint64_t id = 0;
+    uint64_t time = 0; // 毫秒时间戳
+    std::string from;
+    std::string text;
+};
+
+// 内存索引, 只在事件循环线程修改; 冻结后交给后台线程写盘, 之后只读
+struct MemTable
+{
+    struct Postings
+    {
+        std::string bytes;
+        uint64_t last = 0;
+        uint32_t count = 0;
+    };
+
+    std::map<std::string, Postings> terms; // 有序, 写段文件时直接按顺序输出, 前缀查询也靠它
+    std::vector<SearchDoc> docs;           // 按编号递增
+    size_t bytes = 0;
+    std::vector<uint64_t> logs;            // 记着这些消息的日志文件编号, 写成段之后删除
+
+    void add(SearchDoc doc, const std::string &conv)
+    {
+        std::string key = conv;
+        key.push_back('\0');
+        size_t base = key.size();
+        Tokenizer::terms(doc.text, [&](std::string_view term)
+                         {
+                             key.resize(base);
+                             key.append(term);
+                             Postings &p = terms[key];
+                             if (p.last == doc.id)
+                             {
+                                 return; // 同一条消息里重复出现的词只记一次
+                             }
+                             size_t before = p.bytes.size();
+                             Varint::put(p.bytes, doc.id - p.last);
+                             p.last = doc.id;
+                             p.count++;
+                             bytes += p.bytes.size() - before + (p.count == 1 ? key.size() + sizeof(Postings) : 0); });
+        bytes += sizeof(SearchDoc) + doc.from.size() + doc.text.size();
+        docs.push_back(std::move(doc));
+    }
+
+    template <typename F>
+    void term(const std::string &key, bool prefix, F &&f) const
+    {
+        if (!prefix)
+        {
+            auto it = terms.find(key);
+            if (it != terms.end())
+            {
+                f(std::string_view(it->second.bytes));
+            }
+            return;
+        }
+        for (auto it = terms.lower_bound(key); it != terms.end() && it->first.compare(0, key.size(), key) == 0; ++it)
+        {
+            f(std::string_view(it->second.bytes));
+        }
+    }
+
+    bool doc(uint64_t id, SearchDoc &out) const
+    {
+        auto it = std::lower_bound(docs.begin(), docs.end(), id, [](const SearchDoc &d, uint64_t v)
+                                   { return d.id < v; });
+        if (it == docs.end() || it->id != id)
+        {
+            return false;
+        }
+        out = *it;
+        return true;
+    }
+};
+
+// 段文件格式 (本机字节序, 只在同一台机器上读写):
+//   SegmentHeader
+//   消息记录: varint 时间, varint 长度 + 发送者, varint 长度 + 正文
+//   索引项的键和倒排表
+//   消息表: docCount 个 {编号, 记录偏移}, 按编号递增
+//   词表:   termCount 个 TermEntry, 按键递增
+#define SEARCH_SEGMENT_MAGIC "CIX1"
+
+struct SegmentHeader
+{
+    char magic[4];
+    uint32_t reserved;
+    uint64_t seq;     // 生成顺序, 合并出的段比被合并的段大
+    uint64_t minDoc;
+    uint64_t maxDoc;
+    uint64_t docCount;
+    uint64_t termCount;
+    uint64_t docTable;
+    uint64_t termTable;
+};
+
+struct DocEntry
+{
+    uint64_t id;
+    uint64_t offset;
+};
+
+struct TermEntry
+{
+    uint64_t keyOffset;
+    uint32_t keyLength;
+    uint32_t count;
+    uint64_t postingsOffset;
+    uint64_t postingsLength;
+};
+
+// 只读的段, 整个文件 mmap 进来, 查询直接在映射上二分
+// 合并后旧文件被删除, 但映射在最后一个引用释放前一直有效
+class Segment
+{
+public:
+    // 文件损坏或不完整时返回空
+    static std::shared_ptr<Segment> open(const std::string &path)
+    {
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd == -1)
+        {
+            return nullptr;
+        }
+        struct stat st{};
+        if (fstat(fd, &st) == -1 || static_cast<size_t>(st.st_size) < sizeof(SegmentHeader))
+        {
+            close(fd);
+            return nullptr;
+        }
+        void *base = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if (base == MAP_FAILED)
+        {
+            return nullptr;
+        }
+        std::shared_ptr<Segment> segment(new Segment(path, static_cast<const char *>(base), st.st_size));
+        return segment->valid() ? segment : nullptr;
+    }
+
+    ~Segment()
+    {
+        munmap(const_cast<char *>(m_base), m_size);
+    }
+
+    Segment(const Segment &other) = delete;
+    Segment &operator=(const Segment &other) = delete;
+
+    const std::string &path() const { return m_path; }
+    const SegmentHeader &header() const { return m_header; }
+    size_t size() const { return m_size; }
+
+    template <typename F>
+    void term(const std::string &key, bool prefix, F &&f) const
+    {
+        const TermEntry *begin = terms();
+        const TermEntry *end = begin + m_header.termCount;
+        const TermEntry *it = std::lower_bound(begin, end, std::string_view(key), [this](const TermEntry &e, std::string_view k)
+                                               { return keyOf(e) < k; });
+        for (; it != end; ++it)
+        {
+            std::string_view k = keyOf(*it);
+            if (prefix ? k.substr(0, key.size()) != key : k != key)
+            {
+                break;
+            }
+            f(postingsOf(*it));
+        }
+    }
+
+    bool doc(uint64_t id, SearchDoc &out) const
+    {
+        const DocEntry *begin = docs();
+        const DocEntry *end = begin + m_header.docCount;
+        const DocEntry *it = std::lower_bound(begin, end, id, [](const DocEntry &e, uint64_t v)
+                                              { return e.id < v; });
+        if (it == end || it->id != id)
+        {
+            return false;
+        }
+        const char *p = m_base + it->offset;
+        const char *limit = m_base + m_size;
+        uint64_t time, len;
+        if (!Varint::get(p, limit, time) || !Varint::get(p, limit, len) || len > static_cast<size_t>(limit - p))
+        {
+            return false;
+        }
+        out.id = id;
+        out.time = time;
+        out.from.assign(p, len);
+        p += len;
+        if (!Varint::get(p, limit, len) || len > static_cast<size_t>(limit - p))
+        {
+            return false;
+        }
+        out.text.assign(p, len);
+        return true;
+    }
+
+    // 原样取出一条记录, 合并时直接拷贝
+    std::string_view record(size_t index) const
+    {
+        const DocEntry *d = docs();
+        uint64_t begin = d[index].offset;
+        uint64_t end = index + 1 < m_header.docCount ? d[index + 1].offset : recordsEnd();
+        return std::string_view(m_base + begin, end - begin);
+    }
+
+    const DocEntry *docs() const { return reinterpret_cast<const DocEntry *>(m_base + m_header.docTable); }
+    const TermEntry *terms() const { return reinterpret_cast<const TermEntry *>(m_base + m_header.termTable); }
+    std::string_view keyOf(const TermEntry &e) const { return std::string_view(m_base + e.keyOffset, e.keyLength); }
+    std::string_view postingsOf(const TermEntry &e) const { return std::string_view(m_base + e.postingsOffset, e.postingsLength); }
+
+private:
+    Segment(const std::string &path, const char *base, size_t size) : m_path(path), m_base(base), m_size(size)
+    {
+        std::memcpy(&m_header, m_base, sizeof(m_header));
+    }
+
+    bool valid() const
+    {
+        if (std::memcmp(m_header.magic, SEARCH_SEGMENT_MAGIC, 4) != 0)
+        {
+            return false;
+        }
+        auto fits = [this](uint64_t offset, uint64_t count, size_t entry)
+        {
+            return offset % 8 == 0 && offset <= m_size && count <= (m_size - offset) / entry;
+        };
+        if (!fits(m_header.docTable, m_header.docCount, sizeof(DocEntry)) ||
+            !fits(m_header.termTable, m_header.termCount, sizeof(TermEntry)))
+        {
+            return false;
+        }
+        for (uint64_t i = 0; i < m_header.termCount; ++i)
+        {
+            const TermEntry &e = terms()[i];
+            if (e.keyOffset > m_size || e.keyLength > m_size - e.keyOffset ||
+                e.postingsOffset > m_size || e.postingsLength > m_size - e.postingsOffset)
+            {
+                return false;
+            }
+        }
+        for (uint64_t i = 0; i < m_header.docCount; ++i)
+        {
+            if (docs()[i].offset >= m_header.docTable)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // 消息记录区的结尾: 第一个键, 没有键时是消息表
+    uint64_t recordsEnd() const
+    {
+        return m_header.termCount > 0 ? std::min(terms()[0].keyOffset, m_header.docTable) : m_header.docTable;
+    }
+
+    std::string m_path;
+    const char *m_base;
+    size_t m_size;
+    SegmentHeader m_header{};
+};
+
+// 顺序写出一个段: 先写所有消息, 再按键的顺序写索引项, 最后补上两张表和文件头
+// 先写临时文件, fsync 后改名, 崩溃时不会留下半个段
+class SegmentWriter
+{
+public:
+    explicit SegmentWriter(const std::string &path) : m_path(path), m_tmp(path + ".tmp")
+    {
+        m_file = fopen(m_tmp.c_str(), "wb");
+        if (!m_file)
+        {
+            throw std::runtime_error("open " + m_tmp + ": " + strerror(errno));
+        }
+        SegmentHeader header{};
+        write(&header, sizeof(header));
+    }
+
+    ~SegmentWriter()
+    {
+        if (m_file)
+        {
+            fclose(m_file);
+            unlink(m_tmp.c_str());
+        }
+    }
+
+    SegmentWriter(const SegmentWriter &other) = delete;
+    SegmentWriter &operator=(const SegmentWriter &other) = delete;
+
+    void addDoc(const SearchDoc &doc)
+    {
+        m_scratch.clear();
+        Varint::put(m_scratch, doc.time);
+        Varint::put(m_scratch, doc.from.size());
+        m_scratch.append(doc.from);
+        Varint::put(m_scratch, doc.text.size());
+        m_scratch.append(doc.text);
+        addRecord(doc.id, m_scratch);
+    }
+
+    // 已编码的记录, 来自另一个段
+    void addRecord(uint64_t id, std::string_view record)
+    {
+        m_docs.push_back({id, m_offset});
+        write(record.data(), record.size());
+    }
+
+    void addTerm(std::string_view key, std::string_view postings, uint32_t count)
+    {
+        TermEntry e{};
+        e.keyOffset = m_offset;
+        e.keyLength = key.size();
+        write(key.data(), key.size());
+        e.postingsOffset = m_offset;
+        e.postingsLength = postings.size();
+        e.count = count;
+        write(postings.data(), postings.size());
+        m_terms.push_back(e);
+    }
+
+    std::shared_ptr<Segment> finish(uint64_t seq)
+    {
+        SegmentHeader header{};
+        std::memcpy(header.magic, SEARCH_SEGMENT_MAGIC, 4);
+        header.seq = seq;
+        header.minDoc = m_docs.empty() ? 0 : m_docs.front().id;
+        header.maxDoc = m_docs.empty() ? 0 : m_docs.back().id;
+        header.docCount = m_docs.size();
+        header.termCount = m_terms.size();
+
+        static const char zeros[8] = {};
+        write(zeros, (8 - m_offset % 8) % 8);
+        header.docTable = m_offset;
+        write(m_docs.data(), m_docs.size() * sizeof(DocEntry));
+        header.termTable = m_offset;
+        write(m_terms.data(), m_terms.size() * sizeof(TermEntry));
+
+        if (fseek(m_file, 0, SEEK_SET) != 0)
+        {
+            throw std::runtime_error("seek " + m_tmp + ": " + strerror(errno));
+        }
+        write(&header, sizeof(header));
+        if (fflush(m_file) != 0 || fsync(fileno(m_file)) != 0)
+        {
+            throw std::runtime_error("sync " + m_tmp + ": " + strerror(errno));
+        }
+        fclose(m_file);
+        m_file = nullptr;
+        if (rename(m_tmp.c_str(), m_path.c_str()) != 0)
+        {
+            throw std::runtime_error("rename " + m_tmp + ": " + strerror(errno));
+        }
+        syncDirectory(std::filesystem::path(m_path).parent_path().string());
+
+        std::shared_ptr<Segment> segment = Segment::open(m_path);
+        if (!segment)
+        {
+            throw std::runtime_error("reopen " + m_path + " failed");
+        }
+        return segment;
+    }
+
+    static void syncDirectory(const std::string &dir)
+    {
+        int fd = ::open(dir.empty() ? "." : dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (fd != -1)
+        {
+            fsync(fd);
+            close(fd);
+        }
+    }
+
+private:
+    void write(const void *data, size_t len)
+    {
+        if (len > 0 && fwrite(data, 1, len, m_file) != len)
+        {
+            throw std::runtime_error("write " + m_tmp + ": " + strerror(errno));
+        }
+        m_offset += len;
+    }
+
+    std::string m_path;
+    std::string m_tmp;
+    FILE *m_file = nullptr;
+    uint64_t m_offset = 0;
+    std::string m_scratch;
+    std::vector<DocEntry> m_docs;
+    std::vector<TermEntry> m_terms;
+};
+
+// 检索服务
+// add/search 只在事件循环线程调用; 写段和合并在唯一的后台线程里串行执行,
+// 段列表和正在写盘的内存索引由互斥锁保护, 查询时先取一份快照
+class SearchIndex
+{
+public:
+    explicit SearchIndex(const std::string &dir) : m_dir(dir), m_worker(1)
+    {
+        std::filesystem::create_directories(m_dir);
+        load();
+        recover();
+        openLog();
+        if (m_logFd == -1)
+        {
+            throw std::runtime_error("cannot open search log in " + m_dir);
+        }
+        m_worker.init();
+    }
+
+    // 剩下的内存索引同步写盘, 等后台任务做完再退出
+    // 事件循环已经停了, 在后台线程里冻结内存索引也不会有竞争
+    ~SearchIndex()
+    {
+        m_worker.submit([this]()
+                        {
+                            writeFrozen(); // 之前写盘失败留下的
+                            if (!m_mem->docs.empty())
+                            {
+                                freeze();
+                                writeFrozen();
+                            } })
+            .wait();
+        m_worker.shutdown();
+        if (m_logFd != -1)
+        {
+            close(m_logFd);
+        }
+        if (m_mem->docs.empty())
+        {
+            removeLogs(*m_mem);
+        }
+    }
+
+    SearchIndex(const SearchIndex &other) = delete;
+    SearchIndex &operator=(const SearchIndex &other) = delete;
+
+    // 索引一条消息, conv 是会话键 (History::key)
+    void add(const std::string &conv, std::string_view from, std::string_view text)
+    {
+        SearchDoc doc;
+        doc.id = m_nextDoc++;
+        doc.time = std::chrono::duration_cast<std::chrono::milliseconds>(
+                       std::chrono::system_clock::now().time_since_epoch())
+                       .count();
+        doc.from.assign(from.data(), from.size());
+        doc.text.assign(text.data(), text.size());
+        // 日志记录: 编号 | 时间 | 会话键 | 发送者 | 正文, 都是 varint 或 varint 长度加内容
+        Varint::put(m_logBuf, doc.id);
+        Varint::put(m_logBuf, doc.time);
+        for (std::string_view field : {std::string_view(conv), from, text})
+        {
+            Varint::put(m_logBuf, field.size());
+            m_logBuf.append(field.data(), field.size());
+        }
+        m_mem->add(std::move(doc), conv);
+
+        bool full = m_mem->docs.size() >= SEARCH_FLUSH_DOCS || m_mem->bytes >= SEARCH_FLUSH_BYTES;
+        if (full && !m_flushing)
+        {
+            if (!m_frozen)
+            {
+                freeze();
+            }
+            // 上次写盘失败时 m_frozen 还在, 这里顺便重试
+            m_flushing = true;
+            m_worker.submit([this]()
+                            { writeFrozen(); mergeTail(); });
+        }
+    }
+
+    // 把本轮攒下的日志记录写进文件, 每轮事件循环结束时调用
+    void sync()
+    {
+        if (m_logFd == -1)
+        {
+            m_logBuf.clear();
+            return;
+        }
+        for (size_t done = 0; done < m_logBuf.size();)
+        {
+            ssize_t n = write(m_logFd, m_logBuf.data() + done, m_logBuf.size() - done);
+            if (n == -1 && errno == EINTR)
+            {
+                continue;
+            }
+            if (n == -1)
+            {
+                // 只影响崩溃后的恢复, 索引照常工作
+                perror("write: search log");
+                break;
+            }
+            done += n;
+        }
+        m_logBuf.clear();
+    }
+
+    // 在 conv 里查找同时包含所有查询词的消息, 从新到旧最多返回 limit 条
+    std::vector<SearchDoc> search(const std::string &conv, std::string_view query, size_t limit)
+    {
+        std::vector<SearchDoc> hits;
+        std::vector<std::pair<std::string, bool>> terms; // 索引项键, 是否前缀匹配
+        std::vector<std::string> phrases;                // 候选消息必须包含的原文片段
+        std::string key = conv;
+        key.push_back('\0');
+        Tokenizer::runs(query, [&](std::string_view run, bool cjk)
+                        {
+                            phrases.emplace_back(run);
+                            Tokenizer::queryTerms(run, cjk, [&](std::string_view term, bool prefix)
+                                                  { terms.emplace_back(key + std::string(term), prefix); }); });
+        if (terms.empty() || limit == 0)
+        {
+            return hits;
+        }
+
+        std::shared_ptr<const MemTable> frozen;
+        std::vector<std::shared_ptr<Segment>> segments;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            frozen = m_frozen;
+            segments = m_segments;
+        }
+
+        // 从新到旧: 内存索引, 正在写盘的内存索引, 各个段
+        searchIn(*m_mem, terms, phrases, limit, hits);
+        if (frozen && hits.size() < limit)
+        {
+            searchIn(*frozen, terms, phrases, limit, hits);
+        }
+        for (auto it = segments.rbegin(); it != segments.rend() && hits.size() < limit; ++it)
+        {
+            searchIn(**it, terms, phrases, limit, hits);
+        }
+        return hits;
+    }
+
+private:
+    template <typename Source>
+    static void searchIn(const Source &source, const std::vector<std::pair<std::string, bool>> &terms,
+                         const std::vector<std::string> &phrases, size_t limit, std::vector<SearchDoc> &hits)
+    {
+        // 每个查询词的候选编号, 前缀匹配的把多张倒排表并起来
+        std::vector<std::vector<uint64_t>> lists;
+        for (auto &[term, prefix] : terms)
+        {
+            std::vector<uint64_t> ids;
+            size_t parts = 0;
+            source.term(term, prefix, [&](std::string_view postings)
+                        { Varint::decodePostings(postings, ids); ++parts; });
+            if (ids.empty())
+            {
+                return; // 有一个词不存在, 这一部分不可能命中
+            }
+            if (parts > 1)
+            {
+                std::sort(ids.begin(), ids.end());
+                ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+            }
+            lists.push_back(std::move(ids));
+        }
+
+        // 从最短的表开始求交集
+        std::sort(lists.begin(), lists.end(), [](const auto &a, const auto &b)
+                  { return a.size() < b.size(); });
+        std::vector<uint64_t> result = std::move(lists[0]);
+        std::vector<uint64_t> next;
+        for (size_t i = 1; i < lists.size() && !result.empty(); ++i)
+        {
+            next.clear();
+            std::set_intersection(result.begin(), result.end(), lists[i].begin(), lists[i].end(), std::back_inserter(next));
+            result.swap(next);
+        }
+
+        // 二元组可能凑出原文里并不相连的字, 用原文再核对一遍
+        SearchDoc doc;
+        for (auto it = result.rbegin(); it != result.rend() && hits.size() < limit; ++it)
+        {
+            if (!source.doc(*it, doc))
+            {
+                continue;
+            }
+            std::string folded = Tokenizer::fold(doc.text);
+            bool match = std::all_of(phrases.begin(), phrases.end(), [&](const std::string &p)
+                                     { return folded.find(p) != std::string::npos; });
+            if (match)
+            {
+                hits.push_back(doc);
+            }
+        }
+    }
+
+    // 冻结的同时换一个日志文件, 新的内存索引从新文件开始记
+    void freeze()
+    {
+        sync();
+        if (m_logFd != -1)
+        {
+            close(m_logFd);
+        }
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_frozen = std::move(m_mem);
+            m_mem = std::make_shared<MemTable>();
+        }
+        openLog();
+    }
+
+    // 打不开时 m_logFd 为 -1, 这个内存索引不记日志, 崩溃后要丢
+    void openLog()
+    {
+        uint64_t gen = m_nextLog++;
+        m_logFd = open(logPath(gen).c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0600);
+        if (m_logFd == -1)
+        {
+            perror("open: search log");
+            return;
+        }
+        m_mem->logs.push_back(gen);
+    }
+
+    void removeLogs(const MemTable &table)
+    {
+        for (uint64_t gen : table.logs)
+        {
+            unlink(logPath(gen).c_str());
+        }
+    }
+
+    // 启动时按编号顺序重放日志, 已经在段里的消息 (写完段、删日志之前崩溃) 跳过
+    // 末尾不完整的记录是写到一半时崩溃留下的, 丢掉
+    void recover()
+    {
+        std::vector<uint64_t> gens;
+        for (const auto &entry : std::filesystem::directory_iterator(m_dir))
+        {
+            if (entry.path().extension() == ".log")
+            {
+                gens.push_back(std::strtoull(entry.path().stem().c_str(), nullptr, 10));
+            }
+        }
+        std::sort(gens.begin(), gens.end());
+        size_t replayed = 0;
+        for (uint64_t gen : gens)
+        {
+            m_nextLog = std::max(m_nextLog, gen + 1);
+            std::ifstream in(logPath(gen), std::ios::binary);
+            std::string data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+            const char *p = data.data(), *end = p + data.size();
+            size_t kept = 0;
+            while (p < end)
+            {
+                SearchDoc doc;
+                std::string_view fields[3];
+                if (!Varint::get(p, end, doc.id) || !Varint::get(p, end, doc.time))
+                {
+                    break;
+                }
+                bool complete = true;
+                for (std::string_view &field : fields)
+                {
+                    uint64_t len = 0;
+                    if (!Varint::get(p, end, len) || len > static_cast<uint64_t>(end - p))
+                    {
+                        complete = false;
+                        break;
+                    }
+                    field = std::string_view(p, len);
+                    p += len;
+                }
+                if (!complete)
+                {
+                    break;
+                }
+                if (doc.id < m_nextDoc)
+                {
+                    continue;
+                }
+                doc.from.assign(fields[1]);
+                doc.text.assign(fields[2]);
+                m_nextDoc = doc.id + 1;
+                m_mem->add(std::move(doc), std::string(fields[0]));
+                kept++;
+            }
+            if (kept == 0)
+            {
+                unlink(logPath(gen).c_str());
+                continue;
+            }
+            m_mem->logs.push_back(gen);
+            replayed += kept;
+        }
+        if (replayed > 0)
+        {
+            std::cout << "Recovered " << replayed << " unflushed search documents" << std::endl;
+        }
+    }
+
+    // 后台线程: 把冻结的内存索引写成段
+    void writeFrozen()
+    {
+        std::shared_ptr<const MemTable> frozen;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            frozen = m_frozen;
+        }
+        if (!frozen)
+        {
+            m_flushing = false;
+            return;
+        }
+        try
+        {
+            SegmentWriter writer(segmentPath(m_nextSeq));
+            for (const SearchDoc &doc : frozen->docs)
+            {
+                writer.addDoc(doc);
+            }
+            for (auto &[key, postings] : frozen->terms)
+            {
+                writer.addTerm(key, postings.bytes, postings.count);
+            }
+            std::shared_ptr<Segment> segment = writer.finish(m_nextSeq++);
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_segments.push_back(std::move(segment));
+                m_frozen.reset();
+            }
+            removeLogs(*frozen);
+        }
+        catch (const std::exception &e)
+        {
+            // 内存索引继续留着提供查询, 下次攒满时重试
+            std::cerr << "Search index flush failed: " << e.what() << std::endl;
+        }
+        m_flushing = false;
+    }
+
+    // 后台线程: 末尾 SEARCH_MERGE_FANIN 个段大小相近时合并成一个
+    // 新段总在末尾, 小段先合并成中段, 中段攒够了再合并成大段, 每条消息被重写的次数是对数级的
+    void mergeTail()
+    {
+        std::vector<std::shared_ptr<Segment>> inputs;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            if (m_segments.size() < SEARCH_MERGE_FANIN)
+            {
+                return;
+            }
+            inputs.assign(m_segments.end() - SEARCH_MERGE_FANIN, m_segments.end());
+        }
+        auto bySize = [](const auto &a, const auto &b)
+        { return a->size() < b->size(); };
+        size_t smallest = (*std::min_element(inputs.begin(), inputs.end(), bySize))->size();
+        size_t largest = (*std::max_element(inputs.begin(), inputs.end(), bySize))->size();
+        if (largest > smallest * SEARCH_MERGE_RATIO)
+        {
+            return;
+        }
+
+        try
+        {
+            std::shared_ptr<Segment> merged = merge(inputs);
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_segments.erase(m_segments.end() - inputs.size(), m_segments.end());
+                m_segments.push_back(merged);
+            }
+            // 正在进行的查询还持有映射, 删掉文件不影响它们
+            for (auto &segment : inputs)
+            {
+                unlink(segment->path().c_str());
+            }
+        }
+        catch (const std::exception &e)
+        {
+            std::cerr << "Search index merge failed: " << e.what() << std::endl;
+        }
+    }
+
+    // 多路归并: 消息按编号顺序拷贝, 同一个键的倒排表按段的顺序拼接并重新计算差值
+    std::shared_ptr<Segment> merge(const std::vector<std::shared_ptr<Segment>> &inputs)
+    {
+        uint64_t seq = m_nextSeq++;
+        SegmentWriter writer(segmentPath(seq));
+        for (auto &segment : inputs)
+        {
+            const DocEntry *docs = segment->docs();
+            for (uint64_t i = 0; i < segment->header().docCount; ++i)
+            {
+                writer.addRecord(docs[i].id, segment->record(i));
+            }
+        }
+
+        std::vector<uint64_t> cursor(inputs.size(), 0);
+        std::vector<uint64_t> ids;
+        std::string postings;
+        while (true)
+        {
+            std::string_view key;
+            bool found = false;
+            for (size_t s = 0; s < inputs.size(); ++s)
+            {
+                if (cursor[s] < inputs[s]->header().termCount)
+                {
+                    std::string_view k = inputs[s]->keyOf(inputs[s]->terms()[cursor[s]]);
+                    if (!found || k < key)
+                    {
+                        key = k;
+                        found = true;
+                    }
+                }
+            }
+            if (!found)
+            {
+                break;
+            }
+            ids.clear();
+            for (size_t s = 0; s < inputs.size(); ++s)
+            {
+                if (cursor[s] < inputs[s]->header().termCount)
+                {
+                    const TermEntry &e = inputs[s]->terms()[cursor[s]];
+                    if (inputs[s]->keyOf(e) == key)
+                    {
+                        Varint::decodePostings(inputs[s]->postingsOf(e), ids);
+                        cursor[s]++;
+                    }
+                }
+            }
+            postings.clear();
+            uint64_t last = 0;
+            for (uint64_t id : ids)
+            {
+                Varint::put(postings, id - last);
+                last = id;
+            }
+            // key 指向输入段的映射, 上面推进游标后仍然有效
+            writer.addTerm(key, postings, ids.size());
+        }
+        return writer.finish(seq);
+    }
+
+    // 启动时打开目录里的所有段; 合并到一半崩溃时新旧段会同时存在, 被更新的段完全覆盖的旧段直接删掉
+    void load()
+    {
+        std::vector<std::shared_ptr<Segment>> all;
+        for (const auto &entry : std::filesystem::directory_iterator(m_dir))
+        {
+            std::string path = entry.path().string();
+            if (entry.path().extension() == ".tmp")
+            {
+                std::filesystem::remove(entry.path());
+                continue;
+            }
+            if (entry.path().extension() != ".seg")
+            {
+                continue;
+            }
+            std::shared_ptr<Segment> segment = Segment::open(path);
+            if (!segment)
+            {
+                std::cerr << "Skipping corrupt search segment " << path << std::endl;
+                continue;
+            }
+            all.push_back(segment);
+        }
+        std::sort(all.begin(), all.end(), [](const auto &a, const auto &b)
+                  { return a->header().seq > b->header().seq; });
+        for (auto &segment : all)
+        {
+            const SegmentHeader &h = segment->header();
+            bool covered = std::any_of(m_segments.begin(), m_segments.end(), [&](const auto &newer)
+                                       { return newer->header().minDoc <= h.minDoc && h.maxDoc <= newer->header().maxDoc; });
+            if (covered)
+            {
+                unlink(segment->path().c_str());
+                continue;
+            }
+            m_segments.push_back(segment);
+            m_nextDoc = std::max(m_nextDoc, h.maxDoc + 1);
+            m_nextSeq = std::max(m_nextSeq, h.seq + 1);
+        }
+        // 段按覆盖的编号排列, 和写入顺序一致
+        std::sort(m_segments.begin(), m_segments.end(), [](const auto &a, const auto &b)
+                  { return a->header().minDoc < b->header().minDoc; });
+        for (auto &segment : all)
+        {
+            m_nextSeq = std::max(m_nextSeq, segment->header().seq + 1);
+        }
+    }
+
+    std::string logPath(uint64_t gen) const
+    {
+        char name[32];
+        snprintf(name, sizeof(name), "%012llu.log", static_cast<unsigned long long>(gen));
+        return (std::filesystem::path(m_dir) / name).string();
+    }
+
+    std::string segmentPath(uint64_t seq) const
+    {
+        char name[32];
+        snprintf(name, sizeof(name), "%012llu.seg", static_cast<unsigned long long>(seq));
+        return (std::filesystem::path(m_dir) / name).string();
+    }
+
+    std::string m_dir;
+    std::shared_ptr<MemTable> m_mem = std::make_shared<MemTable>();
+    uint64_t m_nextDoc = 1;
+    uint64_t m_nextSeq = 1; // 启动时在 load 里设置, 之后只由后台线程使用
+    uint64_t m_nextLog = 1; // 下一个日志文件的编号
+    int m_logFd = -1;       // 当前内存索引的日志
+    std::string m_logBuf;   // 本轮还没写出的日志记录
+    std::atomic<bool> m_flushing{false};
+    std::mutex m_mutex; // 保护 m_frozen 和 m_segments
+    std::shared_ptr<const MemTable> m_frozen;
+    std::vector<std::shared_ptr<Segment>> m_segments; // 按消息编号递增
+    ThreadPool m_worker;
+};
@@ -6,9 +6,7 @@
 #include <cstring>
 #include <iostream>
 #include <hiredis/hiredis.h>
-
-#define MAX_EVENTS 10
-#define READ_BUFFER 1024
+#include "server.hpp"
 
 void set_nonblocking(int sock) {
     int opts = fcntl(sock, F_GETFL);
@@ -23,137 +21,243 @@ void set_nonblocking(int sock) {
     }
 }
 
-int main() {
-    int server_fd, client_fd;
-    struct sockaddr_in server_addr{}, client_addr{};
-    socklen_t client_len = sizeof(client_addr);
-
-    // 创建 Redis 客户端
-    redisContext *redis_ctx = redisConnect("127.0.0.1", 6379);
-    if (redis_ctx == nullptr || redis_ctx->err) {
-        if (redis_ctx) {
-            std::cerr << "Redis connection error: " << redis_ctx->errstr << std::endl;
-            redisFree(redis_ctx);
-        } else {
-            std::cerr << "Redis connection error: can't allocate redis context" << std::endl;
-        }
-        exit(EXIT_FAILURE);
-    }
-
-    // 创建服务器socket
-    server_fd = socket(AF_INET, SOCK_STREAM, 0);
-    if (server_fd == -1) {
-        perror("socket");
+// 用法: server [port] [nodeId] [--streams] [--takeover] [--upgrade-path=PATH] [--search-dir=DIR] [--journal=DIR] [--redis-shards=LIST]
+//              [--reactors=N] [--reactor-cpus=LIST] [--worker-cpus=LIST] [--max-conns=N] [--shed=LAG_MS:QUEUE_MB]
+//              [--tls] [--tls-cert=FILE --tls-key=FILE] [--trace=N] [--trace-dir=DIR]
+//              [--capture=FILE[:MB]] [--bench-login]
+// 指定 nodeId 时以集群模式运行, 所有节点共用同一个 Redis
+//   本机检查两个节点: 用同一个 redis-server 启动 server 8080 n1 --bench-login 和 server 8081 n2 --bench-login,
+//   再运行 client --check port=8080 peer=8081 bench=1
+// --streams 把会话记录和跨节点投递放进 Redis 流, 崩溃后可重放
+// --search-dir 启用聊天记录全文检索 (SEARCH 命令), 索引文件放在 DIR
+// --journal 消息写 Redis 之前先追加到 DIR 下的本地日志, 崩溃重启后补写; 只在 --streams 下有意义
+// --redis-shards 用户、会话和回执按键分片到这些 Redis 实例 (host:port,...), 默认只用本机 6379;
+//   运行中向控制频道 "shards" 发布 "add host:port" / "remove host:port" 增删实例, 各节点同步修改并迁移数据,
+//   新启动的节点要带上当前的完整列表
+//   本机检查: 起几个 redis-server, 两个节点带同样的列表和 --bench-login, 运行 client --check ... peer=P bench=1 accounts=NAME;
+//   向 "shards" 发布 add/remove 后用同样的 accounts 再跑一次, 检查迁移后账号还在
+// --takeover 启动新版本并从同一端口上运行中的旧进程接管所有连接, 旧进程随后退出
+//   旧进程先等在途的注册和登录结束 (最多 3 秒), 期间昂贵命令回 BUSY; 到时还没结束的连接被关闭, 客户端重连
+// --reactor-cpus 事件循环线程绑到这些核上 (0-3,8 这样的列表), 内存从核所在的 NUMA 节点分配
+// --worker-cpus 线程池和日志同步线程轮流绑到这些核上
+// --reactors=N 启动 N 个反应器进程共用端口 (SO_REUSEPORT), 第 k 个绑到 reactor-cpus 的第 k 个核,
+//   新连接交给在同一个核上处理网卡中断的那个进程; 各进程以 nodeId-k 组成集群, 需要指定 nodeId
+// --max-conns 连接数上限 (默认 10000), 超出的新连接收到 BUSY 后被关闭
+// --shed 过载阈值: 事件循环每轮平滑耗时 (毫秒) 和缓冲区积压 (MB), 默认 50:256, 0 表示不看这个信号;
+//   超过阈值时昂贵命令回 BUSY, 超过两倍时新连接和未登录的请求也回 BUSY, 已登录用户的消息照常处理
+// --tls 只接受 TLS 1.3 连接, 握手后加解密尽量交给内核 (kTLS); 证书和私钥用 --tls-cert/--tls-key 指定 (PEM),
+//   不指定时生成临时自签名证书, 只用于测试
+// --trace=N 每 N 个请求抽一个记录各段耗时 (收帧、分发、线程池排队和执行、Redis、发送), 默认关闭;
+//   向进程发 SIGUSR2 时把各线程最近的记录写成 DIR/chatroom-trace-<pid>-<序号>.json (Chrome trace 格式, 默认 DIR 为 /tmp)
+// --capture 把每条连接的建立、关闭和收到的每一帧 (带时间) 录进 FILE, 可选的 MB 是文件大小上限;
+//   用 client --replay capture=FILE 按原来的节奏回放, 比较两个版本的吞吐和延迟; REGISTER/LOGIN 的密码等参数录制时去掉, 其余请求原样保存
+// --bench-login 接受不带密码的 "LOGIN user" 和不带邮箱 (不做验证) 的 REGISTER, 只用于压测 (client --bench 需要); 任何人都能登录成任何用户
+static int runServer(const ServerOptions &options) {
+    // Server 内含 64KB 读缓冲区, 放在堆上
+    std::unique_ptr<Server> server;
+    try {
+        server = std::make_unique<Server>(options);
+    } catch (const std::exception &e) {
+        std::cerr << "Startup error: " << e.what() << std::endl;
         exit(EXIT_FAILURE);
     }
 
-    // 设置服务器地址和端口
-    server_addr.sin_family = AF_INET;
-    server_addr.sin_addr.s_addr = INADDR_ANY;
-    server_addr.sin_port = htons(12345);
+    server->listenOn();
+    server->run();
+    return 0;
+}
 
-    // 绑定socket
-    if (bind(server_fd, (struct sockaddr *)&server_addr, sizeof(server_addr)) == -1) {
-        perror("bind");
-        exit(EXIT_FAILURE);
+// 父进程建好一组共用端口的监听 socket 再 fork, 加入顺序就是下标, 和按核分配的结果一一对应
+static int runReactors(ServerOptions options, int reactors, const std::vector<int> &cpus) {
+    std::vector<int> fds;
+    for (int k = 0; k < reactors; k++) {
+        fds.push_back(Server::openListener(options.port, true));
     }
-
-    // 开始监听
-    if (listen(server_fd, SOMAXCONN) == -1) {
-        perror("listen");
-        exit(EXIT_FAILURE);
+    if (cpus.size() >= static_cast<size_t>(reactors)) {
+        std::vector<int> steer(cpus.begin(), cpus.begin() + reactors);
+        Affinity::steerByCpu(fds[0], steer);
+        for (int k = 0; k < reactors; k++) {
+            setsockopt(fds[k], SOL_SOCKET, SO_INCOMING_CPU, &steer[k], sizeof(steer[k]));
+        }
     }
 
-    // 设置为非阻塞模式
-    set_nonblocking(server_fd);
-    // 创建epoll实例
-    int epoll_fd = epoll_create1(0);
-    if (epoll_fd == -1) {
-        perror("epoll_create1");
-        exit(EXIT_FAILURE);
+    std::string nodeId = options.nodeId;
+    std::string upgradePath = options.upgradePath;
+    std::string journalDir = options.journalDir;
+    std::string searchDir = options.searchDir;
+    std::string capturePath = options.capturePath;
+    for (int k = 0; k < reactors; k++) {
+        pid_t pid = fork();
+        if (pid == -1) {
+            perror("fork");
+            exit(EXIT_FAILURE);
+        }
+        if (pid == 0) {
+            for (int j = 0; j < reactors; j++) {
+                if (j != k) {
+                    close(fds[j]);
+                }
+            }
+            if (!cpus.empty()) {
+                Affinity::pin(cpus[k % cpus.size()]);
+            }
+            std::string suffix = "-" + std::to_string(k);
+            options.listenFd = fds[k];
+            options.nodeId = nodeId + suffix;
+            options.upgradePath = (upgradePath.empty() ? "/tmp/chatroom-" + std::to_string(options.port) : upgradePath) + suffix + ".sock";
+            options.journalDir = journalDir.empty() ? "" : journalDir + "/" + std::to_string(k);
+            options.searchDir = searchDir.empty() ? "" : searchDir + "/" + std::to_string(k);
+            options.capturePath = capturePath.empty() ? "" : capturePath + suffix;
+            return runServer(options);
+        }
+    }
+    for (int fd : fds) {
+        close(fd);
     }
 
-    // 将服务器socket添加到epoll监听中
-    struct epoll_event ev, events[MAX_EVENTS];
-    ev.events = EPOLLIN;
-    ev.data.fd = server_fd;
-    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, server_fd, &ev) == -1) {
-        perror("epoll_ctl: server_fd");
-        exit(EXIT_FAILURE);
+    int status = 0;
+    pid_t pid;
+    while ((pid = wait(&status)) > 0) {
+        std::cerr << "Reactor process " << pid << " exited with status " << status << std::endl;
     }
+    return 0;
+}
 
-    // 开始事件循环
-    while (true) {
-        int nfds = epoll_wait(epoll_fd, events, MAX_EVENTS, -1);
-        if (nfds == -1) {
-            perror("epoll_wait");
-            exit(EXIT_FAILURE);
-        }
+int main(int argc, char **argv) {
+    // 对端关闭后继续写不应杀死整个进程
+    signal(SIGPIPE, SIG_IGN);
 
-        for (int i = 0; i < nfds; ++i) {
-            if (events[i].data.fd == server_fd) {
-                // 处理新连接
-                client_fd = accept(server_fd, (struct sockaddr *)&client_addr, &client_len);
-                if (client_fd == -1) {
-                    perror("accept");
-                    continue;
+    ServerOptions options;
+    std::vector<std::string> positional;
+    int reactors = 1;
+    std::vector<int> reactorCpus;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--streams") {
+            options.streams = true;
+        } else if (arg == "--takeover") {
+            options.takeover = true;
+        } else if (arg.rfind("--upgrade-path=", 0) == 0) {
+            options.upgradePath = arg.substr(strlen("--upgrade-path="));
+        } else if (arg.rfind("--rate-limit=", 0) == 0) {
+            // --rate-limit=帧/秒:字节/秒:昂贵命令/秒[:集群内每用户消息/秒], 0 表示不限, 突发量取两倍速率
+            std::istringstream in(arg.substr(strlen("--rate-limit=")));
+            RateLimit *limits[] = {&options.limits.messages, &options.limits.bytes,
+                                   &options.limits.costly, &options.limits.userMessages};
+            std::string field;
+            for (RateLimit *limit : limits) {
+                if (!std::getline(in, field, ':')) {
+                    break;
                 }
-                set_nonblocking(client_fd);
-                ev.events = EPOLLIN | EPOLLET;
-                ev.data.fd = client_fd;
-                if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, client_fd, &ev) == -1) {
-                    perror("epoll_ctl: client_fd");
-                    exit(EXIT_FAILURE);
-                }
-                std::cout << "Accepted connection from client." << std::endl;
+                limit->rate = std::atof(field.c_str());
+                limit->burst = limit->rate * 2;
+            }
+        } else if (arg == "--tls") {
+            options.tls = true;
+        } else if (arg.rfind("--tls-cert=", 0) == 0) {
+            options.tls = true;
+            options.tlsCert = arg.substr(strlen("--tls-cert="));
+        } else if (arg.rfind("--tls-key=", 0) == 0) {
+            options.tls = true;
+            options.tlsKey = arg.substr(strlen("--tls-key="));
+        } else if (arg.rfind("--trace=", 0) == 0) {
+            Trace::setRate(std::strtoul(arg.c_str() + strlen("--trace="), nullptr, 10));
+        } else if (arg.rfind("--trace-dir=", 0) == 0) {
+            options.traceDir = arg.substr(strlen("--trace-dir="));
+        } else if (arg == "--bench-login") {
+            options.benchLogin = true;
+        } else if (arg.rfind("--capture=", 0) == 0) {
+            // --capture=文件[:MB]
+            std::string value = arg.substr(strlen("--capture="));
+            size_t colon = value.rfind(':');
+            options.capturePath = value.substr(0, colon);
+            if (colon != std::string::npos) {
+                options.captureLimit = static_cast<uint64_t>(std::atof(value.c_str() + colon + 1) * (1 << 20));
+            }
+        } else if (arg.rfind("--max-conns=", 0) == 0) {
+            options.overload.maxConns = std::strtoul(arg.c_str() + strlen("--max-conns="), nullptr, 10);
+        } else if (arg.rfind("--shed=", 0) == 0) {
+            // --shed=毫秒:MB
+            std::string value = arg.substr(strlen("--shed="));
+            size_t colon = value.find(':');
+            options.overload.lagUs = static_cast<int64_t>(std::atof(value.c_str()) * 1000);
+            if (colon != std::string::npos) {
+                options.overload.queueBytes = static_cast<size_t>(std::atof(value.c_str() + colon + 1) * (1 << 20));
+            }
+        } else if (arg.rfind("--journal=", 0) == 0) {
+            options.journalDir = arg.substr(strlen("--journal="));
+        } else if (arg.rfind("--search-dir=", 0) == 0) {
+            options.searchDir = arg.substr(strlen("--search-dir="));
+        } else if (arg.rfind("--reactors=", 0) == 0) {
+            reactors = std::max(1, std::atoi(arg.c_str() + strlen("--reactors=")));
+        } else if (arg.rfind("--reactor-cpus=", 0) == 0 || arg.rfind("--worker-cpus=", 0) == 0) {
+            std::string list = arg.substr(arg.find('=') + 1);
+            std::vector<int> cpus = Affinity::parse(list);
+            if (cpus.empty()) {
+                std::cerr << "Invalid CPU list: " << list << std::endl;
+                exit(EXIT_FAILURE);
+            }
+            if (arg[2] == 'r') {
+                reactorCpus = cpus;
             } else {
-                // 处理客户端发送的数据
-                char buffer[READ_BUFFER];
-                int bytes_read = read(events[i].data.fd, buffer, READ_BUFFER);
-                if (bytes_read <= 0) {
-                    // 客户端断开连接
-                    if (epoll_ctl(epoll_fd, EPOLL_CTL_DEL, events[i].data.fd, NULL) == -1) {
-                        perror("epoll_ctl: EPOLL_CTL_DEL");
-                    }
-                    close(events[i].data.fd);
-                    std::cout << "Closed connection with client." << std::endl;
-                } else {
-                    // 显示客户端发送的数据
-                    buffer[bytes_read] = '\0';
-                    std::string received_message(buffer);
-
-                    // 解析命令
-                    if (received_message.find("REGISTER") == 0) {
-                        // 格式: REGISTER username password
-                        size_t space1 = received_message.find(' ', 8);
-                        size_t space2 = received_message.find(' ', space1 + 1);
-                        if (space1 != std::string::npos && space2 != std::string::npos) {
-                            std::string username = received_message.substr(8, space1 - 8);
-                            std::string password = received_message.substr(space1 + 1);
-                            std::string redis_key = "user:" + username;
-
-                            // 保存到Redis
-                            redisReply *reply = (redisReply *)redisCommand(redis_ctx, "SET %s %s", "msg", "test");
-                            if (reply == nullptr) {
-                                std::cerr << "Redis command error" << std::endl;
-                            } else {
-                                std::cout << "Registered user: " << username << std::endl;
-                                freeReplyObject(reply);
-                            }
-                        }
-                    } else {
-                        // 处理其他类型的消息
-                        std::cout << "Received from client: " << buffer << std::endl;
-                    }
-
-                    // 回显收到的数据
-                    write(events[i].data.fd, buffer, bytes_read);
+                Affinity::workerCpus() = cpus;
+            }
+        } else if (arg.rfind("--redis-shards=", 0) == 0) {
+            // --redis-shards=host:port,host:port,...
+            std::istringstream in(arg.substr(strlen("--redis-shards=")));
+            options.redisShards.clear();
+            std::string address;
+            while (std::getline(in, address, ',')) {
+                if (!address.empty()) {
+                    options.redisShards.push_back(address);
                 }
             }
+        } else if (arg.rfind("--smtp=", 0) == 0) {
+            // --smtp=host:port
+            std::string relay = arg.substr(strlen("--smtp="));
+            size_t colon = relay.rfind(':');
+            options.smtpHost = relay.substr(0, colon);
+            if (colon != std::string::npos) {
+                options.smtpPort = std::atoi(relay.c_str() + colon + 1);
+            }
+        } else {
+            positional.push_back(arg);
         }
     }
+    if (positional.size() >= 1) {
+        options.port = std::atoi(positional[0].c_str());
+        if (options.port <= 0 || options.port > 65535) {
+            std::cerr << "Invalid port: " << positional[0] << std::endl;
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (positional.size() >= 2) {
+        options.nodeId = positional[1];
+    }
+    if (!options.journalDir.empty() && !options.streams) {
+        std::cerr << "--journal requires --streams" << std::endl;
+        exit(EXIT_FAILURE);
+    }
 
-    redisFree(redis_ctx);
-    close(server_fd);
-    return 0;
+    if (Trace::enabled()) {
+        // 在建任何线程之前屏蔽, 之后的线程都继承; 信号只经 signalfd 交给事件循环
+        sigset_t mask;
+        sigemptyset(&mask);
+        sigaddset(&mask, SIGUSR2);
+        pthread_sigmask(SIG_BLOCK, &mask, nullptr);
+    }
+
+    if (reactors > 1) {
+        if (options.nodeId.empty() || options.takeover) {
+            std::cerr << "--reactors requires a nodeId and cannot be combined with --takeover" << std::endl;
+            exit(EXIT_FAILURE);
+        }
+        return runReactors(options, reactors, reactorCpus);
+    }
+
+    // 先绑核再建 Server, 缓冲池和 Arena 的内存落在本节点上
+    if (!reactorCpus.empty()) {
+        Affinity::pin(reactorCpus[0]);
+    }
+    return runServer(options);
 }
@@ -0,0 +1,2276 @@
+#pragma once
+#include "../include/headFile.hpp"
+#include "../Cli_Ser_Connection/Capture.hpp"
+#include "../Cli_Ser_Connection/Codec.hpp"
+#include "../Cli_Ser_Connection/Trace.hpp"
+#include "../redis/redis.hpp"
+#include "../redis/shard.hpp"
+#include "auth.hpp"
+#include "cluster.hpp"
+#include "conn.hpp"
+#include "handoff.hpp"
+#include "graph.hpp"
+#include "history.hpp"
+#include "journal.hpp"
+#include "mail.hpp"
+#include "Msg.hpp"
+#include "overload.hpp"
+#include "pool.hpp"
+#include "presence.hpp"
+#include "receipt.hpp"
+#include "ratelimit.hpp"
+#include "search.hpp"
+#include "session.hpp"
+#include "snowflake.hpp"
+#include "task.hpp"
+
+#define MAX_EVENTS 64
+#define READ_BUFFER (64 * 1024)
+#define MAX_FRAME (16 * 1024 * 1024)
+
+void set_nonblocking(int sock);
+
+// 服务器启动参数
+struct ServerOptions
+{
+    int port = 12345;
+    std::string nodeId; // 非空时以集群模式运行
+    bool streams = false; // 会话记录和跨节点投递改用 Redis 流
+    bool takeover = false; // 从正在运行的旧进程接管监听 socket 和连接
+    std::string upgradePath; // 热升级用的 UNIX socket 路径, 为空时按端口生成
+    std::string smtpHost = "127.0.0.1"; // 发验证码邮件用的本机 SMTP 中继
+    int smtpPort = 2525;
+    std::string mailFrom = "noreply@chatroom.local";
+    RateLimits limits;
+    OverloadLimits overload;
+    std::string searchDir; // 非空时启用聊天记录检索, 索引段文件放在这个目录
+    std::string journalDir; // 非空时消息先写本地预写日志再写 Redis, 需要 streams
+    std::vector<std::string> redisShards = {"127.0.0.1:6379"}; // 存放用户、会话和回执的 Redis 实例, 按键一致性哈希分片
+    bool tls = false;      // 只接受 TLS 1.3 连接, 握手后记录层尽量交给内核 (kTLS)
+    std::string tlsCert;   // PEM 证书链和私钥, 为空时用临时自签名证书
+    std::string tlsKey;
+    std::string traceDir = "/tmp"; // 收到 SIGUSR2 时追踪结果写到这个目录; 抽样比例见 Trace::setRate
+    std::string capturePath;        // 非空时把收到的每一帧录进这个文件, 供 client --replay 回放
+    bool benchLogin = false;        // 接受不带密码的 "LOGIN user" 和不带邮箱的 REGISTER, 只给压测用; 打开后任何人都能登录成任何用户
+    uint64_t captureLimit = 0;      // 录制文件的大小上限, 0 表示不限
+    int listenFd = -1; // 已经建好的监听 socket (多个反应器进程共用端口时由父进程创建), -1 表示自己创建
+};
+
+// 要发给一个或多个连接的帧
+// 压缩结果在第一次发给协商了压缩的连接时生成 (放在 Arena 里), 群发时所有接收方共用同一份
+struct OutFrame
+{
+    std::string_view raw{};
+    std::string_view packed{}; // 为空表示不值得压缩
+    bool packTried = false;
+};
+
+// 单线程 epoll 服务器
+// 连接对象放在 FdSlab 里, 收发缓冲区来自 BufferPool, 单次请求的临时数据放在 Arena 里,
+// 稳态下处理一条消息不触发 malloc
+// nodeId 非空时以集群模式运行, 跨节点的消息经 Redis 发布订阅转发
+class Server
+{
+public:
+    explicit Server(const ServerOptions &options)
+        : m_port(options.port), m_takeover(options.takeover), m_upgradePath(options.upgradePath), m_listenFd(options.listenFd),
+          m_traceDir(options.traceDir), m_benchLogin(options.benchLogin),
+          m_shards(options.redisShards, {"user:", AUTH_CODE_PREFIX, HISTORY_KEY_PREFIX, RECEIPT_KEY_PREFIX, RATE_USER_PREFIX,
+                                               GRAPH_FRIENDS_PREFIX, GRAPH_BLOCKS_PREFIX, GRAPH_GROUP_PREFIX}),
+          m_lease(m_redis), m_ids(m_lease.node()),
+          m_searchDir(options.searchDir), m_journalDir(options.journalDir), m_limits(options.limits),
+          m_maxConns(options.overload.maxConns), m_shedder(options.overload),
+          m_mailer(options.smtpHost, options.smtpPort, options.mailFrom)
+    {
+        if (m_upgradePath.empty())
+        {
+            m_upgradePath = "/tmp/chatroom-" + std::to_string(m_port) + ".sock";
+        }
+
+        // fd 用完时靠这个备用 fd 腾出位置, 接受并立即关闭排队的连接
+        m_spareFd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+
+        // 常用的帧尺寸先预热, 1KB 以内的聊天消息最多
+        m_pool.reserve(1024, 64);
+        m_pool.reserve(4096, 16);
+
+        if (!options.nodeId.empty())
+        {
+            m_cluster = std::make_unique<Cluster>(options.nodeId, m_redis, options.streams, options.takeover);
+            m_userLimiter = std::make_unique<UserRateLimiter>(m_shards, m_limits.userMessages);
+        }
+        if (options.streams)
+        {
+            m_history = std::make_unique<History>(m_shards);
+        }
+        if (options.tls)
+        {
+            m_tls = std::make_unique<TlsContext>(TlsContext::Server, options.tlsCert, options.tlsKey);
+        }
+        if (!options.capturePath.empty())
+        {
+            m_capture = std::make_unique<CaptureWriter>(options.capturePath, options.captureLimit);
+        }
+    }
+
+    ~Server()
+    {
+        m_conns.forEach([this](Conn &c)
+                        {
+                            c.in.reset(m_pool);
+                            c.out.reset(m_pool);
+                            c.lanes.reset(m_pool);
+                            close(c.fd); });
+        if (m_epollFd != -1)
+        {
+            close(m_epollFd);
+        }
+        if (m_listenFd != -1)
+        {
+            close(m_listenFd);
+        }
+        if (m_upgradeFd != -1)
+        {
+            close(m_upgradeFd);
+        }
+        if (m_upgradeConn != -1)
+        {
+            close(m_upgradeConn);
+        }
+        if (m_spareFd != -1)
+        {
+            close(m_spareFd);
+        }
+        if (m_traceFd != -1)
+        {
+            close(m_traceFd);
+        }
+    }
+
+    Server(const Server &other) = delete;
+    Server &operator=(const Server &other) = delete;
+
+    void listenOn()
+    {
+        // 创建epoll实例
+        m_epollFd = epoll_create1(0);
+        if (m_epollFd == -1)
+        {
+            perror("epoll_create1");
+            exit(EXIT_FAILURE);
+        }
+
+        if (m_takeover)
+        {
+            takeover();
+        }
+        else if (m_listenFd == -1)
+        {
+            m_listenFd = openListener(m_port, false);
+        }
+
+        // 接管时旧进程在交出连接前已把内存里的索引写盘, 这时再打开才能看到完整的段
+        if (!m_searchDir.empty())
+        {
+            m_search = std::make_unique<SearchIndex>(m_searchDir);
+        }
+        // 日志同理, 接管时旧进程已经确认并关闭了它
+        if (!m_journalDir.empty() && m_history)
+        {
+            openJournal();
+        }
+
+        // 将服务器socket添加到epoll监听中
+        struct epoll_event ev{};
+        ev.events = EPOLLIN;
+        ev.data.fd = m_listenFd;
+        if (epoll_ctl(m_epollFd, EPOLL_CTL_ADD, m_listenFd, &ev) == -1)
+        {
+            perror("epoll_ctl: server_fd");
+            exit(EXIT_FAILURE);
+        }
+
+        if (m_cluster)
+        {
+            watch(m_cluster->fd(), [this]()
+                  {
+                      if (m_cluster->onReadable([this](std::string_view from, std::string_view to, std::string_view text, uint64_t seq)
+                                                { return deliverForwarded(from, to, text, seq); }) == -1)
+                      {
+                          std::cerr << "Lost cluster subscription" << std::endl;
+                          exit(EXIT_FAILURE);
+                      } });
+            // 租约过期的节点上的用户当作下线, 经本节点的上下线广播转告其他节点
+            // 本节点自己的租约过期过时, 登记可能已被别的节点清掉, 重新登记所有本地用户
+            watch(m_cluster->aliveFd(), [this]()
+                  {
+                      if (m_cluster->onAliveTimer([this](const std::string &user)
+                                                  { m_presence.change(user, false); }))
+                      {
+                          m_sessions.forEach([this](const std::string &user, int)
+                                             {
+                                                 m_cluster->registerUser(user);
+                                                 m_presence.change(user, true);
+                                             });
+                      } });
+            if (m_cluster->retryFd() != -1)
+            {
+                watch(m_cluster->retryFd(), [this]()
+                      { m_cluster->retry([this](std::string_view from, std::string_view to, std::string_view text, uint64_t seq)
+                                         { return deliverForwarded(from, to, text, seq); }); });
+            }
+        }
+
+        watch(m_auth.fd(), [this]()
+              { m_auth.drain(); });
+        watch(m_tasks.fd(), [this]()
+              { m_tasks.onTimer(); });
+        m_shards.OnPipeline([this](RedisPipeline &pipeline)
+                            { watch(pipeline.Fd(), [this, &pipeline]()
+                                    {
+                                        if (pipeline.OnReadable() == -1)
+                                        {
+                                            std::cerr << "Lost Redis pipeline connection" << std::endl;
+                                            exit(EXIT_FAILURE);
+                                        } }); },
+                            [this](RedisPipeline &pipeline)
+                            { unwatch(pipeline.Fd()); });
+        watch(m_shards.ControlFd(), [this]()
+              {
+                  if (m_shards.OnControl() == -1)
+                  {
+                      std::cerr << "Lost shard control subscription" << std::endl;
+                      exit(EXIT_FAILURE);
+                  } });
+        watch(m_shards.StepFd(), [this]()
+              { m_shards.Step(); });
+        watch(m_graph.fd(), [this]()
+              {
+                  if (m_graph.onChange() == -1)
+                  {
+                      std::cerr << "Lost social graph subscription" << std::endl;
+                      exit(EXIT_FAILURE);
+                  } });
+
+        watch(m_lease.fd(), [this]()
+              {
+                  if (!m_lease.renew())
+                  {
+                      std::cerr << "Lost snowflake node lease " << m_lease.node() << std::endl;
+                      exit(EXIT_FAILURE);
+                  } });
+        watch(m_presence.fd(), [this]()
+              { flushPresence(); });
+        watch(m_receipts.fd(), [this]()
+              { flushReceipts(); });
+        if (m_cluster)
+        {
+            watch(m_cluster->presenceFd(), [this]()
+                  {
+                      if (m_cluster->onPresence([this](std::string_view user, bool online)
+                                                { m_presence.change(std::string(user), online, false); }) == -1)
+                      {
+                          std::cerr << "Lost presence subscription" << std::endl;
+                          exit(EXIT_FAILURE);
+                      } });
+        }
+
+        if (Trace::enabled())
+        {
+            watchTraceSignal();
+        }
+
+        // 接收新版本进程的接管请求
+        m_upgradeFd = Handoff::listenOn(m_upgradePath);
+        if (m_upgradeFd != -1)
+        {
+            watch(m_upgradeFd, [this]()
+                  { onUpgradeRequest(); });
+        }
+    }
+
+    // 让事件循环额外监听一个 fd (水平触发), 可读时回调 onReadable
+    // 失败时只影响这一个 fd, 不能因此断开所有连接
+    bool watch(int fd, std::function<void()> onReadable)
+    {
+        struct epoll_event ev{};
+        ev.events = EPOLLIN;
+        ev.data.fd = fd;
+        if (epoll_ctl(m_epollFd, EPOLL_CTL_ADD, fd, &ev) == -1)
+        {
+            perror("epoll_ctl: watch");
+            return false;
+        }
+        m_watchers[fd] = std::move(onReadable);
+        return true;
+    }
+
+    void unwatch(int fd)
+    {
+        epoll_ctl(m_epollFd, EPOLL_CTL_DEL, fd, NULL);
+        m_watchers.erase(fd);
+    }
+
+    // 开始事件循环
+    void run()
+    {
+        Trace::nameThread("reactor");
+        struct epoll_event events[MAX_EVENTS];
+        while (!m_stopping)
+        {
+            int nfds = epoll_wait(m_epollFd, events, MAX_EVENTS, -1);
+            if (nfds == -1)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                perror("epoll_wait");
+                exit(EXIT_FAILURE);
+            }
+            // 限流用的时间每轮取一次
+            m_now = std::chrono::duration_cast<std::chrono::microseconds>(
+                        std::chrono::steady_clock::now().time_since_epoch())
+                        .count();
+
+            for (int i = 0; i < nfds; ++i)
+            {
+                int fd = events[i].data.fd;
+                if (fd == m_listenFd)
+                {
+                    acceptAll();
+                    continue;
+                }
+
+                Conn *c = m_conns.get(fd);
+                if (!c)
+                {
+                    auto it = m_watchers.find(fd);
+                    if (it != m_watchers.end())
+                    {
+                        it->second();
+                    }
+                    continue;
+                }
+                if (events[i].events & (EPOLLERR | EPOLLHUP))
+                {
+                    closeConn(*c);
+                    continue;
+                }
+                if (c->tls && !c->tls->established())
+                {
+                    continueHandshake(*c);
+                    continue;
+                }
+                if ((events[i].events & EPOLLOUT) && !onWritable(*c))
+                {
+                    continue;
+                }
+                if (events[i].events & EPOLLIN)
+                {
+                    onReadable(*c);
+                }
+            }
+            flushPending();
+            // 一轮事件处理完, 临时数据整体作废
+            m_arena.reset();
+
+            int64_t end = std::chrono::duration_cast<std::chrono::microseconds>(
+                              std::chrono::steady_clock::now().time_since_epoch())
+                              .count();
+            m_shedder.sample(end - m_now, m_pool.lentBytes());
+        }
+    }
+
+    // 发送一帧
+    void sendFrame(Conn &c, std::string_view payload, Lane lane = Lane::Control)
+    {
+        OutFrame frame{payload};
+        sendFrame(c, frame, lane);
+    }
+
+    // 对方协商了压缩且帧足够大时发送压缩后的负载
+    void sendFrame(Conn &c, OutFrame &frame, Lane lane = Lane::Control)
+    {
+        if (c.codec != FrameCodecId::None && frame.raw.size() >= COMPRESS_MIN)
+        {
+            if (!frame.packTried)
+            {
+                frame.packTried = true;
+                FrameCodec &codec = FrameCodec::local();
+                size_t cap = codec.bound(frame.raw.size());
+                char *buf = static_cast<char *>(m_arena.alloc(cap, 1));
+                size_t n = codec.compress(frame.raw.data(), frame.raw.size(), buf, cap);
+                frame.packed = std::string_view(buf, n);
+            }
+            if (!frame.packed.empty())
+            {
+                writeFrame(c, FRAME_COMPRESSED | static_cast<uint32_t>(frame.packed.size()), frame.packed, lane);
+                return;
+            }
+        }
+        writeFrame(c, static_cast<uint32_t>(frame.raw.size()), frame.raw, lane);
+    }
+
+    size_t connectionCount() const { return m_conns.size(); }
+
+private:
+    // 没有排队的数据时先尝试直接写, 写不完的部分放进连接的输出缓冲区
+    // 已有排队时放进对应的通道, 由 onWritable 按权重取出; 批量通道里的大帧先切段
+    void writeFrame(Conn &c, uint32_t header, std::string_view payload, Lane lane)
+    {
+        if (!c.lanesOn)
+        {
+            lane = Lane::Control;
+        }
+        bool split = c.lanesOn && lane == Lane::Bulk && payload.size() > LANE_CHUNK;
+        uint64_t trace = Trace::current();
+        int64_t begin = trace ? Trace::now() : 0;
+        if (trace && c.traceId == 0)
+        {
+            // 写不完时由 onWritable 在输出全部写出后记下 send
+            c.traceId = trace;
+            c.traceSince = begin;
+        }
+        if (!split && c.out.empty() && c.lanes.empty())
+        {
+            uint32_t len = htonl(header);
+            struct iovec iov[2];
+            iov[0].iov_base = &len;
+            iov[0].iov_len = sizeof(len);
+            iov[1].iov_base = const_cast<char *>(payload.data());
+            iov[1].iov_len = payload.size();
+            ssize_t sent = connWritev(c, iov, 2);
+            if (sent < 0)
+            {
+                if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+                {
+                    closeConn(c);
+                    return;
+                }
+                sent = 0;
+            }
+            size_t total = sizeof(len) + payload.size();
+            if (static_cast<size_t>(sent) == total)
+            {
+                if (c.traceId != 0)
+                {
+                    Trace::record("send", c.traceId, c.traceSince, Trace::now(), Trace::tagOf(payload));
+                    c.traceId = 0;
+                }
+                return;
+            }
+            // 只缓冲没写出去的部分
+            if (static_cast<size_t>(sent) < sizeof(len))
+            {
+                c.out.append(m_pool, reinterpret_cast<char *>(&len) + sent, sizeof(len) - sent);
+                c.out.append(m_pool, payload.data(), payload.size());
+            }
+            else
+            {
+                size_t done = sent - sizeof(len);
+                c.out.append(m_pool, payload.data() + done, payload.size() - done);
+            }
+            updateEvents(c, EPOLLIN | EPOLLOUT | EPOLLET);
+            return;
+        }
+        if (!split)
+        {
+            c.lanes.push(m_pool, lane, header, payload);
+        }
+        else
+        {
+            uint32_t flags = header & ~FRAME_LENGTH_MASK;
+            for (size_t off = 0; off < payload.size(); off += LANE_CHUNK)
+            {
+                size_t n = std::min<size_t>(LANE_CHUNK, payload.size() - off);
+                uint32_t more = off + n < payload.size() ? FRAME_MORE : 0;
+                c.lanes.push(m_pool, lane, flags | FRAME_CHUNK | more | static_cast<uint32_t>(n), payload.substr(off, n));
+            }
+        }
+        // out 不空时已经在等 EPOLLOUT; 空着说明这是第一批排队的数据, 马上开始写
+        if (c.out.empty())
+        {
+            onWritable(c);
+        }
+    }
+
+public:
+    // reusePort 时多个进程各自监听同一端口, 由内核在它们之间分配新连接
+    static int openListener(int port, bool reusePort)
+    {
+        // 创建服务器socket
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (fd == -1)
+        {
+            perror("socket");
+            exit(EXIT_FAILURE);
+        }
+
+        int on = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+        if (reusePort)
+        {
+            setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on));
+        }
+
+        // 设置服务器地址和端口
+        struct sockaddr_in server_addr{};
+        server_addr.sin_family = AF_INET;
+        server_addr.sin_addr.s_addr = INADDR_ANY;
+        server_addr.sin_port = htons(port);
+
+        // 绑定socket
+        if (bind(fd, (struct sockaddr *)&server_addr, sizeof(server_addr)) == -1)
+        {
+            perror("bind");
+            exit(EXIT_FAILURE);
+        }
+
+        // 开始监听
+        if (listen(fd, SOMAXCONN) == -1)
+        {
+            perror("listen");
+            exit(EXIT_FAILURE);
+        }
+
+        // 设置为非阻塞模式
+        set_nonblocking(fd);
+        return fd;
+    }
+
+private:
+    // SIGUSR2 时把各线程记下的追踪区间导出成 Chrome trace JSON
+    // 信号在 main 里已经对所有线程屏蔽, 这里用 signalfd 交给事件循环; 写文件放在单独的线程里, 不卡住事件循环
+    void watchTraceSignal()
+    {
+        sigset_t mask;
+        sigemptyset(&mask);
+        sigaddset(&mask, SIGUSR2);
+        m_traceFd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+        if (m_traceFd == -1)
+        {
+            perror("signalfd");
+            return;
+        }
+        watch(m_traceFd, [this]()
+              {
+                  struct signalfd_siginfo info;
+                  while (read(m_traceFd, &info, sizeof(info)) == sizeof(info))
+                  {
+                  }
+                  std::string path = m_traceDir + "/chatroom-trace-" + std::to_string(getpid()) + "-" +
+                                     std::to_string(++m_traceDumps) + ".json";
+                  std::thread([path]()
+                              {
+                                  if (Trace::dump(path))
+                                  {
+                                      std::cerr << "Trace written to " << path << std::endl;
+                                  }
+                                  else
+                                  {
+                                      std::cerr << "Cannot write trace " << path << ": " << strerror(errno) << std::endl;
+                                  } })
+                      .detach(); });
+    }
+
+    // 旧进程: 新版本进程连上升级 socket 后, 把监听 socket 和所有连接连同缓冲区状态交给它
+    // 连接不断开, 客户端无感知, 也就不会出现集体重连和登录高峰
+    // 升级 socket 上有新连接: 只接受同一用户的进程, 请求在事件循环里非阻塞地读,
+    // 连上后不说话的客户端不会卡住事件循环; 同时只等一个请求, 新连接替换还没发完请求的旧连接
+    void onUpgradeRequest()
+    {
+        int sock = accept4(m_upgradeFd, NULL, NULL, SOCK_CLOEXEC | SOCK_NONBLOCK);
+        if (sock == -1)
+        {
+            return;
+        }
+        struct ucred cred{};
+        socklen_t credLen = sizeof(cred);
+        if (getsockopt(sock, SOL_SOCKET, SO_PEERCRED, &cred, &credLen) == -1 || cred.uid != geteuid())
+        {
+            close(sock);
+            return;
+        }
+        if (m_draining)
+        {
+            close(sock); // 已经在交接了
+            return;
+        }
+        dropUpgradeConn();
+        m_upgradeConn = sock;
+        m_upgradeIn.clear();
+        watch(sock, [this]()
+              { onUpgradeReadable(); });
+    }
+
+    void dropUpgradeConn()
+    {
+        if (m_upgradeConn != -1)
+        {
+            unwatch(m_upgradeConn);
+            close(m_upgradeConn);
+            m_upgradeConn = -1;
+        }
+    }
+
+    // 攒齐一条 Handoff 消息 (4 字节长度加内容), 是 TAKEOVER 时开始交接
+    void onUpgradeReadable()
+    {
+        char buf[64];
+        ssize_t n = read(m_upgradeConn, buf, sizeof(buf));
+        if (n == -1 && (errno == EAGAIN || errno == EINTR))
+        {
+            return;
+        }
+        if (n <= 0)
+        {
+            dropUpgradeConn();
+            return;
+        }
+        m_upgradeIn.append(buf, n);
+        if (m_upgradeIn.size() < sizeof(uint32_t))
+        {
+            return;
+        }
+        uint32_t len = 0;
+        std::memcpy(&len, m_upgradeIn.data(), sizeof(len));
+        len = ntohl(len);
+        if (len > sizeof(buf))
+        {
+            dropUpgradeConn();
+            return;
+        }
+        if (m_upgradeIn.size() < sizeof(len) + len)
+        {
+            return;
+        }
+        if (std::string_view(m_upgradeIn).substr(sizeof(len)) != "TAKEOVER")
+        {
+            dropUpgradeConn();
+            return;
+        }
+
+        int sock = m_upgradeConn;
+        unwatch(sock);
+        m_upgradeConn = -1;
+        // 交接期间新进程一直在收, 改回阻塞写; 它卡住时写超时, 按交接中断处理
+        fcntl(sock, F_SETFL, fcntl(sock, F_GETFL) & ~O_NONBLOCK);
+        struct timeval timeout{};
+        timeout.tv_sec = HANDOFF_TIMEOUT_SEC;
+        setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+        drainThenHandOff(sock);
+    }
+
+    // 在途的协程任务 (等 Redis、等鉴权线程、等验证码) 的状态在本进程的协程帧里, 交不出去, 先等它们结束再交接
+    // 等待期间新的昂贵命令回复 BUSY, 在等验证码的 REGISTER 立即以 BUSY 结束, 客户端重试时已经连到新进程;
+    // 超过 HANDOFF_DRAIN_MS 还没结束的任务, 所在的连接在交接时关闭, 和用户态 TLS 连接一样让客户端重连
+    Task drainThenHandOff(int sock)
+    {
+        m_draining = true;
+        m_tasks.cancelFrames();
+        for (int waited = 0; m_inflight > 0 && waited < HANDOFF_DRAIN_MS; waited += HANDOFF_DRAIN_POLL_MS)
+        {
+            co_await m_tasks.sleep(HANDOFF_DRAIN_POLL_MS);
+        }
+        handOff(sock);
+        m_draining = false; // 交接没开始就失败时继续服务
+    }
+
+    // 把监听 socket 和所有连接交给新进程, 之后本进程退出事件循环
+    void handOff(int sock)
+    {
+        std::vector<int> fds;
+        std::cout << "Handing off " << m_conns.size() << " connections to new process." << std::endl;
+
+        // 先把本轮攒下的跨节点消息和会话记录写出去
+        flushPending();
+
+        std::string payload;
+        Msg::putField(payload, "LISTEN");
+        if (Handoff::sendMsg(sock, payload, {m_listenFd}) == -1)
+        {
+            // 新进程还没拿到监听 socket, 继续服务
+            close(sock);
+            return;
+        }
+        if (epoll_ctl(m_epollFd, EPOLL_CTL_DEL, m_listenFd, NULL) == -1)
+        {
+            perror("epoll_ctl: EPOLL_CTL_DEL");
+        }
+        close(m_listenFd);
+        m_listenFd = -1;
+
+        // 用户态加解密的 TLS 连接状态在本进程的 OpenSSL 里, 交不出去, 直接关闭让客户端重连
+        // kTLS 连接的密钥和记录序号都在内核里, 和明文连接一样交出 fd 即可
+        // 排空后仍有协程任务在途的连接同样交不出去 (见 drainThenHandOff)
+        std::vector<Conn *> conns, stateful;
+        m_conns.forEach([&](Conn &c)
+                        { ((c.tls && !c.tls->detachable()) || c.tasks > 0 ? stateful : conns).push_back(&c); });
+        for (Conn *c : stateful)
+        {
+            closeConn(*c);
+        }
+
+        // 连接按批次发送, 每个连接附带用户 ID、未凑齐的输入、未写完的输出和连接状态 (见 connState)
+        for (size_t i = 0; i < conns.size(); i += HANDOFF_MAX_FDS)
+        {
+            payload.clear();
+            fds.clear();
+            Msg::putField(payload, "CONNS2");
+            for (size_t j = i; j < std::min(conns.size(), i + HANDOFF_MAX_FDS); j++)
+            {
+                Conn &c = *conns[j];
+                fds.push_back(c.fd);
+                Msg::putField(payload, c.user);
+                Msg::putField(payload, std::string_view(c.in.begin(), c.in.size()));
+                c.lanes.drainTo(m_pool, c.out);
+                Msg::putField(payload, std::string_view(c.out.begin(), c.out.size()));
+                Msg::putField(payload, connState(c));
+            }
+            if (Handoff::sendMsg(sock, payload, fds) == -1)
+            {
+                std::cerr << "Handoff interrupted, remaining connections will be closed." << std::endl;
+                break;
+            }
+        }
+        // 新进程收到 DONE 后才打开索引和日志目录
+        m_search.reset();
+        flushPending();
+        m_journal.reset();
+        // 发送序号必须先写回, 否则新进程从 Redis 加载到旧值会重复分配; 这一窗口的推送丢弃, 发送者可以用 RECEIPTS 查询
+        m_receipts.flush([](const std::string &, const std::string &, const Receipts::Marks &) {});
+        payload.clear();
+        Msg::putField(payload, "DONE");
+        Handoff::sendMsg(sock, payload);
+        close(sock);
+
+        // 本进程里的副本直接关掉; 在线登记已由新进程接管, 不再从 Redis 注销
+        for (Conn *c : conns)
+        {
+            int fd = c->fd;
+            epoll_ctl(m_epollFd, EPOLL_CTL_DEL, fd, NULL);
+            if (!c->user.empty())
+            {
+                m_sessions.unbind(c->user);
+            }
+            c->in.reset(m_pool);
+            c->out.reset(m_pool);
+            c->lanes.reset(m_pool);
+            m_conns.close(fd);
+            close(fd);
+        }
+
+        // 升级 socket 的路径留给新进程重新绑定
+        unwatch(m_upgradeFd);
+        close(m_upgradeFd);
+        m_upgradeFd = -1;
+        m_stopping = true;
+    }
+
+    // 新进程: 从旧进程接管监听 socket 和连接
+    void takeover()
+    {
+        int sock = Handoff::connectTo(m_upgradePath);
+        if (sock == -1)
+        {
+            std::cerr << "No running server to take over at " << m_upgradePath << std::endl;
+            exit(EXIT_FAILURE);
+        }
+        if (Handoff::sendMsg(sock, "TAKEOVER") == -1)
+        {
+            exit(EXIT_FAILURE);
+        }
+
+        std::string payload;
+        std::vector<int> fds;
+        std::vector<std::pair<int, std::string>> watches;
+        size_t adopted = 0;
+        while (Handoff::recvMsg(sock, payload, fds) == 0)
+        {
+            std::string_view in = payload;
+            std::string_view kind;
+            Msg::getField(in, kind);
+            if (kind == "LISTEN" && fds.size() == 1)
+            {
+                m_listenFd = fds[0];
+                set_nonblocking(m_listenFd);
+            }
+            else if (kind == "CONNS" || kind == "CONNS2")
+            {
+                // CONNS 是不带连接状态的旧格式, 从旧版本升级时仍然接受
+                bool withState = kind == "CONNS2";
+                for (int fd : fds)
+                {
+                    std::string_view user, pendingIn, pendingOut, state;
+                    if (!Msg::getField(in, user) || !Msg::getField(in, pendingIn) || !Msg::getField(in, pendingOut) ||
+                        (withState && !Msg::getField(in, state)))
+                    {
+                        close(fd);
+                        continue;
+                    }
+                    adopt(fd, user, pendingIn, pendingOut, state, watches);
+                    adopted++;
+                }
+            }
+            else if (kind == "DONE")
+            {
+                break;
+            }
+        }
+        close(sock);
+
+        if (m_listenFd == -1)
+        {
+            std::cerr << "Takeover failed: no listening socket received" << std::endl;
+            exit(EXIT_FAILURE);
+        }
+        for (auto &[fd, users] : watches)
+        {
+            std::string_view rest = users;
+            while (!rest.empty())
+            {
+                size_t space = rest.find(' ');
+                std::string user(rest.substr(0, space));
+                rest.remove_prefix(space == std::string_view::npos ? rest.size() : space + 1);
+                m_presence.watch(fd, user, userOnline(user));
+            }
+        }
+        std::cout << "Took over " << adopted << " connections." << std::endl;
+    }
+
+    // 热升级时随连接交出去的状态, 由一串字段组成, 新进程不认识的字段忽略:
+    //   握手结果: 编码号、是否支持回执、是否支持分段, 各一个字符
+    //   WATCH 关注的用户, 空格分隔
+    std::string connState(const Conn &c)
+    {
+        std::string state;
+        char hello[3] = {static_cast<char>('0' + static_cast<int>(c.codec)), c.receipts ? '1' : '0', c.lanesOn ? '1' : '0'};
+        Msg::putField(state, std::string_view(hello, sizeof(hello)));
+        std::string watching;
+        if (auto users = m_presence.watching(c.fd))
+        {
+            for (const std::string &user : *users)
+            {
+                watching += watching.empty() ? "" : " ";
+                watching += user;
+            }
+        }
+        Msg::putField(state, watching);
+        return state;
+    }
+
+    // 关注列表要等所有连接都接过来、在线登记齐了再恢复, 先记在 watches 里
+    static void restoreState(Conn &c, std::string_view state, std::vector<std::pair<int, std::string>> &watches)
+    {
+        std::string_view hello, watching;
+        if (Msg::getField(state, hello) && hello.size() == 3)
+        {
+            FrameCodecId codec = static_cast<FrameCodecId>(hello[0] - '0');
+            c.codec = codec == FrameCodecId::Deflate ? codec : FrameCodecId::None;
+            c.receipts = hello[1] == '1';
+            c.lanesOn = hello[2] == '1';
+        }
+        if (Msg::getField(state, watching) && !watching.empty())
+        {
+            watches.emplace_back(c.fd, std::string(watching));
+        }
+    }
+
+    void adopt(int fd, std::string_view user, std::string_view pendingIn, std::string_view pendingOut, std::string_view state,
+               std::vector<std::pair<int, std::string>> &watches)
+    {
+        set_nonblocking(fd);
+        Conn *c = m_conns.open(fd);
+        c->fd = fd;
+        c->serial = ++m_serial;
+        c->events = EPOLLIN | EPOLLET;
+        c->in.append(m_pool, pendingIn.data(), pendingIn.size());
+        if (!pendingOut.empty())
+        {
+            c->out.append(m_pool, pendingOut.data(), pendingOut.size());
+            c->events |= EPOLLOUT;
+        }
+
+        // 边沿触发下, 加入时缓冲区里已有的数据也会报告一次可读
+        struct epoll_event ev{};
+        ev.events = c->events;
+        ev.data.fd = fd;
+        if (epoll_ctl(m_epollFd, EPOLL_CTL_ADD, fd, &ev) == -1)
+        {
+            perror("epoll_ctl: adopt");
+            c->in.reset(m_pool);
+            c->out.reset(m_pool);
+            m_conns.close(fd);
+            close(fd);
+            return;
+        }
+        restoreState(*c, state, watches);
+        // 接管来的连接在录制里从这里开始, 之前的登录不在录制里
+        if (m_capture)
+        {
+            m_capture->open(c->serial);
+        }
+
+        if (!user.empty())
+        {
+            c->user.assign(user.data(), user.size());
+            m_sessions.bind(c->user, fd);
+            if (m_cluster)
+            {
+                m_cluster->registerUser(c->user);
+            }
+        }
+    }
+
+    // 处理新连接, 每次最多 ACCEPT_BATCH 个, 监听 socket 是水平触发的, 剩下的下一轮继续
+    void acceptAll()
+    {
+        for (int i = 0; i < ACCEPT_BATCH; i++)
+        {
+            int client_fd = accept4(m_listenFd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (client_fd == -1)
+            {
+                if (errno == EINTR || errno == ECONNABORTED)
+                {
+                    continue;
+                }
+                if (errno == EMFILE || errno == ENFILE)
+                {
+                    shedOnFdLimit();
+                }
+                else if (errno != EAGAIN && errno != EWOULDBLOCK)
+                {
+                    perror("accept");
+                }
+                return;
+            }
+
+            // 连接数到上限或负载过高时明确拒绝, 客户端收到 BUSY 后退避重连, 而不是在队列里超时
+            if ((m_maxConns > 0 && m_conns.size() >= m_maxConns) || !m_shedder.admit(Priority::Normal))
+            {
+                reject(client_fd);
+                continue;
+            }
+
+            Conn *c = m_conns.open(client_fd);
+            c->fd = client_fd;
+            c->serial = ++m_serial;
+            c->events = EPOLLIN | EPOLLET;
+
+            struct epoll_event ev{};
+            ev.events = c->events;
+            ev.data.fd = client_fd;
+            if (epoll_ctl(m_epollFd, EPOLL_CTL_ADD, client_fd, &ev) == -1)
+            {
+                perror("epoll_ctl: client_fd");
+                m_conns.close(client_fd);
+                reject(client_fd);
+                continue;
+            }
+            if (m_capture)
+            {
+                m_capture->open(c->serial);
+            }
+            if (m_tls)
+            {
+                c->tls = std::make_unique<TlsStream>(*m_tls, client_fd);
+                continueHandshake(*c);
+            }
+            std::cout << "Accepted connection from client." << std::endl;
+        }
+    }
+
+    // fd 用完时监听 socket 一直可读, 水平触发下事件循环会空转
+    // 先关掉备用 fd 腾出一个位置, 把排队的连接逐个接受并拒绝, 再把备用 fd 占回来
+    // 备用 fd 也被别处占用时暂停监听, 等有连接关闭再恢复
+    void shedOnFdLimit()
+    {
+        while (m_spareFd != -1)
+        {
+            close(m_spareFd);
+            int fd = accept4(m_listenFd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (fd != -1)
+            {
+                reject(fd);
+            }
+            m_spareFd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+            if (fd == -1)
+            {
+                return;
+            }
+        }
+        if (!m_acceptPaused && epoll_ctl(m_epollFd, EPOLL_CTL_DEL, m_listenFd, NULL) == 0)
+        {
+            std::cerr << "Out of file descriptors, pausing accept" << std::endl;
+            m_acceptPaused = true;
+        }
+    }
+
+    void resumeAccept()
+    {
+        if (m_spareFd == -1)
+        {
+            m_spareFd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+        }
+        struct epoll_event ev{};
+        ev.events = EPOLLIN;
+        ev.data.fd = m_listenFd;
+        if (epoll_ctl(m_epollFd, EPOLL_CTL_ADD, m_listenFd, &ev) == 0)
+        {
+            m_acceptPaused = false;
+        }
+    }
+
+    // 尽力发一个 BUSY 帧再关闭, 发不出去也不等; TLS 连接还没握手, 直接关闭
+    void reject(int fd)
+    {
+        static const char busy[] = "\0\0\0\4BUSY";
+        if (!m_tls)
+        {
+            send(fd, busy, sizeof(busy) - 1, MSG_DONTWAIT | MSG_NOSIGNAL);
+        }
+        close(fd);
+    }
+
+    // 握手没完成前连接上的事件都交给握手
+    void continueHandshake(Conn &c)
+    {
+        int done = c.tls->handshake();
+        if (done == -1)
+        {
+            closeConn(c);
+            return;
+        }
+        if (done == 0)
+        {
+            updateEvents(c, EPOLLIN | EPOLLET | (c.tls->wantWrite() ? static_cast<uint32_t>(EPOLLOUT) : 0));
+            return;
+        }
+        // 客户端紧跟着握手发来的请求可能已经到了, 边沿触发下不会再报告一次
+        if (updateEvents(c, EPOLLIN | EPOLLET))
+        {
+            onReadable(c);
+        }
+    }
+
+    // TLS 连接经 TlsStream 收发, 记录层在内核里时它直接转成系统调用
+    ssize_t connRead(Conn &c, void *buf, size_t n)
+    {
+        return c.tls ? c.tls->read(buf, n) : read(c.fd, buf, n);
+    }
+
+    ssize_t connWrite(Conn &c, const void *buf, size_t n)
+    {
+        return c.tls ? c.tls->write(buf, n) : write(c.fd, buf, n);
+    }
+
+    ssize_t connWritev(Conn &c, const struct iovec *iov, int count)
+    {
+        return c.tls ? c.tls->writev(iov, count) : writev(c.fd, iov, count);
+    }
+
+    // 边沿触发, 一直读到 EAGAIN
+    // 完整的帧直接在读缓冲区上解析, 只有不完整的尾部才拷进连接自己的缓冲区
+    void onReadable(Conn &c)
+    {
+        int fd = c.fd;
+        while (true)
+        {
+            ssize_t bytes_read = connRead(c, m_readBuf, sizeof(m_readBuf));
+            m_readAt = Trace::enabled() ? Trace::now() : 0;
+            if (bytes_read < 0)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                if (errno != EAGAIN && errno != EWOULDBLOCK)
+                {
+                    closeConn(c);
+                }
+                return;
+            }
+            if (bytes_read == 0)
+            {
+                // 客户端断开连接
+                closeConn(c);
+                return;
+            }
+
+            size_t consumed = 0;
+            if (c.in.empty())
+            {
+                consumed = parseFrames(c, m_readBuf, bytes_read);
+                if (m_conns.get(fd) != &c)
+                {
+                    return; // 处理过程中连接已关闭
+                }
+                if (consumed < static_cast<size_t>(bytes_read))
+                {
+                    c.in.append(m_pool, m_readBuf + consumed, bytes_read - consumed);
+                }
+            }
+            else
+            {
+                c.in.append(m_pool, m_readBuf, bytes_read);
+                consumed = parseFrames(c, c.in.begin(), c.in.size());
+                if (m_conns.get(fd) != &c)
+                {
+                    return;
+                }
+                c.in.consume(m_pool, consumed);
+            }
+        }
+    }
+
+    // 返回值为 false 表示连接已关闭
+    // 当前一批写完再按权重从各通道取下一批
+    bool onWritable(Conn &c)
+    {
+        while (true)
+        {
+            if (c.out.empty())
+            {
+                c.lanes.refill(m_pool, c.out, LANE_BATCH);
+                if (c.out.empty())
+                {
+                    break;
+                }
+            }
+            ssize_t sent = connWrite(c, c.out.begin(), c.out.size());
+            if (sent < 0)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                if (errno == EAGAIN || errno == EWOULDBLOCK)
+                {
+                    return updateEvents(c, EPOLLIN | EPOLLOUT | EPOLLET);
+                }
+                closeConn(c);
+                return false;
+            }
+            c.out.consume(m_pool, sent);
+        }
+        if (c.traceId != 0)
+        {
+            Trace::record("send", c.traceId, c.traceSince, Trace::now());
+            c.traceId = 0;
+        }
+        return updateEvents(c, EPOLLIN | EPOLLET);
+    }
+
+    // 从 data 中切出所有完整的帧, 返回消费的字节数
+    size_t parseFrames(Conn &c, const char *data, size_t len)
+    {
+        int fd = c.fd;
+        size_t off = 0;
+        while (len - off >= sizeof(uint32_t))
+        {
+            uint32_t header = 0;
+            std::memcpy(&header, data + off, sizeof(header));
+            header = ntohl(header);
+            uint32_t frameLen = header & FRAME_LENGTH_MASK;
+            if (frameLen > MAX_FRAME)
+            {
+                std::cerr << "Frame too large from fd " << fd << std::endl;
+                closeConn(c);
+                return off;
+            }
+            if (len - off - sizeof(frameLen) < frameLen)
+            {
+                break;
+            }
+            std::string_view payload(data + off + sizeof(frameLen), frameLen);
+            off += sizeof(frameLen) + frameLen;
+            if (header & FRAME_COMPRESSED)
+            {
+                if (!FrameCodec::local().decompress(payload.data(), payload.size(), m_unpackBuf, MAX_FRAME))
+                {
+                    std::cerr << "Bad compressed frame from fd " << fd << std::endl;
+                    closeConn(c);
+                    return off;
+                }
+                payload = m_unpackBuf;
+            }
+            onFrame(c, payload);
+            if (m_conns.get(fd) != &c)
+            {
+                return off;
+            }
+        }
+        return off;
+    }
+
+    // 请求可以带请求号 "#<rid> <命令>", 对它的回复都带上同样的前缀, 客户端据此把回复交给对应的请求
+    void onFrame(Conn &c, std::string_view msg)
+    {
+        if (m_capture)
+        {
+            m_capture->frame(c.serial, msg);
+        }
+        m_replyTag = std::string_view();
+        if (!msg.empty() && msg[0] == '#')
+        {
+            size_t space = msg.find(' ');
+            if (space != std::string_view::npos)
+            {
+                m_replyTag = msg.substr(0, space + 1);
+                msg.remove_prefix(space + 1);
+            }
+        }
+        // 抽中的请求记两段: recv 是读到之后排在同一批前面的帧后面等了多久, dispatch 是处理本身;
+        // 处理期间这个追踪号是当前线程的, Redis 命令、提交到线程池的任务和回复的发送都记在它名下
+        uint64_t trace = Trace::sample();
+        if (trace)
+        {
+            Trace::record("recv", trace, m_readAt, Trace::now(), Trace::tagOf(msg));
+        }
+        Trace::Scope dispatch("dispatch", trace, trace ? Trace::tagOf(msg) : 0);
+        if (c.user.empty() && !m_shedder.admit(Priority::Normal))
+        {
+            // 严重过载时先保住已登录用户, 新会话的登录注册等请求直接拒绝
+            busy(c);
+        }
+        else if (!c.msgRate.take(1, m_limits.messages, m_now) ||
+            !c.byteRate.take(msg.size() + sizeof(uint32_t), m_limits.bytes, m_now))
+        {
+            limited(c);
+        }
+        else if (!m_tasks.deliver(c.fd, m_replyTag, msg))
+        {
+            // 没有协程在等这条连接的下一帧时才按命令分发
+            handleCommand(c, msg);
+        }
+        m_replyTag = std::string_view();
+    }
+
+    // 超限的请求直接丢弃, 只回一个固定的短帧; 对方连之前的回复都还没收走时连这一帧也不回
+    void limited(Conn &c)
+    {
+        if (c.out.empty() && c.lanes.empty())
+        {
+            reply(c, "LIMITED");
+        }
+    }
+
+    // 过载时丢弃的请求回 BUSY, 和超限一样不给积压了输出的连接再追加
+    void busy(Conn &c)
+    {
+        if (c.out.empty() && c.lanes.empty())
+        {
+            reply(c, "BUSY");
+        }
+    }
+
+    // 历史记录和鉴权这类昂贵命令另有一个更小的桶, 过载时最先丢弃
+    bool allowCostly(Conn &c)
+    {
+        if (m_draining)
+        {
+            reply(c, "BUSY"); // 正在交接, 不再开始新的协程任务
+            return false;
+        }
+        if (!m_shedder.admit(Priority::Low))
+        {
+            busy(c);
+            return false;
+        }
+        if (c.costlyRate.take(1, m_limits.costly, m_now))
+        {
+            return true;
+        }
+        limited(c);
+        return false;
+    }
+
+    // 集群模式下的用户级全局限流, 令牌按批从 Redis 预取到连接上
+    bool allowUserMessage(Conn &c)
+    {
+        if (!m_userLimiter)
+        {
+            return true;
+        }
+        if (c.userLease == 0)
+        {
+            c.userLease = m_userLimiter->lease(c.user, RATE_LEASE);
+        }
+        if (c.userLease == 0)
+        {
+            limited(c);
+            return false;
+        }
+        --c.userLease;
+        return true;
+    }
+
+    // 回复当前请求的发送方
+    void reply(Conn &c, std::string_view payload, Lane lane = Lane::Control)
+    {
+        if (m_replyTag.empty())
+        {
+            sendFrame(c, payload, lane);
+            return;
+        }
+        char *buf = static_cast<char *>(m_arena.alloc(m_replyTag.size() + payload.size(), 1));
+        std::memcpy(buf, m_replyTag.data(), m_replyTag.size());
+        std::memcpy(buf + m_replyTag.size(), payload.data(), payload.size());
+        sendFrame(c, std::string_view(buf, m_replyTag.size() + payload.size()), lane);
+    }
+
+    void handleCommand(Conn &c, std::string_view msg)
+    {
+        // 解析命令
+        // 格式: HELLO 编码列表 [receipts] [lanes], 协商之后较大的回复按选中的编码压缩
+        // 声明 receipts 的客户端收到 "MSGSEQ seq from text", 并用 ACK 回报进度
+        // 声明 lanes 的客户端能拼接分段的大帧 (FRAME_CHUNK), 也接受聊天消息和控制回复插到大块回复前面
+        if (msg.substr(0, 6) == "HELLO ")
+        {
+            std::string offer = " " + std::string(msg.substr(6)) + " ";
+            c.codec = FrameCodec::negotiate(msg.substr(6));
+            c.receipts = offer.find(" receipts ") != std::string::npos;
+            c.lanesOn = offer.find(" lanes ") != std::string::npos;
+            if (c.lanesOn)
+            {
+                // 内核里没发出去的数据限制在一批以内, 否则自动增长的发送缓冲区能装下几 MB, 排队实际发生在内核里, 通道就不起作用了
+                int lowat = LANE_BATCH;
+                setsockopt(c.fd, IPPROTO_TCP, TCP_NOTSENT_LOWAT, &lowat, sizeof(lowat));
+            }
+            reply(c, m_arena.format("CODEC %s%s%s", FrameCodec::name(c.codec), c.receipts ? " receipts" : "",
+                                    c.lanesOn ? " lanes" : ""));
+            return;
+        }
+
+        // 格式: CODE email
+        if (msg.substr(0, 5) == "CODE ")
+        {
+            if (!allowCostly(c))
+            {
+                return;
+            }
+            sendCode(c.fd, c.serial, std::string(m_replyTag), std::string(msg.substr(5)));
+            return;
+        }
+
+        // 格式: REGISTER username password email [code], 压测服务器上 (--bench-login) 邮箱可以省略
+        if (msg.substr(0, 9) == "REGISTER ")
+        {
+            if (!allowCostly(c))
+            {
+                return;
+            }
+            registerUser(c.fd, c.serial, std::string(m_replyTag), std::string(msg.substr(9)));
+            return;
+        }
+
+        // 格式: LOGIN user [password]
+        if (msg.substr(0, 6) == "LOGIN " && msg.size() > 6)
+        {
+            std::string_view args = msg.substr(6);
+            size_t space = args.find(' ');
+            if (space == std::string_view::npos)
+            {
+                // 不带密码的格式只在压测服务器上接受 (--bench-login)
+                if (m_benchLogin)
+                {
+                    login(c, args);
+                }
+                else
+                {
+                    reply(c, "ERROR invalid credentials");
+                }
+                return;
+            }
+            if (!allowCostly(c))
+            {
+                return;
+            }
+            verifyLogin(c.fd, c.serial, std::string(m_replyTag), std::string(args.substr(0, space)),
+                        std::string(args.substr(space + 1)));
+            return;
+        }
+
+        // 格式: SEND to text
+        if (msg.substr(0, 5) == "SEND " && !c.user.empty())
+        {
+            size_t space = msg.find(' ', 5);
+            if (space != std::string_view::npos)
+            {
+                std::string_view to = msg.substr(5, space - 5);
+                if (m_graph.blocked(to, c.user))
+                {
+                    reply(c, m_arena.format("REFUSED %.*s", (int)to.size(), to.data()));
+                    return;
+                }
+                if (allowUserMessage(c))
+                {
+                    route(c, to, msg.substr(space + 1));
+                }
+                return;
+            }
+        }
+
+        // 格式: HISTORY peer startId count
+        if (msg.substr(0, 8) == "HISTORY " && !c.user.empty() && m_history)
+        {
+            if (!allowCostly(c))
+            {
+                return;
+            }
+            history(c, msg.substr(8));
+            return;
+        }
+
+        // 格式: SEARCH peer words...
+        if (msg.substr(0, 7) == "SEARCH " && !c.user.empty() && m_search)
+        {
+            if (!allowCostly(c))
+            {
+                return;
+            }
+            search(c, msg.substr(7));
+            return;
+        }
+
+        // 格式: WATCH user1 user2 ...
+        if (msg.substr(0, 6) == "WATCH " && !c.user.empty())
+        {
+            watchUsers(c, msg.substr(6));
+            return;
+        }
+
+        // 格式: UNWATCH user1 user2 ...
+        if (msg.substr(0, 8) == "UNWATCH " && !c.user.empty())
+        {
+            std::string_view users = msg.substr(8);
+            while (!users.empty())
+            {
+                size_t space = users.find(' ');
+                m_presence.unwatch(c.fd, std::string(users.substr(0, space)));
+                users.remove_prefix(space == std::string_view::npos ? users.size() : space + 1);
+            }
+            reply(c, "UNWATCHED");
+            return;
+        }
+
+        // 格式: FRIEND user / UNFRIEND user / BLOCK user / UNBLOCK user / JOIN group / LEAVE group
+        if (!c.user.empty())
+        {
+            static const std::pair<std::string_view, std::string_view> changes[] = {
+                {"FRIEND ", "FRIENDED"}, {"UNFRIEND ", "UNFRIENDED"}, {"BLOCK ", "BLOCKED"},
+                {"UNBLOCK ", "UNBLOCKED"}, {"JOIN ", "JOINED"}, {"LEAVE ", "LEFT"}};
+            for (auto &[prefix, done] : changes)
+            {
+                std::string_view target = msg.substr(std::min(prefix.size(), msg.size()));
+                if (msg.substr(0, prefix.size()) != prefix || target.empty() || target.find(' ') != std::string_view::npos)
+                {
+                    continue;
+                }
+                if (!allowCostly(c))
+                {
+                    return;
+                }
+                std::string op(prefix.substr(0, prefix.size() - 1));
+                std::transform(op.begin(), op.end(), op.begin(), ::tolower);
+                if (op == "friend" || op == "block")
+                {
+                    addRelation(c.fd, c.serial, std::string(m_replyTag), op, c.user, std::string(target), done);
+                    return;
+                }
+                m_graph.change(op, c.user, std::string(target));
+                reply(c, m_arena.format("%.*s %.*s", (int)done.size(), done.data(), (int)target.size(), target.data()));
+                return;
+            }
+        }
+
+        // 格式: FRIENDS, 回复 "FRIENDS a b ..."
+        if (msg == "FRIENDS" && !c.user.empty())
+        {
+            reply(c, joinNames("FRIENDS", m_graph.friendsOf(c.user)));
+            return;
+        }
+
+        // 格式: MUTUAL user, 回复 "MUTUAL user a b ..."
+        if (msg.substr(0, 7) == "MUTUAL " && !c.user.empty())
+        {
+            std::string_view peer = msg.substr(7);
+            reply(c, joinNames(std::string("MUTUAL ").append(peer), m_graph.mutual(c.user, peer)));
+            return;
+        }
+
+        // 格式: MEMBERS group, 回复 "MEMBERS group a b ..."
+        if (msg.substr(0, 8) == "MEMBERS " && !c.user.empty())
+        {
+            std::string_view group = msg.substr(8);
+            reply(c, joinNames(std::string("MEMBERS ").append(group), m_graph.members(group)));
+            return;
+        }
+
+        // 格式: SUGGEST, 回复 "SUGGEST user:共同好友数 ..."
+        if (msg == "SUGGEST" && !c.user.empty())
+        {
+            if (!allowCostly(c))
+            {
+                return;
+            }
+            std::string line = "SUGGEST";
+            for (auto &[user, common] : m_graph.suggest(c.user))
+            {
+                line += " " + user + ":" + std::to_string(common);
+            }
+            reply(c, line);
+            return;
+        }
+
+        // 格式: ACK peer:delivered:read ..., 累计值, 不需要回复
+        if (msg.substr(0, 4) == "ACK " && !c.user.empty())
+        {
+            acknowledge(c, msg.substr(4));
+            return;
+        }
+
+        // 格式: UNREAD peer1 peer2 ...
+        if (msg.substr(0, 7) == "UNREAD " && !c.user.empty())
+        {
+            if (!allowCostly(c))
+            {
+                return;
+            }
+            unread(c, msg.substr(7));
+            return;
+        }
+
+        // 格式: RECEIPTS peer, 查询对方对自己消息的送达/已读进度
+        if (msg.substr(0, 9) == "RECEIPTS " && !c.user.empty() && msg.size() > 9)
+        {
+            std::string peer(msg.substr(9));
+            Receipts::Marks marks = m_receipts.status(c.user, peer);
+            reply(c, m_arena.format("RECEIPT %s %llu %llu", peer.c_str(),
+                                    static_cast<unsigned long long>(marks.delivered), static_cast<unsigned long long>(marks.read)));
+            return;
+        }
+
+        // 回显收到的数据
+        reply(c, msg);
+    }
+
+    // 每条记录回一帧 "HIST id from text", 最后以 "HISTEND nextId" 结束
+    // 客户端用 nextId 作为下一页的起点; 带请求号时所有行用换行连接成一帧回复
+    void history(Conn &c, std::string_view args)
+    {
+        std::istringstream in{std::string(args)};
+        std::string peer, start;
+        int count = 0;
+        if (!(in >> peer >> start >> count) || count <= 0)
+        {
+            reply(c, "ERROR usage: HISTORY peer startId count");
+            return;
+        }
+        count = std::min(count, 500);
+
+        int fd = c.fd;
+        bool joined = !m_replyTag.empty();
+        std::string page;
+        auto entries = m_history->range(c.user, peer, start, count);
+        for (auto &entry : entries)
+        {
+            std::string_view from, text;
+            for (auto &[field, value] : entry.fields)
+            {
+                if (field == "from")
+                {
+                    from = value;
+                }
+                else if (field == "text")
+                {
+                    text = value;
+                }
+            }
+            std::string_view line = m_arena.format("HIST %s %.*s %.*s", entry.id.c_str(),
+                                                   (int)from.size(), from.data(), (int)text.size(), text.data());
+            if (joined)
+            {
+                page.append(line).append("\n");
+                continue;
+            }
+            sendFrame(c, line, Lane::Bulk);
+            if (m_conns.get(fd) != &c)
+            {
+                return;
+            }
+        }
+        // 下一页从最后一条之后开始, 用 "(" 表示不含
+        std::string_view end = entries.empty() ? std::string_view("HISTEND")
+                                               : m_arena.format("HISTEND (%s", entries.back().id.c_str());
+        if (joined)
+        {
+            page.append(end);
+            reply(c, page, Lane::Bulk);
+            return;
+        }
+        sendFrame(c, end, Lane::Bulk);
+    }
+
+    // 验证码先写入 Redis 并设置过期时间, 邮件在鉴权线程里发送
+    Task sendCode(int fd, uint64_t serial, std::string tag, std::string address)
+    {
+        InFlight inFlight(*this, fd, serial);
+        if (!Mailer::validAddress(address))
+        {
+            replyTo(fd, serial, tag, "ERROR invalid email");
+            co_return;
+        }
+        std::string code = AuthService::makeCode();
+        co_await m_taskRedis.SetEx(AUTH_CODE_PREFIX + address, AUTH_CODE_TTL, code);
+        auto mail = [this, address, code]()
+        { return mailCode(address, code); };
+        auto sent = co_await offload(m_auth, std::move(mail));
+        if (!sent)
+        {
+            replyTo(fd, serial, tag, "BUSY");
+            co_return;
+        }
+        replyTo(fd, serial, tag, *sent ? "CODESENT" : "ERROR mail delivery failed");
+    }
+
+    // 格式: REGISTER username password email [code]
+    // 带验证码时按 CODE 命令发出的验证码核对 (一次性, 读出即删除)
+    // 只带邮箱时进入对话: 发出验证码后回复 CODESENT, 这条连接随后的帧就是用户输入的验证码,
+    // 输错回复 RETRY, 最多 AUTH_CODE_ATTEMPTS 次; 验证码只保存在协程里, 不写 Redis
+    // 不带邮箱的格式跳过验证, 只在压测服务器上接受 (--bench-login)
+    // 密码哈希交给鉴权线程
+    Task registerUser(int fd, uint64_t serial, std::string tag, std::string args)
+    {
+        InFlight inFlight(*this, fd, serial);
+        std::istringstream in(args);
+        std::string username, password, email, code;
+        if (!(in >> username >> password))
+        {
+            replyTo(fd, serial, tag, "ERROR usage: REGISTER username password email [code]");
+            co_return;
+        }
+        in >> email >> code;
+        if (email.empty() && !m_benchLogin)
+        {
+            replyTo(fd, serial, tag, "ERROR email required");
+            co_return;
+        }
+        std::string key = "user:" + username;
+        if (co_await m_taskRedis.HashExists(key, "password"))
+        {
+            replyTo(fd, serial, tag, "ERROR user exists");
+            co_return;
+        }
+
+        if (!email.empty() && !code.empty())
+        {
+            if (co_await m_taskRedis.GetDel(AUTH_CODE_PREFIX + email) != code)
+            {
+                replyTo(fd, serial, tag, "ERROR invalid verification code");
+                co_return;
+            }
+        }
+        else if (!email.empty())
+        {
+            if (!Mailer::validAddress(email))
+            {
+                replyTo(fd, serial, tag, "ERROR invalid email");
+                co_return;
+            }
+            std::string expected = AuthService::makeCode();
+            auto mail = [this, email, expected]()
+            { return mailCode(email, expected); };
+            auto sent = co_await offload(m_auth, std::move(mail));
+            if (!sent || !*sent)
+            {
+                replyTo(fd, serial, tag, sent ? "ERROR mail delivery failed" : "BUSY");
+                co_return;
+            }
+            replyTo(fd, serial, tag, "CODESENT");
+
+            bool verified = false;
+            for (int attempt = 1; !verified; ++attempt)
+            {
+                auto frame = co_await m_tasks.readFrame(fd, AUTH_CODE_TTL * 1000);
+                if (!frame)
+                {
+                    // 连接已关闭时不会发出; 热升级前被取消时回复 BUSY, 客户端重试
+                    replyTo(fd, serial, tag, m_draining ? "BUSY" : "ERROR verification timed out");
+                    co_return;
+                }
+                tag = std::move(frame->tag);
+                verified = frame->text == expected;
+                if (!verified && attempt >= AUTH_CODE_ATTEMPTS)
+                {
+                    replyTo(fd, serial, tag, "ERROR invalid verification code");
+                    co_return;
+                }
+                if (!verified)
+                {
+                    replyTo(fd, serial, tag, "RETRY");
+                }
+            }
+            // 等验证码期间可能被别人抢注
+            if (co_await m_taskRedis.HashExists(key, "password"))
+            {
+                replyTo(fd, serial, tag, "ERROR user exists");
+                co_return;
+            }
+        }
+
+        auto hashing = [password]()
+        { return AuthService::hashPassword(password); };
+        auto hash = co_await offload(m_auth, std::move(hashing));
+        if (!hash)
+        {
+            replyTo(fd, serial, tag, "BUSY");
+            co_return;
+        }
+        // 前面的 HEXISTS 只是提前拒绝; 两个 REGISTER 同时走到这里时只有一个能建出账号
+        if (!co_await m_taskRedis.HashSetNX(key, "password", *hash))
+        {
+            replyTo(fd, serial, tag, "ERROR user exists");
+            co_return;
+        }
+        if (!email.empty())
+        {
+            co_await m_taskRedis.HashSet(key, "email", email);
+        }
+        std::cout << "Registered user: " << username << std::endl;
+        replyTo(fd, serial, tag, m_arena.format("REGISTERED %s", username.c_str()));
+    }
+
+    // FRIEND/BLOCK 的对象必须是已注册的用户, 否则任意名字都会写进 Redis 和每个节点内存里的图
+    // 等查询期间连接登出或换了账号时丢弃
+    Task addRelation(int fd, uint64_t serial, std::string tag, std::string op, std::string user, std::string target,
+                     std::string_view done)
+    {
+        InFlight inFlight(*this, fd, serial);
+        bool exists = co_await m_taskRedis.HashExists("user:" + target, "password");
+        resume(fd, serial, tag, [&](Conn &c)
+               {
+                   if (c.user != user)
+                   {
+                       return;
+                   }
+                   if (!exists)
+                   {
+                       reply(c, "ERROR no such user");
+                       return;
+                   }
+                   m_graph.change(op, user, target);
+                   reply(c, m_arena.format("%.*s %s", (int)done.size(), done.data(), target.c_str())); });
+    }
+
+    // 取出保存的哈希后在鉴权线程里校验, 通过后回到事件循环完成登录
+    Task verifyLogin(int fd, uint64_t serial, std::string tag, std::string name, std::string secret)
+    {
+        InFlight inFlight(*this, fd, serial);
+        std::string stored = co_await m_taskRedis.HashGet("user:" + name, "password");
+        auto verify = [secret, stored]()
+        { return AuthService::verifyPassword(secret, stored); };
+        auto ok = co_await offload(m_auth, std::move(verify));
+        resume(fd, serial, tag, [this, &name, &ok](Conn &c)
+               {
+                   if (!ok)
+                   {
+                       reply(c, "BUSY");
+                   }
+                   else if (*ok)
+                   {
+                       login(c, name);
+                   }
+                   else
+                   {
+                       reply(c, "ERROR invalid credentials");
+                   } });
+    }
+
+    // 在鉴权线程里调用
+    bool mailCode(const std::string &address, const std::string &code)
+    {
+        return m_mailer.send(address, "Chatroom verification code",
+                             "Your verification code is " + code +
+                                 ". It expires in " + std::to_string(AUTH_CODE_TTL / 60) + " minutes.");
+    }
+
+    // 协程任务在途期间持有, 计入连接的 tasks 和 m_inflight, 热升级据此等待 (见 drainThenHandOff)
+    class InFlight
+    {
+    public:
+        InFlight(Server &server, int fd, uint64_t serial) : m_server(server), m_fd(fd), m_serial(serial)
+        {
+            m_server.m_inflight++;
+            if (Conn *c = conn())
+            {
+                c->tasks++;
+            }
+        }
+
+        ~InFlight()
+        {
+            m_server.m_inflight--;
+            if (Conn *c = conn())
+            {
+                c->tasks--;
+            }
+        }
+
+        InFlight(const InFlight &other) = delete;
+        InFlight &operator=(const InFlight &other) = delete;
+
+    private:
+        Conn *conn()
+        {
+            Conn *c = m_server.m_conns.get(m_fd);
+            return c && c->serial == m_serial ? c : nullptr;
+        }
+
+        Server &m_server;
+        int m_fd;
+        uint64_t m_serial;
+    };
+
+    // 异步任务完成后回到原来的连接, 连接已关闭或 fd 已被新连接复用时丢弃结果
+    void resume(int fd, uint64_t serial, const std::string &tag, const std::function<void(Conn &)> &fn)
+    {
+        Conn *c = m_conns.get(fd);
+        if (!c || c->serial != serial)
+        {
+            return;
+        }
+        m_replyTag = tag;
+        fn(*c);
+        m_replyTag = std::string_view();
+    }
+
+    void replyTo(int fd, uint64_t serial, const std::string &tag, std::string_view payload)
+    {
+        resume(fd, serial, tag, [this, payload](Conn &c)
+               { reply(c, payload); });
+    }
+
+    void login(Conn &c, std::string_view user)
+    {
+        if (!c.user.empty())
+        {
+            logout(c);
+        }
+        c.user.assign(user.data(), user.size());
+        m_sessions.bind(c.user, c.fd);
+        if (m_cluster)
+        {
+            m_cluster->registerUser(c.user);
+        }
+        m_presence.change(c.user, true);
+        reply(c, "LOGGEDIN");
+    }
+
+    void logout(Conn &c)
+    {
+        if (m_sessions.find(c.user) == c.fd)
+        {
+            m_sessions.unbind(c.user);
+            if (m_cluster)
+            {
+                m_cluster->unregisterUser(c.user);
+            }
+            m_presence.change(c.user, false);
+            m_receipts.forget(c.user);
+        }
+        c.user.clear();
+    }
+
+    // 接收方在本节点就直接投递, 否则交给集群转发
+    void route(Conn &c, std::string_view to, std::string_view text)
+    {
+        if (m_history)
+        {
+            uint64_t id = m_ids.next();
+            m_history->append(id, c.user, to, text);
+            if (m_journal)
+            {
+                m_journal->append(id, c.user, to, text);
+            }
+        }
+        if (m_search)
+        {
+            m_search->add(History::key(c.user, to), c.user, text);
+        }
+        uint64_t seq = m_receipts.nextSeq(c.user, to);
+        if (deliverLocal(c.user, to, text, seq))
+        {
+            return;
+        }
+        if (m_cluster)
+        {
+            std::string target(to);
+            std::string node = m_cluster->locate(target);
+            if (!node.empty() && node != m_cluster->nodeId())
+            {
+                m_cluster->forward(node, c.user, to, text, seq);
+                return;
+            }
+        }
+        reply(c, m_arena.format("OFFLINE %.*s", (int)to.size(), to.data()));
+    }
+
+    // 返回 false 表示接收方不在本节点; 支持回执的连接收到带序号的 MSGSEQ
+    bool deliverLocal(std::string_view from, std::string_view to, std::string_view text, uint64_t seq)
+    {
+        Conn *target = m_conns.get(m_sessions.find(std::string(to)));
+        if (!target)
+        {
+            if (m_cluster)
+            {
+                m_cluster->forget(std::string(to)); // 路由缓存可能已过期
+            }
+            return false;
+        }
+        if (target->receipts)
+        {
+            sendFrame(*target, m_arena.format("MSGSEQ %llu %.*s %.*s", static_cast<unsigned long long>(seq),
+                                              (int)from.size(), from.data(), (int)text.size(), text.data()),
+                      Lane::Chat);
+            return true;
+        }
+        sendFrame(*target, m_arena.format("MSG %.*s %.*s", (int)from.size(), from.data(), (int)text.size(), text.data()),
+                  Lane::Chat);
+        return true;
+    }
+
+    // 别的节点转来的消息, 投递成功时在接收方所在的节点也建一份索引
+    bool deliverForwarded(std::string_view from, std::string_view to, std::string_view text, uint64_t seq)
+    {
+        if (!deliverLocal(from, to, text, seq))
+        {
+            return false;
+        }
+        if (m_search)
+        {
+            m_search->add(History::key(from, to), from, text);
+        }
+        return true;
+    }
+
+    static std::string joinNames(std::string line, const std::vector<std::string> &names)
+    {
+        for (const std::string &name : names)
+        {
+            line += " " + name;
+        }
+        return line;
+    }
+
+    // 格式: ACK peer:delivered:read ..., 一帧可以带多个会话
+    void acknowledge(Conn &c, std::string_view args)
+    {
+        while (!args.empty())
+        {
+            size_t space = args.find(' ');
+            std::string_view item = args.substr(0, space);
+            args.remove_prefix(space == std::string_view::npos ? args.size() : space + 1);
+            size_t first = item.find(':');
+            size_t second = item.rfind(':');
+            if (first == std::string_view::npos || first == 0 || second == first)
+            {
+                continue;
+            }
+            std::string marks(item.substr(first + 1));
+            uint64_t delivered = std::strtoull(marks.c_str(), nullptr, 10);
+            uint64_t read = std::strtoull(marks.c_str() + (second - first), nullptr, 10);
+            m_receipts.mark(c.user, item.substr(0, first), delivered, read);
+        }
+    }
+
+    // 格式: UNREAD peer1 peer2 ..., 回复 "UNREAD peer1:n peer2:n ..."
+    void unread(Conn &c, std::string_view args)
+    {
+        std::vector<std::string> peers;
+        while (!args.empty())
+        {
+            size_t space = args.find(' ');
+            if (space != 0)
+            {
+                peers.emplace_back(args.substr(0, space));
+            }
+            args.remove_prefix(space == std::string_view::npos ? args.size() : space + 1);
+        }
+        std::vector<uint64_t> counts = m_receipts.unread(c.user, peers);
+        std::string line = "UNREAD";
+        for (size_t i = 0; i < peers.size(); ++i)
+        {
+            line += " " + peers[i] + ":" + std::to_string(counts[i]);
+        }
+        reply(c, line);
+    }
+
+    // 回执窗口到期, 发送者在本节点且支持回执时推送 "RECEIPT reader delivered read"
+    // 发送者在别的节点时由它用 RECEIPTS 查询
+    void flushReceipts()
+    {
+        m_receipts.flush([this](const std::string &sender, const std::string &reader, const Receipts::Marks &marks)
+                         {
+                             Conn *c = m_conns.get(m_sessions.find(sender));
+                             if (c && c->receipts)
+                             {
+                                 sendFrame(*c, m_arena.format("RECEIPT %s %llu %llu", reader.c_str(),
+                                                              static_cast<unsigned long long>(marks.delivered),
+                                                              static_cast<unsigned long long>(marks.read)));
+                             } });
+    }
+
+    // 每条命中回一帧 "FOUND time from text", 从新到旧, 最后以 "FOUNDEND count" 结束
+    // 带请求号时所有行用换行连接成一帧回复
+    void search(Conn &c, std::string_view args)
+    {
+        size_t space = args.find(' ');
+        if (space == std::string_view::npos || space == 0)
+        {
+            reply(c, "ERROR usage: SEARCH peer words");
+            return;
+        }
+        auto hits = m_search->search(History::key(c.user, args.substr(0, space)), args.substr(space + 1), SEARCH_MAX_RESULTS);
+
+        int fd = c.fd;
+        bool joined = !m_replyTag.empty();
+        std::string page;
+        for (const SearchDoc &hit : hits)
+        {
+            std::string_view line = m_arena.format("FOUND %llu %s %s", static_cast<unsigned long long>(hit.time),
+                                                   hit.from.c_str(), hit.text.c_str());
+            if (joined)
+            {
+                page.append(line).append("\n");
+                continue;
+            }
+            sendFrame(c, line, Lane::Bulk);
+            if (m_conns.get(fd) != &c)
+            {
+                return;
+            }
+        }
+        std::string_view end = m_arena.format("FOUNDEND %zu", hits.size());
+        if (joined)
+        {
+            page.append(end);
+            reply(c, page, Lane::Bulk);
+            return;
+        }
+        sendFrame(c, end, Lane::Bulk);
+    }
+
+    // 上下线窗口到期, 每个关注者收到一帧汇总
+    void flushPresence()
+    {
+        m_presence.flush([this](int fd, std::string_view frame)
+                         {
+                             Conn *c = m_conns.get(fd);
+                             if (c)
+                             {
+                                 sendFrame(*c, frame);
+                             } },
+                         [this](std::string_view batch)
+                         {
+                             if (m_cluster)
+                             {
+                                 m_cluster->publishPresence(batch);
+                             }
+                         });
+    }
+
+    // 本节点或集群里其他节点上在线
+    bool userOnline(const std::string &user)
+    {
+        bool online = m_sessions.find(user) != -1;
+        if (!online && m_cluster)
+        {
+            online = !m_cluster->locate(user).empty();
+        }
+        return online;
+    }
+
+    // 格式: WATCH user1 user2 ..., 立即回复这些用户当前的状态, 之后有变化时推送
+    void watchUsers(Conn &c, std::string_view users)
+    {
+        std::string snapshot = "PRESENCE";
+        while (!users.empty())
+        {
+            size_t space = users.find(' ');
+            std::string user(users.substr(0, space));
+            users.remove_prefix(space == std::string_view::npos ? users.size() : space + 1);
+            if (user.empty())
+            {
+                continue;
+            }
+            if (!m_presence.watch(c.fd, user, userOnline(user)))
+            {
+                reply(c, "ERROR too many watches");
+                return;
+            }
+            snapshot += " " + user + (m_presence.online(user) ? ":1" : ":0");
+        }
+        reply(c, snapshot);
+    }
+
+    // 跨节点消息、会话记录和检索日志每轮只写一次
+    void flushPending()
+    {
+        if (m_search)
+        {
+            m_search->sync();
+        }
+        if (m_cluster)
+        {
+            m_cluster->flush();
+        }
+        if (m_history)
+        {
+            m_history->flush();
+            if (m_journal)
+            {
+                // Redis 写失败过就不再确认, 重启后从日志重放 (至少一次)
+                if (m_history->intact())
+                {
+                    m_journal->ack(m_journal->lastLsn());
+                }
+                m_journal->commit();
+            }
+        }
+    }
+
+    // 打开本地日志, 把上次没来得及写进 Redis 的消息补写进会话记录
+    void openJournal()
+    {
+        try
+        {
+            m_journal = std::make_unique<Journal>(m_journalDir);
+        }
+        catch (const std::exception &e)
+        {
+            std::cerr << "Journal error: " << e.what() << std::endl;
+            exit(EXIT_FAILURE);
+        }
+        auto start = std::chrono::steady_clock::now();
+        size_t replayed = m_journal->replay([this](uint64_t id, std::string_view from, std::string_view to, std::string_view text)
+                                            { m_history->append(id, from, to, text); });
+        m_history->flush();
+        if (m_history->intact())
+        {
+            m_journal->ack(m_journal->lastLsn());
+        }
+        m_journal->commit();
+        if (replayed > 0)
+        {
+            auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+            std::cout << "Replayed " << replayed << " journal records in " << ms << " ms" << std::endl;
+        }
+    }
+
+    // 修改失败时关闭连接并返回 false, 调用方之后不能再碰 c
+    bool updateEvents(Conn &c, uint32_t events)
+    {
+        if (c.events == events)
+        {
+            return true;
+        }
+        struct epoll_event ev{};
+        ev.events = events;
+        ev.data.fd = c.fd;
+        if (epoll_ctl(m_epollFd, EPOLL_CTL_MOD, c.fd, &ev) == -1)
+        {
+            perror("epoll_ctl: EPOLL_CTL_MOD");
+            closeConn(c);
+            return false;
+        }
+        c.events = events;
+        return true;
+    }
+
+    void closeConn(Conn &c)
+    {
+        int fd = c.fd;
+        if (epoll_ctl(m_epollFd, EPOLL_CTL_DEL, fd, NULL) == -1)
+        {
+            perror("epoll_ctl: EPOLL_CTL_DEL");
+        }
+        if (!c.user.empty())
+        {
+            logout(c);
+        }
+        m_presence.removeWatcher(fd);
+        if (m_capture)
+        {
+            m_capture->close(c.serial);
+        }
+        if (c.tls)
+        {
+            c.tls->shutdown();
+        }
+        c.in.reset(m_pool);
+        c.out.reset(m_pool);
+        c.lanes.reset(m_pool);
+        m_conns.close(fd);
+        m_tasks.closed(fd);
+        close(fd);
+        std::cout << "Closed connection with client." << std::endl;
+        if (m_acceptPaused)
+        {
+            resumeAccept();
+        }
+    }
+
+    int m_port;
+    bool m_takeover;
+    std::string m_upgradePath;
+    bool m_stopping = false;
+    bool m_draining = false; // 收到 TAKEOVER, 在等协程任务结束
+    size_t m_inflight = 0;   // 在途的协程任务数, 连接关闭后仍在跑的也算
+    int m_upgradeFd = -1;
+    int m_upgradeConn = -1;  // 还没发完 TAKEOVER 请求的升级连接
+    std::string m_upgradeIn; // 它已经发来的部分
+    int m_listenFd = -1;
+    int m_epollFd = -1;
+    int m_spareFd = -1;         // 备用 fd, 见 shedOnFdLimit
+    bool m_acceptPaused = false; // fd 用完且没有备用 fd 时暂停监听
+    int m_traceFd = -1;          // SIGUSR2 的 signalfd, 只在开启追踪时创建
+    std::string m_traceDir;
+    bool m_benchLogin;
+    uint32_t m_traceDumps = 0;
+    int64_t m_readAt = 0;        // 最近一次读到数据的时间, 纳秒, 只在开启追踪时取
+    RedisAsyncContext m_redis; // 集群的路由表和频道, 以及分片的控制频道
+    RedisShards m_shards;
+    NodeLease m_lease; // 节点号的租约, 在控制实例上
+    IdGenerator m_ids; // 消息 ID
+    SocialGraph m_graph{m_shards, m_redis};
+    BufferPool m_pool;
+    FdSlab<Conn> m_conns;
+    Arena m_arena;
+    SessionRegistry m_sessions;
+    std::string_view m_replyTag; // 正在处理的请求的请求号前缀, 指向读缓冲区或异步回调保存的副本
+    std::unique_ptr<Cluster> m_cluster;
+    std::unique_ptr<History> m_history;
+    std::string m_searchDir;
+    std::unique_ptr<SearchIndex> m_search;
+    std::string m_journalDir;
+    std::unique_ptr<Journal> m_journal;
+    std::unique_ptr<TlsContext> m_tls; // 为空时接受明文连接
+    std::unique_ptr<CaptureWriter> m_capture; // 为空时不录制
+    std::unordered_map<int, std::function<void()>> m_watchers;
+    uint64_t m_serial = 0;
+    RateLimits m_limits;
+    size_t m_maxConns;
+    LoadShedder m_shedder;
+    std::unique_ptr<UserRateLimiter> m_userLimiter; // 只在集群模式下启用
+    int64_t m_now = 0;                              // 本轮事件的时间, 微秒
+    Mailer m_mailer;
+    AuthService m_auth;
+    TaskRedis m_taskRedis{m_shards}; // 协程等待的 Redis 命令走各分片的不等回复连接
+    TaskScheduler m_tasks;
+    Presence m_presence;
+    Receipts m_receipts{m_shards};
+    std::string m_unpackBuf; // 解压后的请求, 容量保留下来复用
+    char m_readBuf[READ_BUFFER];
+};
@@ -0,0 +1,39 @@
+#pragma once
+#include "../include/headFile.hpp"
+
+// 本节点在线用户表: 用户 ID -> 连接 fd
+class SessionRegistry
+{
+public:
+    void bind(const std::string &user, int fd)
+    {
+        m_users[user] = fd;
+    }
+
+    void unbind(const std::string &user)
+    {
+        m_users.erase(user);
+    }
+
+    // 用户不在本节点时返回 -1
+    int find(const std::string &user) const
+    {
+        auto it = m_users.find(user);
+        return it == m_users.end() ? -1 : it->second;
+    }
+
+    size_t size() const { return m_users.size(); }
+
+    // 对每个在线用户回调 fn(user, fd)
+    template <typename F>
+    void forEach(F &&fn) const
+    {
+        for (const auto &[user, fd] : m_users)
+        {
+            fn(user, fd);
+        }
+    }
+
+private:
+    std::unordered_map<std::string, int> m_users;
+};
@@ -0,0 +1,171 @@
+#pragma once
+#include "../include/headFile.hpp"
+#include "../redis/redis.hpp"
+
+#define SNOWFLAKE_EPOCH_MS 1704067200000ULL // 2024-01-01 UTC, 41 位毫秒数够用到 2093 年
+#define SNOWFLAKE_NODE_BITS 10
+#define SNOWFLAKE_SEQ_BITS 12
+#define SNOWFLAKE_NODE_KEY "idgen:node"     // 节点启动时 INCR 这个键, 决定从哪个节点号开始找空闲的
+#define SNOWFLAKE_LEASE_PREFIX "idgen:lease:" // 节点号的租约, 值是持有者的标识
+#define SNOWFLAKE_LEASE_TTL 30              // 租约有效期, 秒
+#define SNOWFLAKE_LEASE_RENEW 10            // 续约间隔, 秒
+
+// 64 位有序 ID: 41 位毫秒时间戳 | 10 位节点号 | 12 位序号, 最高位恒为 0
+// 同一节点上严格递增, 不同节点的 ID 大致按时间排序, 可以直接当排序键
+// 状态只有一个原子变量, 取号是一次 CAS, 事件循环和工作线程都可以调用
+// 时钟回拨时沿用上一个 ID 继续递增, 不会重复; 一毫秒内序号用完时借用下一毫秒
+// 节点号由 NodeLease 从 0..1023 里租用, 同时在线的节点不会拿到同一个号;
+// 进程重启后可能领到别的进程以前用过的号, 只要时钟比那个进程慢不超过租约有效期就不会和它发过的 ID 重复
+class IdGenerator
+{
+public:
+    explicit IdGenerator(uint64_t node) : m_node((node & NODE_MASK) << SNOWFLAKE_SEQ_BITS) {}
+
+    uint64_t next()
+    {
+        uint64_t now = ((nowMs() - SNOWFLAKE_EPOCH_MS) << (SNOWFLAKE_NODE_BITS + SNOWFLAKE_SEQ_BITS)) | m_node;
+        uint64_t last = m_last.load(std::memory_order_relaxed);
+        uint64_t id;
+        do
+        {
+            id = last + 1;
+            if ((id & SEQ_MASK) == 0)
+            {
+                // 序号进位到了节点号上, 改成下一毫秒的第 0 号
+                id = ((timestamp(last) + 1) << (SNOWFLAKE_NODE_BITS + SNOWFLAKE_SEQ_BITS)) | m_node;
+            }
+            id = std::max(id, now);
+        } while (!m_last.compare_exchange_weak(last, id, std::memory_order_relaxed));
+        return id;
+    }
+
+    // ID 里的 Unix 毫秒时间
+    static uint64_t unixMs(uint64_t id)
+    {
+        return timestamp(id) + SNOWFLAKE_EPOCH_MS;
+    }
+
+    // 对应的 Redis 流记录 ID "<毫秒>-<节点号和序号>", 两者的顺序一致
+    static std::string streamId(uint64_t id)
+    {
+        return std::to_string(unixMs(id)) + "-" + std::to_string(id & LOW_MASK);
+    }
+
+private:
+    static constexpr uint64_t SEQ_MASK = (1ULL << SNOWFLAKE_SEQ_BITS) - 1;
+    static constexpr uint64_t NODE_MASK = (1ULL << SNOWFLAKE_NODE_BITS) - 1;
+    static constexpr uint64_t LOW_MASK = (1ULL << (SNOWFLAKE_NODE_BITS + SNOWFLAKE_SEQ_BITS)) - 1;
+
+    static uint64_t timestamp(uint64_t id)
+    {
+        return id >> (SNOWFLAKE_NODE_BITS + SNOWFLAKE_SEQ_BITS);
+    }
+
+    static uint64_t nowMs()
+    {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(
+                   std::chrono::system_clock::now().time_since_epoch())
+            .count();
+    }
+
+    uint64_t m_node;
+    std::atomic<uint64_t> m_last{0};
+};
+
+// 节点号租约
+// 启动时从 INCR 得到的位置开始依次 SET NX 0..1023 的租约键, 第一个成功的就是本节点的号, 全被占用时抛出异常,
+// 不会回绕成和在线节点相同的号; 之后定时续约, 进程退出不主动释放, 租约过期后才能被别的节点领走
+// fd() 是续约用的 timerfd, 由事件循环监听
+class NodeLease
+{
+public:
+    explicit NodeLease(RedisAsyncContext &redis) : m_redis(redis)
+    {
+        char host[256] = {};
+        gethostname(host, sizeof(host) - 1);
+        m_owner = std::string(host) + ":" + std::to_string(getpid()) + ":" +
+                  std::to_string(std::chrono::steady_clock::now().time_since_epoch().count());
+
+        m_renewSha = m_redis.ScriptLoad(RENEW_SCRIPT);
+
+        long long start = m_redis.Incr(SNOWFLAKE_NODE_KEY);
+        for (uint64_t i = 0; i < NODES; ++i)
+        {
+            uint64_t node = (static_cast<uint64_t>(start) + i) % NODES;
+            if (m_redis.SetNx(key(node), SNOWFLAKE_LEASE_TTL, m_owner))
+            {
+                m_node = node;
+                break;
+            }
+        }
+        if (m_node == NODES)
+        {
+            throw std::runtime_error("no free snowflake node id (all " + std::to_string(NODES) + " leased)");
+        }
+        m_renewedAt = std::chrono::steady_clock::now();
+
+        m_timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        if (m_timerFd == -1)
+        {
+            throw std::runtime_error("timerfd_create: " + std::string(strerror(errno)));
+        }
+        struct itimerspec spec{};
+        spec.it_value.tv_sec = SNOWFLAKE_LEASE_RENEW;
+        spec.it_interval = spec.it_value;
+        timerfd_settime(m_timerFd, 0, &spec, nullptr);
+    }
+
+    ~NodeLease()
+    {
+        close(m_timerFd);
+    }
+
+    NodeLease(const NodeLease &other) = delete;
+    NodeLease &operator=(const NodeLease &other) = delete;
+
+    uint64_t node() const { return m_node; }
+    int fd() const { return m_timerFd; }
+
+    // 定时器到期时续约; 租约已被别的节点领走时返回 false, 这时不能再发 ID
+    bool renew()
+    {
+        uint64_t expirations;
+        read(m_timerFd, &expirations, sizeof(expirations));
+        long long renewed = m_redis.EvalSha(m_renewSha, {key(m_node)}, {m_owner, std::to_string(SNOWFLAKE_LEASE_TTL)});
+        if (renewed == -1)
+        {
+            // 可能是 Redis 重启丢了脚本, 重新加载后再试一次
+            m_renewSha = m_redis.ScriptLoad(RENEW_SCRIPT);
+            renewed = m_redis.EvalSha(m_renewSha, {key(m_node)}, {m_owner, std::to_string(SNOWFLAKE_LEASE_TTL)});
+        }
+        auto now = std::chrono::steady_clock::now();
+        if (renewed == 1)
+        {
+            m_renewedAt = now;
+            return true;
+        }
+        // 出错时只要租约还没到期就下次再试; 到期后别的节点可能已经领走, 不能再用
+        return renewed == -1 && now - m_renewedAt < std::chrono::seconds(SNOWFLAKE_LEASE_TTL);
+    }
+
+private:
+    static constexpr uint64_t NODES = 1ULL << SNOWFLAKE_NODE_BITS;
+    // 自己的租约还在就续期; 过期了但没被别人领走就重新占上; 已被别人领走返回 0
+    static constexpr const char *RENEW_SCRIPT =
+        "local owner = redis.call('GET', KEYS[1]) "
+        "if owner == ARGV[1] then return redis.call('EXPIRE', KEYS[1], ARGV[2]) end "
+        "if owner then return 0 end "
+        "redis.call('SET', KEYS[1], ARGV[1], 'EX', ARGV[2]) return 1";
+
+    static std::string key(uint64_t node)
+    {
+        return SNOWFLAKE_LEASE_PREFIX + std::to_string(node);
+    }
+
+    RedisAsyncContext &m_redis;
+    std::string m_owner;
+    std::string m_renewSha;
+    std::chrono::steady_clock::time_point m_renewedAt; // 最近一次续约成功的时间
+    uint64_t m_node = NODES;
+    int m_timerFd = -1;
+};
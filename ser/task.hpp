@@ -0,0 +1,415 @@
+#pragma once
+#include "../include/headFile.hpp"
+#include "../Cli_Ser_Connection/Trace.hpp"
+#include "../redis/shard.hpp"
+#include "auth.hpp"
+#include "pool.hpp"
+
+// 事件循环上的协程
+// 处理函数写成 Task, 用 co_await 顺序地等待下一帧、Redis 回复、线程池里的慢操作或定时器,
+// 挂起时不占线程, 由事件循环在对应的 fd 就绪时恢复; 所有恢复都发生在事件循环线程里
+// 恢复之后连接可能已经关闭, 处理函数只保存 fd 和连接序号, 每次用到连接时重新查找
+// 请求被抽中追踪时, 等 Redis 和线程池的 awaiter 记下挂起前的追踪号, 恢复时接着用, 恢复后的这一段记为 task
+
+// 协程帧从事件循环线程自己的 BufferPool 分配, 帧的大小在编译期就固定, 稳态下不再 malloc
+inline BufferPool &coroFramePool()
+{
+    thread_local BufferPool pool;
+    return pool;
+}
+
+// 分离运行的协程: 创建后立即执行到第一个挂起点, 结束时自己释放帧
+// 只能在事件循环线程里创建和恢复
+struct Task
+{
+    struct promise_type
+    {
+        Task get_return_object() { return {}; }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() {}
+
+        // 和同步处理函数一样, 一个请求出错不影响事件循环
+        void unhandled_exception()
+        {
+            try
+            {
+                throw;
+            }
+            catch (const std::exception &e)
+            {
+                std::cerr << "Task failed: " << e.what() << std::endl;
+            }
+        }
+
+        static void *operator new(size_t size)
+        {
+            size_t capacity = 0;
+            void *frame = coroFramePool().acquire(size, capacity);
+            if (!frame)
+            {
+                throw std::bad_alloc();
+            }
+            return frame;
+        }
+
+        // 按 size 重新算出尺寸级别, 和 acquire 时一致
+        static void operator delete(void *frame, size_t size)
+        {
+            coroFramePool().release(static_cast<char *>(frame), size);
+        }
+    };
+};
+
+// 协程等到的一帧, tag 是这一帧带的请求号前缀, 回复时要带上
+struct TaskFrame
+{
+    std::string tag;
+    std::string text;
+};
+
+// 协程的定时器和按连接等待的帧
+// fd() 是一个 timerfd, 始终对准最早的到期时间
+class TaskScheduler
+{
+public:
+    TaskScheduler()
+    {
+        m_timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        if (m_timerFd == -1)
+        {
+            throw std::runtime_error("timerfd_create: " + std::string(strerror(errno)));
+        }
+    }
+
+    ~TaskScheduler()
+    {
+        close(m_timerFd);
+    }
+
+    TaskScheduler(const TaskScheduler &other) = delete;
+    TaskScheduler &operator=(const TaskScheduler &other) = delete;
+
+    // 有定时器到期时可读, 由事件循环监听
+    int fd() const { return m_timerFd; }
+
+private:
+    struct Waiter;
+    using Timers = std::multimap<int64_t, Waiter *>;
+
+    // 挂起中的协程, 存放在它自己的帧里 (awaiter 的成员)
+    struct Waiter
+    {
+        std::coroutine_handle<> handle;
+        Timers::iterator timer;
+        bool timed = false;
+        int fd = -1; // 等待帧的连接, -1 表示只等定时器
+        std::optional<TaskFrame> frame;
+    };
+
+public:
+    // co_await sleep(ms)
+    class SleepAwaiter
+    {
+    public:
+        SleepAwaiter(TaskScheduler &sched, int64_t ms) : m_sched(sched), m_ms(ms) {}
+        bool await_ready() const { return m_ms <= 0; }
+        void await_suspend(std::coroutine_handle<> handle)
+        {
+            m_waiter.handle = handle;
+            m_sched.addTimer(m_waiter, m_ms);
+        }
+        void await_resume() {}
+
+    private:
+        TaskScheduler &m_sched;
+        int64_t m_ms;
+        Waiter m_waiter;
+    };
+
+    // co_await readFrame(fd, ms): 这条连接的下一帧不再交给命令分发, 而是交给协程
+    // 超时或连接关闭时得到 nullopt; 同一条连接同时只能有一个协程在等
+    class FrameAwaiter
+    {
+    public:
+        FrameAwaiter(TaskScheduler &sched, int fd, int64_t ms) : m_sched(sched), m_ms(ms)
+        {
+            m_waiter.fd = fd;
+        }
+        bool await_ready() const { return m_sched.m_frames.count(m_waiter.fd) > 0; }
+        void await_suspend(std::coroutine_handle<> handle)
+        {
+            m_waiter.handle = handle;
+            m_sched.m_frames[m_waiter.fd] = &m_waiter;
+            if (m_ms > 0)
+            {
+                m_sched.addTimer(m_waiter, m_ms);
+            }
+        }
+        std::optional<TaskFrame> await_resume() { return std::move(m_waiter.frame); }
+
+    private:
+        TaskScheduler &m_sched;
+        int64_t m_ms;
+        Waiter m_waiter;
+    };
+
+    SleepAwaiter sleep(int64_t ms) { return SleepAwaiter(*this, ms); }
+    FrameAwaiter readFrame(int fd, int64_t timeoutMs = 0) { return FrameAwaiter(*this, fd, timeoutMs); }
+
+    // 事件循环收到一帧时调用; 有协程在等这条连接时交给它并返回 true
+    bool deliver(int fd, std::string_view tag, std::string_view text)
+    {
+        auto it = m_frames.find(fd);
+        if (it == m_frames.end())
+        {
+            return false;
+        }
+        Waiter *waiter = it->second;
+        m_frames.erase(it);
+        cancelTimer(*waiter);
+        waiter->frame = TaskFrame{std::string(tag), std::string(text)};
+        waiter->handle.resume();
+        return true;
+    }
+
+    // 连接关闭后调用, 在等它的协程得到 nullopt
+    void closed(int fd)
+    {
+        auto it = m_frames.find(fd);
+        if (it == m_frames.end())
+        {
+            return;
+        }
+        Waiter *waiter = it->second;
+        m_frames.erase(it);
+        cancelTimer(*waiter);
+        waiter->handle.resume();
+    }
+
+    // 所有在等帧的协程得到 nullopt, 连接保持打开; 热升级前用来结束等用户输入的对话
+    void cancelFrames()
+    {
+        auto frames = std::move(m_frames);
+        m_frames.clear();
+        for (auto &[fd, waiter] : frames)
+        {
+            cancelTimer(*waiter);
+            waiter->handle.resume();
+        }
+    }
+
+    // 定时器可读: 恢复所有已到期的协程
+    void onTimer()
+    {
+        uint64_t expirations;
+        read(m_timerFd, &expirations, sizeof(expirations));
+        int64_t now = nowMs();
+        while (!m_timers.empty() && m_timers.begin()->first <= now)
+        {
+            Waiter *waiter = m_timers.begin()->second;
+            m_timers.erase(m_timers.begin());
+            waiter->timed = false;
+            if (waiter->fd != -1)
+            {
+                m_frames.erase(waiter->fd);
+            }
+            waiter->handle.resume(); // 可能增删定时器, 每次重新取最早的
+        }
+        arm();
+    }
+
+private:
+    static int64_t nowMs()
+    {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(
+                   std::chrono::steady_clock::now().time_since_epoch())
+            .count();
+    }
+
+    void addTimer(Waiter &waiter, int64_t ms)
+    {
+        waiter.timer = m_timers.emplace(nowMs() + ms, &waiter);
+        waiter.timed = true;
+        if (waiter.timer == m_timers.begin())
+        {
+            arm();
+        }
+    }
+
+    void cancelTimer(Waiter &waiter)
+    {
+        if (waiter.timed)
+        {
+            m_timers.erase(waiter.timer);
+            waiter.timed = false;
+        }
+    }
+
+    // timerfd 对准最早的到期时间; steady_clock 在 Linux 上就是 CLOCK_MONOTONIC
+    void arm()
+    {
+        struct itimerspec spec{};
+        if (!m_timers.empty())
+        {
+            int64_t deadline = std::max<int64_t>(m_timers.begin()->first, 1);
+            spec.it_value.tv_sec = deadline / 1000;
+            spec.it_value.tv_nsec = (deadline % 1000) * 1000000L;
+        }
+        timerfd_settime(m_timerFd, TFD_TIMER_ABSTIME, &spec, nullptr);
+    }
+
+    int m_timerFd = -1;
+    Timers m_timers;
+    std::unordered_map<int, Waiter *> m_frames; // 连接 -> 在等它下一帧的协程
+};
+
+// co_await 线程池里的慢操作: fn 在工作线程执行, 结果带回事件循环线程后恢复协程
+// 积压已满或 fn 抛出异常时得到 nullopt
+// fn 要先存成具名变量再传进来: GCC 12 会把 co_await 表达式里的 lambda 临时对象按位搬进协程帧,
+// 捕获的短字符串 (SSO) 指向的还是搬之前的位置
+template <typename R>
+class OffloadAwaiter
+{
+public:
+    OffloadAwaiter(AuthService &pool, std::function<R()> fn) : m_pool(pool), m_fn(std::move(fn)) {}
+
+    bool await_ready() const { return false; }
+
+    bool await_suspend(std::coroutine_handle<> handle)
+    {
+        m_trace = Trace::current();
+        return m_pool.submit([this, handle, fn = std::move(m_fn)]() -> AuthService::Completion
+                             {
+                                 std::optional<R> result;
+                                 try
+                                 {
+                                     result = fn();
+                                 }
+                                 catch (const std::exception &e)
+                                 {
+                                     std::cerr << "Offloaded task failed: " << e.what() << std::endl;
+                                 }
+                                 return [this, handle, result = std::move(result)]() mutable
+                                 {
+                                     m_result = std::move(result);
+                                     Trace::Scope task("task", m_trace, 0);
+                                     handle.resume();
+                                 }; });
+    }
+
+    std::optional<R> await_resume() { return std::move(m_result); }
+
+private:
+    AuthService &m_pool;
+    std::function<R()> m_fn;
+    std::optional<R> m_result;
+    uint64_t m_trace = 0;
+};
+
+template <typename F>
+auto offload(AuthService &pool, F fn) -> OffloadAwaiter<decltype(fn())>
+{
+    return OffloadAwaiter<decltype(fn())>(pool, std::move(fn));
+}
+
+// co_await 一条 Redis 命令, convert 在回复到达时把它转换成结果
+// 连接出错时协程仍会恢复, 得到 convert(nullptr)
+template <typename R>
+class RedisAwaiter
+{
+public:
+    using Convert = R (*)(const redisReply *);
+
+    RedisAwaiter(RedisPipeline &redis, std::vector<std::string> args, Convert convert)
+        : m_redis(redis), m_args(std::move(args)), m_convert(convert) {}
+
+    bool await_ready() const { return false; }
+
+    void await_suspend(std::coroutine_handle<> handle)
+    {
+        m_trace = Trace::current();
+        m_begin = m_trace ? Trace::now() : 0;
+        m_redis.Send(m_args, [this, handle](redisReply *reply)
+                     {
+                         m_result = m_convert(reply);
+                         if (m_trace)
+                         {
+                             Trace::record("redis", m_trace, m_begin, Trace::now(), Trace::tagOf(m_args[0]));
+                         }
+                         Trace::Scope task("task", m_trace, 0);
+                         handle.resume(); });
+    }
+
+    R await_resume() { return std::move(m_result); }
+
+private:
+    RedisPipeline &m_redis;
+    std::vector<std::string> m_args;
+    Convert m_convert;
+    R m_result{};
+    uint64_t m_trace = 0;
+    int64_t m_begin = 0;
+};
+
+// 协程用的 Redis 命令, 和 RedisAsyncContext 的同名方法语义相同, 只是返回 awaiter
+// 按键发到所在分片的不等回复连接
+class TaskRedis
+{
+public:
+    explicit TaskRedis(RedisShards &shards) : m_shards(shards) {}
+
+    RedisAwaiter<std::string> HashGet(const std::string &key, const std::string &field)
+    {
+        return {m_shards.PipelineFor(key), {"HGET", key, field}, &toString};
+    }
+
+    RedisAwaiter<bool> HashExists(const std::string &key, const std::string &field)
+    {
+        return {m_shards.PipelineFor(key), {"HEXISTS", key, field}, &toBool};
+    }
+
+    RedisAwaiter<long long> HashSet(const std::string &key, const std::string &field, const std::string &value)
+    {
+        return {m_shards.PipelineFor(key), {"HSET", key, field, value}, &toInteger};
+    }
+
+    // 字段不存在时才写入, 写入了返回 true
+    RedisAwaiter<bool> HashSetNX(const std::string &key, const std::string &field, const std::string &value)
+    {
+        return {m_shards.PipelineFor(key), {"HSETNX", key, field, value}, &toBool};
+    }
+
+    RedisAwaiter<bool> SetEx(const std::string &key, int seconds, const std::string &value)
+    {
+        return {m_shards.PipelineFor(key), {"SETEX", key, std::to_string(seconds), value}, &toStatus};
+    }
+
+    RedisAwaiter<std::string> GetDel(const std::string &key)
+    {
+        return {m_shards.PipelineFor(key), {"GETDEL", key}, &toString};
+    }
+
+private:
+    static std::string toString(const redisReply *reply)
+    {
+        return reply && reply->type == REDIS_REPLY_STRING ? std::string(reply->str, reply->len) : std::string();
+    }
+
+    static bool toBool(const redisReply *reply)
+    {
+        return reply && reply->type == REDIS_REPLY_INTEGER && reply->integer == 1;
+    }
+
+    static long long toInteger(const redisReply *reply)
+    {
+        return reply && reply->type == REDIS_REPLY_INTEGER ? reply->integer : -1;
+    }
+
+    static bool toStatus(const redisReply *reply)
+    {
+        return reply && reply->type == REDIS_REPLY_STATUS;
+    }
+
+    RedisShards &m_shards;
+};
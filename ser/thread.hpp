@@ -1,4 +1,7 @@
+#pragma once
 #include "../include/headFile.hpp"
+#include "../Cli_Ser_Connection/Affinity.hpp"
+#include "../Cli_Ser_Connection/Trace.hpp"
 
 // 任务队列类模板
 template <typename T>
@@ -69,16 +72,17 @@ private:
         // 重载()运算符，使对象可以像函数一样调用
         void operator()()
         {
+            Affinity::pinWorker(); // 配置了工作线程的核时绑上去
+            Trace::nameThread("worker-" + std::to_string(m_id));
             std::function<void(void)> func; // 存储任务的函数对象
             bool dequeued; // 表示是否成功从队列中取出任务
             while (!m_thread_pool->m_shutdown) // 循环直到线程池关闭
             {
                 {
                     std::unique_lock<std::mutex> lock(m_thread_pool->m_mutex); // 锁住线程池的互斥锁
-                    if(m_thread_pool->m_queue.empty()) // 如果任务队列为空，线程等待
-                    {
-                        m_thread_pool->m_conditional_lock.wait(lock); // 等待条件变量
-                    }
+                    // 带条件等待, 避免错过提交或关闭时的通知
+                    m_thread_pool->m_conditional_lock.wait(lock, [this]
+                                                           { return m_thread_pool->m_shutdown || !m_thread_pool->m_queue.empty(); });
                     dequeued = m_thread_pool->m_queue.dequeue(func); // 尝试从队列中取出任务
                 }
                 if(dequeued) // 如果成功取出任务
@@ -139,11 +143,23 @@ public:
         auto task_ptr = std::make_shared<std::packaged_task<decltype(t(args...))()>>(func);
         
         // 将任务封装为无参函数，加入任务队列
-        std::function<void()> queue_func = [task_ptr]()
+        // 提交时所在的请求被抽中追踪时, 在工作线程上记下排队和执行两段, 执行期间沿用同一个追踪号
+        uint64_t trace = Trace::current();
+        int64_t queued = trace ? Trace::now() : 0;
+        std::function<void()> queue_func = [task_ptr, trace, queued]()
         {
+            if (trace)
+            {
+                Trace::record("pool.queue", trace, queued, Trace::now());
+            }
+            Trace::Scope run("pool.run", trace, 0);
             (*task_ptr)();
         };
         m_queue.enqueue(queue_func); // 将任务加入队列
+        {
+            // 等正在检查队列的线程进入等待后再通知, 否则通知会丢失
+            std::unique_lock<std::mutex> lock(m_mutex);
+        }
         m_conditional_lock.notify_one(); // 通知一个等待的线程执行任务
         m_needAdjust.store(true); // 标记需要调整线程池
         return task_ptr->get_future(); // 返回任务的future对象